@@ -28,6 +28,9 @@
 
 #include <algorithm>
 #include <fstream>
+#include <map>
+#include <utility>
+#include <vector>
 
 #include <cstdio> // for rename()
 #include <cstdlib>
@@ -57,7 +60,12 @@
 #endif
 
 #include <xapian/database.h>
+#include <xapian/dbfactory.h>
+#include <xapian/document.h>
 #include <xapian/error.h>
+#include <xapian/postingiterator.h>
+#include <xapian/termiterator.h>
+#include <xapian/valueiterator.h>
 
 using namespace std;
 
@@ -89,8 +97,13 @@ class Compactor::Internal : public Xapian::Internal::intrusive_base {
     string destdir;
     bool renumber;
     bool multipass;
+    bool train_dictionaries;
+    bool build_impacts;
+    enum { REORDER_NONE, REORDER_BY_VALUE, REORDER_BY_SIMILARITY } reorder;
+    Xapian::valueno reorder_slot;
     int compact_to_stub;
     size_t block_size;
+    map<string, size_t> table_block_sizes;
     compaction_level compaction;
 
     Xapian::docid tot_off;
@@ -105,7 +118,8 @@ class Compactor::Internal : public Xapian::Internal::intrusive_base {
     vector<pair<Xapian::docid, Xapian::docid> > used_ranges;
   public:
     Internal()
-	: renumber(true), multipass(false),
+	: renumber(true), multipass(false), train_dictionaries(false),
+	  build_impacts(false), reorder(REORDER_NONE), reorder_slot(0),
 	  block_size(8192), compaction(FULL), tot_off(0),
 	  last_docid(0), backend(UNKNOWN)
     {
@@ -115,6 +129,9 @@ class Compactor::Internal : public Xapian::Internal::intrusive_base {
 
     void add_source(const string & srcdir);
 
+    void reorder_documents(Xapian::Compactor & compactor,
+			   const string & tmpdir);
+
     void compact(Xapian::Compactor & compactor);
 };
 
@@ -128,6 +145,12 @@ Compactor::set_block_size(size_t block_size)
     internal->block_size = block_size;
 }
 
+void
+Compactor::set_block_size(const string & table, size_t block_size)
+{
+    internal->table_block_sizes[table] = block_size;
+}
+
 void
 Compactor::set_renumber(bool renumber)
 {
@@ -146,6 +169,31 @@ Compactor::set_compaction_level(compaction_level compaction)
     internal->compaction = compaction;
 }
 
+void
+Compactor::set_dictionary_training(bool train)
+{
+    internal->train_dictionaries = train;
+}
+
+void
+Compactor::set_impact_ordering(bool impacts)
+{
+    internal->build_impacts = impacts;
+}
+
+void
+Compactor::set_reorder_by_value(Xapian::valueno slot)
+{
+    internal->reorder = Internal::REORDER_BY_VALUE;
+    internal->reorder_slot = slot;
+}
+
+void
+Compactor::set_reorder_by_similarity()
+{
+    internal->reorder = Internal::REORDER_BY_SIMILARITY;
+}
+
 void
 Compactor::set_destdir(const string & destdir)
 {
@@ -203,6 +251,56 @@ backend_mismatch(const string &dbpath1, int backend1,
     throw Xapian::InvalidArgumentError(msg);
 }
 
+/// The number of hash functions in a MinHash signature.
+static const unsigned MINHASH_FUNCTIONS = 4;
+
+/// Hash @a term, with @a seed selecting the hash function.
+static unsigned
+minhash_term(const string & term, unsigned seed)
+{
+    // FNV-1a, followed by a final mix so that the seeds give hash functions
+    // which order the terms differently.
+    unsigned h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (string::const_iterator i = term.begin(); i != term.end(); ++i) {
+	h ^= static_cast<unsigned char>(*i);
+	h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h & 0xffffffffu;
+}
+
+/** Return a MinHash signature for the terms in document @a did.
+ *
+ *  The signature is encoded so that sorting signatures as strings groups
+ *  documents whose smallest hashed term is the same, then sorts those by the
+ *  next hash function, and so on.
+ */
+static string
+minhash_signature(const Xapian::Database & db, Xapian::docid did)
+{
+    unsigned mins[MINHASH_FUNCTIONS];
+    for (unsigned k = 0; k != MINHASH_FUNCTIONS; ++k)
+	mins[k] = 0xffffffffu;
+    for (Xapian::TermIterator t = db.termlist_begin(did);
+	 t != db.termlist_end(did); ++t) {
+	const string & term = *t;
+	for (unsigned k = 0; k != MINHASH_FUNCTIONS; ++k) {
+	    unsigned h = minhash_term(term, k);
+	    if (h < mins[k]) mins[k] = h;
+	}
+    }
+    string signature;
+    for (unsigned k = 0; k != MINHASH_FUNCTIONS; ++k) {
+	for (int shift = 24; shift >= 0; shift -= 8)
+	    signature += char((mins[k] >> shift) & 0xff);
+    }
+    return signature;
+}
+
 namespace Xapian {
 
 void
@@ -349,9 +447,110 @@ Compactor::Internal::add_source(const string & srcdir)
     sources.push_back(string(srcdir) + '/');
 }
 
+void
+Compactor::Internal::reorder_documents(Xapian::Compactor & compactor,
+				       const string & tmpdir)
+{
+    compactor.set_status("reorder", string());
+
+    Xapian::Database db;
+    vector<string>::const_iterator src;
+    for (src = sources.begin(); src != sources.end(); ++src) {
+	db.add_database(Xapian::Database(*src));
+    }
+
+    // Pair each document with the key to order it by.  The docid in the
+    // pair breaks ties, so documents with equal keys keep their order.
+    vector<pair<string, Xapian::docid> > keys;
+    keys.reserve(db.get_doccount());
+    Xapian::ValueIterator v;
+    if (reorder == REORDER_BY_VALUE)
+	v = db.valuestream_begin(reorder_slot);
+    for (Xapian::PostingIterator p = db.postlist_begin(string());
+	 p != db.postlist_end(string()); ++p) {
+	Xapian::docid did = *p;
+	string key;
+	if (reorder == REORDER_BY_VALUE) {
+	    if (v != db.valuestream_end(reorder_slot)) {
+		v.skip_to(did);
+		if (v != db.valuestream_end(reorder_slot) &&
+		    v.get_docid() == did) {
+		    key = *v;
+		}
+	    }
+	} else {
+	    key = minhash_signature(db, did);
+	}
+	keys.push_back(make_pair(key, did));
+    }
+    sort(keys.begin(), keys.end());
+
+    Xapian::WritableDatabase tmp;
+    if (backend == CHERT) {
+#ifdef XAPIAN_HAS_CHERT_BACKEND
+	tmp = Xapian::Chert::open(tmpdir, Xapian::DB_CREATE_OR_OVERWRITE);
+#endif
+    } else if (backend == BRASS) {
+#ifdef XAPIAN_HAS_BRASS_BACKEND
+	// All the documents are new, so the postlist table can be bulk
+	// loaded rather than updated as each batch is flushed.
+	tmp = Xapian::Brass::open(tmpdir, Xapian::DB_CREATE_OR_OVERWRITE |
+					  Xapian::DB_BULK_LOAD);
+#endif
+    }
+
+    vector<pair<string, Xapian::docid> >::const_iterator i;
+    for (i = keys.begin(); i != keys.end(); ++i) {
+	tmp.add_document(db.get_document(i->second));
+    }
+
+    for (Xapian::TermIterator t = db.spellings_begin();
+	 t != db.spellings_end(); ++t) {
+	tmp.add_spelling(*t, t.get_termfreq());
+    }
+
+    for (Xapian::TermIterator k = db.synonym_keys_begin();
+	 k != db.synonym_keys_end(); ++k) {
+	for (Xapian::TermIterator s = db.synonyms_begin(*k);
+	     s != db.synonyms_end(*k); ++s) {
+	    tmp.add_synonym(*k, *s);
+	}
+    }
+
+    // A combined database only reads user metadata from its first
+    // subdatabase, so collect it from each source in turn.
+    map<string, vector<string> > metadata;
+    for (src = sources.begin(); src != sources.end(); ++src) {
+	Xapian::Database source(*src);
+	for (Xapian::TermIterator k = source.metadata_keys_begin();
+	     k != source.metadata_keys_end(); ++k) {
+	    metadata[*k].push_back(source.get_metadata(*k));
+	}
+    }
+    map<string, vector<string> >::const_iterator m;
+    for (m = metadata.begin(); m != metadata.end(); ++m) {
+	const vector<string> & tags = m->second;
+	if (tags.size() == 1) {
+	    tmp.set_metadata(m->first, tags[0]);
+	} else {
+	    tmp.set_metadata(m->first,
+			     compactor.resolve_duplicate_metadata(m->first,
+								  tags.size(),
+								  &tags[0]));
+	}
+    }
+
+    tmp.commit();
+    compactor.set_status("reorder", "Done");
+}
+
 void
 Compactor::Internal::compact(Xapian::Compactor & compactor)
 {
+    if (reorder != REORDER_NONE && !renumber) {
+	throw Xapian::InvalidOperationError("Documents can't be reordered without renumbering them");
+    }
+
     if (renumber)
 	last_docid = tot_off;
 
@@ -450,24 +649,51 @@ Compactor::Internal::compact(Xapian::Compactor & compactor)
 	}
     }
 
-    if (backend == CHERT) {
+    string reorder_dir;
+    try {
+	if (reorder != REORDER_NONE) {
+	    // Copy the documents in the new order to a temporary database,
+	    // then compact that instead of the sources.
+	    reorder_dir = destdir;
+	    reorder_dir += "/reorder.tmp";
+	    reorder_documents(compactor, reorder_dir);
+	    last_docid = Xapian::Database(reorder_dir).get_lastdocid();
+	    sources.assign(1, reorder_dir + '/');
+	    offset.assign(1, 0);
+	}
+
+	if (backend == CHERT) {
 #ifdef XAPIAN_HAS_CHERT_BACKEND
-	compact_chert(compactor, destdir.c_str(), sources, offset, block_size,
-		      compaction, multipass, last_docid);
+	    compact_chert(compactor, destdir.c_str(), sources, offset,
+			  block_size, compaction, multipass, last_docid);
 #else
-	(void)compactor;
-	throw Xapian::FeatureUnavailableError("Chert backend disabled at build time");
+	    (void)compactor;
+	    throw Xapian::FeatureUnavailableError("Chert backend disabled at build time");
 #endif
-    } else if (backend == BRASS) {
+	} else if (backend == BRASS) {
 #ifdef XAPIAN_HAS_BRASS_BACKEND
-	compact_brass(compactor, destdir.c_str(), sources, offset, block_size,
-		      compaction, multipass, last_docid);
+	    compact_brass(compactor, destdir.c_str(), sources, offset,
+			  block_size, compaction, multipass, last_docid,
+			  train_dictionaries, table_block_sizes);
 #else
-	(void)compactor;
-	throw Xapian::FeatureUnavailableError("Brass backend disabled at build time");
+	    (void)compactor;
+	    throw Xapian::FeatureUnavailableError("Brass backend disabled at build time");
 #endif
+	}
+    } catch (...) {
+	// Don't leave the temporary database behind if we fail.
+	if (!reorder_dir.empty()) {
+	    try {
+		removedir(reorder_dir);
+	    } catch (...) {
+	    }
+	}
+	throw;
     }
 
+    if (!reorder_dir.empty())
+	removedir(reorder_dir);
+
     // Create the version file ("iamchert", etc).
     //
     // This file contains a UUID, and we want the copy to have a fresh
@@ -482,6 +708,11 @@ Compactor::Internal::compact(Xapian::Compactor & compactor)
     } else if (backend == BRASS) {
 #ifdef XAPIAN_HAS_BRASS_BACKEND
 	BrassVersion(destdir).create();
+	// The impact-ordered posting lists are built from the finished
+	// database, since they need its statistics.
+	if (build_impacts)
+	    build_brass_impacts(compactor, destdir.c_str(), block_size,
+				table_block_sizes);
 #else
 	// Handled above.
 	exit(1);
@@ -67,6 +67,13 @@ LeafPostList::get_maxweight() const
     return weight ? weight->get_maxpart() : 0;
 }
 
+double
+LeafPostList::get_maxweight_for_wdf(Xapian::termcount wdf_max) const
+{
+    Assert(weight);
+    return weight->get_maxpart_for_wdf(wdf_max);
+}
+
 double
 LeafPostList::get_weight() const
 {
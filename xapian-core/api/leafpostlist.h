@@ -54,6 +54,16 @@ class LeafPostList : public PostList {
     LeafPostList(const std::string & term_)
 	: weight(0), need_doclength(false), term(term_) { }
 
+    /** Return an upper bound on get_weight() for entries with wdf at most
+     *  @a wdf_max.
+     *
+     *  Subclasses which know an upper bound on the wdf for a block of
+     *  entries can use this to skip blocks which can't reach the w_min
+     *  passed to next() or skip_to().  This must only be called if the
+     *  weighting scheme has been set.
+     */
+    double get_maxweight_for_wdf(Xapian::termcount wdf_max) const;
+
   public:
     ~LeafPostList();
 
@@ -406,3 +406,239 @@ ValueCountMatchSpy::get_description() const {
     }
     return d;
 }
+
+/// Marks an empty bucket in ValueOrdinalCountMatchSpy's hash table.
+static const Xapian::doccount NO_ORDINAL = Xapian::doccount(-1);
+
+/// Hash a value for ValueOrdinalCountMatchSpy (this is 32-bit FNV-1a).
+static inline unsigned
+hash_value(const string & value)
+{
+    unsigned h = 2166136261u;
+    for (string::const_iterator i = value.begin(); i != value.end(); ++i) {
+	h ^= static_cast<unsigned char>(*i);
+	h *= 16777619u;
+    }
+    return h;
+}
+
+class ValueOrdinalCountMatchSpy::Internal : public Xapian::Internal::intrusive_base {
+    /// Don't allow assignment.
+    void operator=(const Internal &);
+
+    /// Don't allow copying.
+    Internal(const Internal &);
+
+    /** Hash table mapping values to their ordinals.
+     *
+     *  This uses open addressing with linear probing, and its size is a power
+     *  of two which is kept at least twice the number of values, so probe
+     *  sequences are short.  Empty buckets hold NO_ORDINAL.
+     */
+    vector<Xapian::doccount> buckets;
+
+    /// The hash of each value, indexed by ordinal.
+    vector<unsigned> hashes;
+
+    /// Resize the hash table to have @a size buckets.
+    void rehash(size_t size) {
+	buckets.assign(size, NO_ORDINAL);
+	size_t mask = size - 1;
+	for (size_t ord = 0; ord != hashes.size(); ++ord) {
+	    size_t i = hashes[ord] & mask;
+	    while (buckets[i] != NO_ORDINAL) i = (i + 1) & mask;
+	    buckets[i] = Xapian::doccount(ord);
+	}
+    }
+
+  public:
+    /// The slot to count.
+    Xapian::valueno slot;
+
+    /// Total number of documents seen by the match spy.
+    Xapian::doccount total;
+
+    /// The values seen so far, indexed by ordinal.
+    vector<string> values;
+
+    /// The frequency of each value, indexed by ordinal.
+    vector<Xapian::doccount> freqs;
+
+    Internal(Xapian::valueno slot_) : slot(slot_), total(0) { }
+
+    /** Get the ordinal for @a value, allocating one if it has none yet.
+     *
+     *  The only string comparison is to check the value in the bucket we
+     *  find has the same hash is really @a value.
+     */
+    Xapian::doccount get_ordinal(const string & value) {
+	unsigned h = hash_value(value);
+	if (buckets.empty()) rehash(16);
+	size_t mask = buckets.size() - 1;
+	size_t i = h & mask;
+	while (true) {
+	    Xapian::doccount ord = buckets[i];
+	    if (ord == NO_ORDINAL) break;
+	    if (hashes[ord] == h && values[ord] == value) return ord;
+	    i = (i + 1) & mask;
+	}
+	Xapian::doccount ord = Xapian::doccount(values.size());
+	values.push_back(value);
+	freqs.push_back(0);
+	hashes.push_back(h);
+	if (hashes.size() * 2 > buckets.size()) {
+	    rehash(buckets.size() * 2);
+	} else {
+	    buckets[i] = ord;
+	}
+	return ord;
+    }
+
+    /// Get the values seen and their frequencies.
+    void get_values(map<string, Xapian::doccount> & result) const {
+	result.clear();
+	for (size_t i = 0; i != values.size(); ++i) {
+	    if (freqs[i]) result.insert(make_pair(values[i], freqs[i]));
+	}
+    }
+};
+
+ValueOrdinalCountMatchSpy::ValueOrdinalCountMatchSpy() { }
+
+ValueOrdinalCountMatchSpy::ValueOrdinalCountMatchSpy(Xapian::valueno slot_)
+    : internal(new Internal(slot_)) { }
+
+ValueOrdinalCountMatchSpy::~ValueOrdinalCountMatchSpy() { }
+
+size_t
+ValueOrdinalCountMatchSpy::get_total() const
+{
+    return internal.get() ? internal->total : 0;
+}
+
+void
+ValueOrdinalCountMatchSpy::operator()(const Document &doc, double) {
+    Assert(internal.get());
+    Internal & spy = *internal;
+    ++spy.total;
+    string val(doc.get_value(spy.slot));
+    if (val.empty()) return;
+    ++spy.freqs[spy.get_ordinal(val)];
+}
+
+TermIterator
+ValueOrdinalCountMatchSpy::values_begin() const
+{
+    Assert(internal.get());
+    intrusive_ptr<ValueCountMatchSpy::Internal> counts;
+    counts = new ValueCountMatchSpy::Internal(internal->slot);
+    internal->get_values(counts->values);
+    AutoPtr<ValueCountTermList> termlist(new ValueCountTermList(counts.get()));
+    return Xapian::TermIterator(termlist.release());
+}
+
+TermIterator
+ValueOrdinalCountMatchSpy::top_values_begin(size_t maxvalues) const
+{
+    Assert(internal.get());
+    map<string, Xapian::doccount> counts;
+    internal->get_values(counts);
+    AutoPtr<StringAndFreqTermList> termlist(new StringAndFreqTermList);
+    get_most_frequent_items(termlist->values, counts, maxvalues);
+    termlist->init();
+    return Xapian::TermIterator(termlist.release());
+}
+
+MatchSpy *
+ValueOrdinalCountMatchSpy::clone() const {
+    Assert(internal.get());
+    return new ValueOrdinalCountMatchSpy(internal->slot);
+}
+
+string
+ValueOrdinalCountMatchSpy::name() const {
+    return "Xapian::ValueOrdinalCountMatchSpy";
+}
+
+string
+ValueOrdinalCountMatchSpy::serialise() const {
+    Assert(internal.get());
+    string result;
+    result += encode_length(internal->slot);
+    return result;
+}
+
+MatchSpy *
+ValueOrdinalCountMatchSpy::unserialise(const string & s, const Registry &) const
+{
+    const char * p = s.data();
+    const char * end = p + s.size();
+
+    valueno new_slot = decode_length(&p, end, false);
+    if (p != end) {
+	throw NetworkError("Junk at end of serialised ValueOrdinalCountMatchSpy");
+    }
+
+    return new ValueOrdinalCountMatchSpy(new_slot);
+}
+
+string
+ValueOrdinalCountMatchSpy::serialise_results() const {
+    LOGCALL(REMOTE, string, "ValueOrdinalCountMatchSpy::serialise_results", NO_ARGS);
+    Assert(internal.get());
+    // The values are sent in ordinal order, so the receiver only needs to
+    // look each one up once to map our ordinals to its own.
+    string result;
+    result += encode_length(internal->total);
+    Xapian::doccount items = 0;
+    for (size_t i = 0; i != internal->freqs.size(); ++i) {
+	if (internal->freqs[i]) ++items;
+    }
+    result += encode_length(items);
+    for (size_t i = 0; i != internal->values.size(); ++i) {
+	Xapian::doccount freq = internal->freqs[i];
+	if (!freq) continue;
+	const string & val = internal->values[i];
+	result += encode_length(val.size());
+	result += val;
+	result += encode_length(freq);
+    }
+    RETURN(result);
+}
+
+void
+ValueOrdinalCountMatchSpy::merge_results(const string & s) {
+    LOGCALL_VOID(REMOTE, "ValueOrdinalCountMatchSpy::merge_results", s);
+    Assert(internal.get());
+    const char * p = s.data();
+    const char * end = p + s.size();
+
+    internal->total += decode_length(&p, end, false);
+
+    Xapian::doccount items = decode_length(&p, end, false);
+    while (items != 0) {
+	size_t vallen = decode_length(&p, end, true);
+	string val(p, vallen);
+	p += vallen;
+	doccount freq = decode_length(&p, end, false);
+	internal->freqs[internal->get_ordinal(val)] += freq;
+	--items;
+    }
+    if (p != end) {
+	throw NetworkError("Junk at end of serialised ValueOrdinalCountMatchSpy results");
+    }
+}
+
+string
+ValueOrdinalCountMatchSpy::get_description() const {
+    string d = "ValueOrdinalCountMatchSpy(";
+    if (internal.get()) {
+	d += str(internal->total);
+	d += " docs seen, ";
+	d += str(internal->values.size());
+	d += " distinct values)";
+    } else {
+	d += ")";
+    }
+    return d;
+}
@@ -28,6 +28,7 @@
 
 #include "backends/database.h"
 #include "backends/document.h"
+#include "backends/valuelist.h"
 #include "matcher/multimatch.h"
 
 #include "xapian/document.h"
@@ -231,6 +232,8 @@ ValueWeightPostingSource::get_weight() const
 {
     Assert(!at_end());
     Assert(started);
+    double number;
+    if (value_it.internal->get_value_as_number(number)) return number;
     return sortable_unserialise(*value_it);
 }
 
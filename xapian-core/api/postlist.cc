@@ -71,6 +71,46 @@ PostList::check(Xapian::docid did, double w_min, bool &valid)
     return skip_to(did, w_min);
 }
 
+const Xapian::docid *
+PostList::get_docid_block(size_t &) const
+{
+    return NULL;
+}
+
+const unsigned char *
+PostList::get_docid_bitmap(Xapian::docid &, Xapian::docid &,
+			   Xapian::docid &) const
+{
+    return NULL;
+}
+
+PostList *
+PostList::next_batch(double w_min, double w_stop, Xapian::doccount & n,
+		     Xapian::docid * docids, double * weights)
+{
+    Assert(n);
+    Xapian::doccount count = 0;
+    while (true) {
+	PostList * res = next(w_min);
+	if (rare(res)) {
+	    if (!res->at_end()) {
+		docids[count] = res->get_docid();
+		weights[count] = res->get_weight();
+		++count;
+	    }
+	    n = count;
+	    return res;
+	}
+	if (at_end()) break;
+	docids[count] = get_docid();
+	double wt = get_weight();
+	weights[count] = wt;
+	if (++count == n || wt > w_stop) break;
+    }
+    n = count;
+    return NULL;
+}
+
 Xapian::termcount
 PostList::count_matching_subqs() const
 {
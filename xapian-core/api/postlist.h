@@ -29,6 +29,7 @@
 #include <xapian/postingiterator.h>
 
 #include "backends/positionlist.h"
+#include "omassert.h"
 #include "weight/weightinternal.h"
 
 /// Abstract base class for postlists.
@@ -179,6 +180,77 @@ class Xapian::PostingIterator::Internal : public Xapian::Internal::intrusive_bas
      */
     virtual Internal * check(Xapian::docid did, double w_min, bool &valid);
 
+    /** Return the docids from the current position to the end of the
+     *  block of entries the postlist has decoded.
+     *
+     *  This allows a caller to look ahead at the docids which next() would
+     *  move to without calling it for each.  Each call to next() or
+     *  skip_to() invalidates the returned pointer.
+     *
+     *  The default implementation returns NULL, which a subclass should also
+     *  do if it doesn't have a decoded block to hand.
+     *
+     *  @param n	Set to the number of docids returned, which is at
+     *			least 1 unless NULL is returned.
+     *
+     *  @return A pointer to the docids, the first of which is the current
+     *		docid, or NULL.
+     */
+    virtual const Xapian::docid * get_docid_block(size_t & n) const;
+
+    /** Return a bitmap of the docids around the current position.
+     *
+     *  Bit i of the bitmap (bit i % 8 of byte i / 8, counting from the least
+     *  significant bit) is set if docid @a base + i is in the postlist.  Only
+     *  the bits for docids from the current docid to @a last are meaningful.
+     *  Each call to next() or skip_to() invalidates the returned pointer.
+     *
+     *  The default implementation returns NULL, which a subclass should also
+     *  do if it doesn't have a bitmap to hand.
+     *
+     *  @param base	Set to the docid which bit 0 is for.
+     *  @param first	Set to the current docid.
+     *  @param last	Set to the last docid the bitmap covers.
+     *
+     *  @return A pointer to the bitmap, or NULL.
+     */
+    virtual const unsigned char * get_docid_bitmap(Xapian::docid & base,
+						   Xapian::docid & first,
+						   Xapian::docid & last) const;
+
+    /** Advance through up to @a n documents, recording each one.
+     *
+     *  This is equivalent to calling next() repeatedly and recording
+     *  get_docid() and get_weight() after each call, but saves the caller
+     *  making several virtual method calls per document.
+     *
+     *  Recording stops early if the end of the postlist is reached, if a
+     *  document with a weight greater than @a w_stop is recorded, or if
+     *  pruning occurs.  So on return the postlist (or the pointer returned,
+     *  if not NULL) is either at_end() or positioned on the last document
+     *  recorded, and only that last document can have a weight greater than
+     *  @a w_stop.
+     *
+     *  The default implementation calls next(), get_docid() and get_weight()
+     *  for each document.
+     *
+     *  @param w_min	The minimum weight contribution that is needed (this is
+     *			just a hint which PostList subclasses may ignore).
+     *  @param w_stop	Stop after recording a document with a greater weight
+     *			than this.
+     *  @param n	The number of entries @a docids and @a weights have
+     *			space for, which must be at least 1.  Set to the number
+     *			of documents recorded.
+     *  @param docids	Array to record the docids in.
+     *  @param weights	Array to record the weights in.
+     *
+     *  @return	As for next().  If pruning occurs, the document the returned
+     *		postlist is positioned on (if any) is the last one recorded.
+     */
+    virtual Internal * next_batch(double w_min, double w_stop,
+				  Xapian::doccount & n,
+				  Xapian::docid * docids, double * weights);
+
     /** Advance the current position to the next document in the postlist.
      *
      *  Any weight contribution is acceptable.
@@ -202,4 +274,40 @@ class Xapian::PostingIterator::Internal : public Xapian::Internal::intrusive_bas
 // but in the library code it's still known as "PostList" in most places.
 typedef Xapian::PostingIterator::Internal PostList;
 
+/** Implement PostList::next_batch() for a subclass.
+ *
+ *  The subclass's next() and get_weight() are called non-virtually, so the
+ *  compiler can inline them into the loop.
+ */
+template<class P>
+inline PostList *
+next_batch_helper(P * pl, double w_min, double w_stop,
+		  Xapian::doccount & n,
+		  Xapian::docid * docids, double * weights)
+{
+    Assert(n);
+    Xapian::doccount count = 0;
+    while (true) {
+	PostList * res = pl->P::next(w_min);
+	if (rare(res)) {
+	    // We've been pruned, so record the replacement's position (if any)
+	    // and let the caller substitute it for us.
+	    if (!res->at_end()) {
+		docids[count] = res->get_docid();
+		weights[count] = res->get_weight();
+		++count;
+	    }
+	    n = count;
+	    return res;
+	}
+	if (pl->P::at_end()) break;
+	docids[count] = pl->P::get_docid();
+	double wt = pl->P::get_weight();
+	weights[count] = wt;
+	if (++count == n || wt > w_stop) break;
+    }
+    n = count;
+    return NULL;
+}
+
 #endif // XAPIAN_INCLUDED_POSTLIST_H
@@ -40,6 +40,7 @@
 #include "matcher/queryoptimiser.h"
 #include "matcher/valuerangepostlist.h"
 #include "matcher/valuegepostlist.h"
+#include "matcher/valueindexpostlist.h"
 #include "net/length.h"
 #include "serialise-double.h"
 
@@ -622,6 +623,31 @@ QueryTerm::gather_terms(void * void_terms) const
     }
 }
 
+/** Use a value index for a range filter if it's selective enough.
+ *
+ *  Finding the matches with an index is proportional to the number of them,
+ *  but more work per match than checking values while reading the value
+ *  stream, so we only use the index if a small proportion of the documents
+ *  with a value in the slot match.
+ *
+ *  @return A postlist for the matches, or NULL to read the value stream.
+ */
+static PostList *
+value_index_postlist(const Xapian::Database::Internal & db,
+		     Xapian::valueno slot,
+		     const string & begin, const string * end)
+{
+    const Xapian::doccount MAX_FRACTION = 16;
+    Xapian::doccount max_size = db.get_value_freq(slot) / MAX_FRACTION;
+    if (max_size == 0) return NULL;
+    vector<Xapian::docid> dids;
+    if (!db.get_value_range_docids(slot, begin, end, max_size, dids))
+	return NULL;
+    if (dids.empty()) return new EmptyPostList;
+    return new ValueIndexPostList(&db, slot, begin, end ? *end : string(),
+				  dids);
+}
+
 PostingIterator::Internal *
 QueryValueRange::postlist(QueryOptimiser *qopt, double factor) const
 {
@@ -634,6 +660,8 @@ QueryValueRange::postlist(QueryOptimiser *qopt, double factor) const
     if (!lb.empty() && (end < lb || begin > db.get_value_upper_bound(slot))) {
 	RETURN(new EmptyPostList);
     }
+    PostList * pl = value_index_postlist(db, slot, begin, &end);
+    if (pl) RETURN(pl);
     RETURN(new ValueRangePostList(&db, slot, begin, end));
 }
 
@@ -674,6 +702,8 @@ QueryValueLE::postlist(QueryOptimiser *qopt, double factor) const
     if (limit < db.get_value_lower_bound(slot)) {
 	RETURN(new EmptyPostList);
     }
+    PostList * pl = value_index_postlist(db, slot, string(), &limit);
+    if (pl) RETURN(pl);
     RETURN(new ValueRangePostList(&db, slot, string(), limit));
 }
 
@@ -714,6 +744,8 @@ QueryValueGE::postlist(QueryOptimiser *qopt, double factor) const
     if (!lb.empty() && limit > db.get_value_upper_bound(slot)) {
 	RETURN(new EmptyPostList);
     }
+    PostList * pl = value_index_postlist(db, slot, limit, NULL);
+    if (pl) RETURN(pl);
     RETURN(new ValueGePostList(&db, slot, limit));
 }
 
@@ -47,6 +47,8 @@ class QueryTerm : public Query::Internal {
 	      Xapian::termpos pos_)
 	: term(term_), wqf(wqf_), pos(pos_) { }
 
+    const std::string & get_term() const { return term; }
+
     PostingIterator::Internal * postlist(QueryOptimiser * qopt, double factor) const;
 
     termcount get_length() const { return wqf; }
@@ -173,6 +175,8 @@ class QueryBranch : public Query::Internal {
 
     size_t num_subqueries() const { return subqueries.size(); }
 
+    const QueryVector & get_subqueries() const { return subqueries; }
+
     virtual Query::Internal * done() = 0;
 };
 
@@ -176,6 +176,8 @@ Registry::Internal::add_defaults()
     Xapian::MatchSpy * spy;
     spy = new Xapian::ValueCountMatchSpy();
     matchspies[spy->name()] = spy;
+    spy = new Xapian::ValueOrdinalCountMatchSpy();
+    matchspies[spy->name()] = spy;
 
     Xapian::LatLongMetric * metric;
     metric = new Xapian::GreatCircleMetric();
@@ -1,11 +1,13 @@
 noinst_HEADERS +=\
 	backends/alltermslist.h\
+	backends/blockcache.h\
 	backends/byte_length_strings.h\
 	backends/contiguousalldocspostlist.h\
 	backends/database.h\
 	backends/databasereplicator.h\
 	backends/document.h\
 	backends/flint_lock.h\
+	backends/impactlist.h\
 	backends/multivaluelist.h\
 	backends/positionlist.h\
 	backends/prefix_compressed_strings.h\
@@ -23,6 +25,7 @@ lib_src +=\
 	backends/database.cc\
 	backends/databasereplicator.cc\
 	backends/dbfactory.cc\
+	backends/impactlist.cc\
 	backends/slowvaluelist.cc\
 	backends/valuelist.cc
 
@@ -31,6 +34,11 @@ lib_src +=\
 	backends/dbfactory_remote.cc
 endif
 
+if BUILD_BACKEND_BRASS_OR_CHERT
+lib_src +=\
+	backends/blockcache.cc
+endif
+
 if BUILD_BACKEND_CHERT
 lib_src +=\
         backends/contiguousalldocspostlist.cc\
@@ -0,0 +1,248 @@
+/** @file blockcache.cc
+ * @brief Process-wide cache of B-tree blocks shared between tables.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "blockcache.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "debuglog.h"
+#include "omassert.h"
+
+using namespace std;
+
+BlockCache::Shard::Shard() : used(0), capacity(0), hits(0), misses(0)
+{
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_init(&mutex, NULL);
+#endif
+}
+
+BlockCache::Shard::~Shard()
+{
+    list<Entry>::iterator i;
+    for (i = lru.begin(); i != lru.end(); ++i) {
+	delete [] i->data;
+    }
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_destroy(&mutex);
+#endif
+}
+
+void
+BlockCache::Shard::lock()
+{
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_lock(&mutex);
+#endif
+}
+
+void
+BlockCache::Shard::unlock()
+{
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void
+BlockCache::Shard::trim()
+{
+    while (used > capacity) {
+	Assert(!lru.empty());
+	Entry & victim = lru.back();
+	used -= victim.size;
+	index.erase(victim.key);
+	delete [] victim.data;
+	lru.pop_back();
+    }
+}
+
+bool
+BlockCache::Shard::lookup(const Key & key, byte * p, unsigned size)
+{
+    lock();
+    map<Key, list<Entry>::iterator>::iterator i = index.find(key);
+    if (i == index.end()) {
+	++misses;
+	unlock();
+	return false;
+    }
+    list<Entry>::iterator e = i->second;
+    AssertEq(e->size, size);
+    memcpy(p, e->data, size);
+    // Move to the front of the LRU list.
+    lru.splice(lru.begin(), lru, e);
+    ++hits;
+    unlock();
+    return true;
+}
+
+void
+BlockCache::Shard::insert(const Key & key, const byte * p, unsigned size)
+{
+    if (size > capacity) return;
+    byte * data = new byte[size];
+    memcpy(data, p, size);
+    lock();
+    if (index.find(key) != index.end()) {
+	// Another thread got there first.
+	unlock();
+	delete [] data;
+	return;
+    }
+    try {
+	lru.push_front(Entry(key, data, size));
+	index.insert(make_pair(key, lru.begin()));
+    } catch (...) {
+	if (!lru.empty() && lru.front().data == data) lru.pop_front();
+	unlock();
+	delete [] data;
+	throw;
+    }
+    used += size;
+    trim();
+    unlock();
+}
+
+void
+BlockCache::Shard::discard(unsigned file, uint4 revision)
+{
+    lock();
+    list<Entry>::iterator i = lru.begin();
+    while (i != lru.end()) {
+	if (i->key.file == file && i->key.revision < revision) {
+	    used -= i->size;
+	    index.erase(i->key);
+	    delete [] i->data;
+	    i = lru.erase(i);
+	} else {
+	    ++i;
+	}
+    }
+    unlock();
+}
+
+void
+BlockCache::Shard::set_capacity(size_t capacity_)
+{
+    lock();
+    capacity = capacity_;
+    trim();
+    unlock();
+}
+
+BlockCache::BlockCache(size_t capacity_) : capacity(0)
+{
+    LOGCALL_CTOR(DB, "BlockCache", capacity_);
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_init(&files_mutex, NULL);
+#endif
+    set_capacity(capacity_);
+}
+
+BlockCache::~BlockCache()
+{
+    LOGCALL_DTOR(DB, "BlockCache");
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_destroy(&files_mutex);
+#endif
+}
+
+static BlockCache *
+create_block_cache()
+{
+#ifdef HAVE_PTHREAD_MUTEX
+    const char * p = getenv("XAPIAN_BLOCK_CACHE_SIZE");
+    if (p) {
+	size_t capacity = strtoul(p, NULL, 10);
+	if (capacity) return new BlockCache(capacity);
+    }
+#endif
+    // Without mutexes we can't safely share blocks between Database objects
+    // which may be in use by different threads.
+    return NULL;
+}
+
+BlockCache *
+BlockCache::get_instance()
+{
+    // The cache is intentionally never deleted, as tables may still be
+    // using it during the destruction of static objects.
+    static BlockCache * instance = create_block_cache();
+    return instance;
+}
+
+void
+BlockCache::set_capacity(size_t capacity_)
+{
+    LOGCALL_VOID(DB, "BlockCache::set_capacity", capacity_);
+    capacity = capacity_;
+    for (int i = 0; i != SHARDS; ++i) {
+	shards[i].set_capacity(capacity_ / SHARDS);
+    }
+}
+
+unsigned
+BlockCache::register_file(const string & id)
+{
+    LOGCALL(DB, unsigned, "BlockCache::register_file", id);
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_lock(&files_mutex);
+#endif
+    map<string, unsigned>::const_iterator i = file_ids.find(id);
+    unsigned file;
+    if (i != file_ids.end()) {
+	file = i->second;
+    } else {
+	file = file_ids.size();
+	file_ids.insert(make_pair(id, file));
+    }
+#ifdef HAVE_PTHREAD_MUTEX
+    pthread_mutex_unlock(&files_mutex);
+#endif
+    RETURN(file);
+}
+
+void
+BlockCache::discard(unsigned file, uint4 revision)
+{
+    LOGCALL_VOID(DB, "BlockCache::discard", file | revision);
+    for (int i = 0; i != SHARDS; ++i) {
+	shards[i].discard(file, revision);
+    }
+}
+
+unsigned long
+BlockCache::get_hits() const
+{
+    unsigned long total = 0;
+    for (int i = 0; i != SHARDS; ++i) total += shards[i].hits;
+    return total;
+}
+
+unsigned long
+BlockCache::get_misses() const
+{
+    unsigned long total = 0;
+    for (int i = 0; i != SHARDS; ++i) total += shards[i].misses;
+    return total;
+}
@@ -0,0 +1,226 @@
+/** @file blockcache.h
+ * @brief Process-wide cache of B-tree blocks shared between tables.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_BLOCKCACHE_H
+#define XAPIAN_INCLUDED_BLOCKCACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+
+#ifdef HAVE_PTHREAD_MUTEX
+# include <pthread.h>
+#endif
+
+#include "internaltypes.h"
+
+/** A size-bounded cache of B-tree blocks shared by all read-only tables.
+ *
+ *  Entries are keyed by a file id (allocated by register_file() from a string
+ *  which identifies a particular table file - copies of a database share a
+ *  UUID, so the table code includes the file's device and inode too), the
+ *  revision the table is open at, and the block number.  The contents of a
+ *  block which is part of a given revision of a table never change while
+ *  that revision is current, and the table code only inserts a block once
+ *  the existing revision checks have accepted it, so it's safe for tables
+ *  opened at the same revision to share cached blocks even if they are in
+ *  different Database objects.
+ *
+ *  Once a newer revision of a file is committed by a writer in the same
+ *  process, its blocks from older revisions are discarded.  A writer in
+ *  another process can't tell us, so a reader which finds every block it
+ *  needs in the cache may keep reading its old revision until it reopens.
+ *
+ *  The cache is split into shards, each with its own lock and LRU list, so
+ *  that threads using different Database objects rarely contend.
+ *
+ *  The cache is disabled unless the environment variable
+ *  XAPIAN_BLOCK_CACHE_SIZE is set to the maximum number of bytes of block
+ *  data to hold.
+ */
+class BlockCache {
+    /// Prevent copying.
+    BlockCache(const BlockCache &);
+
+    /// Prevent assignment.
+    void operator=(const BlockCache &);
+
+    /// The number of independently locked shards.
+    enum { SHARDS = 16 };
+
+    struct Key {
+	unsigned file;
+	uint4 revision;
+	uint4 n;
+
+	Key(unsigned file_, uint4 revision_, uint4 n_)
+	    : file(file_), revision(revision_), n(n_) { }
+
+	bool operator<(const Key & o) const {
+	    if (n != o.n) return n < o.n;
+	    if (file != o.file) return file < o.file;
+	    return revision < o.revision;
+	}
+    };
+
+    struct Entry {
+	Key key;
+	byte * data;
+	unsigned size;
+
+	Entry(const Key & key_, byte * data_, unsigned size_)
+	    : key(key_), data(data_), size(size_) { }
+    };
+
+    class Shard {
+	/// Prevent copying.
+	Shard(const Shard &);
+
+	/// Prevent assignment.
+	void operator=(const Shard &);
+
+#ifdef HAVE_PTHREAD_MUTEX
+	pthread_mutex_t mutex;
+#endif
+
+	/// Most recently used entry at the front.
+	std::list<Entry> lru;
+
+	std::map<Key, std::list<Entry>::iterator> index;
+
+	/// Bytes of block data currently held.
+	size_t used;
+
+	/// Maximum bytes of block data to hold.
+	size_t capacity;
+
+	void lock();
+
+	void unlock();
+
+	/// Discard least recently used entries until within capacity.
+	void trim();
+
+      public:
+	unsigned long hits, misses;
+
+	Shard();
+
+	~Shard();
+
+	bool lookup(const Key & key, byte * p, unsigned size);
+
+	void insert(const Key & key, const byte * p, unsigned size);
+
+	/// Discard entries for @a file from revisions before @a revision.
+	void discard(unsigned file, uint4 revision);
+
+	void set_capacity(size_t capacity_);
+    };
+
+    Shard shards[SHARDS];
+
+#ifdef HAVE_PTHREAD_MUTEX
+    /// Protects file_ids.
+    pthread_mutex_t files_mutex;
+#endif
+
+    std::map<std::string, unsigned> file_ids;
+
+    size_t capacity;
+
+    Shard & shard_for(const Key & key) {
+	return shards[(key.n ^ (key.file * 0x9e3779b1u)) % SHARDS];
+    }
+
+  public:
+    /// Create a cache holding up to @a capacity_ bytes of block data.
+    explicit BlockCache(size_t capacity_);
+
+    ~BlockCache();
+
+    /** Return the process-wide block cache.
+     *
+     *  @return NULL if the cache isn't enabled.
+     */
+    static BlockCache * get_instance();
+
+    /** Set the maximum number of bytes of block data to cache.
+     *
+     *  If the capacity is reduced, the least recently used blocks are
+     *  discarded to bring the cache within the new limit.  Setting it to 0
+     *  effectively disables the cache.
+     */
+    void set_capacity(size_t capacity_);
+
+    /// Get the maximum number of bytes of block data to cache.
+    size_t get_capacity() const { return capacity; }
+
+    /** Get a file id to use for the table identified by @a id.
+     *
+     *  Calling this again with the same id returns the same file id.
+     */
+    unsigned register_file(const std::string & id);
+
+    /** Look up a block.
+     *
+     *  @return true if the block was found, in which case @a size bytes
+     *		have been copied to @a p.
+     */
+    bool lookup(unsigned file, uint4 revision, uint4 n, byte * p,
+		unsigned size) {
+	Key key(file, revision, n);
+	return shard_for(key).lookup(key, p, size);
+    }
+
+    /// Add a block which has just been read from disk.
+    void insert(unsigned file, uint4 revision, uint4 n, const byte * p,
+		unsigned size) {
+	Key key(file, revision, n);
+	shard_for(key).insert(key, p, size);
+    }
+
+    /** Discard the blocks cached for @a file from revisions before
+     *  @a revision.
+     *
+     *  This is called once a newer revision of the file has been committed,
+     *  or a reader has found that the revision it has open has been
+     *  overwritten.  The writer may reuse the blocks of older revisions, so
+     *  readers of those should read from disk again, which lets them notice
+     *  this and throw Xapian::DatabaseModifiedError as they would without
+     *  the cache.
+     */
+    void discard(unsigned file, uint4 revision);
+
+    /** Number of lookups which found the block in the cache.
+     *
+     *  The counters aren't locked while summing, so this is only approximate
+     *  if other threads are using the cache at the time.
+     */
+    unsigned long get_hits() const;
+
+    /** Number of lookups which didn't find the block in the cache.
+     *
+     *  The counters aren't locked while summing, so this is only approximate
+     *  if other threads are using the cache at the time.
+     */
+    unsigned long get_misses() const;
+};
+
+#endif // XAPIAN_INCLUDED_BLOCKCACHE_H
@@ -7,7 +7,9 @@ noinst_HEADERS +=\
 	backends/brass/brass_alldocspostlist.h\
 	backends/brass/brass_alltermslist.h\
 	backends/brass/brass_btreebase.h\
+	backends/brass/brass_bulkload.h\
 	backends/brass/brass_check.h\
+	backends/brass/brass_codec.h\
 	backends/brass/brass_compact.h\
 	backends/brass/brass_cursor.h\
 	backends/brass/brass_database.h\
@@ -15,6 +17,7 @@ noinst_HEADERS +=\
 	backends/brass/brass_dbcheck.h\
 	backends/brass/brass_dbstats.h\
 	backends/brass/brass_document.h\
+	backends/brass/brass_impact.h\
 	backends/brass/brass_inverter.h\
 	backends/brass/brass_lazytable.h\
 	backends/brass/brass_metadata.h\
@@ -37,7 +40,9 @@ lib_src +=\
 	backends/brass/brass_alldocspostlist.cc\
 	backends/brass/brass_alltermslist.cc\
 	backends/brass/brass_btreebase.cc\
+	backends/brass/brass_bulkload.cc\
 	backends/brass/brass_check.cc\
+	backends/brass/brass_codec.cc\
 	backends/brass/brass_compact.cc\
 	backends/brass/brass_cursor.cc\
 	backends/brass/brass_database.cc\
@@ -45,6 +50,7 @@ lib_src +=\
 	backends/brass/brass_dbcheck.cc\
 	backends/brass/brass_dbstats.cc\
 	backends/brass/brass_document.cc\
+	backends/brass/brass_impact.cc\
 	backends/brass/brass_inverter.cc\
 	backends/brass/brass_metadata.cc\
 	backends/brass/brass_positionlist.cc\
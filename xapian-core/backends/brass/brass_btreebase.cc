@@ -26,6 +26,7 @@
 #include <xapian/error.h>
 
 #include "brass_btreebase.h"
+#include "brass_codec.h"
 #include "fd.h"
 #include "io_utils.h"
 #include "omassert.h"
@@ -63,11 +64,19 @@ using namespace std;
  * ITEM_COUNT
  * LAST_BLOCK
  * HAVE_FAKEROOT
+ * SEQUENTIAL
+ * CODEC	The codec used for compressed tags (see BrassCodec).  Not
+ * 		present in format 5, which always used zlib.
+ * DICTIONARY	The dictionary used for compressed tags, as a length followed
+ * 		by that many raw bytes (length 0 for no dictionary).  Not
+ * 		present in formats 5 and 6.
+ * FLAGS	Flags whose meaning depends on the table (see
+ * 		BrassTable::get_flags()).  Not present in formats before 8.
  * REVISION2	A second copy of the revision number, for consistency checks.
  * BITMAP	The bitmap.  This will be BIT_MAP_SIZE raw bytes.
  * REVISION3	A third copy of the revision number, for consistency checks.
  */
-#define CURR_FORMAT 5U
+#define CURR_FORMAT 8U
 
 BrassTable_base::BrassTable_base()
 	: revision(0),
@@ -79,6 +88,8 @@ BrassTable_base::BrassTable_base()
 	  last_block(0),
 	  have_fakeroot(false),
 	  sequential(false),
+	  codec(BrassCodec::ZLIB),
+	  flags(0),
 	  bit_map_low(0),
 	  bit_map0(0),
 	  bit_map(0)
@@ -97,6 +108,9 @@ BrassTable_base::swap(BrassTable_base &other)
     std::swap(last_block, other.last_block);
     std::swap(have_fakeroot, other.have_fakeroot);
     std::swap(sequential, other.sequential);
+    std::swap(codec, other.codec);
+    std::swap(dictionary, other.dictionary);
+    std::swap(flags, other.flags);
     std::swap(bit_map_low, other.bit_map_low);
     std::swap(bit_map0, other.bit_map0);
     std::swap(bit_map, other.bit_map);
@@ -179,7 +193,7 @@ BrassTable_base::read(const string & name, char ch, bool read_bitmap,
     DO_UNPACK_UINT_ERRCHECK(&start, end, revision);
     uint4 format;
     DO_UNPACK_UINT_ERRCHECK(&start, end, format);
-    if (format != CURR_FORMAT) {
+    if (format > CURR_FORMAT || format < 5) {
 	err_msg += "Bad base file format " + str(format) + " in " +
 		    basename + "\n";
 	return false;
@@ -198,6 +212,41 @@ BrassTable_base::read(const string & name, char ch, bool read_bitmap,
     DO_UNPACK_UINT_ERRCHECK(&start, end, sequential_);
     sequential = sequential_;
 
+    uint4 codec_ = BrassCodec::ZLIB;
+    if (format > 5) {
+	DO_UNPACK_UINT_ERRCHECK(&start, end, codec_);
+    }
+    codec = codec_;
+
+    dictionary.resize(0);
+    if (format > 6) {
+	uint4 dictionary_size;
+	DO_UNPACK_UINT_ERRCHECK(&start, end, dictionary_size);
+	// Check the size before we allocate space for the dictionary.
+	if (dictionary_size > BrassCodec::max_dictionary_size(codec)) {
+	    throw Xapian::DatabaseCorruptError("Compression dictionary size " +
+					       str(dictionary_size) +
+					       " too large in " + basename);
+	}
+	// The dictionary is likely to be larger than what we've read so far.
+	size_t n = min(size_t(end - start), size_t(dictionary_size));
+	dictionary.assign(start, n);
+	start += n;
+	if (n < dictionary_size) {
+	    dictionary.resize(dictionary_size);
+	    (void)io_read(h, &dictionary[n], dictionary_size - n,
+			  dictionary_size - n);
+	    start = buf;
+	    end = buf + io_read(h, buf, REASONABLE_BASE_SIZE, 0);
+	}
+    }
+
+    uint4 flags_ = 0;
+    if (format > 7) {
+	DO_UNPACK_UINT_ERRCHECK(&start, end, flags_);
+    }
+    flags = flags_;
+
     if (have_fakeroot && !sequential) {
 	sequential = true; // FIXME : work out why we need this...
 	/*
@@ -274,7 +323,8 @@ BrassTable_base::write_to_file(const string &filename,
 			       char base_letter,
 			       const string &tablename,
 			       int changes_fd,
-			       const string * changes_tail)
+			       const string * changes_tail,
+			       int * fd_out)
 {
     calculate_last_block();
 
@@ -289,6 +339,9 @@ BrassTable_base::write_to_file(const string &filename,
     pack_uint(buf, static_cast<uint4>(last_block));
     pack_uint(buf, have_fakeroot);
     pack_uint(buf, sequential);
+    pack_uint(buf, static_cast<uint4>(codec));
+    pack_string(buf, dictionary);
+    pack_uint(buf, flags);
     pack_uint(buf, revision);  // REVISION2
     if (bit_map_size > 0) {
 	buf.append(reinterpret_cast<const char *>(bit_map), bit_map_size);
@@ -318,6 +371,11 @@ BrassTable_base::write_to_file(const string &filename,
     }
 
     io_write(h, buf.data(), buf.size());
+    if (fd_out) {
+	io_start_sync(h);
+	*fd_out = h.release();
+	return;
+    }
     io_sync(h);
 }
 
@@ -58,6 +58,9 @@ class BrassTable_base {
 	uint4 get_last_block() const { return last_block; }
 	bool get_have_fakeroot() const { return have_fakeroot; }
 	bool get_sequential() const { return sequential; }
+	int get_codec() const { return codec; }
+	const std::string & get_dictionary() const { return dictionary; }
+	unsigned get_flags() const { return flags; }
 
 	void set_revision(uint4 revision_) {
 	    revision = revision_;
@@ -80,13 +83,29 @@ class BrassTable_base {
 	void set_sequential(bool sequential_) {
 	    sequential = sequential_;
 	}
+	void set_codec(int codec_) {
+	    codec = codec_;
+	}
+	void set_dictionary(const std::string & dictionary_) {
+	    dictionary = dictionary_;
+	}
+	void set_flags(unsigned flags_) {
+	    flags = flags_;
+	}
 
-	/** Write the btree base file to disk. */
+	/** Write the btree base file to disk.
+	 *
+	 *  @param fd_out	If NULL, the file is synced and closed.
+	 *			Otherwise writeback of the file is started and
+	 *			the file descriptor is stored in *fd_out, and
+	 *			the caller must sync and close it.
+	 */
 	void write_to_file(const std::string &filename,
 			   char base_letter,
 			   const std::string &tablename,
 			   int changes_fd,
-			   const std::string * changes_tail);
+			   const std::string * changes_tail,
+			   int * fd_out = NULL);
 
 	/* Methods dealing with the bitmap */
 	/** true iff block n was free at the start of the transaction on
@@ -134,6 +153,9 @@ class BrassTable_base {
 	uint4 last_block;
 	bool have_fakeroot;
 	bool sequential;
+	int codec;
+	std::string dictionary;
+	unsigned flags;
 
 	/* Data related to the bitmap */
 	/** byte offset into the bit map below which there
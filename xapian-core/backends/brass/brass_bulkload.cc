@@ -0,0 +1,178 @@
+/** @file brass_bulkload.cc
+ * @brief Build the postlist table of a new brass database from sorted runs.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "brass_bulkload.h"
+
+#include "xapian/error.h"
+
+#include "autoptr.h"
+#include "brass_compact.h"
+#include "brass_inverter.h"
+#include "brass_postlist.h"
+#include "debuglog.h"
+#include "fileutils.h"
+#include "omassert.h"
+#include "safeerrno.h"
+#include "safesysstat.h"
+#include "str.h"
+
+using namespace std;
+
+BrassBulkLoad::~BrassBulkLoad()
+{
+    LOGCALL_DTOR(DB, "BrassBulkLoad");
+    try {
+	remove_runs(0);
+    } catch (...) {
+	// Ignore errors removing the runs - we can't throw from a destructor.
+    }
+}
+
+string
+BrassBulkLoad::new_run_dir()
+{
+    string dir = db_dir;
+    dir += "/bulk";
+    dir += str(next_run++);
+    // A run directory may have been left behind if an earlier bulk load was
+    // interrupted, in which case we just reuse it.
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+	throw Xapian::DatabaseError("Cannot create directory '" + dir + "'",
+				    errno);
+    }
+    return dir;
+}
+
+void
+BrassBulkLoad::merge_runs(size_t first, BrassTable * out)
+{
+    LOGCALL_VOID(DB, "BrassBulkLoad::merge_runs", first | out);
+    vector<string> inputs;
+    inputs.reserve(runs.size() - first);
+    for (size_t i = first; i != runs.size(); ++i) {
+	inputs.push_back(runs[i].first + "/postlist.");
+    }
+    merge_brass_postlists(out, inputs);
+}
+
+void
+BrassBulkLoad::remove_runs(size_t first)
+{
+    LOGCALL_VOID(DB, "BrassBulkLoad::remove_runs", first);
+    while (runs.size() > first) {
+	if (open_runs.size() == runs.size()) {
+	    delete open_runs.back();
+	    open_runs.pop_back();
+	}
+	removedir(runs.back().first);
+	runs.pop_back();
+    }
+}
+
+void
+BrassBulkLoad::add_run(Inverter & inverter)
+{
+    LOGCALL_VOID(DB, "BrassBulkLoad::add_run", NO_ARGS);
+    string dir = new_run_dir();
+    {
+	BrassPostListTable run(dir, false);
+	try {
+	    // Use maximum blocksize for temporary tables, as compaction does.
+	    run.create_and_open(65536);
+	    run.set_full_compaction(true);
+	    inverter.flush(run);
+	    run.flush_db();
+	    run.commit(1);
+	} catch (...) {
+	    removedir(dir);
+	    throw;
+	}
+    }
+    runs.push_back(make_pair(dir, 0u));
+
+    // Merge runs of the same generation once there are enough of them.  We
+    // only need to check the end of the list, since a merge can only make
+    // the last generation match the one before it.
+    while (runs.size() >= RUNS_PER_MERGE) {
+	size_t first = runs.size() - RUNS_PER_MERGE;
+	unsigned generation = runs.back().second;
+	if (runs[first].second != generation) break;
+
+	dir = new_run_dir();
+	{
+	    BrassTable merged("postlist", dir + "/postlist.", false);
+	    try {
+		merged.create_and_open(65536);
+		merged.set_full_compaction(true);
+		merge_runs(first, &merged);
+		merged.flush_db();
+		merged.commit(1);
+	    } catch (...) {
+		removedir(dir);
+		throw;
+	    }
+	}
+	remove_runs(first);
+	runs.push_back(make_pair(dir, generation + 1));
+    }
+}
+
+void
+BrassBulkLoad::get_freqs(const vector<string> & terms,
+			 vector<Xapian::doccount> & termfreqs,
+			 vector<Xapian::termcount> & collfreqs) const
+{
+    LOGCALL_VOID(DB, "BrassBulkLoad::get_freqs", terms.size() | (void*)&termfreqs | (void*)&collfreqs);
+    termfreqs.assign(terms.size(), 0);
+    collfreqs.assign(terms.size(), 0);
+    vector<Xapian::doccount> run_termfreqs;
+    vector<Xapian::termcount> run_collfreqs;
+    open_runs.resize(runs.size(), NULL);
+    for (size_t i = 0; i != runs.size(); ++i) {
+	if (!open_runs[i]) {
+	    AutoPtr<BrassPostListTable> run(
+		new BrassPostListTable(runs[i].first, true));
+	    // Each run is committed as revision 1.
+	    if (!run->open(1)) {
+		throw Xapian::DatabaseOpeningError("Couldn't open bulk load "
+						   "run '" + runs[i].first +
+						   "'");
+	    }
+	    open_runs[i] = run.release();
+	}
+	// The runs hold disjoint sets of documents, so we can just add up
+	// the frequencies.
+	open_runs[i]->get_freqs(terms, run_termfreqs, run_collfreqs);
+	for (size_t j = 0; j != terms.size(); ++j) {
+	    termfreqs[j] += run_termfreqs[j];
+	    collfreqs[j] += run_collfreqs[j];
+	}
+    }
+}
+
+void
+BrassBulkLoad::finish(BrassTable * out)
+{
+    LOGCALL_VOID(DB, "BrassBulkLoad::finish", out);
+    if (runs.empty()) return;
+    merge_runs(0, out);
+    remove_runs(0);
+}
@@ -0,0 +1,129 @@
+/** @file brass_bulkload.h
+ * @brief Build the postlist table of a new brass database from sorted runs.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_BRASS_BULKLOAD_H
+#define XAPIAN_INCLUDED_BRASS_BULKLOAD_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <xapian/types.h>
+
+class BrassPostListTable;
+class BrassTable;
+class Inverter;
+
+/** Build the postlist table of a new database from sorted runs.
+ *
+ *  When adding documents to a new database, each batch of buffered postlist
+ *  changes would normally be merged into the postlist table, which means
+ *  updating chunks all over the table and leaves blocks around half full.
+ *
+ *  Instead, each batch is written out in key order to a temporary postlist
+ *  table (a "run") in a subdirectory of the database directory.  Because the
+ *  run is written sequentially, and all documents are new, the runs contain
+ *  disjoint ascending docid ranges for each term, so they can be combined
+ *  with the same merging code which xapian-compact uses.  Once
+ *  RUNS_PER_MERGE runs of the same generation have accumulated they are
+ *  merged into a single run of the next generation, which bounds the number
+ *  of runs (and so the number of file descriptors needed for the final
+ *  merge) while only rewriting each posting a logarithmic number of times.
+ *  Finally, finish() merges all the runs into the real postlist table,
+ *  writing it in a single pass in key order.
+ */
+class BrassBulkLoad {
+    /// Prevent copying.
+    BrassBulkLoad(const BrassBulkLoad &);
+
+    /// Prevent assignment.
+    void operator=(const BrassBulkLoad &);
+
+    /// The number of runs of one generation to merge together.
+    enum { RUNS_PER_MERGE = 16 };
+
+    /// The database directory the runs are created in.
+    std::string db_dir;
+
+    /// Number used to name the next run.
+    unsigned next_run;
+
+    /** The runs which haven't been merged into the postlist table yet.
+     *
+     *  Each entry is the directory holding the run and its generation.  The
+     *  generations are non-increasing along the vector.
+     */
+    std::vector<std::pair<std::string, unsigned> > runs;
+
+    /** The runs which get_freqs() has opened, indexed like runs.
+     *
+     *  The runs don't change once written, so we keep them open to avoid
+     *  opening every run each time the statistics are read.  Entries are
+     *  NULL for runs which haven't been opened, and the vector may be
+     *  shorter than runs.
+     */
+    mutable std::vector<BrassPostListTable *> open_runs;
+
+    /// Create a new empty directory for a run, and return its path.
+    std::string new_run_dir();
+
+    /// Merge the runs from index @a first onwards into @a out.
+    void merge_runs(size_t first, BrassTable * out);
+
+    /// Remove the runs from index @a first onwards.
+    void remove_runs(size_t first);
+
+  public:
+    /// Create runs in subdirectories of @a db_dir_.
+    explicit BrassBulkLoad(const std::string & db_dir_)
+	: db_dir(db_dir_), next_run(0) { }
+
+    /// Remove any runs which haven't been merged.
+    ~BrassBulkLoad();
+
+    /** Write the postlist changes buffered in @a inverter out as a new run.
+     *
+     *  The buffered changes are cleared.  All the changes must be for
+     *  documents with higher docids than those in existing runs.
+     */
+    void add_run(Inverter & inverter);
+
+    /** Merge all the runs into the postlist table @a out.
+     *
+     *  The runs are then removed.  @a out must not already contain any
+     *  postlist or document length chunks.
+     */
+    void finish(BrassTable * out);
+
+    /** Get the frequencies of @a terms in the runs.
+     *
+     *  The postlist table doesn't have the posting lists while we're bulk
+     *  loading, so this allows term statistics to be read without ending
+     *  bulk loading.  Changes which haven't been written out as a run yet
+     *  aren't included.
+     */
+    void get_freqs(const std::vector<std::string> & terms,
+		   std::vector<Xapian::doccount> & termfreqs,
+		   std::vector<Xapian::termcount> & collfreqs) const;
+
+    /// Discard all the runs.
+    void clear() { remove_runs(0); }
+};
+
+#endif // XAPIAN_INCLUDED_BRASS_BULKLOAD_H
@@ -0,0 +1,602 @@
+/** @file brass_codec.cc
+ * @brief Codecs for compressing tags in brass tables.
+ */
+/* Copyright 1999,2000,2001 BrightStation PLC
+ * Copyright 2002,2003,2004,2005,2006,2007,2008,2009,2010,2011,2012,2013 Olly Betts
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "brass_codec.h"
+
+#include "brass_table.h"
+
+#include "xapian/error.h"
+
+#include "common/compression_stream.h"
+#include "debuglog.h"
+#include "omassert.h"
+#include "pack.h"
+#include "str.h"
+#include "unaligned.h"
+
+#include <algorithm>
+#include <climits>
+#include <queue>
+
+#ifdef HAVE_LZ4
+# include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+#ifdef HAVE_ZDICT_H
+# include <zdict.h>
+#endif
+
+using namespace std;
+
+BrassCodec::~BrassCodec() { }
+
+namespace {
+
+/// The original codec, using zlib's raw deflate format.
+class ZlibCodec : public BrassCodec {
+    CompressionStream comp_stream;
+
+    /// The dictionary (empty for none).
+    string dictionary;
+
+  public:
+    explicit ZlibCodec(const string & dictionary_)
+	: comp_stream(Z_DEFAULT_STRATEGY), dictionary(dictionary_) { }
+
+    bool compress(const string & tag, string & out);
+
+    void decompress(const string & tag, string & out);
+};
+
+bool
+ZlibCodec::compress(const string & tag, string & out)
+{
+    comp_stream.lazy_alloc_deflate_zstream();
+    if (!dictionary.empty()) {
+	int err = deflateSetDictionary(comp_stream.deflate_zstream,
+				       (const Bytef *)dictionary.data(),
+				       (uInt)dictionary.size());
+	if (rare(err != Z_OK))
+	    throw Xapian::DatabaseError("deflateSetDictionary failed");
+    }
+
+    comp_stream.deflate_zstream->next_in = (Bytef *)const_cast<char *>(tag.data());
+    comp_stream.deflate_zstream->avail_in = (uInt)tag.size();
+
+    // If compressed size is >= tag.size(), we don't want to compress.
+    unsigned long blk_len = tag.size() - 1;
+    unsigned char * blk = new unsigned char[blk_len];
+    comp_stream.deflate_zstream->next_out = blk;
+    comp_stream.deflate_zstream->avail_out = (uInt)blk_len;
+
+    int err = deflate(comp_stream.deflate_zstream, Z_FINISH);
+    bool compressed = false;
+    if (err == Z_STREAM_END) {
+	// If deflate succeeded, then the output was at least one byte
+	// smaller than the input.
+	out.assign(reinterpret_cast<const char *>(blk), comp_stream.deflate_zstream->total_out);
+	compressed = true;
+    } else {
+	// Deflate failed - presumably the data wasn't compressible.
+    }
+
+    delete [] blk;
+    return compressed;
+}
+
+void
+ZlibCodec::decompress(const string & tag, string & out)
+{
+    out.resize(0);
+    // May not be enough for a compressed tag, but it's a reasonable guess.
+    out.reserve(tag.size() + tag.size() / 2);
+
+    Bytef buf[8192];
+
+    comp_stream.lazy_alloc_inflate_zstream();
+    if (!dictionary.empty()) {
+	// With raw inflate, the dictionary is set up front rather than in
+	// response to Z_NEED_DICT.
+	int err = inflateSetDictionary(comp_stream.inflate_zstream,
+				       (const Bytef *)dictionary.data(),
+				       (uInt)dictionary.size());
+	if (rare(err != Z_OK))
+	    throw Xapian::DatabaseError("inflateSetDictionary failed");
+    }
+
+    comp_stream.inflate_zstream->next_in = (Bytef*)const_cast<char *>(tag.data());
+    comp_stream.inflate_zstream->avail_in = (uInt)tag.size();
+
+    int err = Z_OK;
+    while (err != Z_STREAM_END) {
+	comp_stream.inflate_zstream->next_out = buf;
+	comp_stream.inflate_zstream->avail_out = (uInt)sizeof(buf);
+	err = inflate(comp_stream.inflate_zstream, Z_SYNC_FLUSH);
+	if (err == Z_BUF_ERROR && comp_stream.inflate_zstream->avail_in == 0) {
+	    LOGLINE(DB, "Z_BUF_ERROR - faking checksum of " << comp_stream.inflate_zstream->adler);
+	    Bytef header2[4];
+	    setint4(header2, 0, comp_stream.inflate_zstream->adler);
+	    comp_stream.inflate_zstream->next_in = header2;
+	    comp_stream.inflate_zstream->avail_in = 4;
+	    err = inflate(comp_stream.inflate_zstream, Z_SYNC_FLUSH);
+	    if (err == Z_STREAM_END) break;
+	}
+
+	if (err != Z_OK && err != Z_STREAM_END) {
+	    if (err == Z_MEM_ERROR) throw std::bad_alloc();
+	    string msg = "inflate failed";
+	    if (comp_stream.inflate_zstream->msg) {
+		msg += " (";
+		msg += comp_stream.inflate_zstream->msg;
+		msg += ')';
+	    }
+	    throw Xapian::DatabaseError(msg);
+	}
+
+	out.append(reinterpret_cast<const char *>(buf),
+		   comp_stream.inflate_zstream->next_out - buf);
+    }
+    if (out.size() != comp_stream.inflate_zstream->total_out) {
+	string msg = "compressed tag didn't expand to the expected size: ";
+	msg += str(out.size());
+	msg += " != ";
+	// OpenBSD's zlib.h uses off_t instead of uLong for total_out.
+	msg += str((size_t)comp_stream.inflate_zstream->total_out);
+	throw Xapian::DatabaseCorruptError(msg);
+    }
+}
+
+/** Unpack the uncompressed length from the start of a compressed tag.
+ *
+ *  The LZ4 and zstd codecs store the uncompressed length before the
+ *  compressed data, so we can decompress in a single call into a buffer of
+ *  the right size.
+ */
+static inline size_t
+unpack_tag_length(const char ** p, const char * end)
+{
+    size_t len;
+    if (!unpack_uint(p, end, &len) || len > size_t(INT_MAX))
+	throw Xapian::DatabaseCorruptError("Bad compressed tag header");
+    return len;
+}
+
+static inline void
+check_tag_length(size_t got, size_t expected)
+{
+    if (rare(got != expected)) {
+	string msg = "compressed tag didn't expand to the expected size: ";
+	msg += str(got);
+	msg += " != ";
+	msg += str(expected);
+	throw Xapian::DatabaseCorruptError(msg);
+    }
+}
+
+#ifdef HAVE_LZ4
+/// LZ4 - much faster than zlib, but a lower compression ratio.
+class Lz4Codec : public BrassCodec {
+    /// The dictionary (empty for none).
+    string dictionary;
+
+    /// Stream state for compressing with a dictionary.
+    LZ4_stream_t * stream;
+
+  public:
+    explicit Lz4Codec(const string & dictionary_)
+	: dictionary(dictionary_), stream(NULL) { }
+
+    ~Lz4Codec();
+
+    bool compress(const string & tag, string & out);
+
+    void decompress(const string & tag, string & out);
+};
+
+Lz4Codec::~Lz4Codec()
+{
+    if (stream) LZ4_freeStream(stream);
+}
+
+bool
+Lz4Codec::compress(const string & tag, string & out)
+{
+    if (tag.size() > size_t(LZ4_MAX_INPUT_SIZE)) return false;
+    out.resize(0);
+    pack_uint(out, tag.size());
+    size_t header_len = out.size();
+    int bound = LZ4_compressBound(int(tag.size()));
+    out.resize(header_len + bound);
+    int len;
+    if (dictionary.empty()) {
+	len = LZ4_compress_default(tag.data(), &out[header_len],
+				   int(tag.size()), bound);
+    } else {
+	if (!stream) {
+	    stream = LZ4_createStream();
+	    if (!stream) throw std::bad_alloc();
+	}
+	// This resets the stream, so each tag is compressed independently.
+	LZ4_loadDict(stream, dictionary.data(), int(dictionary.size()));
+	len = LZ4_compress_fast_continue(stream, tag.data(), &out[header_len],
+					 int(tag.size()), bound, 1);
+    }
+    if (len <= 0 || header_len + len >= tag.size()) return false;
+    out.resize(header_len + len);
+    return true;
+}
+
+void
+Lz4Codec::decompress(const string & tag, string & out)
+{
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    size_t len = unpack_tag_length(&p, end);
+    out.resize(len);
+    if (len == 0) return;
+    int r;
+    if (dictionary.empty()) {
+	r = LZ4_decompress_safe(p, &out[0], int(end - p), int(len));
+    } else {
+	r = LZ4_decompress_safe_usingDict(p, &out[0], int(end - p), int(len),
+					  dictionary.data(),
+					  int(dictionary.size()));
+    }
+    if (r < 0)
+	throw Xapian::DatabaseCorruptError("LZ4 decompression of tag failed");
+    check_tag_length(size_t(r), len);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/// The zstd compression level to use.
+const int ZSTD_LEVEL = 3;
+
+/// Zstandard - faster than zlib, and a better compression ratio.
+class ZstdCodec : public BrassCodec {
+    ZSTD_CCtx * cctx;
+
+    ZSTD_DCtx * dctx;
+
+    /// The dictionary (empty for none).
+    string dictionary;
+
+    /// The dictionary prepared for compressing, or NULL if not yet needed.
+    ZSTD_CDict * cdict;
+
+    /// The dictionary prepared for decompressing, or NULL if not yet needed.
+    ZSTD_DDict * ddict;
+
+  public:
+    explicit ZstdCodec(const string & dictionary_)
+	: cctx(NULL), dctx(NULL), dictionary(dictionary_),
+	  cdict(NULL), ddict(NULL) { }
+
+    ~ZstdCodec();
+
+    bool compress(const string & tag, string & out);
+
+    void decompress(const string & tag, string & out);
+};
+
+ZstdCodec::~ZstdCodec()
+{
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+}
+
+bool
+ZstdCodec::compress(const string & tag, string & out)
+{
+    if (!cctx) {
+	cctx = ZSTD_createCCtx();
+	if (!cctx) throw std::bad_alloc();
+    }
+    if (!dictionary.empty() && !cdict) {
+	cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(),
+				 ZSTD_LEVEL);
+	if (!cdict) throw std::bad_alloc();
+    }
+    out.resize(0);
+    pack_uint(out, tag.size());
+    size_t header_len = out.size();
+    size_t bound = ZSTD_compressBound(tag.size());
+    out.resize(header_len + bound);
+    size_t len;
+    if (cdict) {
+	len = ZSTD_compress_usingCDict(cctx, &out[header_len], bound,
+				       tag.data(), tag.size(), cdict);
+    } else {
+	len = ZSTD_compressCCtx(cctx, &out[header_len], bound,
+				tag.data(), tag.size(), ZSTD_LEVEL);
+    }
+    if (ZSTD_isError(len) || header_len + len >= tag.size()) return false;
+    out.resize(header_len + len);
+    return true;
+}
+
+void
+ZstdCodec::decompress(const string & tag, string & out)
+{
+    if (!dctx) {
+	dctx = ZSTD_createDCtx();
+	if (!dctx) throw std::bad_alloc();
+    }
+    if (!dictionary.empty() && !ddict) {
+	ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+	if (!ddict) throw std::bad_alloc();
+    }
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    size_t len = unpack_tag_length(&p, end);
+    out.resize(len);
+    if (len == 0) return;
+    size_t r;
+    if (ddict) {
+	r = ZSTD_decompress_usingDDict(dctx, &out[0], len, p, end - p, ddict);
+    } else {
+	r = ZSTD_decompressDCtx(dctx, &out[0], len, p, end - p);
+    }
+    if (ZSTD_isError(r)) {
+	string msg = "zstd decompression of tag failed: ";
+	msg += ZSTD_getErrorName(r);
+	throw Xapian::DatabaseCorruptError(msg);
+    }
+    check_tag_length(r, len);
+}
+#endif
+
+/// Length of the substrings build_dictionary() counts occurrences of.
+const size_t DICT_KMER = 8;
+
+/// Length of the pieces of the samples build_dictionary() chooses between.
+const size_t DICT_SEGMENT = 64;
+
+/// Number of bits of hash build_dictionary() uses to count substrings.
+const unsigned DICT_HASH_BITS = 20;
+
+static inline unsigned
+hash_kmer(const char * p)
+{
+    unsigned h = 0;
+    for (size_t i = 0; i != DICT_KMER; ++i) {
+	h = h * 31 + static_cast<unsigned char>(p[i]);
+    }
+    return h & ((1u << DICT_HASH_BITS) - 1);
+}
+
+/// A candidate piece of a sample for build_dictionary().
+struct DictSegment {
+    unsigned score;
+
+    const char * p;
+
+    size_t len;
+
+    DictSegment(unsigned score_, const char * p_, size_t len_)
+	: score(score_), p(p_), len(len_) { }
+
+    bool operator<(const DictSegment & o) const { return score < o.score; }
+};
+
+/** Score how useful the segment at @a p of length @a len would be.
+ *
+ *  This is the total number of other samples which each of its substrings
+ *  occurs in, ignoring those which only occur in one sample (which are no
+ *  use in a dictionary).
+ */
+static unsigned
+score_segment(const vector<unsigned> & freq, const char * p, size_t len)
+{
+    unsigned score = 0;
+    for (size_t i = 0; i + DICT_KMER <= len; ++i) {
+	unsigned f = freq[hash_kmer(p + i)];
+	if (f > 1) score += f;
+    }
+    return score;
+}
+
+/** Build a dictionary of at most @a max_size bytes from @a samples.
+ *
+ *  This is a simplified version of the "cover" algorithm zstd's dictionary
+ *  builder uses.  We count how many samples each short substring occurs in,
+ *  then greedily pick the pieces of the samples which cover the most common
+ *  substrings, discounting substrings already covered by an earlier pick.
+ */
+static string
+build_dictionary(const vector<string> & samples, size_t max_size)
+{
+    vector<unsigned> freq(1u << DICT_HASH_BITS);
+    {
+	vector<unsigned> last(1u << DICT_HASH_BITS, unsigned(-1));
+	for (unsigned n = 0; n != samples.size(); ++n) {
+	    const string & sample = samples[n];
+	    for (size_t i = 0; i + DICT_KMER <= sample.size(); ++i) {
+		unsigned h = hash_kmer(sample.data() + i);
+		if (last[h] != n) {
+		    last[h] = n;
+		    ++freq[h];
+		}
+	    }
+	}
+    }
+
+    priority_queue<DictSegment> candidates;
+    vector<string>::const_iterator s;
+    for (s = samples.begin(); s != samples.end(); ++s) {
+	for (size_t i = 0; i + DICT_KMER <= s->size(); i += DICT_SEGMENT) {
+	    size_t len = min(DICT_SEGMENT, s->size() - i);
+	    unsigned score = score_segment(freq, s->data() + i, len);
+	    if (score) candidates.push(DictSegment(score, s->data() + i, len));
+	}
+    }
+
+    vector<DictSegment> chosen;
+    size_t total = 0;
+    while (!candidates.empty() && total < max_size) {
+	DictSegment seg = candidates.top();
+	candidates.pop();
+	// Rescore, as picks since this segment was scored may have covered
+	// some of its substrings.  If it's no longer the best, put it back.
+	unsigned score = score_segment(freq, seg.p, seg.len);
+	if (score == 0) continue;
+	if (score < seg.score && !candidates.empty() &&
+	    score < candidates.top().score) {
+	    seg.score = score;
+	    candidates.push(seg);
+	    continue;
+	}
+	for (size_t i = 0; i + DICT_KMER <= seg.len; ++i) {
+	    freq[hash_kmer(seg.p + i)] = 0;
+	}
+	seg.len = min(seg.len, max_size - total);
+	chosen.push_back(seg);
+	total += seg.len;
+    }
+
+    // Put the most useful pieces at the end, where they're closest to the
+    // data being compressed (and zlib only uses the last 32K anyway).
+    string dictionary;
+    dictionary.reserve(total);
+    vector<DictSegment>::const_reverse_iterator i;
+    for (i = chosen.rbegin(); i != chosen.rend(); ++i) {
+	dictionary.append(i->p, i->len);
+    }
+    return dictionary;
+}
+
+}
+
+BrassCodec *
+BrassCodec::create(int codec, const string & dictionary)
+{
+    LOGCALL_STATIC(DB, BrassCodec *, "BrassCodec::create", codec | dictionary.size());
+    switch (codec) {
+	case ZLIB:
+	    RETURN(new ZlibCodec(dictionary));
+	case LZ4:
+#ifdef HAVE_LZ4
+	    RETURN(new Lz4Codec(dictionary));
+#else
+	    throw Xapian::FeatureUnavailableError("LZ4 tag compression support not enabled");
+#endif
+	case ZSTD:
+#ifdef HAVE_ZSTD
+	    RETURN(new ZstdCodec(dictionary));
+#else
+	    throw Xapian::FeatureUnavailableError("zstd tag compression support not enabled");
+#endif
+    }
+    throw Xapian::DatabaseCorruptError("Unknown tag compression codec " +
+				       str(codec));
+}
+
+size_t
+BrassCodec::max_dictionary_size(int codec)
+{
+    switch (codec) {
+	case ZLIB:
+	    // Deflate can only refer back 32K.
+	    return 32768;
+	case LZ4:
+	    // LZ4 can only refer back 64K.
+	    return 65536;
+	case ZSTD:
+	    // The default size zstd's dictionary builder uses.
+	    return 112640;
+    }
+    throw Xapian::DatabaseCorruptError("Unknown tag compression codec " +
+				       str(codec));
+}
+
+string
+BrassCodec::train_dictionary(int codec, const vector<string> & samples)
+{
+    LOGCALL_STATIC(DB, string, "BrassCodec::train_dictionary", codec | samples.size());
+    size_t max_size = max_dictionary_size(codec);
+#ifdef HAVE_ZDICT_H
+    if (codec == ZSTD && !samples.empty()) {
+	string buf;
+	vector<size_t> sizes;
+	sizes.reserve(samples.size());
+	vector<string>::const_iterator i;
+	for (i = samples.begin(); i != samples.end(); ++i) {
+	    buf += *i;
+	    sizes.push_back(i->size());
+	}
+	string dictionary(max_size, '\0');
+	size_t r = ZDICT_trainFromBuffer(&dictionary[0], max_size,
+					 buf.data(), &sizes[0],
+					 unsigned(sizes.size()));
+	if (!ZDICT_isError(r)) {
+	    dictionary.resize(r);
+	    RETURN(dictionary);
+	}
+	// ZDICT_trainFromBuffer() fails if there are too few samples, in
+	// which case we just use our own builder.
+	LOGLINE(DB, "ZDICT_trainFromBuffer() failed: " <<
+		    ZDICT_getErrorName(r));
+    }
+#endif
+    RETURN(build_dictionary(samples, max_size));
+}
+
+const char *
+BrassCodec::get_name(int codec)
+{
+    switch (codec) {
+	case ZLIB:
+	    return "zlib";
+	case LZ4:
+	    return "lz4";
+	case ZSTD:
+	    return "zstd";
+    }
+    return "unknown";
+}
+
+static int
+parse_codec_name(const string & name)
+{
+    for (int codec = BrassCodec::ZLIB; codec <= BrassCodec::ZSTD; ++codec) {
+	if (name == BrassCodec::get_name(codec)) return codec;
+    }
+    throw Xapian::InvalidArgumentError("Unknown tag compression codec '" +
+				       name + "' in XAPIAN_BRASS_COMPRESSION");
+}
+
+int
+BrassCodec::configured_for_table(const char * tablename)
+{
+    LOGCALL_STATIC(DB, int, "BrassCodec::configured_for_table", tablename);
+    string name;
+    if (!BrassTable::get_table_setting("XAPIAN_BRASS_COMPRESSION", tablename,
+				       name))
+	RETURN(-1);
+    RETURN(parse_codec_name(name));
+}
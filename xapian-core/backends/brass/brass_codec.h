@@ -0,0 +1,129 @@
+/** @file brass_codec.h
+ * @brief Codecs for compressing tags in brass tables.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_BRASS_CODEC_H
+#define XAPIAN_INCLUDED_BRASS_CODEC_H
+
+#include <string>
+#include <vector>
+
+/** A codec for compressing the tags in a brass table.
+ *
+ *  The codec a table uses is chosen when the table is created and recorded
+ *  in its base files, so all the compressed tags in a table use the same
+ *  codec.  Which tags are compressed is recorded per item, so switching
+ *  codec only requires that the table is rebuilt (e.g. by xapian-compact).
+ *
+ *  A table can also have a dictionary of strings common in its tags, which
+ *  the codec compresses every tag against.  This is a big win for tables of
+ *  small, similar tags (such as document data), since each tag is compressed
+ *  separately so otherwise has no context to find matches in.  Like the
+ *  codec, the dictionary is fixed when the table is created.
+ */
+class BrassCodec {
+    /// Prevent copying.
+    BrassCodec(const BrassCodec &);
+
+    /// Prevent assignment.
+    void operator=(const BrassCodec &);
+
+  protected:
+    BrassCodec() { }
+
+  public:
+    /** The available codecs.
+     *
+     *  These values are stored in base files, so they mustn't be changed.
+     */
+    enum {
+	ZLIB = 0,
+	LZ4 = 1,
+	ZSTD = 2
+    };
+
+    virtual ~BrassCodec();
+
+    /** Compress a tag.
+     *
+     *  @param tag	The tag to compress.
+     *  @param out	Set to the compressed tag if true is returned.
+     *
+     *  @return	true if the tag was compressed, or false if the compressed
+     *		form wouldn't be smaller.
+     */
+    virtual bool compress(const std::string & tag, std::string & out) = 0;
+
+    /** Decompress a tag.
+     *
+     *  @param tag	The compressed tag.
+     *  @param out	Set to the uncompressed tag.
+     */
+    virtual void decompress(const std::string & tag, std::string & out) = 0;
+
+    /** Create a codec.
+     *
+     *  @param codec	One of the codec constants.
+     *  @param dictionary	The dictionary to compress against (empty for
+     *				none).
+     *
+     *  @exception Xapian::FeatureUnavailableError if support for @a codec
+     *		   wasn't enabled when Xapian was built.
+     *  @exception Xapian::DatabaseCorruptError if @a codec isn't known.
+     */
+    static BrassCodec * create(int codec, const std::string & dictionary);
+
+    /** Return the largest dictionary we use for @a codec.
+     *
+     *  The codecs can't make use of a larger one, so a table with a bigger
+     *  dictionary is corrupt.
+     */
+    static size_t max_dictionary_size(int codec);
+
+    /** Build a dictionary for @a codec from sample tags.
+     *
+     *  @param codec	One of the codec constants.
+     *  @param samples	Uncompressed tags representative of those in the
+     *			table.
+     *
+     *  @return	The dictionary, or an empty string if the samples don't
+     *		contain enough repeated data to be worth using one.
+     */
+    static std::string train_dictionary(int codec,
+					const std::vector<std::string> & samples);
+
+    /// Return the name of @a codec (e.g. "zlib").
+    static const char * get_name(int codec);
+
+    /** Return the codec configured for new tables named @a tablename.
+     *
+     *  This is controlled by the environment variable
+     *  XAPIAN_BRASS_COMPRESSION, which is a comma-separated list of entries
+     *  each either a codec name (to use for all tables), or
+     *  TABLENAME=CODEC to override the codec for a particular table - e.g.
+     *  "lz4,record=zstd".
+     *
+     *  @return	The codec, or -1 if none is configured for @a tablename.
+     *
+     *  @exception Xapian::InvalidArgumentError if the variable names an
+     *		   unknown codec.
+     */
+    static int configured_for_table(const char * tablename);
+};
+
+#endif // XAPIAN_INCLUDED_BRASS_CODEC_H
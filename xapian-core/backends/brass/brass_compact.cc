@@ -25,6 +25,7 @@
 
 #include <algorithm>
 #include <queue>
+#include <set>
 
 #include <cstdio>
 
@@ -33,10 +34,17 @@
 #include "brass_table.h"
 #include "brass_compact.h"
 #include "brass_cursor.h"
+#include "brass_impact.h"
+#include "brass_positionlist.h"
+#include "brass_postlist.h"
+#include "brass_values.h"
+#include "autoptr.h"
 #include "filetests.h"
 #include "internaltypes.h"
 #include "pack.h"
+#include "backends/impactlist.h"
 #include "backends/valuestats.h"
+#include "weight/weightinternal.h"
 
 #include "../byte_length_strings.h"
 #include "../prefix_compressed_strings.h"
@@ -66,18 +74,36 @@ is_valuestats_key(const string & key)
     return key.size() > 1 && key[0] == '\0' && key[1] == '\xd0';
 }
 
+static inline bool
+is_valueindex_key(const string & key)
+{
+    return key.size() > 1 && key[0] == '\0' && key[1] == '\xd4';
+}
+
 static inline bool
 is_valuechunk_key(const string & key)
 {
     return key.size() > 1 && key[0] == '\0' && key[1] == '\xd8';
 }
 
+static inline bool
+is_valuesummary_key(const string & key)
+{
+    return key.size() > 1 && key[0] == '\0' && key[1] == '\xdc';
+}
+
 static inline bool
 is_doclenchunk_key(const string & key)
 {
     return key.size() > 1 && key[0] == '\0' && key[1] == '\xe0';
 }
 
+static inline bool
+is_doclencolumn_key(const string & key)
+{
+    return key.size() > 1 && key[0] == '\0' && key[1] == '\xe8';
+}
+
 class PostlistCursor : private BrassCursor {
     Xapian::docid offset;
 
@@ -86,6 +112,13 @@ class PostlistCursor : private BrassCursor {
     Xapian::docid firstdid;
     Xapian::termcount tf, cf;
 
+    /** Has the cursor run off the end of the table?
+     *
+     *  This can be true straight after construction, if the table only has
+     *  entries which we rebuild rather than copy.
+     */
+    using BrassCursor::after_end;
+
     PostlistCursor(BrassTable *in, Xapian::docid offset_)
 	: BrassCursor(in), offset(offset_), firstdid(0)
     {
@@ -99,7 +132,14 @@ class PostlistCursor : private BrassCursor {
     }
 
     bool next() {
-	if (!BrassCursor::next()) return false;
+	do {
+	    if (!BrassCursor::next()) return false;
+	    // The doclen column is rebuilt from the doclen chunks, since the
+	    // docids in each chunk of it change if we renumber.  Value chunk
+	    // summaries and value indexes are rebuilt from the value chunks.
+	} while (is_doclencolumn_key(current_key) ||
+		 is_valuesummary_key(current_key) ||
+		 is_valueindex_key(current_key));
 	// We put all chunks into the non-initial chunk form here, then fix up
 	// the first chunk for each term in the merged database as we merge.
 	read_tag();
@@ -178,6 +218,114 @@ class PostlistCursorGt {
     }
 };
 
+/** Can compressed tags be copied from table @a in to @a out as they are?
+ *
+ *  If the tables use different codecs or dictionaries, the tags need to be
+ *  decompressed and then recompressed with the codec of @a out.
+ */
+static inline bool
+same_codec(const BrassTable * in, const BrassTable * out)
+{
+    return in->get_codec() == out->get_codec() &&
+	   in->get_dictionary() == out->get_dictionary();
+}
+
+/** Return the tag compression codec used by the first of @a inputs present.
+ *
+ *  @a dictionary is set to the dictionary it uses.
+ */
+static int
+get_inputs_codec(const char * tablename, const vector<string> & inputs,
+		 bool lazy, string & dictionary)
+{
+    for (size_t i = 0; i < inputs.size(); ++i) {
+	BrassTable in(tablename, inputs[i], true, DONT_COMPRESS, lazy);
+	in.open();
+	if (in.is_open()) {
+	    dictionary = in.get_dictionary();
+	    return in.get_codec();
+	}
+    }
+    dictionary.resize(0);
+    return BrassCodec::ZLIB;
+}
+
+/// Return the flags of the first of @a inputs present.
+static unsigned
+get_inputs_flags(const char * tablename, const vector<string> & inputs,
+		 bool lazy)
+{
+    for (size_t i = 0; i < inputs.size(); ++i) {
+	BrassTable in(tablename, inputs[i], true, DONT_COMPRESS, lazy);
+	in.open();
+	if (in.is_open()) return in.get_flags();
+    }
+    return 0;
+}
+
+/// Add the value slots which any of @a inputs has an index for to @a slots.
+static void
+get_inputs_indexed_slots(const vector<string> & inputs,
+			 set<Xapian::valueno> & slots)
+{
+    for (size_t i = 0; i < inputs.size(); ++i) {
+	BrassTable in("postlist", inputs[i], true);
+	in.open();
+	if (!in.is_open()) continue;
+	string tag;
+	if (in.get_exact_entry(Brass::make_valueindex_slots_key(), tag)) {
+	    set<Xapian::valueno> in_slots;
+	    Brass::decode_indexed_slots(tag, in_slots);
+	    slots.insert(in_slots.begin(), in_slots.end());
+	}
+    }
+}
+
+/// The maximum number of tags to sample to train a dictionary.
+const brass_tablesize_t MAX_DICTIONARY_SAMPLES = 20000;
+
+/// The maximum total size of the tags sampled to train a dictionary.
+const size_t MAX_DICTIONARY_SAMPLE_BYTES = 8 * 1024 * 1024;
+
+/** Train a dictionary for @a codec from tags sampled from @a inputs.
+ *
+ *  We sample tags evenly spread through the inputs.
+ */
+static string
+train_dictionary(int codec, const char * tablename,
+		 const vector<string> & inputs, bool lazy)
+{
+    brass_tablesize_t entries = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+	BrassTable in(tablename, inputs[i], true, DONT_COMPRESS, lazy);
+	in.open();
+	if (in.is_open()) entries += in.get_entry_count();
+    }
+    brass_tablesize_t step = entries / MAX_DICTIONARY_SAMPLES + 1;
+
+    vector<string> samples;
+    size_t sample_bytes = 0;
+    brass_tablesize_t n = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+	BrassTable in(tablename, inputs[i], true, DONT_COMPRESS, lazy);
+	in.open();
+	if (in.empty()) continue;
+
+	BrassCursor cur(&in);
+	cur.find_entry(string());
+	while (cur.next()) {
+	    if (n++ % step) continue;
+	    cur.read_tag();
+	    sample_bytes += cur.current_tag.size();
+	    if (sample_bytes > MAX_DICTIONARY_SAMPLE_BYTES) break;
+	    samples.push_back(cur.current_tag);
+	}
+	if (sample_bytes > MAX_DICTIONARY_SAMPLE_BYTES) break;
+    }
+
+    return BrassCodec::train_dictionary(codec, samples);
+}
+
 static string
 encode_valuestats(Xapian::doccount freq,
 		  const string & lbound, const string & ubound)
@@ -192,12 +340,94 @@ encode_valuestats(Xapian::doccount freq,
     return value;
 }
 
+/** Write the doclen column for the doclen chunks @a tags to @a out.
+ *
+ *  The keys for the doclen column sort after those for the doclen chunks,
+ *  so this should be called just after they're written.
+ */
+static void
+write_doclen_column(BrassTable * out,
+		    const vector<pair<Xapian::docid, string> > & tags)
+{
+    vector<uint8> entries;
+    Xapian::docid chunk_first_did = 0;
+    vector<pair<Xapian::docid, string> >::const_iterator i;
+    for (i = tags.begin(); i != tags.end(); ++i) {
+	const char * pos = i->second.data();
+	const char * end = pos + i->second.size();
+	bool is_last_chunk;
+	unsigned encoding;
+	Xapian::docid increase_to_last;
+	string chunk_entries;
+	if (!Brass::unpack_chunk_flags(&pos, end, &is_last_chunk, &encoding) ||
+	    !unpack_uint(&pos, end, &increase_to_last) ||
+	    !Brass::decode_chunk_entries(encoding, pos, end, chunk_entries)) {
+	    throw Xapian::DatabaseCorruptError("Bad doclen chunk");
+	}
+	pos = chunk_entries.data();
+	end = pos + chunk_entries.size();
+	Xapian::docid did = i->first;
+	while (pos != end) {
+	    Xapian::termcount doclen;
+	    if (!unpack_uint(&pos, end, &doclen))
+		throw Xapian::DatabaseCorruptError("Bad doclen chunk");
+	    if (did - chunk_first_did >= Brass::DOCLEN_COLUMN_CHUNK_SIZE ||
+		chunk_first_did == 0) {
+		if (!entries.empty()) {
+		    out->add(BrassPostListTable::make_doclen_column_key(chunk_first_did),
+			     Brass::encode_doclen_column(entries));
+		    entries.clear();
+		}
+		chunk_first_did = did - (did - 1) % Brass::DOCLEN_COLUMN_CHUNK_SIZE;
+	    }
+	    entries.resize(did - chunk_first_did, 0);
+	    entries.push_back(uint8(doclen) + 1);
+	    if (pos == end) break;
+	    Xapian::docid inc;
+	    if (!unpack_uint(&pos, end, &inc))
+		throw Xapian::DatabaseCorruptError("Bad doclen chunk");
+	    did += inc + 1;
+	}
+    }
+    if (!entries.empty()) {
+	out->add(BrassPostListTable::make_doclen_column_key(chunk_first_did),
+		 Brass::encode_doclen_column(entries));
+    }
+}
+
+/** Add the value index entries for value chunk @a tag to @a out.
+ *
+ *  Nothing is added unless the chunk's slot is in @a indexed_slots.
+ */
+static void
+add_valueindex_entries(BrassTable * out, const string & key, const string & tag,
+		       const set<Xapian::valueno> & indexed_slots)
+{
+    const char * p = key.data() + 2;
+    const char * end = key.data() + key.size();
+    Xapian::valueno slot;
+    Xapian::docid did;
+    if (!unpack_uint(&p, end, &slot) ||
+	!unpack_uint_preserving_sort(&p, end, &did)) {
+	throw Xapian::DatabaseCorruptError("bad value key");
+    }
+    if (indexed_slots.find(slot) == indexed_slots.end()) return;
+    Brass::ValueChunkReader reader(tag.data(), tag.size(), did);
+    for ( ; !reader.at_end(); reader.next()) {
+	out->add(Brass::make_valueindex_key(slot, reader.get_value(),
+					    reader.get_docid()),
+		 string());
+    }
+}
+
 static void
 merge_postlists(Xapian::Compactor & compactor,
 		BrassTable * out, vector<Xapian::docid>::const_iterator offset,
 		vector<string>::const_iterator b,
 		vector<string>::const_iterator e,
-		Xapian::docid last_docid)
+		Xapian::docid last_docid,
+		const set<Xapian::valueno> & indexed_slots,
+		bool rechunk)
 {
     totlen_t tot_totlen = 0;
     Xapian::termcount doclen_lbound = static_cast<Xapian::termcount>(-1);
@@ -216,6 +446,10 @@ merge_postlists(Xapian::Compactor & compactor,
 	// PostlistCursor takes ownership of BrassTable in and is
 	// responsible for deleting it.
 	PostlistCursor * cur = new PostlistCursor(in, *offset);
+	if (cur->after_end()) {
+	    delete cur;
+	    continue;
+	}
 	// Merge the METAINFO tags from each database into one.
 	// They have a key consisting of a single zero byte.
 	// They may be absent, if the database contains no documents.  If it
@@ -247,6 +481,12 @@ merge_postlists(Xapian::Compactor & compactor,
 	    doclen_ubound_tmp += wdf_ubound_tmp;
 	    doclen_ubound = max(doclen_ubound, doclen_ubound_tmp);
 
+	    // The oldest changeset doesn't carry over to the output.
+	    brass_revision_number_t oldest_changeset;
+	    if (!unpack_uint(&data, end, &oldest_changeset)) {
+		throw Xapian::DatabaseCorruptError("Tag containing meta information is corrupt.");
+	    }
+
 	    totlen_t totlen = 0;
 	    if (!unpack_uint_last(&data, end, &totlen)) {
 		throw Xapian::DatabaseCorruptError("Tag containing meta information is corrupt.");
@@ -274,6 +514,7 @@ merge_postlists(Xapian::Compactor & compactor,
 	pack_uint(tag, doclen_lbound);
 	pack_uint(tag, wdf_ubound);
 	pack_uint(tag, doclen_ubound - wdf_ubound);
+	pack_uint(tag, brass_revision_number_t(0));
 	pack_uint_last(tag, tot_totlen);
 	out->add(string(1, '\0'), tag);
     }
@@ -386,12 +627,35 @@ merge_postlists(Xapian::Compactor & compactor,
 	}
     }
 
-    // Merge valuestream chunks.
+    // The value indexes are rebuilt from the value chunks, since the docids
+    // change if we renumber.  Their keys sort before the value chunks, but
+    // adding them as we go saves holding them all in memory.
+    if (!indexed_slots.empty()) {
+	out->add(Brass::make_valueindex_slots_key(),
+		 Brass::encode_indexed_slots(indexed_slots));
+    }
+
+    // Merge valuestream chunks, converting them to or from numeric columns
+    // if out uses a different format.  The chunk summaries sort after all
+    // the chunks, so we add them once all the chunks have been added.
+    bool value_summaries =
+	(out->get_flags() & BrassTable::FLAG_VALUE_SUMMARIES);
+    vector<pair<string, string> > summaries;
     while (!pq.empty()) {
 	PostlistCursor * cur = pq.top();
 	const string & key = cur->key;
 	if (!is_valuechunk_key(key)) break;
 	Assert(!is_user_metadata_key(key));
+	if (value_summaries) {
+	    // The summary key is the chunk key with a different prefix.
+	    string summary_key = key;
+	    summary_key[1] = '\xdc';
+	    summaries.push_back(make_pair(summary_key,
+					  Brass::summarise_value_chunk(cur->tag)));
+	}
+	if (!indexed_slots.empty())
+	    add_valueindex_entries(out, key, cur->tag, indexed_slots);
+	Brass::convert_value_chunk(cur->tag, out->get_flags());
 	out->add(key, cur->tag);
 	pq.pop();
 	if (cur->next()) {
@@ -400,7 +664,17 @@ merge_postlists(Xapian::Compactor & compactor,
 	    delete cur;
 	}
     }
+    vector<pair<string, string> >::const_iterator summary;
+    for (summary = summaries.begin(); summary != summaries.end(); ++summary) {
+	out->add(summary->first, summary->second);
+    }
 
+    // Chunks are copied as they are, except that they're converted to or
+    // from the bit-packed or bitmap formats if out uses different formats.
+    // If rechunk is set, each posting list is instead split into chunks
+    // afresh, which avoids leaving a short chunk from the end of each input
+    // in the middle of it.
+    unsigned flags = out->get_flags();
     Xapian::termcount tf = 0, cf = 0; // Initialise to avoid warnings.
     vector<pair<Xapian::docid, string> > tags;
     while (true) {
@@ -411,13 +685,17 @@ merge_postlists(Xapian::Compactor & compactor,
 	}
 	Assert(cur == NULL || !is_user_metadata_key(cur->key));
 	if (cur == NULL || cur->key != last_key) {
+	    // Rechunking also converts the chunks to the format out uses.
+	    if (rechunk && !tags.empty())
+		Brass::rechunk_postlist(tags, flags);
 	    if (!tags.empty()) {
 		string first_tag;
 		pack_uint(first_tag, tf);
 		pack_uint(first_tag, cf);
 		pack_uint(first_tag, tags[0].first - 1);
 		string tag = tags[0].second;
-		tag[0] = (tags.size() == 1) ? '1' : '0';
+		if (!rechunk)
+		    Brass::convert_chunk(tag, tags.size() == 1, flags);
 		first_tag += tag;
 		out->add(last_key, first_tag);
 
@@ -433,9 +711,15 @@ merge_postlists(Xapian::Compactor & compactor,
 		i = tags.begin();
 		while (++i != tags.end()) {
 		    tag = i->second;
-		    tag[0] = (i + 1 == tags.end()) ? '1' : '0';
+		    if (!rechunk)
+			Brass::convert_chunk(tag, i + 1 == tags.end(), flags);
 		    out->add(pack_brass_postlist_key(term, i->first), tag);
 		}
+
+		if (is_doclenchunk_key(last_key) &&
+		    (out->get_flags() & BrassTable::FLAG_DOCLEN_COLUMN)) {
+		    write_doclen_column(out, tags);
+		}
 	    }
 	    tags.clear();
 	    if (cur == NULL) break;
@@ -499,7 +783,7 @@ merge_spellings(BrassTable * out,
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
-	    bool compressed = cur->read_tag(true);
+	    bool compressed = cur->read_tag(same_codec(cur->get_table(), out));
 	    out->add(key, cur->current_tag, compressed);
 	    if (cur->next()) {
 		pq.push(cur);
@@ -613,7 +897,7 @@ merge_synonyms(BrassTable * out,
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
-	    bool compressed = cur->read_tag(true);
+	    bool compressed = cur->read_tag(same_codec(cur->get_table(), out));
 	    out->add(key, cur->current_tag, compressed);
 	    if (cur->next()) {
 		pq.push(cur);
@@ -677,7 +961,8 @@ static void
 multimerge_postlists(Xapian::Compactor & compactor,
 		     BrassTable * out, const char * tmpdir,
 		     Xapian::docid last_docid,
-		     vector<string> tmp, vector<Xapian::docid> off)
+		     vector<string> tmp, vector<Xapian::docid> off,
+		     const set<Xapian::valueno> & indexed_slots)
 {
     unsigned int c = 0;
     while (tmp.size() > 3) {
@@ -700,8 +985,10 @@ multimerge_postlists(Xapian::Compactor & compactor,
 	    // Use maximum blocksize for temporary tables.
 	    tmptab.create_and_open(65536);
 
+	    // The value indexes are only needed in the final output.
 	    merge_postlists(compactor, &tmptab, off.begin() + i,
-			    tmp.begin() + i, tmp.begin() + j, last_docid);
+			    tmp.begin() + i, tmp.begin() + j, last_docid,
+			    set<Xapian::valueno>(), false);
 	    if (c > 0) {
 		for (unsigned int k = i; k < j; ++k) {
 		    unlink((tmp[k] + "DB").c_str());
@@ -718,7 +1005,8 @@ multimerge_postlists(Xapian::Compactor & compactor,
 	++c;
     }
     merge_postlists(compactor,
-		    out, off.begin(), tmp.begin(), tmp.end(), last_docid);
+		    out, off.begin(), tmp.begin(), tmp.end(), last_docid,
+		    indexed_slots, false);
     if (c > 0) {
 	for (size_t k = 0; k < tmp.size(); ++k) {
 	    unlink((tmp[k] + "DB").c_str());
@@ -743,6 +1031,12 @@ merge_docid_keyed(const char * tablename,
 	BrassCursor cur(&in);
 	cur.find_entry(string());
 
+	// Position lists need re-encoding if the output uses another format.
+	bool convert_positions =
+	    ((in.get_flags() ^ out->get_flags()) &
+	     BrassTable::FLAG_PACKED_POSITIONS);
+	vector<Xapian::termpos> positions;
+
 	string key;
 	while (cur.next()) {
 	    // Adjust the key if this isn't the first database.
@@ -765,7 +1059,17 @@ merge_docid_keyed(const char * tablename,
 	    } else {
 		key = cur.current_key;
 	    }
-	    bool compressed = cur.read_tag(true);
+	    if (convert_positions) {
+		cur.read_tag();
+		BrassPositionListTable::decode(cur.current_tag, positions,
+					       in.get_flags());
+		string tag;
+		BrassPositionListTable::encode(tag, positions,
+					       out->get_flags());
+		out->add(key, tag);
+		continue;
+	    }
+	    bool compressed = cur.read_tag(same_codec(&in, out));
 	    out->add(key, cur.current_tag, compressed);
 	}
     }
@@ -780,7 +1084,8 @@ compact_brass(Xapian::Compactor & compactor,
 	      const char * destdir, const vector<string> & sources,
 	      const vector<Xapian::docid> & offset, size_t block_size,
 	      Xapian::Compactor::compaction_level compaction, bool multipass,
-	      Xapian::docid last_docid) {
+	      Xapian::docid last_docid, bool train_dictionaries,
+	      const map<string, size_t> & table_block_sizes) {
     enum table_type {
 	POSTLIST, RECORD, TERMLIST, POSITION, VALUE, SPELLING, SYNONYM
     };
@@ -869,12 +1174,53 @@ compact_brass(Xapian::Compactor & compactor,
 	    continue;
 	}
 
+	// A block size set for this table on the compactor takes precedence
+	// over one configured for new tables of this name.
+	size_t table_block_size;
+	map<string, size_t>::const_iterator bs = table_block_sizes.find(t->name);
+	if (bs != table_block_sizes.end()) {
+	    table_block_size = bs->second;
+	} else {
+	    table_block_size =
+		BrassTable::configured_block_size(t->name, block_size);
+	}
+
 	BrassTable out(t->name, dest, false, t->compress_strategy, t->lazy);
+	if (t->compress_strategy != DONT_COMPRESS) {
+	    // Keep the codec and dictionary the inputs use, unless a codec has
+	    // been explicitly configured for new tables.
+	    string dictionary;
+	    int codec = BrassCodec::configured_for_table(t->name);
+	    if (codec < 0) {
+		codec = get_inputs_codec(t->name, inputs, t->lazy, dictionary);
+	    }
+	    // Document data and termlists consist of lots of small tags which
+	    // are similar to one another, so benefit from a dictionary.
+	    if (train_dictionaries && (t->type == RECORD || t->type == TERMLIST)) {
+		compactor.set_status(t->name, "Training dictionary");
+		dictionary = train_dictionary(codec, t->name, inputs, t->lazy);
+	    }
+	    out.set_codec(codec, dictionary);
+	}
+	set<Xapian::valueno> indexed_slots;
+	if (t->type == POSTLIST) {
+	    // Keep the posting list format the inputs use, unless one has
+	    // been explicitly configured for new tables.
+	    unsigned flags = get_inputs_flags(t->name, inputs, t->lazy);
+	    out.set_flags(BrassPostListTable::configured_flags(flags));
+	    // Likewise index the value slots any input indexes.
+	    if (!BrassPostListTable::configured_indexed_slots(indexed_slots))
+		get_inputs_indexed_slots(inputs, indexed_slots);
+	} else if (t->type == POSITION) {
+	    // Likewise for the position list format.
+	    unsigned flags = get_inputs_flags(t->name, inputs, t->lazy);
+	    out.set_flags(BrassPositionListTable::configured_flags(flags));
+	}
 	if (!t->lazy) {
-	    out.create_and_open(block_size);
+	    out.create_and_open(table_block_size);
 	} else {
 	    out.erase();
-	    out.set_block_size(block_size);
+	    out.set_block_size(table_block_size);
 	}
 
 	out.set_full_compaction(compaction != compactor.STANDARD);
@@ -884,11 +1230,11 @@ compact_brass(Xapian::Compactor & compactor,
 	    case POSTLIST:
 		if (multipass && inputs.size() > 3) {
 		    multimerge_postlists(compactor, &out, destdir, last_docid,
-					 inputs, offset);
+					 inputs, offset, indexed_slots);
 		} else {
 		    merge_postlists(compactor, &out, offset.begin(),
 				    inputs.begin(), inputs.end(),
-				    last_docid);
+				    last_docid, indexed_slots, false);
 		}
 		break;
 	    case SPELLING:
@@ -945,4 +1291,90 @@ compact_brass(Xapian::Compactor & compactor,
 	    compactor.set_status(t->name, status);
 	}
     }
+
+    // Any impact-ordered posting lists in the destination are for some other
+    // database.  If they're wanted, build_brass_impacts() creates new ones
+    // once the rest of the database is written.
+    BrassTable impact("impact", string(destdir) + "/impact.", false,
+		      DONT_COMPRESS, true);
+    impact.erase();
+}
+
+void
+build_brass_impacts(Xapian::Compactor & compactor, const char * destdir,
+		    size_t block_size,
+		    const map<string, size_t> & table_block_sizes)
+{
+    compactor.set_status("impact", string());
+
+    Xapian::Database db = Xapian::Brass::open(destdir);
+    const Xapian::Database::Internal & subdb = *db.internal[0];
+
+    // The impacts use the statistics the matcher will use for a query
+    // against this database on its own, without an RSet.
+    Xapian::Weight::Internal stats;
+    stats.total_length = subdb.get_total_length();
+    stats.collection_size = subdb.get_doccount();
+    stats.set_bounds_from_db(db);
+
+    const Xapian::BM25Weight bm25;
+    const Xapian::Weight & scheme = bm25;
+    const brass_revision_number_t revision = 1;
+
+    string dest = destdir;
+    dest += "/impact.";
+    BrassTable out("impact", dest, false, DONT_COMPRESS, true);
+    out.erase();
+    map<string, size_t>::const_iterator bs = table_block_sizes.find("impact");
+    if (bs != table_block_sizes.end()) {
+	out.set_block_size(bs->second);
+    } else {
+	out.set_block_size(BrassTable::configured_block_size("impact",
+							     block_size));
+    }
+    out.set_full_compaction(true);
+
+    out.add(BrassImpactTable::make_header_key(),
+	    BrassImpactTable::make_header_tag(revision, scheme.name(),
+					      scheme.serialise()));
+
+    vector<pair<double, Xapian::docid> > postings;
+    string tag;
+    for (Xapian::TermIterator t = db.allterms_begin();
+	 t != db.allterms_end(); ++t) {
+	const string & term = *t;
+	stats.termfreqs.clear();
+	stats.termfreqs[term] = TermFreqs(t.get_termfreq(), 0,
+					  db.get_collection_freq(term));
+	AutoPtr<Xapian::Weight> wt(scheme.clone());
+	wt->init_(stats, 1, term, 1, 1.0);
+
+	postings.clear();
+	for (Xapian::PostingIterator p = db.postlist_begin(term);
+	     p != db.postlist_end(term); ++p) {
+	    double w = wt->get_sumpart(p.get_wdf(), p.get_doclength());
+	    postings.push_back(make_pair(w, *p));
+	}
+	tag.resize(0);
+	ImpactList::encode(tag, postings);
+	out.add(BrassImpactTable::make_key(term), tag);
+    }
+
+    out.flush_db();
+    out.commit(revision);
+    compactor.set_status("impact", "Done");
+}
+
+void
+merge_brass_postlists(BrassTable * out, const vector<string> & inputs)
+{
+    // The compactor is only used to resolve duplicate user metadata, which
+    // the tables merged here never contain.
+    Xapian::Compactor compactor;
+    vector<Xapian::docid> offset(inputs.size(), 0);
+    // Each input contributes a short chunk to most posting lists, so rechunk
+    // them.
+    BrassCompact::merge_postlists(compactor, out, offset.begin(),
+				  inputs.begin(), inputs.end(), 0,
+				  set<Xapian::valueno>(), true);
 }
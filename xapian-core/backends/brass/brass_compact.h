@@ -22,17 +22,42 @@
 #ifndef XAPIAN_INCLUDED_BRASS_COMPACT_H
 #define XAPIAN_INCLUDED_BRASS_COMPACT_H
 
+#include <map>
 #include <vector>
 #include <string>
 
 #include "xapian/compactor.h"
 #include "xapian/types.h"
 
+class BrassTable;
+
 void
 compact_brass(Xapian::Compactor & compactor,
 	      const char * destdir, const std::vector<std::string> & sources,
 	      const std::vector<Xapian::docid> & offset, size_t block_size,
 	      Xapian::Compactor::compaction_level compaction, bool multipass,
-	      Xapian::docid last_docid);
+	      Xapian::docid last_docid, bool train_dictionaries,
+	      const std::map<std::string, size_t> & table_block_sizes);
+
+/** Build impact-ordered posting lists for the brass database @a destdir.
+ *
+ *  The database must be at revision 1, as it is just after compaction.
+ */
+void
+build_brass_impacts(Xapian::Compactor & compactor, const char * destdir,
+		    size_t block_size,
+		    const std::map<std::string, size_t> & table_block_sizes);
+
+/** Merge postlist tables into @a out.
+ *
+ *  The input tables are specified by their path prefixes (e.g.
+ *  "/path/to/db/postlist.").  The docids aren't renumbered, so the postlist
+ *  chunks for each term in the inputs must be for disjoint ranges of docids.
+ *  Each posting list is split into chunks afresh, rather than the chunks
+ *  being copied.  No metainfo entry is written to @a out.
+ */
+void
+merge_brass_postlists(BrassTable * out,
+		      const std::vector<std::string> & inputs);
 
 #endif
@@ -58,14 +58,18 @@ BrassCursor::BrassCursor(const BrassTable *B_)
 	  tag_status(UNREAD),
 	  B(B_),
 	  version(B_->cursor_version),
-	  level(B_->level)
+	  level(B_->level),
+	  mapping(B_->mapping),
+	  leaves_scanned(0),
+	  readahead_n(BLK_UNUSED),
+	  readahead_c(0)
 {
     B->cursor_created_since_last_modification = true;
     C = new Brass::Cursor[level + 1];
 
     for (int j = 0; j < level; j++) {
         C[j].n = BLK_UNUSED;
-	C[j].p = new byte[B->block_size];
+	C[j].p = owns_block(j) ? new byte[B->block_size] : NULL;
     }
     C[level].n = B->C[level].n;
     C[level].p = B->C[level].p;
@@ -75,12 +79,24 @@ void
 BrassCursor::rebuild()
 {
     int new_level = B->level;
+    if (mapping != B->mapping) {
+	// The table has been reopened, so any block pointers we have into
+	// the old mapping are no use (the leaf buffer is ours either way).
+	for (int j = 1; j < level; ++j) {
+	    if (owns_block(j)) delete [] C[j].p;
+	    C[j].p = NULL;
+	}
+	mapping = B->mapping;
+	for (int j = 1; j < level; ++j) {
+	    if (owns_block(j)) C[j].p = new byte[B->block_size];
+	}
+    }
     if (new_level <= level) {
 	for (int i = 0; i < new_level; i++) {
 	    C[i].n = BLK_UNUSED;
 	}
 	for (int j = new_level; j < level; ++j) {
-	    delete C[j].p;
+	    if (owns_block(j)) delete [] C[j].p;
 	}
     } else {
 	Cursor * old_C = C;
@@ -91,7 +107,7 @@ BrassCursor::rebuild()
 	}
 	delete [] old_C;
 	for (int j = level; j < new_level; j++) {
-	    C[j].p = new byte[B->block_size];
+	    C[j].p = owns_block(j) ? new byte[B->block_size] : NULL;
 	    C[j].n = BLK_UNUSED;
 	}
     }
@@ -101,12 +117,19 @@ BrassCursor::rebuild()
     version = B->cursor_version;
 }
 
+void
+BrassCursor::moved_forwards(uint4 old_leaf)
+{
+    if (C[0].n != old_leaf && ++leaves_scanned >= 2)
+	B->readahead(C, readahead_n, readahead_c);
+}
+
 BrassCursor::~BrassCursor()
 {
     // Use the value of level stored in the cursor rather than the
     // Btree, since the Btree might have been deleted already.
     for (int j = 0; j < level; j++) {
-	delete [] C[j].p;
+	if (owns_block(j)) delete [] C[j].p;
     }
     delete [] C;
 }
@@ -168,6 +191,7 @@ BrassCursor::next()
 	// the next key.
     }
     if (tag_status == UNREAD) {
+	uint4 old_leaf = C[0].n;
 	while (true) {
 	    if (! B->next(C, 0)) {
 		is_positioned = false;
@@ -178,6 +202,7 @@ BrassCursor::next()
 		break;
 	    }
 	}
+	if (is_positioned) moved_forwards(old_leaf);
     }
 
     if (!is_positioned) {
@@ -199,6 +224,7 @@ BrassCursor::find_entry(const string &key)
     if (B->cursor_version != version) {
 	rebuild();
     }
+    reset_scan();
 
     is_after_end = false;
 
@@ -247,6 +273,7 @@ BrassCursor::find_entry_ge(const string &key)
     if (B->cursor_version != version) {
 	rebuild();
     }
+    reset_scan();
 
     is_after_end = false;
 
@@ -298,6 +325,7 @@ BrassCursor::read_tag(bool keep_compressed)
 	Assert(B->level <= level);
 	Assert(is_positioned);
 
+	uint4 old_leaf = C[0].n;
 	if (B->read_tag(C, &current_tag, keep_compressed)) {
 	    tag_status = COMPRESSED;
 	} else {
@@ -307,6 +335,7 @@ BrassCursor::read_tag(bool keep_compressed)
 	// We need to call B->next(...) after B->read_tag(...) so that the
 	// cursor ends up on the next key.
 	is_positioned = B->next(C, 0);
+	if (is_positioned) moved_forwards(old_leaf);
 
 	LOGLINE(DB, "tag=" << hex_display_encode(current_tag));
     }
@@ -25,6 +25,8 @@
 
 #include "brass_types.h"
 
+#include <xapian/intrusive_ptr.h>
+
 #include <string>
 using std::string;
 
@@ -62,6 +64,30 @@ class Cursor {
 	bool rewrite;
 };
 
+/** A read-only memory mapping of a table's DB file.
+ *
+ *  Cursors hold a reference to the mapping their block pointers point into,
+ *  so it stays mapped if the table is closed or reopened while they exist.
+ */
+class Mapping : public Xapian::Internal::intrusive_base {
+    private:
+	// Prevent copying
+	Mapping(const Mapping &);
+	Mapping & operator=(const Mapping &);
+
+    public:
+	/// The start of the mapped DB file.
+	byte * addr;
+
+	/// The length of the mapping in bytes.
+	size_t size;
+
+	Mapping(byte * addr_, size_t size_) : addr(addr_), size(size_) { }
+
+	/// Unmap the file.
+	~Mapping();
+};
+
 }
 
 class BrassTable;
@@ -112,6 +138,47 @@ class BrassCursor {
 	/** The value of level in the Btree structure. */
 	int level;
 
+	/** The mapping of the Btree's DB file, or NULL if it isn't mapped.
+	 *
+	 *  If it is mapped, the block pointers in C above the leaf level point
+	 *  into the mapping rather than to buffers we own.  Holding a reference
+	 *  keeps those pointers valid, and tells us what to delete, even if
+	 *  the Btree has been reopened or deleted.
+	 */
+	Xapian::Internal::intrusive_ptr<Brass::Mapping> mapping;
+
+	/** Does this cursor own the buffer for level @a j?
+	 *
+	 *  Leaf blocks are always copied out of any mapping - see
+	 *  BrassTable::block_to_cursor().
+	 */
+	bool owns_block(int j) const { return j == 0 || !mapping.get(); }
+
+	/** Leaf blocks moved onto by next() since the cursor was positioned.
+	 *
+	 *  Used to spot a sequential scan, for which we issue readahead.
+	 */
+	unsigned leaves_scanned;
+
+	/// Where readahead has been issued up to - see BrassTable::readahead().
+	uint4 readahead_n;
+
+	/// Where readahead has been issued up to - see BrassTable::readahead().
+	int readahead_c;
+
+	/** Note that the cursor has moved forwards from leaf block @a old_leaf.
+	 *
+	 *  If it's now on a different leaf, and has moved onto enough leaves
+	 *  in a row to look like a sequential scan, issue readahead.
+	 */
+	void moved_forwards(uint4 old_leaf);
+
+	/// The cursor has been repositioned, so any scan has ended.
+	void reset_scan() {
+	    leaves_scanned = 0;
+	    readahead_n = BLK_UNUSED;
+	}
+
 	/** Get the key.
 	 *
 	 *  The key of the item at the cursor is copied into key.
@@ -35,6 +35,7 @@
 #include "backends/contiguousalldocspostlist.h"
 #include "brass_alldocspostlist.h"
 #include "brass_alltermslist.h"
+#include "brass_bulkload.h"
 #include "brass_replicate_internal.h"
 #include "brass_document.h"
 #include "../flint_lock.h"
@@ -65,7 +66,9 @@
 
 #include <algorithm>
 #include "autoptr.h"
+#include <set>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace Xapian;
@@ -108,6 +111,7 @@ BrassDatabase::BrassDatabase(const string &brass_dir, int action,
 	  value_manager(&postlist_table, &termlist_table),
 	  synonym_table(db_dir, readonly),
 	  spelling_table(db_dir, readonly),
+	  impact_table(db_dir, readonly),
 	  record_table(db_dir, readonly),
 	  lock(db_dir),
 	  max_changesets(0)
@@ -188,12 +192,23 @@ BrassDatabase::create_and_open_tables(unsigned int block_size)
     // Create postlist_table first, and record_table last.  Existence of
     // record_table is considered to imply existence of the database.
     version_file.create();
-    postlist_table.create_and_open(block_size);
-    position_table.create_and_open(block_size);
-    termlist_table.create_and_open(block_size);
-    synonym_table.create_and_open(block_size);
-    spelling_table.create_and_open(block_size);
-    record_table.create_and_open(block_size);
+    use_block_cache();
+    postlist_table.set_flags(BrassPostListTable::configured_flags(0));
+    postlist_table.create_and_open(
+	BrassTable::configured_block_size("postlist", block_size));
+    position_table.set_flags(BrassPositionListTable::configured_flags(0));
+    position_table.create_and_open(
+	BrassTable::configured_block_size("position", block_size));
+    termlist_table.create_and_open(
+	BrassTable::configured_block_size("termlist", block_size));
+    synonym_table.create_and_open(
+	BrassTable::configured_block_size("synonym", block_size));
+    spelling_table.create_and_open(
+	BrassTable::configured_block_size("spelling", block_size));
+    impact_table.create_and_open(
+	BrassTable::configured_block_size("impact", block_size));
+    record_table.create_and_open(
+	BrassTable::configured_block_size("record", block_size));
 
     Assert(database_exists());
 
@@ -204,6 +219,26 @@ BrassDatabase::create_and_open_tables(unsigned int block_size)
     }
 
     stats.zero();
+
+    // The list of indexed value slots is written with the first commit.
+    set<Xapian::valueno> indexed_slots;
+    if (BrassPostListTable::configured_indexed_slots(indexed_slots))
+	value_manager.set_indexed_slots(indexed_slots);
+}
+
+void
+BrassDatabase::use_block_cache()
+{
+    LOGCALL_VOID(DB, "BrassDatabase::use_block_cache", NO_ARGS);
+    if (!BlockCache::get_instance()) return;
+    string db_id = version_file.get_uuid_string();
+    postlist_table.use_block_cache(db_id);
+    position_table.use_block_cache(db_id);
+    termlist_table.use_block_cache(db_id);
+    synonym_table.use_block_cache(db_id);
+    spelling_table.use_block_cache(db_id);
+    impact_table.use_block_cache(db_id);
+    record_table.use_block_cache(db_id);
 }
 
 bool
@@ -220,8 +255,18 @@ BrassDatabase::open_tables_consistent()
 
     brass_revision_number_t cur_rev = record_table.get_open_revision_number();
 
-    // Check the version file unless we're reopening.
-    if (cur_rev == 0) version_file.read_and_check();
+    if (readonly && BlockCache::get_instance()) {
+	// The UUID forms part of the key for the shared block cache, and if
+	// we're reopening the database might have been replaced since we last
+	// read it, so we need to check the version file every time.
+	version_file.read_and_check();
+	use_block_cache();
+    } else if (cur_rev == 0) {
+	// Check the version file unless we're reopening.
+	version_file.read_and_check();
+	// A writer uses the cache to discard blocks it has superseded.
+	if (!readonly) use_block_cache();
+    }
 
     record_table.open();
     brass_revision_number_t revision = record_table.get_open_revision_number();
@@ -232,12 +277,7 @@ BrassDatabase::open_tables_consistent()
 	RETURN(false);
     }
 
-    // Set the block_size for optional tables as they may not currently exist.
-    unsigned int block_size = record_table.get_block_size();
-    position_table.set_block_size(block_size);
-    termlist_table.set_block_size(block_size);
-    synonym_table.set_block_size(block_size);
-    spelling_table.set_block_size(block_size);
+    set_optional_table_block_sizes();
 
     value_manager.reset();
 
@@ -246,6 +286,7 @@ BrassDatabase::open_tables_consistent()
     while (!fully_opened && (tries_left--) > 0) {
 	if (spelling_table.open(revision) &&
 	    synonym_table.open(revision) &&
+	    impact_table.open(revision) &&
 	    termlist_table.open(revision) &&
 	    position_table.open(revision) &&
 	    postlist_table.open(revision)) {
@@ -283,6 +324,25 @@ BrassDatabase::open_tables_consistent()
     return true;
 }
 
+void
+BrassDatabase::set_optional_table_block_sizes()
+{
+    LOGCALL_VOID(DB, "BrassDatabase::set_optional_table_block_sizes", NO_ARGS);
+    // Set the block_size for optional tables as they may not currently exist.
+    // Unless one is configured for the table, use the record table's.
+    unsigned int block_size = record_table.get_block_size();
+    position_table.set_block_size(
+	BrassTable::configured_block_size("position", block_size));
+    termlist_table.set_block_size(
+	BrassTable::configured_block_size("termlist", block_size));
+    synonym_table.set_block_size(
+	BrassTable::configured_block_size("synonym", block_size));
+    spelling_table.set_block_size(
+	BrassTable::configured_block_size("spelling", block_size));
+    impact_table.set_block_size(
+	BrassTable::configured_block_size("impact", block_size));
+}
+
 void
 BrassDatabase::open_tables(brass_revision_number_t revision)
 {
@@ -290,17 +350,13 @@ BrassDatabase::open_tables(brass_revision_number_t revision)
     version_file.read_and_check();
     record_table.open(revision);
 
-    // Set the block_size for optional tables as they may not currently exist.
-    unsigned int block_size = record_table.get_block_size();
-    position_table.set_block_size(block_size);
-    termlist_table.set_block_size(block_size);
-    synonym_table.set_block_size(block_size);
-    spelling_table.set_block_size(block_size);
+    set_optional_table_block_sizes();
 
     value_manager.reset();
 
     spelling_table.open(revision);
     synonym_table.open(revision);
+    impact_table.open(revision);
     termlist_table.open(revision);
     position_table.open(revision);
     postlist_table.open(revision);
@@ -383,6 +439,7 @@ BrassDatabase::set_revision_number(brass_revision_number_t new_revision)
     termlist_table.flush_db();
     synonym_table.flush_db();
     spelling_table.flush_db();
+    impact_table.flush_db();
     record_table.flush_db();
 
     int changes_fd = -1;
@@ -438,24 +495,59 @@ BrassDatabase::set_revision_number(brass_revision_number_t new_revision)
 	    termlist_table.write_changed_blocks(changes_fd, compressed);
 	    synonym_table.write_changed_blocks(changes_fd, compressed);
 	    spelling_table.write_changed_blocks(changes_fd, compressed);
+	    impact_table.write_changed_blocks(changes_fd, compressed);
 	    record_table.write_changed_blocks(changes_fd, compressed);
 	    position_table.write_changed_blocks(changes_fd, compressed);
 	    postlist_table.write_changed_blocks(changes_fd, compressed);
 	}
 
-	postlist_table.commit(new_revision, changes_fd);
-	position_table.commit(new_revision, changes_fd);
-	termlist_table.commit(new_revision, changes_fd);
-	synonym_table.commit(new_revision, changes_fd);
-	spelling_table.commit(new_revision, changes_fd);
+	// Commit the tables as a group: first write out all the new base
+	// files and start writeback of every table's data, then wait for all
+	// of it to reach the disk, and only then make the new revision live.
+	// The waits are still one table at a time, but the writes they wait
+	// for have all been started by then, and every table is on disk
+	// before any base file is renamed.  The record table must be the last
+	// to have its base renamed, since its revision is used to decide
+	// which revision of the database is current.
+	BrassTable * tables[] = {
+	    &postlist_table,
+	    &position_table,
+	    &termlist_table,
+	    &synonym_table,
+	    &spelling_table,
+	    &impact_table,
+	    &record_table
+	};
+	const size_t n_tables = sizeof(tables) / sizeof(tables[0]);
+	// The number of tables whose new revision is live.
+	size_t n_finished = 0;
+	try {
+	    for (size_t i = 0; i != n_tables - 1; ++i) {
+		tables[i]->commit_start(new_revision, changes_fd);
+	    }
 
-	string changes_tail; // Data to be appended to the changes file
-	if (changes_fd >= 0) {
-	    changes_tail += '\0';
-	    pack_uint(changes_tail, new_revision);
-	}
-	record_table.commit(new_revision, changes_fd, &changes_tail);
+	    string changes_tail; // Data to be appended to the changes file
+	    if (changes_fd >= 0) {
+		changes_tail += '\0';
+		pack_uint(changes_tail, new_revision);
+	    }
+	    record_table.commit_start(new_revision, changes_fd, &changes_tail);
 
+	    for (size_t i = 0; i != n_tables; ++i) {
+		tables[i]->commit_sync();
+	    }
+	    while (n_finished != n_tables) {
+		tables[n_finished]->commit_finish();
+		++n_finished;
+	    }
+	} catch (...) {
+	    // Tables which have finished committing are in a consistent state
+	    // at the new revision, so leave those open.
+	    for (size_t i = n_finished; i != n_tables; ++i) {
+		tables[i]->commit_abandon();
+	    }
+	    throw;
+	}
     } catch (...) {
 	// Remove the changeset, if there was one.
 	if (changes_fd >= 0) {
@@ -502,6 +594,7 @@ BrassDatabase::close()
     termlist_table.close(true);
     synonym_table.close(true);
     spelling_table.close(true);
+    impact_table.close(true);
     record_table.close(true);
     lock.release();
 }
@@ -542,6 +635,7 @@ BrassDatabase::send_whole_database(RemoteConnection & conn, double end_time)
 	"\x0b""termlist.DB""\x0e""termlist.baseA\x0e""termlist.baseB"
 	"\x0a""synonym.DB""\x0d""synonym.baseA\x0d""synonym.baseB"
 	"\x0b""spelling.DB""\x0e""spelling.baseA\x0e""spelling.baseB"
+	"\x09""impact.DB""\x0c""impact.baseA\x0c""impact.baseB"
 	"\x09""record.DB""\x0c""record.baseA\x0c""record.baseB"
 	"\x0b""position.DB""\x0e""position.baseA\x0e""position.baseB"
 	"\x0b""postlist.DB""\x0e""postlist.baseA\x0e""postlist.baseB"
@@ -750,6 +844,7 @@ BrassDatabase::cancel()
     value_manager.cancel();
     synonym_table.cancel();
     spelling_table.cancel();
+    impact_table.cancel();
     record_table.cancel();
 }
 
@@ -811,6 +906,15 @@ BrassDatabase::get_collection_freq(const string & term) const
     RETURN(postlist_table.get_collection_freq(term));
 }
 
+void
+BrassDatabase::get_freqs(const vector<string> & terms,
+			 vector<Xapian::doccount> & termfreqs,
+			 vector<Xapian::termcount> & collfreqs) const
+{
+    LOGCALL_VOID(DB, "BrassDatabase::get_freqs", terms.size() | (void*)&termfreqs | (void*)&collfreqs);
+    postlist_table.get_freqs(terms, termfreqs, collfreqs);
+}
+
 Xapian::doccount
 BrassDatabase::get_value_freq(Xapian::valueno slot) const
 {
@@ -889,6 +993,32 @@ BrassDatabase::open_value_list(Xapian::valueno slot) const
     RETURN(new BrassValueList(slot, ptrtothis));
 }
 
+bool
+BrassDatabase::get_value_range_docids(Xapian::valueno slot,
+				      const string & begin,
+				      const string * end,
+				      Xapian::doccount max_size,
+				      vector<Xapian::docid> & dids) const
+{
+    LOGCALL(DB, bool, "BrassDatabase::get_value_range_docids", slot | begin | end | max_size | Literal("dids"));
+    RETURN(value_manager.get_value_range_docids(slot, begin, end, max_size,
+						dids));
+}
+
+bool
+BrassDatabase::get_impact_weighting(string & name, string & params) const
+{
+    LOGCALL(DB, bool, "BrassDatabase::get_impact_weighting", name | params);
+    RETURN(impact_table.get_weighting(get_revision_number(), name, params));
+}
+
+ImpactList *
+BrassDatabase::open_impact_list(const string & tname) const
+{
+    LOGCALL(DB, ImpactList *, "BrassDatabase::open_impact_list", tname);
+    RETURN(impact_table.open_impact_list(tname));
+}
+
 TermList *
 BrassDatabase::open_term_list(Xapian::docid did) const
 {
@@ -1024,11 +1154,12 @@ BrassDatabase::throw_termlist_table_close_exception() const
 
 BrassWritableDatabase::BrassWritableDatabase(const string &dir, int action,
 					       int block_size)
-	: BrassDatabase(dir, action, block_size),
+	: BrassDatabase(dir, action & XAPIAN_DB_ACTION_MASK, block_size),
 	  change_count(0),
 	  flush_threshold(0),
 	  modify_shortcut_document(NULL),
-	  modify_shortcut_docid(0)
+	  modify_shortcut_docid(0),
+	  bulk_load(NULL)
 {
     LOGCALL_CTOR(DB, "BrassWritableDatabase", dir | action | block_size);
 
@@ -1037,12 +1168,22 @@ BrassWritableDatabase::BrassWritableDatabase(const string &dir, int action,
 	flush_threshold = atoi(p);
     if (flush_threshold == 0)
 	flush_threshold = 10000;
+
+    // We can only bulk load postlists if there aren't any existing ones
+    // which the runs would need to be merged with.  The other tables don't
+    // need special handling, since adding new documents only appends to them,
+    // which the B-tree code already spots and handles by filling each block
+    // before starting the next.
+    if ((action & Xapian::DB_BULK_LOAD) && stats.get_last_docid() == 0)
+	bulk_load = new BrassBulkLoad(db_dir);
 }
 
 BrassWritableDatabase::~BrassWritableDatabase()
 {
     LOGCALL_DTOR(DB, "BrassWritableDatabase");
     dtor_called();
+    // Any runs which are left weren't committed, so just discard them.
+    delete bulk_load;
 }
 
 void
@@ -1050,7 +1191,11 @@ BrassWritableDatabase::commit()
 {
     if (transaction_active())
 	throw Xapian::InvalidOperationError("Can't commit during a transaction");
-    if (change_count) flush_postlist_changes();
+    if (bulk_load) {
+	end_bulk_load();
+    } else if (change_count) {
+	flush_postlist_changes();
+    }
     apply();
 }
 
@@ -1058,11 +1203,32 @@ void
 BrassWritableDatabase::flush_postlist_changes() const
 {
     stats.write(postlist_table);
-    inverter.flush(postlist_table);
+    if (bulk_load) {
+	bulk_load->add_run(inverter);
+	// Value changes are written straight to the postlist table, but we
+	// don't apply() while bulk loading so we need to flush them here to
+	// limit memory use.
+	value_manager.merge_changes();
+    } else {
+	inverter.flush(postlist_table);
+    }
 
     change_count = 0;
 }
 
+void
+BrassWritableDatabase::end_bulk_load() const
+{
+    if (!bulk_load) return;
+    LOGCALL_VOID(DB, "BrassWritableDatabase::end_bulk_load", NO_ARGS);
+    if (change_count) flush_postlist_changes();
+    postlist_table.set_full_compaction(true);
+    bulk_load->finish(&postlist_table);
+    postlist_table.set_full_compaction(false);
+    delete bulk_load;
+    bulk_load = NULL;
+}
+
 void
 BrassWritableDatabase::close()
 {
@@ -1151,7 +1317,9 @@ BrassWritableDatabase::add_document_(Xapian::docid did,
     // currently holds.
     if (++change_count >= flush_threshold) {
 	flush_postlist_changes();
-	if (!transaction_active()) apply();
+	// While bulk loading, the postlist changes are only merged into the
+	// postlist table when we commit.
+	if (!transaction_active() && !bulk_load) apply();
     }
 
     RETURN(did);
@@ -1163,6 +1331,8 @@ BrassWritableDatabase::delete_document(Xapian::docid did)
     LOGCALL_VOID(DB, "BrassWritableDatabase::delete_document", did);
     Assert(did != 0);
 
+    end_bulk_load();
+
     if (!termlist_table.is_open())
 	throw_termlist_table_close_exception();
 
@@ -1235,6 +1405,8 @@ BrassWritableDatabase::replace_document(Xapian::docid did,
 	    return;
 	}
 
+	end_bulk_load();
+
 	if (!termlist_table.is_open()) {
 	    // We can replace an *unused* docid <= last_docid too.
 	    intrusive_ptr<const BrassDatabase> ptrtothis(this);
@@ -1409,6 +1581,12 @@ BrassWritableDatabase::get_doclength(Xapian::docid did) const
     Xapian::termcount doclen;
     if (inverter.get_doclength(did, doclen))
 	RETURN(doclen);
+    if (bulk_load) {
+	// The document length postings are in the runs until bulk loading
+	// ends, but the termlist stores the length too.
+	intrusive_ptr<const BrassDatabase> ptrtothis(this);
+	RETURN(BrassTermList(ptrtothis, did).get_doclength());
+    }
     RETURN(BrassDatabase::get_doclength(did));
 }
 
@@ -1416,6 +1594,13 @@ Xapian::doccount
 BrassWritableDatabase::get_termfreq(const string & term) const
 {
     LOGCALL(DB, Xapian::doccount, "BrassWritableDatabase::get_termfreq", term);
+    if (bulk_load) {
+	vector<string> terms(1, term);
+	vector<Xapian::doccount> termfreqs;
+	vector<Xapian::termcount> collfreqs;
+	get_freqs(terms, termfreqs, collfreqs);
+	RETURN(termfreqs[0]);
+    }
     RETURN(BrassDatabase::get_termfreq(term) + inverter.get_tfdelta(term));
 }
 
@@ -1423,9 +1608,34 @@ Xapian::termcount
 BrassWritableDatabase::get_collection_freq(const string & term) const
 {
     LOGCALL(DB, Xapian::termcount, "BrassWritableDatabase::get_collection_freq", term);
+    if (bulk_load) {
+	vector<string> terms(1, term);
+	vector<Xapian::doccount> termfreqs;
+	vector<Xapian::termcount> collfreqs;
+	get_freqs(terms, termfreqs, collfreqs);
+	RETURN(collfreqs[0]);
+    }
     RETURN(BrassDatabase::get_collection_freq(term) + inverter.get_cfdelta(term));
 }
 
+void
+BrassWritableDatabase::get_freqs(const vector<string> & terms,
+				 vector<Xapian::doccount> & termfreqs,
+				 vector<Xapian::termcount> & collfreqs) const
+{
+    LOGCALL_VOID(DB, "BrassWritableDatabase::get_freqs", terms.size() | (void*)&termfreqs | (void*)&collfreqs);
+    if (bulk_load) {
+	// The posting lists are in the runs until bulk loading ends.
+	bulk_load->get_freqs(terms, termfreqs, collfreqs);
+    } else {
+	BrassDatabase::get_freqs(terms, termfreqs, collfreqs);
+    }
+    for (size_t i = 0; i != terms.size(); ++i) {
+	termfreqs[i] += inverter.get_tfdelta(terms[i]);
+	collfreqs[i] += inverter.get_cfdelta(terms[i]);
+    }
+}
+
 Xapian::doccount
 BrassWritableDatabase::get_value_freq(Xapian::valueno slot) const
 {
@@ -1467,6 +1677,7 @@ LeafPostList *
 BrassWritableDatabase::open_post_list(const string& tname) const
 {
     LOGCALL(DB, LeafPostList *, "BrassWritableDatabase::open_post_list", tname);
+    end_bulk_load();
     intrusive_ptr<const BrassWritableDatabase> ptrtothis(this);
 
     if (tname.empty()) {
@@ -1495,10 +1706,36 @@ BrassWritableDatabase::open_value_list(Xapian::valueno slot) const
     RETURN(BrassDatabase::open_value_list(slot));
 }
 
+bool
+BrassWritableDatabase::get_value_range_docids(Xapian::valueno slot,
+					      const string & begin,
+					      const string * end,
+					      Xapian::doccount max_size,
+					      vector<Xapian::docid> & dids) const
+{
+    LOGCALL(DB, bool, "BrassWritableDatabase::get_value_range_docids", slot | begin | end | max_size | Literal("dids"));
+    // The index is updated when the changes are merged.
+    if (change_count) value_manager.merge_changes();
+    RETURN(BrassDatabase::get_value_range_docids(slot, begin, end, max_size,
+						 dids));
+}
+
+bool
+BrassWritableDatabase::get_impact_weighting(string & name,
+					    string & params) const
+{
+    LOGCALL(DB, bool, "BrassWritableDatabase::get_impact_weighting", name | params);
+    // Uncommitted changes aren't reflected in the impact-ordered posting
+    // lists.
+    if (change_count || postlist_table.is_modified()) RETURN(false);
+    RETURN(BrassDatabase::get_impact_weighting(name, params));
+}
+
 TermList *
 BrassWritableDatabase::open_allterms(const string & prefix) const
 {
     LOGCALL(DB, TermList *, "BrassWritableDatabase::open_allterms", NO_ARGS);
+    end_bulk_load();
     if (change_count) {
 	// There are changes, and terms may have been added or removed, and so
 	// we need to flush changes for terms with the specified prefix (but
@@ -1520,6 +1757,7 @@ BrassWritableDatabase::cancel()
     BrassDatabase::cancel();
     stats.read(postlist_table);
 
+    if (bulk_load) bulk_load->clear();
     inverter.clear();
     value_stats.clear();
     change_count = 0;
@@ -27,6 +27,7 @@
 
 #include "backends/database.h"
 #include "brass_dbstats.h"
+#include "brass_impact.h"
 #include "brass_inverter.h"
 #include "brass_positionlist.h"
 #include "brass_postlist.h"
@@ -46,6 +47,7 @@
 
 class BrassTermList;
 class BrassAllDocsPostList;
+class BrassBulkLoad;
 class RemoteConnection;
 
 /** A backend designed for efficient indexing and retrieval, using
@@ -99,6 +101,10 @@ class BrassDatabase : public Xapian::Database::Internal {
 	 */
 	mutable BrassSpellingTable spelling_table;
 
+	/** Table storing impact-ordered posting lists.
+	 */
+	BrassImpactTable impact_table;
+
 	/** Table storing records.
 	 *
 	 *  Whenever an update is performed, this table is the last to be
@@ -139,6 +145,13 @@ class BrassDatabase : public Xapian::Database::Internal {
 	 */
 	bool open_tables_consistent();
 
+	/** Tell the tables to use the shared block cache, if it's enabled.
+	 *
+	 *  The version file must have been read or created first, since the
+	 *  database's UUID forms part of the cache key.
+	 */
+	void use_block_cache();
+
 	/** Get a write lock on the database, or throw an
 	 *  Xapian::DatabaseLockError if failure.
 	 *
@@ -148,6 +161,13 @@ class BrassDatabase : public Xapian::Database::Internal {
 	 */
 	void get_database_write_lock(bool creating);
 
+	/** Set the block sizes to create the optional tables with.
+	 *
+	 *  These tables may not currently exist, so are created when first
+	 *  written to.
+	 */
+	void set_optional_table_block_sizes();
+
 	/** Open tables at specified revision number.
 	 *
 	 *  @exception Xapian::InvalidArgumentError is thrown if the specified
@@ -262,6 +282,9 @@ class BrassDatabase : public Xapian::Database::Internal {
 	Xapian::termcount get_doclength(Xapian::docid did) const;
 	Xapian::doccount get_termfreq(const string & tname) const;
 	Xapian::termcount get_collection_freq(const string & tname) const;
+	void get_freqs(const vector<string> & terms,
+		       vector<Xapian::doccount> & termfreqs,
+		       vector<Xapian::termcount> & collfreqs) const;
 	Xapian::doccount get_value_freq(Xapian::valueno slot) const;
 	std::string get_value_lower_bound(Xapian::valueno slot) const;
 	std::string get_value_upper_bound(Xapian::valueno slot) const;
@@ -273,6 +296,12 @@ class BrassDatabase : public Xapian::Database::Internal {
 
 	LeafPostList * open_post_list(const string & tname) const;
 	ValueList * open_value_list(Xapian::valueno slot) const;
+	bool get_value_range_docids(Xapian::valueno slot,
+				    const string & begin, const string * end,
+				    Xapian::doccount max_size,
+				    std::vector<Xapian::docid> & dids) const;
+	bool get_impact_weighting(string & name, string & params) const;
+	ImpactList * open_impact_list(const string & tname) const;
 	Xapian::Document::Internal * open_document(Xapian::docid did, bool lazy) const;
 
 	PositionList * open_position_list(Xapian::docid did, const string & term) const;
@@ -326,9 +355,21 @@ class BrassWritableDatabase : public BrassDatabase {
 	 */
 	mutable Xapian::docid modify_shortcut_docid;
 
+	/** Sorted runs of postlist changes, if we're bulk loading.
+	 *
+	 *  NULL if we aren't bulk loading.
+	 */
+	mutable BrassBulkLoad * bulk_load;
+
 	/// Flush any unflushed postlist changes, but don't commit them.
 	void flush_postlist_changes() const;
 
+	/** Stop bulk loading, merging any runs into the postlist table.
+	 *
+	 *  Does nothing if we aren't bulk loading.
+	 */
+	void end_bulk_load() const;
+
 	/// Close all the tables permanently.
 	void close();
 
@@ -384,6 +425,9 @@ class BrassWritableDatabase : public BrassDatabase {
 	Xapian::termcount get_doclength(Xapian::docid did) const;
 	Xapian::doccount get_termfreq(const string & tname) const;
 	Xapian::termcount get_collection_freq(const string & tname) const;
+	void get_freqs(const vector<string> & terms,
+		       vector<Xapian::doccount> & termfreqs,
+		       vector<Xapian::termcount> & collfreqs) const;
 	Xapian::doccount get_value_freq(Xapian::valueno slot) const;
 	std::string get_value_lower_bound(Xapian::valueno slot) const;
 	std::string get_value_upper_bound(Xapian::valueno slot) const;
@@ -391,6 +435,11 @@ class BrassWritableDatabase : public BrassDatabase {
 
 	LeafPostList * open_post_list(const string & tname) const;
 	ValueList * open_value_list(Xapian::valueno slot) const;
+	bool get_value_range_docids(Xapian::valueno slot,
+				    const string & begin, const string * end,
+				    Xapian::doccount max_size,
+				    std::vector<Xapian::docid> & dids) const;
+	bool get_impact_weighting(string & name, string & params) const;
 	TermList * open_allterms(const string & prefix) const;
 
 	void add_spelling(const string & word, Xapian::termcount freqinc) const;
@@ -30,15 +30,21 @@
 
 #include "brass_check.h"
 #include "brass_cursor.h"
+#include "brass_impact.h"
+#include "brass_positionlist.h"
+#include "brass_postlist.h"
 #include "brass_table.h"
 #include "brass_types.h"
+#include "brass_values.h"
 #include "pack.h"
+#include "backends/impactlist.h"
 #include "backends/valuestats.h"
 
 #include <xapian.h>
 
 #include "autoptr.h"
 #include <ostream>
+#include <set>
 #include <vector>
 
 using namespace std;
@@ -78,11 +84,22 @@ check_brass_table(const char * tablename, string filename, int opts,
     if (strcmp(tablename, "postlist") == 0) {
 	// Now check the structure of each postlist in the table.
 	map<Xapian::valueno, VStats> valuestats;
+	// The summaries expected for the value chunks seen, by summary key.
+	map<string, string> value_summaries;
+	bool have_value_summaries =
+	    (table.get_flags() & BrassTable::FLAG_VALUE_SUMMARIES);
+	// The value slots with an index, and the keys of the index entries
+	// not yet matched with a value.
+	set<Xapian::valueno> indexed_slots;
+	set<string> valueindex_keys;
 	string current_term;
 	Xapian::docid lastdid = 0;
 	Xapian::termcount termfreq = 0, collfreq = 0;
 	Xapian::termcount tf = 0, cf = 0;
 	bool have_metainfo_key = false;
+	// The number of entries in the doclen posting list and in the doclen
+	// column.
+	Xapian::doccount doclen_entries = 0, doclen_column_entries = 0;
 
 	// The first key/tag pair should be the METAINFO - though this may be
 	// missing if the table only contains user-metadata.
@@ -136,6 +153,20 @@ check_brass_table(const char * tablename, string filename, int opts,
 		continue;
 	    }
 
+	    if (key.size() == 2 && key[0] == '\0' && key[1] == '\xd4') {
+		// The list of indexed slots is written when the database is
+		// created, so it can be present without the METAINFO key.
+		cursor->read_tag();
+		try {
+		    Brass::decode_indexed_slots(cursor->current_tag,
+						indexed_slots);
+		} catch (const Xapian::DatabaseCorruptError & e) {
+		    out << e.get_msg() << endl;
+		    ++errors;
+		}
+		continue;
+	    }
+
 	    if (!have_metainfo_key) {
 		out << "METAINFO key missing from postlist table" << endl;
 		++errors;
@@ -182,7 +213,9 @@ check_brass_table(const char * tablename, string filename, int opts,
 		}
 
 		bool is_last_chunk;
-		if (!unpack_bool(&pos, end, &is_last_chunk)) {
+		unsigned encoding;
+		if (!Brass::unpack_chunk_flags(&pos, end, &is_last_chunk,
+					       &encoding)) {
 		    out << "Failed to unpack last chunk flag for doclen" << endl;
 		    ++errors;
 		    continue;
@@ -194,6 +227,18 @@ check_brass_table(const char * tablename, string filename, int opts,
 		    continue;
 		}
 		lastdid += did;
+		// Check encoded entries in the normal format.
+		string entries;
+		if (encoding) {
+		    if (!Brass::decode_chunk_entries(encoding, pos, end,
+						     entries)) {
+			out << "Failed to decode doclen chunk" << endl;
+			++errors;
+			continue;
+		    }
+		    pos = entries.data();
+		    end = pos + entries.size();
+		}
 		bool bad = false;
 		while (true) {
 		    Xapian::termcount doclen;
@@ -203,6 +248,7 @@ check_brass_table(const char * tablename, string filename, int opts,
 			bad = true;
 			break;
 		    }
+		    ++doclen_entries;
 
 		    if (did > db_last_docid) {
 			out << "document id " << did << " in doclen stream "
@@ -258,6 +304,57 @@ check_brass_table(const char * tablename, string filename, int opts,
 		continue;
 	    }
 
+	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xe8') {
+		// Doclen column chunk.
+		if (!(table.get_flags() & BrassTable::FLAG_DOCLEN_COLUMN)) {
+		    out << "Doclen column chunk in table without a doclen "
+			   "column" << endl;
+		    ++errors;
+		}
+		const char * p = key.data();
+		const char * end = p + key.length();
+		p += 2;
+		Xapian::docid chunk_no;
+		if (!unpack_uint_preserving_sort(&p, end, &chunk_no) || p != end) {
+		    out << "Bad doclen column key" << endl;
+		    ++errors;
+		    continue;
+		}
+		cursor->read_tag();
+		vector<uint8> entries;
+		if (!Brass::decode_doclen_column(cursor->current_tag, entries) ||
+		    entries.empty() || entries.back() == 0) {
+		    out << "Bad doclen column chunk" << endl;
+		    ++errors;
+		    continue;
+		}
+		Xapian::docid did = chunk_no * Brass::DOCLEN_COLUMN_CHUNK_SIZE;
+		for (size_t i = 0; i != entries.size(); ++i) {
+		    ++did;
+		    if (entries[i] == 0) continue;
+		    ++doclen_column_entries;
+		    if (did > db_last_docid) {
+			out << "document id " << did << " in doclen column "
+			    << "is larger than get_last_docid() "
+			    << db_last_docid << endl;
+			++errors;
+		    }
+		    if (!doclens.empty()) {
+			Xapian::termcount termlist_doclen = 0;
+			if (did < doclens.size())
+			    termlist_doclen = doclens[did];
+			if (entries[i] - 1 != termlist_doclen) {
+			    out << "document id " << did << ": length "
+				<< entries[i] - 1 << " in doclen column "
+				"doesn't match " << termlist_doclen
+				<< " in the termlist table" << endl;
+			    ++errors;
+			}
+		    }
+		}
+		continue;
+	    }
+
 	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xd0') {
 		// Value stats.
 		const char * p = key.data();
@@ -303,6 +400,52 @@ check_brass_table(const char * tablename, string filename, int opts,
 		continue;
 	    }
 
+	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xd4') {
+		// Value index entry.
+		Xapian::valueno slot;
+		string value;
+		Xapian::docid did;
+		try {
+		    (void)Brass::decode_valueindex_key(key, slot, value, did);
+		} catch (const Xapian::DatabaseCorruptError & e) {
+		    out << e.get_msg() << endl;
+		    ++errors;
+		    continue;
+		}
+		if (indexed_slots.find(slot) == indexed_slots.end()) {
+		    out << "Value index entry for slot " << slot
+			<< " which has no index" << endl;
+		    ++errors;
+		    continue;
+		}
+		valueindex_keys.insert(valueindex_keys.end(), key);
+		continue;
+	    }
+
+	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xdc') {
+		// Value stream chunk summary.
+		if (!have_value_summaries) {
+		    out << "Value chunk summary in table without summaries"
+			<< endl;
+		    ++errors;
+		    continue;
+		}
+		map<string, string>::iterator i = value_summaries.find(key);
+		if (i == value_summaries.end()) {
+		    out << "Value chunk summary with no value chunk" << endl;
+		    ++errors;
+		    continue;
+		}
+		cursor->read_tag();
+		if (cursor->current_tag != i->second) {
+		    out << "Value chunk summary doesn't match value chunk"
+			<< endl;
+		    ++errors;
+		}
+		value_summaries.erase(i);
+		continue;
+	    }
+
 	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xd8') {
 		// Value stream chunk.
 		const char * p = key.data();
@@ -329,9 +472,34 @@ check_brass_table(const char * tablename, string filename, int opts,
 		VStats & v = valuestats[slot];
 
 		cursor->read_tag();
+		if (have_value_summaries) {
+		    string summary_key = key;
+		    summary_key[1] = '\xdc';
+		    try {
+			value_summaries[summary_key] =
+			    Brass::summarise_value_chunk(cursor->current_tag);
+		    } catch (const Xapian::DatabaseCorruptError & e) {
+			out << "Bad value chunk: " << e.get_msg() << endl;
+			++errors;
+			continue;
+		    }
+		}
+		if (!cursor->current_tag.empty() &&
+		    cursor->current_tag[0] == '\0') {
+		    // Check a numeric column by converting it to strings.
+		    try {
+			Brass::convert_value_chunk(cursor->current_tag, 0);
+		    } catch (const Xapian::DatabaseCorruptError & e) {
+			out << "Bad numeric value chunk: " << e.get_msg()
+			    << endl;
+			++errors;
+			continue;
+		    }
+		}
 		p = cursor->current_tag.data();
 		end = p + cursor->current_tag.size();
 
+		bool indexed = (indexed_slots.find(slot) != indexed_slots.end());
 		while (true) {
 		    string value;
 		    if (!unpack_string(&p, end, value)) {
@@ -342,6 +510,19 @@ check_brass_table(const char * tablename, string filename, int opts,
 
 		    ++v.freq_real;
 
+		    if (indexed) {
+			set<string>::iterator e = valueindex_keys.find(
+				Brass::make_valueindex_key(slot, value, did));
+			if (e == valueindex_keys.end()) {
+			    out << "Value index for slot " << slot
+				<< " has no entry for document " << did
+				<< endl;
+			    ++errors;
+			} else {
+			    valueindex_keys.erase(e);
+			}
+		    }
+
 		    // FIXME: Cross-check that docid did has value slot (and
 		    // vice versa - that there's a value here if the slot entry
 		    // says so).
@@ -473,7 +654,9 @@ check_brass_table(const char * tablename, string filename, int opts,
 	    }
 
 	    bool is_last_chunk;
-	    if (!unpack_bool(&pos, end, &is_last_chunk)) {
+	    unsigned encoding;
+	    if (!Brass::unpack_chunk_flags(&pos, end, &is_last_chunk,
+					   &encoding)) {
 		out << "Failed to unpack last chunk flag" << endl;
 		++errors;
 		continue;
@@ -485,6 +668,27 @@ check_brass_table(const char * tablename, string filename, int opts,
 		continue;
 	    }
 	    lastdid += did;
+	    Xapian::termcount chunk_wdf_max = Xapian::termcount(-1);
+	    if (encoding & Brass::CHUNK_HAS_MAX_WDF) {
+		const char * p = pos;
+		if (!unpack_uint(&p, end, &chunk_wdf_max)) {
+		    out << "Failed to unpack chunk's max wdf" << endl;
+		    ++errors;
+		    continue;
+		}
+	    }
+	    // Check encoded entries in the normal format.
+	    string entries;
+	    if (encoding) {
+		if (!Brass::decode_chunk_entries(encoding, pos, end,
+						 entries)) {
+		    out << "Failed to decode posting list chunk" << endl;
+		    ++errors;
+		    continue;
+		}
+		pos = entries.data();
+		end = pos + entries.size();
+	    }
 	    bool bad = false;
 	    while (true) {
 		Xapian::termcount wdf;
@@ -496,6 +700,11 @@ check_brass_table(const char * tablename, string filename, int opts,
 		}
 		++tf;
 		cf += wdf;
+		if (wdf > chunk_wdf_max) {
+		    out << "wdf " << wdf << " > chunk's max wdf "
+			<< chunk_wdf_max << endl;
+		    ++errors;
+		}
 
 		if (pos == end) break;
 
@@ -542,6 +751,26 @@ check_brass_table(const char * tablename, string filename, int opts,
 	    ++errors;
 	}
 
+	if ((table.get_flags() & BrassTable::FLAG_DOCLEN_COLUMN) &&
+	    doclen_column_entries != doclen_entries) {
+	    out << "Doclen column has " << doclen_column_entries
+		<< " entries but doclen posting list has " << doclen_entries
+		<< endl;
+	    ++errors;
+	}
+
+	if (!value_summaries.empty()) {
+	    out << value_summaries.size() << " value chunks have no summary"
+		<< endl;
+	    ++errors;
+	}
+
+	if (!valueindex_keys.empty()) {
+	    out << valueindex_keys.size() << " value index entries have no "
+		   "value" << endl;
+	    ++errors;
+	}
+
 	map<Xapian::valueno, VStats>::const_iterator i;
 	for (i = valuestats.begin(); i != valuestats.end(); ++i) {
 	    if (i->second.freq != i->second.freq_real) {
@@ -756,6 +985,15 @@ check_brass_table(const char * tablename, string filename, int opts,
 	    }
 	    if (pos == end) {
 		// Special case for single entry position list.
+	    } else if (table.get_flags() & BrassTable::FLAG_PACKED_POSITIONS) {
+		vector<Xapian::termpos> positions;
+		try {
+		    BrassPositionListTable::decode(data, positions,
+						   table.get_flags());
+		} catch (const Xapian::DatabaseCorruptError &) {
+		    out << tablename << " table: Packed position list corrupt or not strictly monotonically increasing" << endl;
+		    ++errors;
+		}
 	    } else {
 		// Skip the header we just read.
 		BitReader rd(data, pos - data.data());
@@ -780,6 +1018,58 @@ check_brass_table(const char * tablename, string filename, int opts,
 		}
 	    }
 	}
+    } else if (strcmp(tablename, "impact") == 0) {
+	// Now check the impact-ordered posting lists.
+	const string header_key = BrassImpactTable::make_header_key();
+	if (cursor->after_end() || cursor->current_key != header_key) {
+	    out << tablename << " table: No header" << endl;
+	    ++errors;
+	}
+	for ( ; !cursor->after_end(); cursor->next()) {
+	    const string & key = cursor->current_key;
+	    cursor->read_tag();
+	    if (key == header_key) continue;
+
+	    const char * pos = key.data();
+	    const char * end = pos + key.size();
+	    string term;
+	    if (!unpack_string_preserving_sort(&pos, end, term) ||
+		pos != end) {
+		out << tablename << " table: Bad key" << endl;
+		++errors;
+		continue;
+	    }
+
+	    try {
+		ImpactList pl(cursor->current_tag);
+		unsigned prev_impact = ImpactList::MAX_QUANTISED_IMPACT + 1;
+		for ( ; !pl.at_end(); pl.next()) {
+		    if (pl.get_impact() >= prev_impact) {
+			out << "Impacts not in descending order for term '"
+			    << term << "'" << endl;
+			++errors;
+			break;
+		    }
+		    prev_impact = pl.get_impact();
+		    const vector<Xapian::docid> & docids = pl.get_docids();
+		    Xapian::docid prev_did = 0;
+		    vector<Xapian::docid>::const_iterator d;
+		    for (d = docids.begin(); d != docids.end(); ++d) {
+			if (*d <= prev_did || *d > db_last_docid) {
+			    out << "Bad docid " << *d << " in impact list for "
+				"term '" << term << "'" << endl;
+			    ++errors;
+			    break;
+			}
+			prev_did = *d;
+		    }
+		}
+	    } catch (const Xapian::DatabaseCorruptError & e) {
+		out << tablename << " table: " << e.get_msg() << " for term '"
+		    << term << "'" << endl;
+		++errors;
+	    }
+	}
     } else {
 	out << tablename << " table: Don't know how to check structure\n" << endl;
 	return errors;
@@ -0,0 +1,75 @@
+/** @file brass_impact.cc
+ * @brief Impact-ordered posting lists for a brass database.
+ */
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include "brass_impact.h"
+
+#include "xapian/error.h"
+
+#include "backends/impactlist.h"
+#include "debuglog.h"
+#include "pack.h"
+
+using namespace std;
+
+string
+BrassImpactTable::make_header_tag(brass_revision_number_t revision,
+				  const string & name, const string & params)
+{
+    string tag;
+    pack_uint(tag, revision);
+    pack_string(tag, name);
+    tag += params;
+    return tag;
+}
+
+string
+BrassImpactTable::make_key(const string & term)
+{
+    string key;
+    pack_string_preserving_sort(key, term, true);
+    return key;
+}
+
+bool
+BrassImpactTable::get_weighting(brass_revision_number_t revision,
+				string & scheme, string & params) const
+{
+    LOGCALL(DB, bool, "BrassImpactTable::get_weighting", revision | scheme | params);
+    string tag;
+    if (!get_exact_entry(make_header_key(), tag)) RETURN(false);
+
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    brass_revision_number_t built_for;
+    if (!unpack_uint(&p, end, &built_for) || !unpack_string(&p, end, scheme)) {
+	throw Xapian::DatabaseCorruptError("Bad impact table header");
+    }
+    if (built_for != revision) RETURN(false);
+    params.assign(p, end - p);
+    RETURN(true);
+}
+
+ImpactList *
+BrassImpactTable::open_impact_list(const string & term) const
+{
+    LOGCALL(DB, ImpactList *, "BrassImpactTable::open_impact_list", term);
+    string tag;
+    if (!get_exact_entry(make_key(term), tag)) RETURN(NULL);
+    RETURN(new ImpactList(tag));
+}
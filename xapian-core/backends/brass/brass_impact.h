@@ -0,0 +1,87 @@
+/** @file brass_impact.h
+ * @brief Impact-ordered posting lists for a brass database.
+ */
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef XAPIAN_INCLUDED_BRASS_IMPACT_H
+#define XAPIAN_INCLUDED_BRASS_IMPACT_H
+
+#include "brass_lazytable.h"
+#include "brass_types.h"
+
+#include <string>
+
+class ImpactList;
+
+/** Table holding impact-ordered posting lists.
+ *
+ *  This table is only written by the compactor, which builds it from the
+ *  finished database if asked to.  As well as an ImpactList for each term,
+ *  it holds a header recording the weighting scheme the impacts were
+ *  calculated with and the revision of the database they were built for -
+ *  any later revision may have different postings and statistics, so the
+ *  impact-ordered lists are then ignored.
+ */
+class BrassImpactTable : public BrassLazyTable {
+  public:
+    /** Create a new BrassImpactTable object.
+     *
+     *  This method does not create or open the table on disk - you
+     *  must call the create() or open() methods respectively!
+     *
+     *  @param dbdir		The directory the brass database is stored in.
+     *  @param readonly		true if we're opening read-only, else false.
+     */
+    BrassImpactTable(const std::string & dbdir, bool readonly)
+	: BrassLazyTable("impact", dbdir + "/impact.", readonly,
+			 DONT_COMPRESS) { }
+
+    /// Return the key the header is stored under.
+    static std::string make_header_key() { return std::string(1, '\0'); }
+
+    /** Return the header tag.
+     *
+     *  @param revision	The revision of the database the impacts are for.
+     *  @param name	The name of the weighting scheme.
+     *  @param params	The serialised parameters of the weighting scheme.
+     */
+    static std::string make_header_tag(brass_revision_number_t revision,
+				       const std::string & name,
+				       const std::string & params);
+
+    /// Return the key the impact-ordered posting list for @a term is under.
+    static std::string make_key(const std::string & term);
+
+    /** Get the weighting scheme the impacts were calculated with.
+     *
+     *  @param revision	The revision the database is open at.
+     *  @param scheme	Set to the name of the weighting scheme.
+     *  @param params	Set to its serialised parameters.
+     *
+     *  @return false if there are no impact-ordered posting lists for
+     *		@a revision.
+     */
+    bool get_weighting(brass_revision_number_t revision,
+		       std::string & scheme, std::string & params) const;
+
+    /** Open the impact-ordered posting list for @a term.
+     *
+     *  @return NULL if the table has no entry for @a term.
+     */
+    ImpactList * open_impact_list(const std::string & term) const;
+};
+
+#endif // XAPIAN_INCLUDED_BRASS_IMPACT_H
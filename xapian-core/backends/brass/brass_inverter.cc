@@ -33,6 +33,8 @@ void
 Inverter::flush_doclengths(BrassPostListTable & table)
 {
     table.merge_doclen_changes(doclen_changes);
+    if (table.get_flags() & BrassTable::FLAG_DOCLEN_COLUMN)
+	table.merge_doclen_column_changes(doclen_changes);
     doclen_changes.clear();
 }
 
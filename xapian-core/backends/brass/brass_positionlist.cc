@@ -24,15 +24,109 @@
 
 #include <xapian/types.h>
 
+#include "bitpack.h"
 #include "bitstream.h"
 #include "debuglog.h"
+#include "noreturn.h"
 #include "pack.h"
+#include "xapian/error.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 
 using namespace std;
 
+XAPIAN_NORETURN(static void throw_corrupt());
+static void
+throw_corrupt()
+{
+    throw Xapian::DatabaseCorruptError("Position list data corrupt");
+}
+
+unsigned
+BrassPositionListTable::configured_flags(unsigned flags)
+{
+    LOGCALL_STATIC(DB, unsigned, "BrassPositionListTable::configured_flags", flags);
+    const char * p = getenv("XAPIAN_BRASS_POSITION_FORMAT");
+    if (p && *p) {
+	if (strcmp(p, "packed") == 0) {
+	    flags |= BrassTable::FLAG_PACKED_POSITIONS;
+	} else if (strcmp(p, "interpolative") == 0) {
+	    flags &= ~unsigned(BrassTable::FLAG_PACKED_POSITIONS);
+	} else {
+	    throw Xapian::InvalidArgumentError(string("Unknown position format '") +
+					       p + "' in XAPIAN_BRASS_POSITION_FORMAT");
+	}
+    }
+    RETURN(flags);
+}
+
+void
+BrassPositionListTable::encode(string & s,
+			       const vector<Xapian::termpos> & positions,
+			       unsigned flags)
+{
+    Assert(!positions.empty());
+    pack_uint(s, positions.back());
+
+    // A single entry list is just its position, whichever format is used.
+    if (positions.size() == 1) return;
+
+    if (!(flags & FLAG_PACKED_POSITIONS)) {
+	BitWriter wr(s);
+	wr.encode(positions[0], positions.back());
+	wr.encode(positions.size() - 2, positions.back() - positions[0]);
+	wr.encode_interpolative(positions, 0, positions.size() - 1);
+	swap(s, wr.freeze());
+	return;
+    }
+
+    // The packed format is the number of positions, then each full block of
+    // BITPACK_BLOCK_SIZE positions as the increase in the last position over
+    // the previous block, the number of bits used and the packed gaps
+    // between positions.  Any remaining positions follow as pack_uint()
+    // coded gaps.
+    pack_uint(s, positions.size());
+    Xapian::termpos prev = 0;
+    size_t i = 0;
+    uint4 gaps[BITPACK_BLOCK_SIZE];
+    while (positions.size() - i >= BITPACK_BLOCK_SIZE) {
+	Xapian::termpos block_prev = prev;
+	for (unsigned j = 0; j != BITPACK_BLOCK_SIZE; ++j) {
+	    gaps[j] = positions[i] - prev;
+	    prev = positions[i++];
+	}
+	pack_uint(s, prev - block_prev);
+	unsigned bits = bitpack_bits_needed(gaps, BITPACK_BLOCK_SIZE);
+	s += char(bits);
+	bitpack_block(s, gaps, bits);
+    }
+    while (i != positions.size()) {
+	pack_uint(s, positions[i] - prev);
+	prev = positions[i++];
+    }
+}
+
+void
+BrassPositionListTable::decode(const string & data,
+			       vector<Xapian::termpos> & positions,
+			       unsigned flags)
+{
+    positions.clear();
+    BrassPositionList pl;
+    pl.read_data(data, flags);
+    positions.reserve(pl.get_size());
+    for (pl.next(); !pl.at_end(); pl.next()) {
+	Xapian::termpos pos = pl.get_position();
+	if (!positions.empty() && pos <= positions.back()) throw_corrupt();
+	positions.push_back(pos);
+    }
+    if (positions.size() != pl.get_size()) throw_corrupt();
+}
+
 void
 BrassPositionListTable::set_positionlist(Xapian::docid did,
 					 const string & tname,
@@ -49,15 +143,7 @@ BrassPositionListTable::set_positionlist(Xapian::docid did,
     string key = make_key(did, tname);
 
     string s;
-    pack_uint(s, poscopy.back());
-
-    if (poscopy.size() > 1) {
-	BitWriter wr(s);
-	wr.encode(poscopy[0], poscopy.back());
-	wr.encode(poscopy.size() - 2, poscopy.back() - poscopy[0]);
-	wr.encode_interpolative(poscopy, 0, poscopy.size() - 1);
-	swap(s, wr.freeze());
-    }
+    encode(s, poscopy, get_flags());
 
     if (check_for_update) {
 	string old_tag;
@@ -82,13 +168,21 @@ BrassPositionListTable::positionlist_count(Xapian::docid did,
     const char * end = pos + data.size();
     Xapian::termpos pos_last;
     if (!unpack_uint(&pos, end, &pos_last)) {
-	throw Xapian::DatabaseCorruptError("Position list data corrupt");
+	throw_corrupt();
     }
     if (pos == end) {
 	// Special case for single entry position list.
 	RETURN(1);
     }
 
+    if (get_flags() & FLAG_PACKED_POSITIONS) {
+	Xapian::termcount pos_size;
+	if (!unpack_uint(&pos, end, &pos_size)) {
+	    throw_corrupt();
+	}
+	RETURN(pos_size);
+    }
+
     // Skip the header we just read.
     BitReader rd(data, pos - data.data());
     Xapian::termpos pos_first = rd.decode(pos_last);
@@ -98,44 +192,133 @@ BrassPositionListTable::positionlist_count(Xapian::docid did,
 
 ///////////////////////////////////////////////////////////////////////////
 
+void
+BrassPositionList::read_block(Xapian::termpos target)
+{
+    LOGCALL_VOID(DB, "BrassPositionList::read_block", target);
+    Assert(remaining);
+    const char * end = data.data() + data.size();
+    while (remaining >= BITPACK_BLOCK_SIZE) {
+	Xapian::termpos inc;
+	if (!unpack_uint(&p, end, &inc) || p == end) {
+	    throw_corrupt();
+	}
+	unsigned bits = static_cast<unsigned char>(*p++);
+	size_t bytes = bitpack_block_bytes(bits);
+	if (bits > 32 || size_t(end - p) < bytes) {
+	    throw_corrupt();
+	}
+	remaining -= BITPACK_BLOCK_SIZE;
+	if (buf_last + inc < target) {
+	    // Nothing in this block can be wanted, so don't decode it.
+	    buf_last += inc;
+	    p += bytes;
+	    continue;
+	}
+
+	uint4 gaps[BITPACK_BLOCK_SIZE];
+	bitunpack_block(p, gaps, bits);
+	p += bytes;
+	Xapian::termpos pos = buf_last;
+	for (unsigned j = 0; j != BITPACK_BLOCK_SIZE; ++j) {
+	    pos += gaps[j];
+	    buf[j] = pos;
+	}
+	if (pos != buf_last + inc) {
+	    throw_corrupt();
+	}
+	buf_last = pos;
+	buf_len = BITPACK_BLOCK_SIZE;
+	buf_pos = 0;
+	if (remaining == 0 && buf_last != last) {
+	    throw_corrupt();
+	}
+	return;
+    }
+
+    for (unsigned j = 0; j != remaining; ++j) {
+	Xapian::termpos inc;
+	if (!unpack_uint(&p, end, &inc)) {
+	    throw_corrupt();
+	}
+	buf_last += inc;
+	buf[j] = buf_last;
+    }
+    if (p != end || buf_last != last) {
+	throw_corrupt();
+    }
+    buf_len = remaining;
+    buf_pos = 0;
+    remaining = 0;
+}
+
 bool
 BrassPositionList::read_data(const BrassTable * table, Xapian::docid did,
 			     const string & tname)
 {
     LOGCALL(DB, bool, "BrassPositionList::read_data", table | did | tname);
 
-    have_started = false;
-
-    string data;
-    if (!table->get_exact_entry(BrassPositionListTable::make_key(did, tname), data)) {
+    string tag;
+    if (!table->get_exact_entry(BrassPositionListTable::make_key(did, tname), tag)) {
 	// There's no positional information for this term.
+	have_started = false;
 	size = 0;
 	last = 0;
 	current_pos = 1;
 	RETURN(false);
     }
 
-    const char * pos = data.data();
-    const char * end = pos + data.size();
+    read_data(tag, table->get_flags());
+    RETURN(true);
+}
+
+void
+BrassPositionList::read_data(const string & tag, unsigned flags)
+{
+    LOGCALL_VOID(DB, "BrassPositionList::read_data", tag | flags);
+
+    have_started = false;
+    packed = false;
+
+    const char * pos = tag.data();
+    const char * end = pos + tag.size();
     Xapian::termpos pos_last;
     if (!unpack_uint(&pos, end, &pos_last)) {
-	throw Xapian::DatabaseCorruptError("Position list data corrupt");
+	throw_corrupt();
     }
     if (pos == end) {
 	// Special case for single entry position list.
 	size = 1;
 	current_pos = last = pos_last;
-	RETURN(true);
+	return;
+    }
+
+    if (flags & BrassTable::FLAG_PACKED_POSITIONS) {
+	Xapian::termcount pos_size;
+	if (!unpack_uint(&pos, end, &pos_size) || pos_size < 2) {
+	    throw_corrupt();
+	}
+	packed = true;
+	size_t skip = pos - tag.data();
+	data = tag;
+	p = data.data() + skip;
+	remaining = pos_size;
+	size = pos_size;
+	last = pos_last;
+	buf_last = 0;
+	read_block(0);
+	current_pos = buf[0];
+	return;
     }
+
     // Skip the header we just read.
-    rd.init(data, pos - data.data());
+    rd.init(tag, pos - tag.data());
     Xapian::termpos pos_first = rd.decode(pos_last);
     Xapian::termpos pos_size = rd.decode(pos_last - pos_first) + 2;
     rd.decode_interpolative(0, pos_size - 1, pos_first, pos_last);
     size = pos_size;
     last = pos_last;
     current_pos = pos_first;
-    RETURN(true);
 }
 
 Xapian::termcount
@@ -166,6 +349,11 @@ BrassPositionList::next()
 	current_pos = 1;
 	return;
     }
+    if (packed) {
+	if (++buf_pos == buf_len) read_block(0);
+	current_pos = buf[buf_pos];
+	return;
+    }
     current_pos = rd.decode_interpolative_next();
 }
 
@@ -183,6 +371,13 @@ BrassPositionList::skip_to(Xapian::termpos termpos)
 	current_pos = 1;
 	return;
     }
+    if (packed) {
+	if (current_pos >= termpos) return;
+	if (buf_last < termpos) read_block(termpos);
+	buf_pos = lower_bound(buf + buf_pos, buf + buf_len, termpos) - buf;
+	current_pos = buf[buf_pos];
+	return;
+    }
     while (current_pos < termpos) {
 	if (current_pos == last) {
 	    last = 0;
@@ -24,12 +24,14 @@
 
 #include <xapian/types.h>
 
+#include "bitpack.h"
 #include "bitstream.h"
 #include "brass_lazytable.h"
 #include "pack.h"
 #include "backends/positionlist.h"
 
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -54,6 +56,36 @@ class BrassPositionListTable : public BrassLazyTable {
 	: BrassLazyTable("position", dbdir + "/position.", readonly,
 			 DONT_COMPRESS) { }
 
+    /** Get the flags to create a position table with.
+     *
+     *  The XAPIAN_BRASS_POSITION_FORMAT environment variable can be set to
+     *  "packed" or "interpolative" to select the format used for position
+     *  lists in new tables.
+     *
+     *  @param flags	The flags to use if the format isn't configured.
+     */
+    static unsigned configured_flags(unsigned flags);
+
+    /** Encode a position list.
+     *
+     *  @param s	String to append the encoded list to.
+     *  @param positions	The positions, in ascending order (at least one).
+     *  @param flags	The flags of the table the list is for.
+     */
+    static void encode(string & s,
+		       const vector<Xapian::termpos> & positions,
+		       unsigned flags);
+
+    /** Decode a position list.
+     *
+     *  @param data	The encoded list.
+     *  @param positions	Vector to store the positions in.
+     *  @param flags	The flags of the table the list is from.
+     */
+    static void decode(const string & data,
+		       vector<Xapian::termpos> & positions,
+		       unsigned flags);
+
     /** Set the position list for term tname in document did.
      *
      *  @param check_for_update If true, check if the new list is the same as
@@ -74,11 +106,51 @@ class BrassPositionListTable : public BrassLazyTable {
 					 const string & term) const;
 };
 
-/** A position list in a brass database. */
+/** A position list in a brass database.
+ *
+ *  Position lists are stored in one of two formats, depending on the
+ *  table's flags.  By default they are interpolative coded, which is compact
+ *  but has to be decoded a bit at a time.  With FLAG_PACKED_POSITIONS set,
+ *  the gaps between positions are bit-packed in blocks of
+ *  BITPACK_BLOCK_SIZE, each preceded by its last position, so whole blocks
+ *  can be decoded at once and skip_to() can step over blocks without
+ *  decoding them.
+ */
 class BrassPositionList : public PositionList {
     /// Interpolative decoder.
     BitReader rd;
 
+    /// Is the list in the packed format?
+    bool packed;
+
+    /// The encoded list, if it is in the packed format.
+    string data;
+
+    /// The position of the next block to decode in @a data.
+    const char * p;
+
+    /// The number of positions not yet decoded into @a buf.
+    Xapian::termcount remaining;
+
+    /// The last position decoded into @a buf.
+    Xapian::termpos buf_last;
+
+    /// The index of the current position in @a buf.
+    unsigned buf_pos;
+
+    /// The number of positions in @a buf.
+    unsigned buf_len;
+
+    /// The positions from the current block.
+    Xapian::termpos buf[BITPACK_BLOCK_SIZE];
+
+    /** Decode the next block into @a buf.
+     *
+     *  Whole blocks whose last position is less than @a target are skipped
+     *  over without being decoded.
+     */
+    void read_block(Xapian::termpos target);
+
     /// Current entry.
     Xapian::termpos current_pos;
 
@@ -102,11 +174,11 @@ class BrassPositionList : public PositionList {
 
   public:
     /// Default constructor.
-    BrassPositionList() { }
+    BrassPositionList() : packed(false) { }
 
     /// Construct and initialise with data.
     BrassPositionList(const BrassTable * table, Xapian::docid did,
-		      const string & tname) {
+		      const string & tname) : packed(false) {
 	(void)read_data(table, did, tname);
     }
 
@@ -117,6 +189,13 @@ class BrassPositionList : public PositionList {
     bool read_data(const BrassTable * table, Xapian::docid did,
 		   const string & tname);
 
+    /** Fill list from an encoded position list, and move to the start.
+     *
+     *  @param tag	The encoded position list.
+     *  @param flags	The flags of the table it is from.
+     */
+    void read_data(const string & tag, unsigned flags);
+
     /// Returns size of position list.
     Xapian::termcount get_size() const;
 
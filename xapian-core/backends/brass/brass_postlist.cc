@@ -27,13 +27,109 @@
 #include "brass_cursor.h"
 #include "brass_database.h"
 #include "debuglog.h"
+#include "docidsearch.h"
+#include "xapian/error.h"
 #include "noreturn.h"
 #include "pack.h"
 #include "str.h"
 #include "unicode/description_append.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
 using Xapian::Internal::intrusive_ptr;
 
+/** Set or clear @a flag in @a flags if environment variable @a envvar says to.
+ *
+ *  The variable can be "on" or "off".  If it's unset or empty, @a flags is
+ *  left unchanged.
+ */
+static void
+parse_on_off(const char * envvar, unsigned flag, unsigned & flags)
+{
+    const char * p = getenv(envvar);
+    if (!p || !*p) return;
+    if (strcmp(p, "on") == 0) {
+	flags |= flag;
+    } else if (strcmp(p, "off") == 0) {
+	flags &= ~flag;
+    } else {
+	throw Xapian::InvalidArgumentError(string("Unknown setting '") + p +
+					   "' for " + envvar);
+    }
+}
+
+unsigned
+BrassPostListTable::configured_flags(unsigned flags)
+{
+    LOGCALL_STATIC(DB, unsigned, "BrassPostListTable::configured_flags", flags);
+    const char * p = getenv("XAPIAN_BRASS_POSTLIST_FORMAT");
+    if (p && *p) {
+	if (strcmp(p, "packed") == 0) {
+	    flags |= BrassTable::FLAG_PACKED_POSTLISTS;
+	    flags &= ~unsigned(BrassTable::FLAG_BITMAP_POSTLISTS);
+	} else if (strcmp(p, "bitmap") == 0) {
+	    flags |= BrassTable::FLAG_PACKED_POSTLISTS |
+		     BrassTable::FLAG_BITMAP_POSTLISTS;
+	} else if (strcmp(p, "varint") == 0) {
+	    flags &= ~unsigned(BrassTable::FLAG_PACKED_POSTLISTS |
+			       BrassTable::FLAG_BITMAP_POSTLISTS);
+	} else {
+	    throw Xapian::InvalidArgumentError(string("Unknown postlist format '") +
+					       p + "' in XAPIAN_BRASS_POSTLIST_FORMAT");
+	}
+    }
+    p = getenv("XAPIAN_BRASS_DOCLEN_FORMAT");
+    if (p && *p) {
+	if (strcmp(p, "column") == 0) {
+	    flags |= BrassTable::FLAG_DOCLEN_COLUMN;
+	} else if (strcmp(p, "postlist") == 0) {
+	    flags &= ~unsigned(BrassTable::FLAG_DOCLEN_COLUMN);
+	} else {
+	    throw Xapian::InvalidArgumentError(string("Unknown doclen format '") +
+					       p + "' in XAPIAN_BRASS_DOCLEN_FORMAT");
+	}
+    }
+    p = getenv("XAPIAN_BRASS_VALUE_FORMAT");
+    if (p && *p) {
+	if (strcmp(p, "numeric") == 0) {
+	    flags |= BrassTable::FLAG_NUMERIC_VALUES;
+	} else if (strcmp(p, "string") == 0) {
+	    flags &= ~unsigned(BrassTable::FLAG_NUMERIC_VALUES);
+	} else {
+	    throw Xapian::InvalidArgumentError(string("Unknown value format '") +
+					       p + "' in XAPIAN_BRASS_VALUE_FORMAT");
+	}
+    }
+    parse_on_off("XAPIAN_BRASS_VALUE_SUMMARIES", BrassTable::FLAG_VALUE_SUMMARIES, flags);
+    RETURN(flags);
+}
+
+bool
+BrassPostListTable::configured_indexed_slots(set<Xapian::valueno> & slots)
+{
+    LOGCALL_STATIC(DB, bool, "BrassPostListTable::configured_indexed_slots", Literal("slots"));
+    const char * p = getenv("XAPIAN_BRASS_VALUE_INDEX");
+    if (!p || !*p) RETURN(false);
+    slots.clear();
+    if (strcmp(p, "none") == 0) RETURN(true);
+    while (true) {
+	char * end;
+	unsigned long slot = strtoul(p, &end, 10);
+	if (end == p || slot >= Xapian::BAD_VALUENO ||
+	    (*end != ',' && *end != '\0')) {
+	    throw Xapian::InvalidArgumentError(string("Bad list of value slots '") +
+					       getenv("XAPIAN_BRASS_VALUE_INDEX") +
+					       "' in XAPIAN_BRASS_VALUE_INDEX");
+	}
+	slots.insert(Xapian::valueno(slot));
+	if (*end == '\0') break;
+	p = end + 1;
+    }
+    RETURN(true);
+}
+
 Xapian::doccount
 BrassPostListTable::get_termfreq(const string & term) const
 {
@@ -60,9 +156,63 @@ BrassPostListTable::get_collection_freq(const string & term) const
     return collfreq;
 }
 
+void
+BrassPostListTable::get_freqs(const vector<string> & terms,
+			      vector<Xapian::doccount> & termfreqs,
+			      vector<Xapian::termcount> & collfreqs) const
+{
+    LOGCALL_VOID(DB, "BrassPostListTable::get_freqs", terms.size() | (void*)&termfreqs | (void*)&collfreqs);
+    vector<string> keys;
+    keys.reserve(terms.size());
+    vector<string>::const_iterator t;
+    for (t = terms.begin(); t != terms.end(); ++t) {
+	keys.push_back(make_key(*t));
+    }
+
+    vector<string> tags;
+    vector<bool> found;
+    get_exact_entries(keys, tags, found);
+
+    termfreqs.assign(terms.size(), 0);
+    collfreqs.assign(terms.size(), 0);
+    for (size_t i = 0; i != terms.size(); ++i) {
+	if (!found[i]) continue;
+	const char * p = tags[i].data();
+	BrassPostList::read_number_of_entries(&p, p + tags[i].size(),
+					      &termfreqs[i], &collfreqs[i]);
+    }
+}
+
+bool
+BrassPostListTable::get_doclength_from_column(Xapian::docid did,
+					      Xapian::termcount * doclen_ptr) const
+{
+    Xapian::docid chunk_no = (did - 1) / Brass::DOCLEN_COLUMN_CHUNK_SIZE;
+    if (chunk_no != doclen_column_chunk_no) {
+	if (!get_exact_entry(make_doclen_column_key(did), doclen_column_chunk)) {
+	    doclen_column_chunk.resize(0);
+	} else if (doclen_column_chunk.empty() ||
+		   doclen_column_chunk[0] == 0 ||
+		   static_cast<unsigned char>(doclen_column_chunk[0]) >
+		       sizeof(uint8)) {
+	    throw Xapian::DatabaseCorruptError("Bad chunk in doclen column");
+	}
+	doclen_column_chunk_no = chunk_no;
+    }
+    return Brass::read_doclen_column(doclen_column_chunk,
+				     (did - 1) % Brass::DOCLEN_COLUMN_CHUNK_SIZE,
+				     doclen_ptr);
+}
+
 Xapian::termcount
 BrassPostListTable::get_doclength(Xapian::docid did,
 				  intrusive_ptr<const BrassDatabase> db) const {
+    if (get_flags() & FLAG_DOCLEN_COLUMN) {
+	Xapian::termcount doclen;
+	if (!get_doclength_from_column(did, &doclen))
+	    throw Xapian::DocNotFoundError("Document " + str(did) + " not found");
+	return doclen;
+    }
     if (!doclen_pl.get()) {
 	// Don't keep a reference back to the database, since this
 	// would make a reference loop.
@@ -77,6 +227,10 @@ bool
 BrassPostListTable::document_exists(Xapian::docid did,
 				    intrusive_ptr<const BrassDatabase> db) const
 {
+    if (get_flags() & FLAG_DOCLEN_COLUMN) {
+	Xapian::termcount doclen;
+	return get_doclength_from_column(did, &doclen);
+    }
     if (!doclen_pl.get()) {
 	// Don't keep a reference back to the database, since this
 	// would make a reference loop.
@@ -128,6 +282,13 @@ class Brass::PostlistChunkWriter {
 	void flush(BrassTable *table);
 
     private:
+	/** Append the chunk's header and entries to @a tag.
+	 *
+	 *  The entries are bit-packed if @a table is set to write bit-packed
+	 *  chunks.
+	 */
+	void append_chunk(const BrassTable * table, string & tag) const;
+
 	string orig_key;
 	string tname;
 	bool is_first_chunk;
@@ -230,20 +391,31 @@ read_wdf(const char ** posptr, const char * end, Xapian::termcount * wdf_ptr)
     if (!unpack_uint(posptr, end, wdf_ptr)) report_read_error(*posptr);
 }
 
+/// Make the flags byte at the start of a chunk header.
+static inline char
+make_chunk_flags(bool is_last_chunk, unsigned encoding)
+{
+    return char('0' + ((is_last_chunk ? Brass::CHUNK_IS_LAST : 0) | encoding));
+}
+
 /// Read the start of a chunk.
 static Xapian::docid
 read_start_of_chunk(const char ** posptr,
 		    const char * end,
 		    Xapian::docid first_did_in_chunk,
-		    bool * is_last_chunk_ptr)
+		    bool * is_last_chunk_ptr,
+		    unsigned * encoding_ptr)
 {
-    LOGCALL_STATIC(DB, Xapian::docid, "read_start_of_chunk", reinterpret_cast<const void*>(posptr) | reinterpret_cast<const void*>(end) | first_did_in_chunk | reinterpret_cast<const void*>(is_last_chunk_ptr));
+    LOGCALL_STATIC(DB, Xapian::docid, "read_start_of_chunk", reinterpret_cast<const void*>(posptr) | reinterpret_cast<const void*>(end) | first_did_in_chunk | reinterpret_cast<const void*>(is_last_chunk_ptr) | reinterpret_cast<const void*>(encoding_ptr));
     Assert(is_last_chunk_ptr);
+    Assert(encoding_ptr);
 
-    // Read whether this is the last chunk
-    if (!unpack_bool(posptr, end, is_last_chunk_ptr))
+    // Read whether this is the last chunk, and how its entries are encoded.
+    if (!Brass::unpack_chunk_flags(posptr, end, is_last_chunk_ptr,
+				   encoding_ptr))
 	report_read_error(*posptr);
     LOGVALUE(DB, *is_last_chunk_ptr);
+    LOGVALUE(DB, *encoding_ptr);
 
     // Read what the final document ID in this chunk is.
     Xapian::docid increase_to_last;
@@ -254,6 +426,434 @@ read_start_of_chunk(const char ** posptr,
     RETURN(last_did_in_chunk);
 }
 
+/** Read the header of a bit-packed block.
+ *
+ *  This also checks that all the block's packed data is present.
+ *
+ *  @return false if the header is invalid or the data is truncated.
+ */
+static inline bool
+read_block_header(const char ** posptr, const char * end,
+		  unsigned * did_bits_ptr, unsigned * wdf_bits_ptr)
+{
+    const char * & pos = *posptr;
+    if (end - pos < 2) return false;
+    unsigned did_bits = static_cast<unsigned char>(*pos++);
+    unsigned wdf_bits = static_cast<unsigned char>(*pos++);
+    if (did_bits > 32 || wdf_bits > 32) return false;
+    if (size_t(end - pos) < bitpack_block_bytes(did_bits + wdf_bits))
+	return false;
+    *did_bits_ptr = did_bits;
+    *wdf_bits_ptr = wdf_bits;
+    return true;
+}
+
+/** A place to skip to in a chunk.
+ *
+ *  The first member is the docid of the entry before that place, relative
+ *  to the first docid in the chunk, and the second is the offset of that
+ *  place from the start of the encoded entries.
+ */
+typedef pair<Xapian::docid, size_t> chunk_skip;
+
+/** How many entries apart to put skip table entries in chunks which aren't
+ *  bit-packed.
+ *
+ *  Bit-packed chunks have a skip table entry for each block after the
+ *  first.
+ */
+const unsigned CHUNK_SKIP_INTERVAL = 64;
+
+/** Convert the entries of a postlist chunk to the bit-packed format.
+ *
+ *  In the bit-packed format, the number of entries is stored first.  Then
+ *  the entries are split into blocks of BITPACK_BLOCK_SIZE, each of which
+ *  is stored as the number of bits used for the docid increases and for
+ *  the wdfs (one byte each), followed by the docid increases and then the
+ *  wdfs bit-packed (see bitpack.h).  The increase for the first entry in
+ *  the chunk is stored as 0.  Any entries left over after the last full
+ *  block are stored as in the normal format.
+ *
+ *  @param pos	Start of the entries in the normal format.
+ *  @param end	End of the entries.
+ *  @param out	The bit-packed entries are appended to this.
+ *  @param skips	The start of each block after the first is appended to
+ *			this.
+ *
+ *  @return true if the entries were converted, or false if they can't
+ *	    usefully be (because there are too few for a block, or a value is
+ *	    too large to bit-pack).
+ */
+static bool
+pack_chunk_entries(const char * pos, const char * end, string & out,
+		   vector<chunk_skip> & skips)
+{
+    LOGCALL_STATIC(DB, bool, "pack_chunk_entries", (const void *)pos | (const void *)end | out | (void*)&skips);
+    vector<uint4> increases, wdfs;
+    Xapian::docid increase = 0;
+    while (true) {
+	Xapian::termcount wdf;
+	read_wdf(&pos, end, &wdf);
+	// We can only bit-pack values which fit in 32 bits.
+	if (uint4(increase) != increase || uint4(wdf) != wdf) RETURN(false);
+	increases.push_back(increase);
+	wdfs.push_back(wdf);
+	if (pos == end) break;
+	if (!unpack_uint(&pos, end, &increase)) report_read_error(pos);
+    }
+
+    size_t entries = wdfs.size();
+    if (entries < BITPACK_BLOCK_SIZE) RETURN(false);
+
+    size_t start = out.size();
+    pack_uint(out, entries);
+    Xapian::docid did = 0;
+    size_t i = 0;
+    while (entries - i >= BITPACK_BLOCK_SIZE) {
+	if (i) skips.push_back(chunk_skip(did, out.size() - start));
+	unsigned did_bits = bitpack_bits_needed(&increases[i],
+						BITPACK_BLOCK_SIZE);
+	unsigned wdf_bits = bitpack_bits_needed(&wdfs[i], BITPACK_BLOCK_SIZE);
+	out += char(did_bits);
+	out += char(wdf_bits);
+	bitpack_block(out, &increases[i], did_bits);
+	bitpack_block(out, &wdfs[i], wdf_bits);
+	for (size_t j = i; j != i + BITPACK_BLOCK_SIZE; ++j) {
+	    did += increases[j] + (j != 0);
+	}
+	i += BITPACK_BLOCK_SIZE;
+    }
+    for ( ; i != entries; ++i) {
+	pack_uint(out, increases[i]);
+	pack_uint(out, wdfs[i]);
+    }
+    RETURN(true);
+}
+
+/** Convert the entries of a bit-packed postlist chunk to the normal format.
+ *
+ *  @param pos	Start of the bit-packed entries.
+ *  @param end	End of the bit-packed entries.
+ *  @param out	The entries are appended to this.
+ *
+ *  @return false if the bit-packed data is corrupt.
+ */
+static bool
+unpack_chunk_entries(const char * pos, const char * end, string & out)
+{
+    LOGCALL_STATIC(DB, bool, "unpack_chunk_entries", (const void *)pos | (const void *)end | out);
+    Xapian::doccount entries;
+    if (!unpack_uint(&pos, end, &entries)) RETURN(false);
+    Xapian::doccount blocks = entries / BITPACK_BLOCK_SIZE;
+    if (blocks == 0) RETURN(false);
+
+    uint4 increases[BITPACK_BLOCK_SIZE];
+    uint4 wdfs[BITPACK_BLOCK_SIZE];
+    for (Xapian::doccount b = 0; b != blocks; ++b) {
+	unsigned did_bits, wdf_bits;
+	if (!read_block_header(&pos, end, &did_bits, &wdf_bits)) RETURN(false);
+	bitunpack_block(pos, increases, did_bits);
+	pos += bitpack_block_bytes(did_bits);
+	bitunpack_block(pos, wdfs, wdf_bits);
+	pos += bitpack_block_bytes(wdf_bits);
+	for (unsigned i = 0; i != BITPACK_BLOCK_SIZE; ++i) {
+	    // The first entry's increase isn't stored in the normal format.
+	    if (b || i) pack_uint(out, increases[i]);
+	    pack_uint(out, wdfs[i]);
+	}
+    }
+    // Any remaining entries are already in the normal format.
+    out.append(pos, end);
+    RETURN(true);
+}
+
+/// The fewest entries a chunk needs to be stored as a bitmap.
+const Xapian::doccount BITMAP_MIN_ENTRIES = 64;
+
+/** The sparsest chunk which is stored as a bitmap.
+ *
+ *  A chunk is only stored as a bitmap if at least one in this many of the
+ *  docids it spans has an entry, so the bitmap takes at most this many bits
+ *  per entry.
+ */
+const Xapian::docid BITMAP_MAX_SPAN_PER_ENTRY = 8;
+
+/** Convert the entries of a postlist chunk to a bitmap.
+ *
+ *  Bit i of the bitmap (see docid_bitmap_next()) is set if the chunk has an
+ *  entry for the docid i after its first.  The wdf isn't stored since all
+ *  the entries must have the same wdf.
+ *
+ *  @param pos	Start of the entries in the normal format.
+ *  @param end	End of the entries.
+ *  @param out	The bitmap is appended to this.
+ *  @param wdf_ptr	Set to the wdf of the entries.
+ *
+ *  @return true if the entries were converted, or false if they shouldn't
+ *	    be (because there are too few, they're too sparse, or their wdfs
+ *	    differ).
+ */
+static bool
+bitmap_chunk_entries(const char * pos, const char * end, string & out,
+		     Xapian::termcount * wdf_ptr)
+{
+    LOGCALL_STATIC(DB, bool, "bitmap_chunk_entries", (const void *)pos | (const void *)end | out | wdf_ptr);
+    read_wdf(&pos, end, wdf_ptr);
+    vector<Xapian::docid> offsets(1, 0);
+    Xapian::docid offset = 0;
+    while (pos != end) {
+	read_did_increase(&pos, end, &offset);
+	Xapian::termcount wdf;
+	read_wdf(&pos, end, &wdf);
+	if (wdf != *wdf_ptr) RETURN(false);
+	offsets.push_back(offset);
+    }
+    if (offsets.size() < BITMAP_MIN_ENTRIES ||
+	offset / BITMAP_MAX_SPAN_PER_ENTRY >= offsets.size())
+	RETURN(false);
+
+    size_t start = out.size();
+    out.append(offset / 8 + 1, '\0');
+    vector<Xapian::docid>::const_iterator i;
+    for (i = offsets.begin(); i != offsets.end(); ++i) {
+	out[start + *i / 8] |= char(1 << (*i % 8));
+    }
+    RETURN(true);
+}
+
+/** Convert a bitmap postlist chunk to the normal format.
+ *
+ *  @param wdf	The wdf of the entries.
+ *  @param pos	Start of the bitmap.
+ *  @param end	End of the bitmap.
+ *  @param out	The entries are appended to this.
+ *
+ *  @return false if the bitmap is corrupt.
+ */
+static bool
+unbitmap_chunk_entries(Xapian::termcount wdf,
+		       const char * pos, const char * end, string & out)
+{
+    LOGCALL_STATIC(DB, bool, "unbitmap_chunk_entries", wdf | (const void *)pos | (const void *)end | out);
+    if (pos == end || !(*pos & 1) || end[-1] == 0) RETURN(false);
+    const unsigned char * bitmap = reinterpret_cast<const unsigned char *>(pos);
+    Xapian::docid last = Xapian::docid(end - pos) * 8 - 1;
+    pack_uint(out, wdf);
+    Xapian::docid prev = 0;
+    while (true) {
+	Xapian::docid offset = docid_bitmap_next(bitmap, prev + 1, last);
+	if (offset > last) break;
+	pack_uint(out, offset - prev - 1);
+	pack_uint(out, wdf);
+	prev = offset;
+    }
+    RETURN(true);
+}
+
+/// Find where to put skip table entries for entries in the normal format.
+static void
+find_chunk_skips(const char * pos, const char * end,
+		 vector<chunk_skip> & skips)
+{
+    const char * start = pos;
+    Xapian::docid did = 0;
+    read_wdf(&pos, end, NULL);
+    for (unsigned i = 1; pos != end; ++i) {
+	if (i % CHUNK_SKIP_INTERVAL == 0)
+	    skips.push_back(chunk_skip(did, pos - start));
+	read_did_increase(&pos, end, &did);
+	read_wdf(&pos, end, NULL);
+    }
+}
+
+unsigned
+Brass::encode_chunk_entries(const char * pos, const char * end,
+			    string & out, unsigned flags)
+{
+    LOGCALL_STATIC(DB, unsigned, "Brass::encode_chunk_entries", (const void *)pos | (const void *)end | out | flags);
+    unsigned encoding = 0;
+    string entries;
+    vector<chunk_skip> skips;
+    if (pos != end && (flags & BrassTable::FLAG_BITMAP_POSTLISTS)) {
+	Xapian::termcount wdf;
+	if (bitmap_chunk_entries(pos, end, entries, &wdf)) {
+	    // The bitmap needs no skip table, since skip_to() can go straight
+	    // to the bit for a docid.
+	    pack_uint(out, wdf);
+	    out += entries;
+	    RETURN(CHUNK_IS_BITMAP | CHUNK_HAS_MAX_WDF);
+	}
+    }
+    if ((flags & BrassTable::FLAG_PACKED_POSTLISTS) &&
+	pack_chunk_entries(pos, end, entries, skips)) {
+	encoding = CHUNK_IS_PACKED;
+    } else if (pos != end) {
+	entries.assign(pos, end);
+	find_chunk_skips(pos, end, skips);
+    }
+
+    if (pos == end) {
+	out += entries;
+	RETURN(encoding);
+    }
+
+    // Find the largest wdf in each part of the chunk which the skip table
+    // points to.
+    vector<Xapian::termcount> wdf_maxes(skips.size() + 1, 0);
+    Xapian::docid did = 0;
+    size_t segment = 0;
+    while (true) {
+	Xapian::termcount wdf;
+	read_wdf(&pos, end, &wdf);
+	while (segment != skips.size() && did > skips[segment].first)
+	    ++segment;
+	if (wdf > wdf_maxes[segment]) wdf_maxes[segment] = wdf;
+	if (pos == end) break;
+	read_did_increase(&pos, end, &did);
+    }
+    pack_uint(out, *max_element(wdf_maxes.begin(), wdf_maxes.end()));
+    encoding |= CHUNK_HAS_MAX_WDF;
+
+    if (!skips.empty()) {
+	// The skip table is its length, then the largest wdf before the first
+	// place it points to, followed by the differences between successive
+	// docids and offsets and the largest wdf from each place on.
+	string table;
+	pack_uint(table, wdf_maxes[0]);
+	did = 0;
+	size_t offset = 0;
+	for (size_t i = 0; i != skips.size(); ++i) {
+	    pack_uint(table, skips[i].first - did);
+	    pack_uint(table, skips[i].second - offset);
+	    pack_uint(table, wdf_maxes[i + 1]);
+	    did = skips[i].first;
+	    offset = skips[i].second;
+	}
+	pack_uint(out, table.size());
+	out += table;
+	encoding |= CHUNK_HAS_SKIPS;
+    }
+    out += entries;
+    RETURN(encoding);
+}
+
+bool
+Brass::decode_chunk_entries(unsigned encoding,
+			    const char * pos, const char * end,
+			    string & out)
+{
+    LOGCALL_STATIC(DB, bool, "Brass::decode_chunk_entries", encoding | (const void *)pos | (const void *)end | out);
+    Xapian::termcount wdf_max = 0;
+    if (encoding & CHUNK_HAS_MAX_WDF) {
+	if (!unpack_uint(&pos, end, &wdf_max)) RETURN(false);
+    }
+    if (encoding & CHUNK_IS_BITMAP) {
+	if ((encoding & (CHUNK_IS_PACKED | CHUNK_HAS_SKIPS)) ||
+	    !(encoding & CHUNK_HAS_MAX_WDF))
+	    RETURN(false);
+	RETURN(unbitmap_chunk_entries(wdf_max, pos, end, out));
+    }
+    if (encoding & CHUNK_HAS_SKIPS) {
+	size_t table_len;
+	if (!unpack_uint(&pos, end, &table_len) ||
+	    table_len > size_t(end - pos))
+	    RETURN(false);
+	pos += table_len;
+    }
+    if (encoding & CHUNK_IS_PACKED)
+	RETURN(unpack_chunk_entries(pos, end, out));
+    out.append(pos, end);
+    RETURN(true);
+}
+
+void
+Brass::convert_chunk(string & chunk, bool is_last_chunk, unsigned flags)
+{
+    LOGCALL_STATIC_VOID(DB, "Brass::convert_chunk", chunk | is_last_chunk | flags);
+    const char * pos = chunk.data();
+    const char * end = pos + chunk.size();
+    bool old_is_last_chunk;
+    unsigned encoding;
+    Xapian::docid increase_to_last;
+    if (!unpack_chunk_flags(&pos, end, &old_is_last_chunk, &encoding) ||
+	!unpack_uint(&pos, end, &increase_to_last))
+	report_read_error(pos);
+
+    // Chunks written before the wdf bound was stored get converted so
+    // that they gain one.  If bitmaps are wanted, we need to convert any
+    // chunk which isn't one to see if it should be.
+    bool packed = (flags & BrassTable::FLAG_PACKED_POSTLISTS);
+    bool bitmap = (flags & BrassTable::FLAG_BITMAP_POSTLISTS);
+    bool same_format;
+    if (encoding & CHUNK_IS_BITMAP) {
+	same_format = bitmap;
+    } else {
+	same_format = (bool(encoding & CHUNK_IS_PACKED) == packed && !bitmap);
+    }
+    if (same_format && (pos == end || (encoding & CHUNK_HAS_MAX_WDF))) {
+	chunk[0] = make_chunk_flags(is_last_chunk, encoding);
+	return;
+    }
+
+    string entries;
+    if (!decode_chunk_entries(encoding, pos, end, entries))
+	throw Xapian::DatabaseCorruptError("Bad encoded posting list chunk");
+    string new_chunk;
+    new_chunk += '\0';
+    pack_uint(new_chunk, increase_to_last);
+    encoding = encode_chunk_entries(entries.data(),
+				    entries.data() + entries.size(),
+				    new_chunk, flags);
+    new_chunk[0] = make_chunk_flags(is_last_chunk, encoding);
+    chunk.swap(new_chunk);
+}
+
+string
+Brass::encode_doclen_column(const vector<uint8> & entries)
+{
+    uint8 max_entry = 0;
+    vector<uint8>::const_iterator i;
+    for (i = entries.begin(); i != entries.end(); ++i) {
+	if (*i > max_entry) max_entry = *i;
+    }
+    unsigned width = 1;
+    while (width < sizeof(uint8) && (max_entry >> (8 * width))) ++width;
+
+    string chunk;
+    chunk.reserve(1 + entries.size() * width);
+    chunk += char(width);
+    for (i = entries.begin(); i != entries.end(); ++i) {
+	uint8 entry = *i;
+	for (unsigned j = 0; j != width; ++j) {
+	    chunk += char(entry & 0xff);
+	    entry >>= 8;
+	}
+    }
+    return chunk;
+}
+
+bool
+Brass::decode_doclen_column(const string & chunk, vector<uint8> & entries)
+{
+    entries.clear();
+    if (chunk.empty()) return false;
+    size_t width = static_cast<unsigned char>(chunk[0]);
+    if (width == 0 || width > sizeof(uint8) || (chunk.size() - 1) % width)
+	return false;
+    size_t n = (chunk.size() - 1) / width;
+    if (n > DOCLEN_COLUMN_CHUNK_SIZE) return false;
+    entries.reserve(n);
+    const unsigned char * p =
+	reinterpret_cast<const unsigned char *>(chunk.data()) + 1;
+    for (size_t i = 0; i != n; ++i) {
+	uint8 entry = 0;
+	for (size_t j = width; j != 0; --j) entry = (entry << 8) | p[j - 1];
+	entries.push_back(entry);
+	p += width;
+    }
+    return true;
+}
+
 /** PostlistChunkReader is essentially an iterator wrapper
  *  around a postlist chunk.  It simply iterates through the
  *  entries in a postlist.
@@ -367,12 +967,13 @@ make_start_of_first_chunk(Xapian::doccount entries,
  */
 static inline string
 make_start_of_chunk(bool new_is_last_chunk,
+		    unsigned new_encoding,
 		    Xapian::docid new_first_did,
 		    Xapian::docid new_final_did)
 {
     Assert(new_final_did >= new_first_did);
     string chunk;
-    pack_bool(chunk, new_is_last_chunk);
+    chunk += make_chunk_flags(new_is_last_chunk, new_encoding);
     pack_uint(chunk, new_final_did - new_first_did);
     return chunk;
 }
@@ -382,6 +983,7 @@ write_start_of_chunk(string & chunk,
 		     unsigned int start_of_chunk_header,
 		     unsigned int end_of_chunk_header,
 		     bool is_last_chunk,
+		     unsigned encoding,
 		     Xapian::docid first_did_in_chunk,
 		     Xapian::docid last_did_in_chunk)
 {
@@ -389,8 +991,22 @@ write_start_of_chunk(string & chunk,
 
     chunk.replace(start_of_chunk_header,
 		  end_of_chunk_header - start_of_chunk_header,
-		  make_start_of_chunk(is_last_chunk, first_did_in_chunk,
-				      last_did_in_chunk));
+		  make_start_of_chunk(is_last_chunk, encoding,
+				      first_did_in_chunk, last_did_in_chunk));
+}
+
+void
+PostlistChunkWriter::append_chunk(const BrassTable * table,
+				  string & tag) const
+{
+    string entries;
+    unsigned encoding = Brass::encode_chunk_entries(chunk.data(),
+						    chunk.data() + chunk.size(),
+						    entries,
+						    table->get_flags());
+    tag += make_start_of_chunk(is_last_chunk, encoding,
+			       first_did, current_did);
+    tag += entries;
 }
 
 void
@@ -481,9 +1097,10 @@ PostlistChunkWriter::flush(BrassTable *table)
 
 	    // Read the chunk header
 	    bool new_is_last_chunk;
+	    unsigned new_encoding;
 	    Xapian::docid new_last_did_in_chunk =
 		read_start_of_chunk(&tagpos, tagend, new_first_did,
-				    &new_is_last_chunk);
+				    &new_is_last_chunk, &new_encoding);
 
 	    string chunk_data(tagpos, tagend);
 
@@ -494,8 +1111,9 @@ PostlistChunkWriter::flush(BrassTable *table)
 	    string tag;
 	    tag = make_start_of_first_chunk(num_ent, coll_freq, new_first_did);
 	    tag += make_start_of_chunk(new_is_last_chunk,
-					      new_first_did,
-					      new_last_did_in_chunk);
+				       new_encoding,
+				       new_first_did,
+				       new_last_did_in_chunk);
 	    tag += chunk_data;
 	    table->add(orig_key, tag);
 	    return;
@@ -543,10 +1161,11 @@ PostlistChunkWriter::flush(BrassTable *table)
 		    report_read_error(keypos);
 	    }
 	    bool wrong_is_last_chunk;
+	    unsigned encoding;
 	    string::size_type start_of_chunk_header = tagpos - tag.data();
 	    Xapian::docid last_did_in_chunk =
 		read_start_of_chunk(&tagpos, tagend, first_did_in_chunk,
-				    &wrong_is_last_chunk);
+				    &wrong_is_last_chunk, &encoding);
 	    string::size_type end_of_chunk_header = tagpos - tag.data();
 
 	    // write new is_last flag
@@ -554,6 +1173,7 @@ PostlistChunkWriter::flush(BrassTable *table)
 				 start_of_chunk_header,
 				 end_of_chunk_header,
 				 true, // is_last_chunk
+				 encoding,
 				 first_did_in_chunk,
 				 last_did_in_chunk);
 	    table->add(cursor->current_key, tag);
@@ -593,8 +1213,7 @@ PostlistChunkWriter::flush(BrassTable *table)
 
 	    tag = make_start_of_first_chunk(num_ent, coll_freq, first_did);
 
-	    tag += make_start_of_chunk(is_last_chunk, first_did, current_did);
-	    tag += chunk;
+	    append_chunk(table, tag);
 	    table->add(key, tag);
 	    return;
 	}
@@ -632,14 +1251,74 @@ PostlistChunkWriter::flush(BrassTable *table)
 	    new_key = orig_key;
 	}
 
-	// ...and write the start of this chunk.
-	tag = make_start_of_chunk(is_last_chunk, first_did, current_did);
-
-	tag += chunk;
+	// ...and write this chunk.
+	append_chunk(table, tag);
 	table->add(new_key, tag);
     }
 }
 
+/// Encode @a entries as a chunk and append it to @a chunks.
+static void
+add_rechunked(vector<pair<Xapian::docid, string> > & chunks,
+	      Xapian::docid first_did, Xapian::docid last_did,
+	      const string & entries, bool is_last_chunk, unsigned flags)
+{
+    string encoded;
+    unsigned encoding =
+	Brass::encode_chunk_entries(entries.data(),
+				    entries.data() + entries.size(),
+				    encoded, flags);
+    chunks.push_back(make_pair(first_did,
+			       make_start_of_chunk(is_last_chunk, encoding,
+						   first_did, last_did)));
+    chunks.back().second += encoded;
+}
+
+void
+Brass::rechunk_postlist(vector<pair<Xapian::docid, string> > & chunks,
+			unsigned flags)
+{
+    LOGCALL_STATIC_VOID(DB, "Brass::rechunk_postlist", chunks.size() | flags);
+    vector<pair<Xapian::docid, string> > result;
+    // The entries of the chunk being built, in the normal format.
+    string entries;
+    Xapian::docid first_did = 0, last_did = 0;
+    vector<pair<Xapian::docid, string> >::const_iterator i;
+    for (i = chunks.begin(); i != chunks.end(); ++i) {
+	const char * pos = i->second.data();
+	const char * end = pos + i->second.size();
+	bool is_last_chunk;
+	unsigned encoding;
+	(void)read_start_of_chunk(&pos, end, i->first, &is_last_chunk,
+				  &encoding);
+	string decoded;
+	if (!decode_chunk_entries(encoding, pos, end, decoded))
+	    throw Xapian::DatabaseCorruptError("Bad encoded posting list chunk");
+	PostlistChunkReader reader(i->first, decoded);
+	for ( ; !reader.is_at_end(); reader.next()) {
+	    Xapian::docid did = reader.get_docid();
+	    if (!entries.empty()) {
+		Assert(did > last_did);
+		// Start a new chunk once this one reaches the size at which
+		// PostlistChunkWriter would.
+		if (entries.size() >= CHUNKSIZE) {
+		    add_rechunked(result, first_did, last_did, entries, false,
+				  flags);
+		    entries.resize(0);
+		} else {
+		    pack_uint(entries, did - last_did - 1);
+		}
+	    }
+	    if (entries.empty()) first_did = did;
+	    pack_uint(entries, reader.get_wdf());
+	    last_did = did;
+	}
+    }
+    if (!entries.empty())
+	add_rechunked(result, first_did, last_did, entries, true, flags);
+    chunks.swap(result);
+}
+
 /** Read the number of entries in the posting list.
  *  This must only be called when *posptr is pointing to the start of
  *  the first chunk of the posting list.
@@ -664,12 +1343,37 @@ void BrassPostList::read_number_of_entries(const char ** posptr,
  *
  *  A chunk (except for the first chunk) contains:
  *
- *  1)  bool - true if this is the last chunk.
+ *  1)  flags - '0' plus CHUNK_IS_LAST if this is the last chunk, plus
+ *      CHUNK_IS_PACKED if the entries are bit-packed, plus CHUNK_HAS_SKIPS
+ *      if there's a skip table, plus CHUNK_HAS_MAX_WDF if the largest wdf
+ *      in the chunk is stored, plus CHUNK_IS_BITMAP if the entries are a
+ *      bitmap.
  *  2)  difference between final docid in chunk and first docid.
  *  3)  wdf for the first item.
  *  4)  increment in docid to next item, followed by wdf for the item.
  *  5)  (4) repeatedly.
  *
+ *  If the entries are bit-packed, (3) to (5) are replaced by the format
+ *  described for pack_chunk_entries().  If CHUNK_IS_BITMAP is set, they
+ *  are replaced by the bitmap described for bitmap_chunk_entries(), and
+ *  the wdf of every entry is the largest wdf.
+ *
+ *  If CHUNK_HAS_MAX_WDF is set, the largest wdf of any entry in the chunk
+ *  comes next after (2).
+ *
+ *  If there's a skip table, it comes between (2) (and the largest wdf) and
+ *  the entries.  It starts with its length in bytes, followed by a pair of
+ *  values for each place in the entries which skip_to() can jump to: the
+ *  increase in the docid of the entry before that place, and the increase
+ *  in the offset of that place from the start of the entries (both from the
+ *  previous pair, or from the first docid in the chunk and 0 for the first
+ *  pair).  If CHUNK_HAS_MAX_WDF is set, the table also has the largest wdf
+ *  of the entries before the first place just after its length, and the
+ *  largest wdf of the entries from each place up to the next as a third
+ *  value after each pair.  These bounds let next() and skip_to() skip over
+ *  chunks and parts of chunks which can't reach the weight the matcher
+ *  needs (the "block-max WAND" technique).
+ *
  *  The first chunk begins with the number of entries, the collection
  *  frequency, then the docid of the first document, then has the header of a
  *  standard chunk.
@@ -681,7 +1385,19 @@ BrassPostList::BrassPostList(intrusive_ptr<const BrassDatabase> this_db_,
 	  this_db(keep_reference ? this_db_ : NULL),
 	  have_started(false),
 	  is_at_end(false),
-	  cursor(this_db_->postlist_table.cursor_get())
+	  cursor(this_db_->postlist_table.cursor_get()),
+	  blocks_left(0),
+	  block_size(0),
+	  block_index(0),
+	  block_wdf_data(NULL),
+	  block_wdf_bits(0),
+	  chunk_blocks(0),
+	  bitmap(NULL),
+	  skip_pos(NULL),
+	  chunk_wdf_max(Xapian::termcount(-1)),
+	  segment_wdf_max(Xapian::termcount(-1)),
+	  chunk_max_weight(-1.0),
+	  segment_max_weight(-1.0)
 {
     LOGCALL_CTOR(DB, "BrassPostList", this_db_.get() | term_ | keep_reference);
     string key = BrassPostListTable::make_key(term);
@@ -702,9 +1418,10 @@ BrassPostList::BrassPostList(intrusive_ptr<const BrassDatabase> this_db_,
 
     did = read_start_of_first_chunk(&pos, end, &number_of_entries, NULL);
     first_did_in_chunk = did;
+    unsigned encoding;
     last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
-					    &is_last_chunk);
-    read_wdf(&pos, end, &wdf);
+					    &is_last_chunk, &encoding);
+    read_first_entry(encoding);
     LOGLINE(DB, "Initial docid " << did);
 }
 
@@ -722,10 +1439,223 @@ BrassPostList::get_doclength() const
     RETURN(this_db->get_doclength(did));
 }
 
+void
+BrassPostList::read_first_entry(unsigned encoding)
+{
+    LOGCALL_VOID(DB, "BrassPostList::read_first_entry", encoding);
+    blocks_left = 0;
+    block_size = 0;
+    block_index = 0;
+    chunk_blocks = 0;
+    bitmap = NULL;
+    skip_pos = NULL;
+    chunk_wdf_max = Xapian::termcount(-1);
+    chunk_max_weight = -1.0;
+    segment_max_weight = -1.0;
+    if (encoding & Brass::CHUNK_HAS_MAX_WDF) {
+	if (!unpack_uint(&pos, end, &chunk_wdf_max)) report_read_error(pos);
+    }
+    segment_wdf_max = chunk_wdf_max;
+    if (encoding & Brass::CHUNK_HAS_SKIPS) {
+	// Leave the skip table to be read if skip_to() needs it.
+	size_t table_len;
+	if (!unpack_uint(&pos, end, &table_len)) report_read_error(pos);
+	if (table_len > size_t(end - pos)) {
+	    throw Xapian::DatabaseCorruptError("Posting list chunk's skip table is truncated");
+	}
+	skip_pos = pos;
+	skip_end = pos + table_len;
+	pos = skip_end;
+	if (encoding & Brass::CHUNK_HAS_MAX_WDF) {
+	    if (!unpack_uint(&skip_pos, skip_end, &segment_wdf_max)) {
+		throw Xapian::DatabaseCorruptError("Bad skip table in posting list chunk");
+	    }
+	}
+	next_skip_ptr = pos;
+	next_skip_did = first_did_in_chunk;
+	skip_index = 0;
+	read_skip();
+    }
+
+    if (encoding & Brass::CHUNK_IS_BITMAP) {
+	// The bitmap must have a bit for each docid up to the last in the
+	// chunk (and no more bytes), with the bits for the first and last set.
+	Xapian::docid span = last_did_in_chunk - first_did_in_chunk;
+	if (!(encoding & Brass::CHUNK_HAS_MAX_WDF) ||
+	    size_t(end - pos) != span / 8 + 1 || !(*pos & 1) ||
+	    !(pos[span / 8] & (1 << (span % 8)))) {
+	    throw Xapian::DatabaseCorruptError("Bad bitmap posting list chunk");
+	}
+	bitmap = reinterpret_cast<const unsigned char *>(pos);
+	pos = end;
+	wdf = chunk_wdf_max;
+	return;
+    }
+
+    if (!(encoding & Brass::CHUNK_IS_PACKED)) {
+	read_wdf(&pos, end, &wdf);
+	return;
+    }
+
+    Xapian::doccount entries;
+    if (!unpack_uint(&pos, end, &entries)) report_read_error(pos);
+    blocks_left = entries / BITPACK_BLOCK_SIZE;
+    if (blocks_left == 0) {
+	throw Xapian::DatabaseCorruptError("Bit-packed posting list chunk has no blocks");
+    }
+    chunk_blocks = blocks_left;
+    read_block(first_did_in_chunk - 1);
+    read_block_wdfs();
+    did = block_did[0];
+    wdf = block_wdf[0];
+}
+
+void
+BrassPostList::read_skip()
+{
+    LOGCALL_VOID(DB, "BrassPostList::read_skip", NO_ARGS);
+    Assert(skip_pos);
+    if (skip_pos == skip_end) {
+	skip_pos = NULL;
+	return;
+    }
+    Xapian::docid did_increase;
+    size_t offset_increase;
+    if (!unpack_uint(&skip_pos, skip_end, &did_increase) ||
+	!unpack_uint(&skip_pos, skip_end, &offset_increase)) {
+	throw Xapian::DatabaseCorruptError("Bad skip table in posting list chunk");
+    }
+    if (chunk_wdf_max != Xapian::termcount(-1)) {
+	if (!unpack_uint(&skip_pos, skip_end, &next_skip_wdf_max)) {
+	    throw Xapian::DatabaseCorruptError("Bad skip table in posting list chunk");
+	}
+    } else {
+	next_skip_wdf_max = chunk_wdf_max;
+    }
+    next_skip_did += did_increase;
+    if (rare(offset_increase >= size_t(end - next_skip_ptr) ||
+	     next_skip_did >= last_did_in_chunk)) {
+	throw Xapian::DatabaseCorruptError("Skip table entry points past the end of posting list chunk");
+    }
+    next_skip_ptr += offset_increase;
+    ++skip_index;
+}
+
+void
+BrassPostList::skip_forward(Xapian::docid desired_did)
+{
+    LOGCALL_VOID(DB, "BrassPostList::skip_forward", desired_did);
+    const char * skip_ptr = NULL;
+    Xapian::docid skip_did = 0;
+    unsigned skip_block = 0;
+    while (skip_pos && next_skip_did < desired_did) {
+	if (next_skip_ptr >= pos) {
+	    skip_ptr = next_skip_ptr;
+	    skip_did = next_skip_did;
+	    // The nth skip table entry in a bit-packed chunk is for the
+	    // (n + 1)th block.
+	    skip_block = skip_index;
+	}
+	next_segment();
+    }
+    if (!skip_ptr) return;
+
+    LOGLINE(DB, "Skipping to offset " << (skip_ptr - pos) << " after docid " << skip_did);
+    pos = skip_ptr;
+    did = skip_did;
+    if (chunk_blocks) {
+	blocks_left = chunk_blocks - skip_block;
+	read_block(did);
+    }
+}
+
+void
+BrassPostList::skip_blocks_below(double w_min)
+{
+    LOGCALL_VOID(DB, "BrassPostList::skip_blocks_below", w_min);
+    while (!is_at_end) {
+	if (chunk_wdf_max == Xapian::termcount(-1)) return;
+	if (chunk_max_weight < 0)
+	    chunk_max_weight = get_maxweight_for_wdf(chunk_wdf_max);
+	if (chunk_max_weight < w_min) {
+	    LOGLINE(DB, "Skipping chunk ending at docid " << last_did_in_chunk);
+	    next_chunk();
+	    continue;
+	}
+
+	// Find the part of the chunk which the current entry is in.
+	while (skip_pos && next_skip_did < did) next_segment();
+	if (segment_max_weight < 0)
+	    segment_max_weight = get_maxweight_for_wdf(segment_wdf_max);
+	if (segment_max_weight >= w_min) return;
+
+	if (!skip_pos) {
+	    // The rest of the chunk can't reach w_min.
+	    next_chunk();
+	    continue;
+	}
+	LOGLINE(DB, "Skipping entries up to docid " << next_skip_did);
+	bool have_document = move_forward_in_chunk_to_at_least(next_skip_did + 1);
+	(void)have_document;
+	Assert(have_document);
+    }
+}
+
+void
+BrassPostList::read_block(Xapian::docid base)
+{
+    LOGCALL_VOID(DB, "BrassPostList::read_block", base);
+    Assert(blocks_left);
+    --blocks_left;
+    unsigned did_bits, wdf_bits;
+    if (!read_block_header(&pos, end, &did_bits, &wdf_bits)) {
+	throw Xapian::DatabaseCorruptError("Bad block in bit-packed posting list chunk");
+    }
+    uint4 increases[BITPACK_BLOCK_SIZE];
+    bitunpack_block(pos, increases, did_bits);
+    pos += bitpack_block_bytes(did_bits);
+    for (unsigned i = 0; i != BITPACK_BLOCK_SIZE; ++i) {
+	base += increases[i] + 1;
+	block_did[i] = base;
+    }
+    if (rare(base > last_did_in_chunk || base < block_did[0])) {
+	throw Xapian::DatabaseCorruptError("Document ID in bit-packed block of posting list is after the end of the chunk");
+    }
+    block_wdf_data = pos;
+    block_wdf_bits = wdf_bits;
+    pos += bitpack_block_bytes(wdf_bits);
+    block_size = BITPACK_BLOCK_SIZE;
+    block_index = 0;
+}
+
 bool
 BrassPostList::next_in_chunk()
 {
     LOGCALL(DB, bool, "BrassPostList::next_in_chunk", NO_ARGS);
+    if (bitmap) {
+	if (did == last_did_in_chunk) RETURN(false);
+	did = first_did_in_chunk +
+	    docid_bitmap_next(bitmap, did - first_did_in_chunk + 1,
+			      last_did_in_chunk - first_did_in_chunk);
+	RETURN(true);
+    }
+    if (block_size) {
+	if (usual(++block_index < block_size)) {
+	    did = block_did[block_index];
+	    wdf = block_wdf[block_index];
+	    RETURN(true);
+	}
+	if (blocks_left) {
+	    read_block(did);
+	    read_block_wdfs();
+	    did = block_did[0];
+	    wdf = block_wdf[0];
+	    RETURN(true);
+	}
+	// Move on to any entries after the last block.
+	block_size = 0;
+    }
+
     if (pos == end) RETURN(false);
 
     read_did_increase(&pos, end, &did);
@@ -780,9 +1710,10 @@ BrassPostList::next_chunk()
     end = pos + cursor->current_tag.size();
 
     first_did_in_chunk = did;
+    unsigned encoding;
     last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
-					    &is_last_chunk);
-    read_wdf(&pos, end, &wdf);
+					    &is_last_chunk, &encoding);
+    read_first_entry(encoding);
 }
 
 PositionList *
@@ -806,7 +1737,6 @@ PostList *
 BrassPostList::next(double w_min)
 {
     LOGCALL(DB, PostList *, "BrassPostList::next", w_min);
-    (void)w_min; // no warning
 
     if (!have_started) {
 	have_started = true;
@@ -814,6 +1744,8 @@ BrassPostList::next(double w_min)
 	if (!next_in_chunk()) next_chunk();
     }
 
+    if (w_min > 0 && weight) skip_blocks_below(w_min);
+
     if (is_at_end) {
 	LOGLINE(DB, "Moved to end");
     } else {
@@ -823,6 +1755,36 @@ BrassPostList::next(double w_min)
     RETURN(NULL);
 }
 
+PostList *
+BrassPostList::next_batch(double w_min, double w_stop, Xapian::doccount & n,
+			  Xapian::docid * docids, double * weights)
+{
+    LOGCALL(DB, PostList *, "BrassPostList::next_batch", w_min | w_stop | n);
+    if (w_min > 0 && weight) {
+	// Let next() skip any blocks which can't reach w_min.
+	RETURN(next_batch_helper(this, w_min, w_stop, n, docids, weights));
+    }
+
+    AssertRel(n,>,0);
+    Xapian::doccount count = 0;
+    while (true) {
+	if (have_started && block_size && block_index + 1 < block_size) {
+	    ++block_index;
+	    did = block_did[block_index];
+	    wdf = block_wdf[block_index];
+	} else {
+	    (void)BrassPostList::next(w_min);
+	    if (is_at_end) break;
+	}
+	docids[count] = did;
+	double wt = LeafPostList::get_weight();
+	weights[count] = wt;
+	if (++count == n || wt > w_stop) break;
+    }
+    n = count;
+    RETURN(NULL);
+}
+
 bool
 BrassPostList::current_chunk_contains(Xapian::docid desired_did)
 {
@@ -873,9 +1835,10 @@ BrassPostList::move_to_chunk_containing(Xapian::docid desired_did)
     }
 
     first_did_in_chunk = did;
+    unsigned encoding;
     last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
-					    &is_last_chunk);
-    read_wdf(&pos, end, &wdf);
+					    &is_last_chunk, &encoding);
+    read_first_entry(encoding);
 
     // Possible, since desired_did might be after end of this chunk and before
     // the next.
@@ -890,6 +1853,33 @@ BrassPostList::move_forward_in_chunk_to_at_least(Xapian::docid desired_did)
 	RETURN(true);
 
     if (desired_did <= last_did_in_chunk) {
+	if (bitmap) {
+	    // The last docid's bit is set, so there must be a set bit.
+	    did = first_did_in_chunk +
+		docid_bitmap_next(bitmap, desired_did - first_did_in_chunk,
+				  last_did_in_chunk - first_did_in_chunk);
+	    RETURN(true);
+	}
+	if (skip_pos) skip_forward(desired_did);
+	if (block_size) {
+	    // Skip any blocks which end before desired_did, without unpacking
+	    // their wdfs.
+	    while (block_did[block_size - 1] < desired_did && blocks_left) {
+		read_block(block_did[block_size - 1]);
+	    }
+	    if (block_did[block_size - 1] >= desired_did) {
+		read_block_wdfs();
+		block_index += docid_gallop(block_did + block_index,
+					    block_size - block_index,
+					    desired_did);
+		did = block_did[block_index];
+		wdf = block_wdf[block_index];
+		RETURN(true);
+	    }
+	    // desired_did is after the last block.
+	    did = block_did[block_size - 1];
+	    block_size = 0;
+	}
 	while (pos != end) {
 	    read_did_increase(&pos, end, &did);
 	    if (did >= desired_did) {
@@ -905,6 +1895,9 @@ BrassPostList::move_forward_in_chunk_to_at_least(Xapian::docid desired_did)
     }
 
     pos = end;
+    blocks_left = 0;
+    block_size = 0;
+    bitmap = NULL;
     RETURN(false);
 }
 
@@ -912,7 +1905,6 @@ PostList *
 BrassPostList::skip_to(Xapian::docid desired_did, double w_min)
 {
     LOGCALL(DB, PostList *, "BrassPostList::skip_to", desired_did | w_min);
-    (void)w_min; // no warning
     // We've started now - if we hadn't already, we're already positioned
     // at start so there's no need to actually do anything.
     have_started = true;
@@ -933,6 +1925,8 @@ BrassPostList::skip_to(Xapian::docid desired_did, double w_min)
     (void)have_document;
     Assert(have_document);
 
+    if (w_min > 0 && weight) skip_blocks_below(w_min);
+
     if (is_at_end) {
 	LOGLINE(DB, "Skipped to end");
     } else {
@@ -1032,8 +2026,15 @@ BrassPostListTable::get_chunk(const string &tname,
     }
 
     bool is_last_chunk;
+    unsigned encoding;
     Xapian::docid last_did_in_chunk;
-    last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk, &is_last_chunk);
+    last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
+					    &is_last_chunk, &encoding);
+    // The chunk reader and writer work with entries in the normal format.
+    string entries;
+    if (!Brass::decode_chunk_entries(encoding, pos, end, entries)) {
+	throw Xapian::DatabaseCorruptError("Bad encoded posting list chunk");
+    }
     *to = new PostlistChunkWriter(cursor->current_key, is_first_chunk, tname,
 				  is_last_chunk);
     if (did > last_did_in_chunk) {
@@ -1041,10 +2042,9 @@ BrassPostListTable::get_chunk(const string &tname,
 	// until I've a clearer picture of everything which needs to be done.
 	// (FIXME)
 	*from = NULL;
-	(*to)->raw_append(first_did_in_chunk, last_did_in_chunk,
-			  string(pos, end));
+	(*to)->raw_append(first_did_in_chunk, last_did_in_chunk, entries);
     } else {
-	*from = new PostlistChunkReader(first_did_in_chunk, string(pos, end));
+	*from = new PostlistChunkReader(first_did_in_chunk, entries);
     }
     if (is_last_chunk) RETURN(Xapian::docid(-1));
 
@@ -1067,6 +2067,57 @@ BrassPostListTable::get_chunk(const string &tname,
     RETURN(first_did_of_next_chunk - 1);
 }
 
+string
+BrassPostListTable::make_doclen_column_key(Xapian::docid did)
+{
+    string key("\0\xe8", 2);
+    pack_uint_preserving_sort(key, (did - 1) / Brass::DOCLEN_COLUMN_CHUNK_SIZE);
+    return key;
+}
+
+void
+BrassPostListTable::merge_doclen_column_changes(const map<Xapian::docid, Xapian::termcount> & doclens)
+{
+    LOGCALL_VOID(DB, "BrassPostListTable::merge_doclen_column_changes", doclens);
+    Assert(get_flags() & FLAG_DOCLEN_COLUMN);
+
+    // The cached chunk may be about to change.
+    doclen_column_chunk_no = Xapian::docid(-1);
+
+    map<Xapian::docid, Xapian::termcount>::const_iterator j = doclens.begin();
+    vector<uint8> entries;
+    while (j != doclens.end()) {
+	Xapian::docid chunk_no = (j->first - 1) / Brass::DOCLEN_COLUMN_CHUNK_SIZE;
+	string key = make_doclen_column_key(j->first);
+	string tag;
+	if (get_exact_entry(key, tag)) {
+	    if (!Brass::decode_doclen_column(tag, entries))
+		throw Xapian::DatabaseCorruptError("Bad chunk in doclen column");
+	} else {
+	    entries.clear();
+	}
+
+	// Apply the changes for all the docids in this chunk.
+	do {
+	    Xapian::docid i = (j->first - 1) % Brass::DOCLEN_COLUMN_CHUNK_SIZE;
+	    if (i >= entries.size()) entries.resize(i + 1, 0);
+	    if (j->second == DELETED_POSTING) {
+		entries[i] = 0;
+	    } else {
+		entries[i] = uint8(j->second) + 1;
+	    }
+	} while (++j != doclens.end() &&
+		 (j->first - 1) / Brass::DOCLEN_COLUMN_CHUNK_SIZE == chunk_no);
+
+	while (!entries.empty() && entries.back() == 0) entries.pop_back();
+	if (entries.empty()) {
+	    del(key);
+	} else {
+	    add(key, Brass::encode_doclen_column(entries));
+	}
+    }
+}
+
 void
 BrassPostListTable::merge_doclen_changes(const map<Xapian::docid, Xapian::termcount> & doclens)
 {
@@ -1083,7 +2134,7 @@ BrassPostListTable::merge_doclen_changes(const map<Xapian::docid, Xapian::termco
     if (!key_exists(current_key)) {
 	LOGLINE(DB, "Adding dummy first chunk");
 	string newtag = make_start_of_first_chunk(0, 0, 0);
-	newtag += make_start_of_chunk(true, 0, 0);
+	newtag += make_start_of_chunk(true, 0, 0, 0);
 	add(current_key, newtag);
     }
 
@@ -1153,17 +2204,20 @@ BrassPostListTable::merge_changes(const string &term,
 	Xapian::termcount collfreq;
 	Xapian::docid firstdid, lastdid;
 	bool islast;
+	unsigned encoding;
 	if (pos == end) {
 	    termfreq = 0;
 	    collfreq = 0;
 	    firstdid = 0;
 	    lastdid = 0;
 	    islast = true;
+	    encoding = 0;
 	} else {
 	    firstdid = read_start_of_first_chunk(&pos, end,
 						 &termfreq, &collfreq);
 	    // Handle the generic start of chunk header.
-	    lastdid = read_start_of_chunk(&pos, end, firstdid, &islast);
+	    lastdid = read_start_of_chunk(&pos, end, firstdid, &islast,
+					  &encoding);
 	}
 
 	termfreq += changes.get_tfdelta();
@@ -1190,7 +2244,7 @@ BrassPostListTable::merge_changes(const string &term,
 
 	// Rewrite start of first chunk to update termfreq and collfreq.
 	string newhdr = make_start_of_first_chunk(termfreq, collfreq, firstdid);
-	newhdr += make_start_of_chunk(islast, firstdid, lastdid);
+	newhdr += make_start_of_chunk(islast, encoding, firstdid, lastdid);
 	if (pos == end) {
 	    add(current_key, newhdr);
 	} else {
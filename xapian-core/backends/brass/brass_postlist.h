@@ -31,11 +31,15 @@
 #include "brass_types.h"
 #include "brass_positionlist.h"
 #include "api/leafpostlist.h"
+#include "bitpack.h"
+#include "internaltypes.h"
 #include "omassert.h"
 
 #include "autoptr.h"
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -45,6 +49,169 @@ class BrassDatabase;
 namespace Brass {
     class PostlistChunkReader;
     class PostlistChunkWriter;
+
+    /** Flags stored in the first byte of a postlist chunk's header.
+     *
+     *  The byte is '0' plus the flags, so a chunk which isn't bit-packed
+     *  and has no skip table has the same header as in older databases.
+     */
+    enum {
+	/// This is the last chunk in the posting list.
+	CHUNK_IS_LAST = 1,
+	/// The chunk's entries are in the bit-packed format.
+	CHUNK_IS_PACKED = 2,
+	/// The chunk's entries are preceded by a skip table.
+	CHUNK_HAS_SKIPS = 4,
+	/// The chunk stores an upper bound on the wdf of its entries.
+	CHUNK_HAS_MAX_WDF = 8,
+	/** The chunk's entries are stored as a bitmap of docids, all with
+	 *  the wdf stored for CHUNK_HAS_MAX_WDF.
+	 */
+	CHUNK_IS_BITMAP = 16
+    };
+
+    /** Decode the flags at the start of a postlist chunk's header.
+     *
+     *  @param is_last_chunk_ptr	Set to whether this is the last chunk.
+     *  @param encoding_ptr	Set to the flags which say how the chunk's
+     *				entries are encoded (CHUNK_IS_PACKED,
+     *				CHUNK_HAS_SKIPS, CHUNK_HAS_MAX_WDF and
+     *				CHUNK_IS_BITMAP).
+     *
+     *  @return false if the flags are invalid.
+     */
+    inline bool
+    unpack_chunk_flags(const char ** p, const char * end,
+		       bool * is_last_chunk_ptr, unsigned * encoding_ptr)
+    {
+	const char * & ptr = *p;
+	unsigned flags;
+	if (rare(ptr == end ||
+		 ((flags = static_cast<unsigned char>(*ptr++ - '0')) &
+		  ~unsigned(CHUNK_IS_LAST | CHUNK_IS_PACKED | CHUNK_HAS_SKIPS |
+			    CHUNK_HAS_MAX_WDF | CHUNK_IS_BITMAP)))) {
+	    ptr = NULL;
+	    return false;
+	}
+	*is_last_chunk_ptr = (flags & CHUNK_IS_LAST);
+	*encoding_ptr = flags & ~unsigned(CHUNK_IS_LAST);
+	return true;
+    }
+
+    /** Encode the entries of a postlist chunk.
+     *
+     *  The entries are stored as a bitmap if the table's flags allow it and
+     *  they're dense enough and all have the same wdf.  Otherwise they are
+     *  bit-packed if the flags allow it and there are enough of them, and a
+     *  skip table is added if there are enough entries for it to be useful.
+     *  The largest wdf in the chunk, and in each part of it which the skip
+     *  table points to, is stored too.
+     *
+     *  @param p	Start of the entries in the normal format.
+     *  @param end	End of the entries.
+     *  @param out	The encoded entries are appended to this.
+     *  @param flags	The postlist table's flags, which say which formats
+     *			to use (BrassTable::FLAG_PACKED_POSTLISTS and
+     *			BrassTable::FLAG_BITMAP_POSTLISTS).
+     *
+     *  @return The encoding used (suitable for unpack_chunk_flags()).
+     */
+    unsigned encode_chunk_entries(const char * p, const char * end,
+				  std::string & out, unsigned flags);
+
+    /** Convert the entries of a postlist chunk to the normal format.
+     *
+     *  @param encoding	How the entries are encoded.
+     *  @param p	Start of the encoded entries.
+     *  @param end	End of the encoded entries.
+     *  @param out	The entries are appended to this.
+     *
+     *  @return false if the encoded data is corrupt.
+     */
+    bool decode_chunk_entries(unsigned encoding,
+			      const char * p, const char * end,
+			      std::string & out);
+
+    /** Set the flags of a chunk and convert it to the requested format.
+     *
+     *  @param chunk	A chunk (without the extra header of a first chunk).
+     *  @param is_last_chunk	Whether the chunk is now the last chunk.
+     *  @param flags	The postlist table's flags, which say which formats
+     *			to use (see encode_chunk_entries()).
+     */
+    void convert_chunk(std::string & chunk, bool is_last_chunk,
+		       unsigned flags);
+
+    /** Split the chunks of a posting list afresh into chunks of the usual
+     *  size.
+     *
+     *  Merging posting lists by copying their chunks leaves a short chunk
+     *  at the end of each source's part of the list, so this is used to
+     *  repack them when that would leave a lot of short chunks.
+     *
+     *  @param chunks	The first docid and the chunk (without the extra
+     *			header of a first chunk) for each chunk in the
+     *			posting list, in order.  These are replaced by the
+     *			new chunks, in the format @a flags asks for and with
+     *			the last one marked as the last chunk.
+     *  @param flags	The postlist table's flags, which say which formats
+     *			to use (see encode_chunk_entries()).
+     */
+    void rechunk_postlist(std::vector<std::pair<Xapian::docid,
+						std::string> > & chunks,
+			  unsigned flags);
+
+    /// The number of docids covered by each chunk of the doclen column.
+    const Xapian::docid DOCLEN_COLUMN_CHUNK_SIZE = 512;
+
+    /** Encode a chunk of the document length column.
+     *
+     *  A chunk starts with a byte giving the number of bytes used for each
+     *  entry, followed by the entries for consecutive docids, stored
+     *  little-endian.  Each entry is the document length plus one, or 0 if
+     *  there's no such document.  Entries after the last document in the
+     *  chunk aren't stored.
+     *
+     *  @param entries	The entries for the docids the chunk covers, in
+     *			order.
+     */
+    std::string encode_doclen_column(const std::vector<uint8> & entries);
+
+    /** Decode a chunk of the document length column.
+     *
+     *  @param chunk	The encoded chunk.
+     *  @param entries	Set to the entries in the chunk.
+     *
+     *  @return false if the chunk is corrupt.
+     */
+    bool decode_doclen_column(const std::string & chunk,
+			      std::vector<uint8> & entries);
+
+    /** Read one document length from a chunk of the doclen column.
+     *
+     *  @param chunk	An encoded chunk (which must be valid).
+     *  @param index	The docid's offset from the start of the chunk.
+     *  @param doclen_ptr	Set to the document length if the document
+     *				exists.
+     *
+     *  @return false if there's no such document.
+     */
+    inline bool
+    read_doclen_column(const std::string & chunk, Xapian::docid index,
+		       Xapian::termcount * doclen_ptr)
+    {
+	if (chunk.empty()) return false;
+	size_t width = static_cast<unsigned char>(chunk[0]);
+	size_t offset = 1 + index * width;
+	if (offset + width > chunk.size()) return false;
+	const unsigned char * p =
+	    reinterpret_cast<const unsigned char *>(chunk.data()) + offset;
+	uint8 entry = 0;
+	for (size_t i = width; i != 0; --i) entry = (entry << 8) | p[i - 1];
+	if (entry == 0) return false;
+	*doclen_ptr = Xapian::termcount(entry - 1);
+	return true;
+    }
 }
 
 class BrassPostList;
@@ -53,6 +220,24 @@ class BrassPostListTable : public BrassTable {
 	/// PostList for looking up document lengths.
 	mutable AutoPtr<BrassPostList> doclen_pl;
 
+	/// The chunk of the doclen column last looked up.
+	mutable std::string doclen_column_chunk;
+
+	/** The number of the chunk in doclen_column_chunk.
+	 *
+	 *  This is Xapian::docid(-1) if no chunk has been read.
+	 */
+	mutable Xapian::docid doclen_column_chunk_no;
+
+	/** Look up a document length in the doclen column.
+	 *
+	 *  This must only be called if the table has FLAG_DOCLEN_COLUMN set.
+	 *
+	 *  @return false if there's no such document.
+	 */
+	bool get_doclength_from_column(Xapian::docid did,
+				       Xapian::termcount * doclen_ptr) const;
+
     public:
 	/** Create a new table object.
 	 *
@@ -68,20 +253,75 @@ class BrassPostListTable : public BrassTable {
 	 */
 	BrassPostListTable(const string & path_, bool readonly_)
 	    : BrassTable("postlist", path_ + "/postlist.", readonly_),
-	      doclen_pl()
+	      doclen_pl(), doclen_column_chunk_no(Xapian::docid(-1))
 	{ }
 
 	bool open(brass_revision_number_t revno) {
 	    doclen_pl.reset(0);
+	    doclen_column_chunk_no = Xapian::docid(-1);
 	    return BrassTable::open(revno);
 	}
 
+	/** Return the flags configured for new postlist tables.
+	 *
+	 *  The environment variable XAPIAN_BRASS_POSTLIST_FORMAT can be
+	 *  "packed" to write chunks with enough entries in the bit-packed
+	 *  format, "bitmap" to also write dense chunks as bitmaps, or
+	 *  "varint" for the normal format.
+	 *
+	 *  The environment variable XAPIAN_BRASS_DOCLEN_FORMAT can be
+	 *  "column" to keep a dense column of document lengths as well as the
+	 *  document length posting list, or "postlist" not to.
+	 *
+	 *  The environment variable XAPIAN_BRASS_VALUE_FORMAT can be
+	 *  "numeric" to store value stream chunks holding only integers
+	 *  encoded with Xapian::sortable_serialise() as numeric columns, or
+	 *  "string" not to.
+	 *
+	 *  The environment variable XAPIAN_BRASS_VALUE_SUMMARIES can be "on"
+	 *  to keep a summary of the range of values in each value stream
+	 *  chunk, or "off" not to.
+	 *
+	 *  @param flags	The flags to use for anything which isn't
+	 *			configured.
+	 *
+	 *  @return	The flags.
+	 *
+	 *  @exception Xapian::InvalidArgumentError if a variable names an
+	 *		   unknown format.
+	 */
+	static unsigned configured_flags(unsigned flags);
+
+	/** Return the value slots configured to have an index.
+	 *
+	 *  The environment variable XAPIAN_BRASS_VALUE_INDEX can be a
+	 *  comma-separated list of value slot numbers to keep an index of
+	 *  the values in, ordered by value, or "none".
+	 *
+	 *  @param slots	Set to the slots, if configured.
+	 *
+	 *  @return	true if the slots to index are configured.
+	 *
+	 *  @exception Xapian::InvalidArgumentError if the variable isn't a
+	 *		   valid list of slots.
+	 */
+	static bool configured_indexed_slots(std::set<Xapian::valueno> & slots);
+
 	/// Merge changes for a term.
 	void merge_changes(const string &term, const Inverter::PostingChanges & changes);
 
 	/// Merge document length changes.
 	void merge_doclen_changes(const map<Xapian::docid, Xapian::termcount> & doclens);
 
+	/** Merge document length changes into the doclen column.
+	 *
+	 *  This must only be called if the table has FLAG_DOCLEN_COLUMN set.
+	 */
+	void merge_doclen_column_changes(const map<Xapian::docid, Xapian::termcount> & doclens);
+
+	/// Compose the key for the chunk of the doclen column containing @a did.
+	static string make_doclen_column_key(Xapian::docid did);
+
 	Xapian::docid get_chunk(const string &tname,
 		Xapian::docid did, bool adding,
 		Brass::PostlistChunkReader ** from,
@@ -113,6 +353,15 @@ class BrassPostListTable : public BrassTable {
 	 */
 	Xapian::termcount get_collection_freq(const std::string & term) const;
 
+	/** Get the term and collection frequencies of several terms at once.
+	 *
+	 *  This is more efficient than calling get_termfreq() and
+	 *  get_collection_freq() for each term.
+	 */
+	void get_freqs(const std::vector<std::string> & terms,
+		       std::vector<Xapian::doccount> & termfreqs,
+		       std::vector<Xapian::termcount> & collfreqs) const;
+
 	/** Returns the length of document @a did. */
 	Xapian::termcount get_doclength(Xapian::docid did,
 					Xapian::Internal::intrusive_ptr<const BrassDatabase> db) const;
@@ -169,12 +418,153 @@ class BrassPostList : public LeafPostList {
 	/// The number of entries in the posting list.
 	Xapian::doccount number_of_entries;
 
+	/// The number of bit-packed blocks in the current chunk not yet read.
+	unsigned blocks_left;
+
+	/** The number of entries in block_did.
+	 *
+	 *  This is 0 unless the current entry is in a bit-packed block.
+	 */
+	unsigned block_size;
+
+	/// The index of the current entry in block_did.
+	unsigned block_index;
+
+	/// The docids in the current bit-packed block.
+	Xapian::docid block_did[BITPACK_BLOCK_SIZE];
+
+	/// The wdfs in the current bit-packed block.
+	uint4 block_wdf[BITPACK_BLOCK_SIZE];
+
+	/** The packed wdfs of the current block, if not yet unpacked.
+	 *
+	 *  The wdfs of blocks which skip_to() skips over are never unpacked.
+	 */
+	const char * block_wdf_data;
+
+	/// The number of bits each wdf at block_wdf_data is packed into.
+	unsigned block_wdf_bits;
+
+	/// The number of bit-packed blocks in the current chunk.
+	unsigned chunk_blocks;
+
+	/** The bitmap of the current chunk's entries.
+	 *
+	 *  This is NULL unless the current chunk is stored as a bitmap, in
+	 *  which case all its entries have wdf chunk_wdf_max.
+	 */
+	const unsigned char * bitmap;
+
+	/** Position of the next entry to read in the chunk's skip table.
+	 *
+	 *  This is NULL if the chunk has no skip table, or if next_skip_ptr
+	 *  and next_skip_did aren't valid.
+	 */
+	const char * skip_pos;
+
+	/// Pointer to the byte after the end of the chunk's skip table.
+	const char * skip_end;
+
+	/** The position in the chunk which the next skip table entry points
+	 *  to.
+	 *
+	 *  This is the start of an entry (or of a bit-packed block).
+	 */
+	const char * next_skip_ptr;
+
+	/// The docid of the entry before next_skip_ptr.
+	Xapian::docid next_skip_did;
+
+	/// The number of skip table entries read so far.
+	unsigned skip_index;
+
+	/** An upper bound on the wdf of the entries in the current chunk.
+	 *
+	 *  This is Xapian::termcount(-1) if the chunk doesn't store a bound.
+	 */
+	Xapian::termcount chunk_wdf_max;
+
+	/** An upper bound on the wdf of the entries in the part of the chunk
+	 *  which starts at the last skip table entry read (or at the start
+	 *  of the chunk if none have been read).
+	 */
+	Xapian::termcount segment_wdf_max;
+
+	/// The upper bound on the wdf of the part starting at next_skip_ptr.
+	Xapian::termcount next_skip_wdf_max;
+
+	/** Upper bound on the weight of entries in the current chunk.
+	 *
+	 *  This is calculated from chunk_wdf_max when first needed, and is
+	 *  negative until then.
+	 */
+	double chunk_max_weight;
+
+	/** Upper bound on the weight of entries in the current part of the
+	 *  chunk.
+	 *
+	 *  This is calculated from segment_wdf_max when first needed, and is
+	 *  negative until then.
+	 */
+	double segment_max_weight;
+
 	/// Copying is not allowed.
 	BrassPostList(const BrassPostList &);
 
 	/// Assignment is not allowed.
 	void operator=(const BrassPostList &);
 
+	/** Read the first entry of the chunk at pos.
+	 *
+	 *  @param encoding	How the chunk's entries are encoded.
+	 */
+	void read_first_entry(unsigned encoding);
+
+	/// Read the next entry in the chunk's skip table.
+	void read_skip();
+
+	/** Move on to the next part of the chunk in the skip table.
+	 *
+	 *  This updates segment_wdf_max and reads the next skip table entry,
+	 *  but doesn't change the current position.
+	 */
+	void next_segment() {
+	    segment_wdf_max = next_skip_wdf_max;
+	    segment_max_weight = -1.0;
+	    read_skip();
+	}
+
+	/** Skip any entries which can't have a weight of at least @a w_min.
+	 *
+	 *  This uses the upper bounds on the wdf stored for each chunk and
+	 *  for each part of a chunk in its skip table to skip over whole
+	 *  chunks and blocks of entries without decoding them.
+	 */
+	void skip_blocks_below(double w_min);
+
+	/** Use the chunk's skip table to move towards @a desired_did.
+	 *
+	 *  This moves to the last place in the skip table which is after the
+	 *  current position and before @a desired_did, if there is one.
+	 */
+	void skip_forward(Xapian::docid desired_did);
+
+	/** Read the docids of the next bit-packed block in the chunk.
+	 *
+	 *  The wdfs are left packed - call read_block_wdfs() to unpack them.
+	 *
+	 *  @param base	The docid of the entry before the block.
+	 */
+	void read_block(Xapian::docid base);
+
+	/// Unpack the wdfs of the current block, if not already done.
+	void read_block_wdfs() {
+	    if (block_wdf_data) {
+		bitunpack_block(block_wdf_data, block_wdf, block_wdf_bits);
+		block_wdf_data = NULL;
+	    }
+	}
+
 	/** Move to the next item in the chunk, if possible.
 	 *  If already at the end of the chunk, returns false.
 	 */
@@ -263,9 +653,44 @@ class BrassPostList : public LeafPostList {
 	/// Move to the next document.
 	PostList * next(double w_min);
 
+	/** Move through several documents.
+	 *
+	 *  Within a bit-packed block this steps through the decoded entries
+	 *  directly.
+	 */
+	PostList * next_batch(double w_min, double w_stop, Xapian::doccount & n,
+			      Xapian::docid * docids, double * weights);
+
 	/// Skip to next document with docid >= docid.
 	PostList * skip_to(Xapian::docid desired_did, double w_min);
 
+	/** Return the rest of the current bit-packed block's docids.
+	 *
+	 *  Entries which aren't in a bit-packed block aren't decoded ahead,
+	 *  so for those this returns NULL.
+	 */
+	const Xapian::docid * get_docid_block(size_t & n) const {
+	    if (!have_started || is_at_end || !block_size) return NULL;
+	    AssertEq(block_did[block_index], did);
+	    n = block_size - block_index;
+	    return block_did + block_index;
+	}
+
+	/** Return the current chunk's bitmap.
+	 *
+	 *  Chunks which aren't stored as bitmaps don't have one, so for those
+	 *  this returns NULL.
+	 */
+	const unsigned char * get_docid_bitmap(Xapian::docid & base,
+					       Xapian::docid & first,
+					       Xapian::docid & last) const {
+	    if (!have_started || is_at_end || !bitmap) return NULL;
+	    base = first_did_in_chunk;
+	    first = did;
+	    last = last_did_in_chunk;
+	    return bitmap;
+	}
+
 	/// Return true if and only if we're off the end of the list.
 	bool at_end() const { return is_at_end; }
 
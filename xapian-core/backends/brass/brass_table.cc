@@ -28,6 +28,7 @@
 #include <xapian/error.h>
 
 #include "safeerrno.h"
+#include "safesysstat.h"
 
 #include "omassert.h"
 #include "posixy_wrapper.h"
@@ -48,6 +49,9 @@
 // #define DANGEROUS
 
 #include <sys/types.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 // Trying to include the correct headers with the correct defines set to
 // get pread() and pwrite() prototyped on every platform without breaking any
@@ -62,9 +66,11 @@ PWRITE_PROTOTYPE
 #endif
 
 #include <cstdio>    /* for rename */
+#include <cstdlib>   /* for getenv */
 #include <cstring>   /* for memmove */
 #include <climits>   /* for CHAR_BIT */
 
+#include "blockruns.h"
 #include "brass_btreebase.h"
 #include "brass_cursor.h"
 
@@ -178,12 +184,46 @@ static inline byte *zeroed_new(size_t size)
 
 #define BYTE_PAIR_RANGE (1 << 2 * CHAR_BIT)
 
-/// read_block(n, p) reads block n of the DB file to address p.
-void
+/** read_block(n, p) reads block n of the DB file to address p.
+ *
+ *  If the table is using the shared block cache, the block is copied from
+ *  there if possible.  A block read from the file isn't added to the cache
+ *  here - the caller should call add_to_block_cache() once it has checked
+ *  the block is part of the revision we have open.
+ *
+ *  @return true if the block came from the shared block cache.
+ */
+bool
 BrassTable::read_block(uint4 n, byte * p) const
 {
     // Log the value of p, not the contents of the block it points to...
-    LOGCALL_VOID(DB, "BrassTable::read_block", n | (void*)p);
+    LOGCALL(DB, bool, "BrassTable::read_block", n | (void*)p);
+    if (block_cache && !writable &&
+	block_cache->lookup(block_cache_file, revision_number, n, p,
+			    block_size))
+	RETURN(true);
+    read_block_from_file(n, p);
+    RETURN(false);
+}
+
+/** add_to_block_cache(n, p) adds block n, read from the file to p, to the
+ *  shared block cache, if the table is using it.
+ */
+void
+BrassTable::add_to_block_cache(uint4 n, const byte * p) const
+{
+    LOGCALL_VOID(DB, "BrassTable::add_to_block_cache", n | (const void*)p);
+    // A block from a later revision has been overwritten since the revision
+    // we have open, so mustn't be shared with other readers of it.
+    if (block_cache && !writable && REVISION(p) <= revision_number)
+	block_cache->insert(block_cache_file, revision_number, n, p,
+			    block_size);
+}
+
+void
+BrassTable::read_block_from_file(uint4 n, byte * p) const
+{
+    LOGCALL_VOID(DB, "BrassTable::read_block_from_file", n | (void*)p);
     /* Use the base bit_map_size not the bitmap's size, because
      * the latter is uninitialised in readonly mode.
      */
@@ -225,6 +265,80 @@ BrassTable::read_block(uint4 n, byte * p) const
 #endif
 }
 
+/** mapped_block(n) returns the address of block n in the mapped DB file.
+ *
+ *  The revision a reader opened is fully written before its base file is,
+ *  so its blocks are all within the part of the file we mapped.  A block
+ *  number past the end must have come from a block a writer has since
+ *  reused, so we report the revision as discarded.
+ */
+byte *
+BrassTable::mapped_block(uint4 n) const
+{
+    LOGCALL(DB, byte *, "BrassTable::mapped_block", n);
+    Assert(mapping.get());
+    if (rare((off_t(n) + 1) * block_size > off_t(mapping->size))) {
+	set_overwritten();
+    }
+    RETURN(mapping->addr + size_t(block_size) * n);
+}
+
+/** copy_mapped_block(n, p) copies block n from the mapped DB file to p.
+ *
+ *  The mapping is shared, so a writer which reuses the block will change it
+ *  under us.  If the block in the mapping isn't from our revision once we've
+ *  copied it, the copy may be torn, so we report the revision as discarded.
+ *  If it is, the caller checks the copy like a block read from the file.
+ */
+void
+BrassTable::copy_mapped_block(uint4 n, byte * p) const
+{
+    LOGCALL_VOID(DB, "BrassTable::copy_mapped_block", n | (void*)p);
+    const byte * m = mapped_block(n);
+    memcpy(p, m, block_size);
+    if (rare(REVISION(m) > revision_number)) set_overwritten();
+}
+
+/** map_file() maps the DB file into memory, if enabled by the environment.
+ *
+ *  Only used for tables opened read-only.  If mapping the file fails, we
+ *  quietly fall back to reading blocks with read_block().
+ */
+void
+BrassTable::map_file()
+{
+    LOGCALL_VOID(DB, "BrassTable::map_file", NO_ARGS);
+    Assert(!writable);
+    Assert(!mapping.get());
+#ifdef HAVE_MMAP
+    const char *p = getenv("XAPIAN_BRASS_MMAP");
+    if (!p || !*p) return;
+
+    // A table with a faked root block has no blocks on disk to map, and
+    // the faked root block is built in a buffer owned by the table.
+    if (faked_root_block) return;
+
+    struct stat statbuf;
+    if (fstat(handle, &statbuf) < 0 || statbuf.st_size <= 0) return;
+    if (sizeof(size_t) < sizeof(off_t) &&
+	statbuf.st_size != off_t(size_t(statbuf.st_size))) {
+	// Too large to map in our address space.
+	return;
+    }
+    size_t size = size_t(statbuf.st_size);
+    void * m = mmap(NULL, size, PROT_READ, MAP_SHARED, handle, 0);
+    if (m == MAP_FAILED) return;
+    mapping = new Brass::Mapping(static_cast<byte *>(m), size);
+#endif
+}
+
+Brass::Mapping::~Mapping()
+{
+#ifdef HAVE_MMAP
+    (void)munmap(addr, size);
+#endif
+}
+
 /** write_block(n, p) writes block n in the DB file from address p.
  *  When writing we check to see if the DB file has already been
  *  modified. If not (so this is the first write) the old base is
@@ -258,6 +372,8 @@ BrassTable::write_block(uint4 n, const byte * p) const
 	latest_revision_number = revision_number;
     }
 
+    if (direct_handle >= 0 && write_block_direct(n, p)) return;
+
 #ifdef HAVE_PWRITE
     off_t offset = off_t(block_size) * n;
     int m = block_size;
@@ -294,6 +410,93 @@ BrassTable::write_block(uint4 n, const byte * p) const
 #endif
 }
 
+/// The alignment O_DIRECT needs for buffers (and offsets and lengths).
+#define DIRECT_IO_ALIGNMENT 4096
+
+/** open_direct_io() opens the DB file for writing with O_DIRECT, if enabled.
+ *
+ *  Enabled by setting XAPIAN_BRASS_DIRECT_IO to a non-empty value.  Writing
+ *  blocks with O_DIRECT means a large commit or compaction doesn't evict
+ *  the blocks other processes are reading from the page cache.  We still
+ *  read through the normal handle, and sync it when committing.  If O_DIRECT
+ *  isn't supported, we quietly fall back to writing through the page cache.
+ */
+void
+BrassTable::open_direct_io()
+{
+    LOGCALL_VOID(DB, "BrassTable::open_direct_io", NO_ARGS);
+    Assert(direct_handle < 0);
+#if defined O_DIRECT && defined HAVE_PWRITE
+    const char *p = getenv("XAPIAN_BRASS_DIRECT_IO");
+    if (!p || !*p) return;
+
+    // The blocks have to be a multiple of the alignment.
+    if (block_size % DIRECT_IO_ALIGNMENT != 0) return;
+
+    direct_handle = ::open((name + "DB").c_str(),
+			   O_WRONLY | O_DIRECT | O_BINARY | O_CLOEXEC);
+    if (direct_handle < 0) {
+	LOGLINE(DB, "Opening with O_DIRECT failed: " << strerror(errno));
+	return;
+    }
+    if (!direct_buf_storage) {
+	direct_buf_storage = new byte[block_size + DIRECT_IO_ALIGNMENT];
+	size_t misalign =
+	    reinterpret_cast<size_t>(direct_buf_storage) % DIRECT_IO_ALIGNMENT;
+	direct_buf = direct_buf_storage;
+	if (misalign) direct_buf += DIRECT_IO_ALIGNMENT - misalign;
+    }
+#endif
+}
+
+/** write_block_direct(n, p) writes block n from address p with O_DIRECT.
+ *
+ *  Returns false if the write failed in a way which suggests the file
+ *  system doesn't really support O_DIRECT, in which case we stop using it,
+ *  and the caller should write the block normally.
+ */
+bool
+BrassTable::write_block_direct(uint4 n, const byte * p) const
+{
+    LOGCALL(DB, bool, "BrassTable::write_block_direct", n | p);
+    Assert(direct_handle >= 0);
+#if defined O_DIRECT && defined HAVE_PWRITE
+    memcpy(direct_buf, p, block_size);
+    off_t offset = off_t(block_size) * n;
+    while (true) {
+	ssize_t bytes_written = pwrite(direct_handle, direct_buf, block_size,
+				       offset);
+	if (bytes_written == ssize_t(block_size)) RETURN(true);
+	if (bytes_written == -1) {
+	    if (errno == EINTR) continue;
+	    if (errno != EINVAL) {
+		string message = "Error writing block: ";
+		message += strerror(errno);
+		throw Xapian::DatabaseError(message);
+	    }
+	}
+	// EINVAL means the alignment isn't acceptable after all, and a
+	// partial write would leave the rest unaligned.  Either way, rewrite
+	// the block normally.
+	LOGLINE(DB, "Writing with O_DIRECT failed - falling back");
+	close_direct_io();
+	RETURN(false);
+    }
+#else
+    (void)n;
+    (void)p;
+    RETURN(false);
+#endif
+}
+
+void
+BrassTable::close_direct_io() const
+{
+    if (direct_handle >= 0) {
+	(void)::close(direct_handle);
+	direct_handle = -1;
+    }
+}
 
 /* A note on cursors:
 
@@ -324,9 +527,62 @@ BrassTable::set_overwritten() const
     // overwritten to be flagged, so that's a DatabaseCorruptError.
     if (writable)
 	throw Xapian::DatabaseCorruptError("Db block overwritten - are there multiple writers?");
+    // Other readers of this revision, or older ones, mustn't keep using
+    // cached copies of its blocks.
+    if (block_cache)
+	block_cache->discard(block_cache_file, revision_number + 1);
     throw Xapian::DatabaseModifiedError("The revision being read has been discarded - you should call Xapian::Database::reopen() and retry the operation");
 }
 
+void
+BrassTable::readahead(const Brass::Cursor * C_, uint4 & ra_n, int & ra_c) const
+{
+    LOGCALL_VOID(DB, "BrassTable::readahead", (const void*)C_ | ra_n | ra_c);
+    if (handle < 0) return;
+    if (sequential) {
+	// Leaf blocks are in order on disk, with just the occasional branch
+	// block between them, so read ahead a contiguous range of blocks.
+	uint4 n = C_[0].n;
+	uint4 first = n + 1;
+	if (ra_n != BLK_UNUSED && ra_n >= n) {
+	    if (ra_n - n > BRASS_READAHEAD_BLOCKS / 2) return;
+	    first = ra_n + 1;
+	}
+	uint4 last = min(n + BRASS_READAHEAD_BLOCKS, base.get_last_block());
+	if (first > last) return;
+	io_readahead(handle, off_t(block_size) * first,
+		     off_t(block_size) * (last - first + 1));
+	ra_n = last;
+	return;
+    }
+
+    if (level == 0) return;
+    // Read ahead the leaf blocks which the level 1 block points to after the
+    // current one, coalescing runs of adjacent blocks.
+    const byte * p = C_[1].p;
+    int c = C_[1].c + D2;
+    if (ra_n == C_[1].n && ra_c >= C_[1].c) {
+	if (ra_c - C_[1].c > (BRASS_READAHEAD_BLOCKS / 2) * D2) return;
+	c = ra_c + D2;
+    }
+    int end = min(int(DIR_END(p)), C_[1].c + (BRASS_READAHEAD_BLOCKS + 1) * D2);
+    if (c >= end) return;
+    BlockRuns runs;
+    uint4 run_start, run_len;
+    for (ra_c = c; ra_c < end; ra_c += D2) {
+	if (runs.add(Item(p, ra_c).block_given_by(), run_start, run_len)) {
+	    io_readahead(handle, off_t(block_size) * run_start,
+			 off_t(block_size) * run_len);
+	}
+    }
+    if (runs.flush(run_start, run_len)) {
+	io_readahead(handle, off_t(block_size) * run_start,
+		     off_t(block_size) * run_len);
+    }
+    ra_n = C_[1].n;
+    ra_c = end - D2;
+}
+
 /* block_to_cursor(C, j, n) puts block n into position C[j] of cursor
    C, writing the block currently at C[j] back to disk if necessary.
    Note that
@@ -343,7 +599,7 @@ BrassTable::block_to_cursor(Brass::Cursor * C_, int j, uint4 n) const
     LOGCALL_VOID(DB, "BrassTable::block_to_cursor", (void*)C_ | j | n);
     if (n == C_[j].n) return;
     byte * p = C_[j].p;
-    Assert(p);
+    Assert(p || mapping.get());
 
     // FIXME: only needs to be done in write mode
     if (C_[j].rewrite) {
@@ -353,13 +609,32 @@ BrassTable::block_to_cursor(Brass::Cursor * C_, int j, uint4 n) const
 	C_[j].rewrite = false;
     }
 
-    // Check if the block is in the built-in cursor (potentially in
-    // modified form).
-    if (writable && n == C[j].n) {
+    bool from_file = false;
+    if (mapping.get()) {
+	// n was read from the parent block in the mapping.  If a writer has
+	// reused that block since, n is garbage, so check before following
+	// it.  The check after reading block n below covers the parent being
+	// reused while we read it.
+	if (j < level && rare(REVISION(C_[j + 1].p) > revision_number)) {
+	    set_overwritten();
+	    return;
+	}
+	if (j == 0) {
+	    // Copy leaf blocks, since cursors read items from them long after
+	    // moving to them, by which time a writer may have reused them.
+	    copy_mapped_block(n, p);
+	} else {
+	    // Just point the cursor at the block in the mapped file.
+	    p = mapped_block(n);
+	    C_[j].p = p;
+	}
+    } else if (writable && n == C[j].n) {
+	// The block is in the built-in cursor (potentially in modified
+	// form).
 	if (p != C[j].p)
 	    memcpy(p, C[j].p, block_size);
     } else {
-	read_block(n, p);
+	from_file = !read_block(n, p);
     }
 
     C_[j].n = n;
@@ -369,6 +644,12 @@ BrassTable::block_to_cursor(Brass::Cursor * C_, int j, uint4 n) const
 	    set_overwritten();
 	    return;
 	}
+	// If the parent block is in the mapping, it could have been reused
+	// since we checked it, in which case n may not be from our revision.
+	if (mapping.get() && rare(REVISION(C_[j + 1].p) > revision_number)) {
+	    set_overwritten();
+	    return;
+	}
     }
 
     if (rare(j != GET_LEVEL(p))) {
@@ -380,6 +661,8 @@ BrassTable::block_to_cursor(Brass::Cursor * C_, int j, uint4 n) const
 	msg += str(GET_LEVEL(p));
 	throw Xapian::DatabaseCorruptError(msg);
     }
+
+    if (from_file) add_to_block_cache(n, p);
 }
 
 /** Btree::alter(); is called when the B-tree is to be altered.
@@ -1030,28 +1313,11 @@ BrassTable::add(const string &key, string tag, bool already_compressed)
 	CompileTimeAssert(DONT_COMPRESS != Z_RLE);
 #endif
 
-	comp_stream.lazy_alloc_deflate_zstream();
-
-	comp_stream.deflate_zstream->next_in = (Bytef *)const_cast<char *>(tag.data());
-	comp_stream.deflate_zstream->avail_in = (uInt)tag.size();
-
-	// If compressed size is >= tag.size(), we don't want to compress.
-	unsigned long blk_len = tag.size() - 1;
-	unsigned char * blk = new unsigned char[blk_len];
-	comp_stream.deflate_zstream->next_out = blk;
-	comp_stream.deflate_zstream->avail_out = (uInt)blk_len;
-
-	int err = deflate(comp_stream.deflate_zstream, Z_FINISH);
-	if (err == Z_STREAM_END) {
-	    // If deflate succeeded, then the output was at least one byte
-	    // smaller than the input.
-	    tag.assign(reinterpret_cast<const char *>(blk), comp_stream.deflate_zstream->total_out);
+	string compressed_tag;
+	if (get_tag_codec()->compress(tag, compressed_tag)) {
+	    swap(tag, compressed_tag);
 	    compressed = true;
-	} else {
-	    // Deflate failed - presumably the data wasn't compressible.
 	}
-
-	delete [] blk;
     }
 
     // sort of matching kt.append_chunk(), but setting the chunk
@@ -1190,6 +1456,93 @@ BrassTable::get_exact_entry(const string &key, string & tag) const
     RETURN(true);
 }
 
+namespace {
+
+/// Order indices into a vector of keys by the keys they index.
+class KeyIndexOrder {
+    const vector<string> & keys;
+
+  public:
+    explicit KeyIndexOrder(const vector<string> & keys_) : keys(keys_) { }
+
+    bool operator()(size_t a, size_t b) const { return keys[a] < keys[b]; }
+};
+
+}
+
+void
+BrassTable::get_exact_entries(const vector<string> & keys,
+			      vector<string> & tags,
+			      vector<bool> & found) const
+{
+    LOGCALL_VOID(DB, "BrassTable::get_exact_entries", keys.size() | (void*)&tags | (void*)&found);
+    tags.assign(keys.size(), string());
+    found.assign(keys.size(), false);
+
+    if (handle < 0) {
+	if (handle == -2) {
+	    BrassTable::throw_database_closed();
+	}
+	return;
+    }
+
+    vector<size_t> order;
+    order.reserve(keys.size());
+    for (size_t i = 0; i != keys.size(); ++i) {
+	Assert(!keys[i].empty());
+	// An oversized key can't exist, so don't search for it.
+	if (keys[i].size() <= BRASS_BTREE_MAX_KEY_LEN)
+	    order.push_back(i);
+    }
+    // The B-tree compares keys bytewise, just like std::string does.
+    sort(order.begin(), order.end(), KeyIndexOrder(keys));
+
+    vector<size_t>::const_iterator i;
+    if (!writable && level > 0 && order.size() > 1) {
+	// Find the leaf block each key is in (which only needs to read
+	// branch blocks), and issue readahead for them all.
+	vector<uint4> leaves;
+	for (i = order.begin(); i != order.end(); ++i) {
+	    form_key(keys[*i]);
+	    Key key = kt.key();
+	    for (int j = level; j > 0; --j) {
+		const byte * p = C[j].p;
+		int c = find_in_block(p, key, false, C[j].c);
+		C[j].c = c;
+		uint4 n = Item(p, c).block_given_by();
+		if (j > 1) {
+		    block_to_cursor(C, j - 1, n);
+		} else if (leaves.empty() || leaves.back() != n) {
+		    leaves.push_back(n);
+		}
+	    }
+	}
+	sort(leaves.begin(), leaves.end());
+	// Coalesce runs of adjacent blocks.
+	BlockRuns runs;
+	uint4 first, count;
+	vector<uint4>::const_iterator l;
+	for (l = leaves.begin(); l != leaves.end(); ++l) {
+	    if (runs.add(*l, first, count)) {
+		io_readahead(handle, off_t(block_size) * first,
+			     off_t(block_size) * count);
+	    }
+	}
+	if (runs.flush(first, count)) {
+	    io_readahead(handle, off_t(block_size) * first,
+			 off_t(block_size) * count);
+	}
+    }
+
+    for (i = order.begin(); i != order.end(); ++i) {
+	form_key(keys[*i]);
+	if (find(C)) {
+	    (void)read_tag(C, &tags[*i], false);
+	    found[*i] = true;
+	}
+    }
+}
+
 bool
 BrassTable::key_exists(const string &key) const
 {
@@ -1235,54 +1588,7 @@ BrassTable::read_tag(Brass::Cursor * C_, string *tag, bool keep_compressed) cons
     // at once.
 
     string utag;
-    // May not be enough for a compressed tag, but it's a reasonable guess.
-    utag.reserve(tag->size() + tag->size() / 2);
-
-    Bytef buf[8192];
-
-    comp_stream.lazy_alloc_inflate_zstream();
-
-    comp_stream.inflate_zstream->next_in = (Bytef*)const_cast<char *>(tag->data());
-    comp_stream.inflate_zstream->avail_in = (uInt)tag->size();
-
-    int err = Z_OK;
-    while (err != Z_STREAM_END) {
-	comp_stream.inflate_zstream->next_out = buf;
-	comp_stream.inflate_zstream->avail_out = (uInt)sizeof(buf);
-	err = inflate(comp_stream.inflate_zstream, Z_SYNC_FLUSH);
-	if (err == Z_BUF_ERROR && comp_stream.inflate_zstream->avail_in == 0) {
-	    LOGLINE(DB, "Z_BUF_ERROR - faking checksum of " << comp_stream.inflate_zstream->adler);
-	    Bytef header2[4];
-	    setint4(header2, 0, comp_stream.inflate_zstream->adler);
-	    comp_stream.inflate_zstream->next_in = header2;
-	    comp_stream.inflate_zstream->avail_in = 4;
-	    err = inflate(comp_stream.inflate_zstream, Z_SYNC_FLUSH);
-	    if (err == Z_STREAM_END) break;
-	}
-
-	if (err != Z_OK && err != Z_STREAM_END) {
-	    if (err == Z_MEM_ERROR) throw std::bad_alloc();
-	    string msg = "inflate failed";
-	    if (comp_stream.inflate_zstream->msg) {
-		msg += " (";
-		msg += comp_stream.inflate_zstream->msg;
-		msg += ')';
-	    }
-	    throw Xapian::DatabaseError(msg);
-	}
-
-	utag.append(reinterpret_cast<const char *>(buf),
-		    comp_stream.inflate_zstream->next_out - buf);
-    }
-    if (utag.size() != comp_stream.inflate_zstream->total_out) {
-	string msg = "compressed tag didn't expand to the expected size: ";
-	msg += str(utag.size());
-	msg += " != ";
-	// OpenBSD's zlib.h uses off_t instead of uLong for total_out.
-	msg += str((size_t)comp_stream.inflate_zstream->total_out);
-	throw Xapian::DatabaseCorruptError(msg);
-    }
-
+    get_tag_codec()->decompress(*tag, utag);
     swap(*tag, utag);
 
     RETURN(false);
@@ -1415,6 +1721,8 @@ BrassTable::basic_open(bool revision_supplied, brass_revision_number_t revision_
 	item_count =       base.get_item_count();
 	faked_root_block = base.get_have_fakeroot();
 	sequential =       base.get_sequential();
+	use_codec(base.get_codec(), base.get_dictionary());
+	flags =            base.get_flags();
 
 	if (other_base != 0) {
 	    latest_revision_number = other_base->get_revision();
@@ -1490,9 +1798,9 @@ BrassTable::do_open_to_write(bool revision_supplied,
     if (handle == -2) {
 	BrassTable::throw_database_closed();
     }
-    int flags = O_RDWR | O_BINARY | O_CLOEXEC;
-    if (create_db) flags |= O_CREAT | O_TRUNC;
-    handle = ::open((name + "DB").c_str(), flags, 0666);
+    int open_flags = O_RDWR | O_BINARY | O_CLOEXEC;
+    if (create_db) open_flags |= O_CREAT | O_TRUNC;
+    handle = ::open((name + "DB").c_str(), open_flags, 0666);
     if (handle < 0) {
 	// lazy doesn't make a lot of sense with create_db anyway, but ENOENT
 	// with O_CREAT means a parent directory doesn't exist.
@@ -1507,6 +1815,8 @@ BrassTable::do_open_to_write(bool revision_supplied,
 	throw Xapian::DatabaseOpeningError(message);
     }
 
+    register_with_block_cache();
+
     if (!basic_open(revision_supplied, revision_)) {
 	::close(handle);
 	handle = -1;
@@ -1520,6 +1830,7 @@ BrassTable::do_open_to_write(bool revision_supplied,
     }
 
     writable = true;
+    open_direct_io();
 
     for (int j = 0; j <= level; j++) {
 	C[j].n = BLK_UNUSED;
@@ -1567,7 +1878,19 @@ BrassTable::BrassTable(const char * tablename_, const string & path_,
 	  split_p(0),
 	  compress_strategy(compress_strategy_),
 	  comp_stream(compress_strategy_),
-	  lazy(lazy_)
+	  codec_for_create(-1),
+	  codec(BrassCodec::ZLIB),
+	  tag_codec(NULL),
+	  flags_for_create(0),
+	  flags(0),
+	  lazy(lazy_),
+	  block_cache(NULL),
+	  block_cache_file(0),
+	  mapping(NULL),
+	  commit_base_fd(-1),
+	  direct_handle(-1),
+	  direct_buf_storage(NULL),
+	  direct_buf(NULL)
 {
     LOGCALL_CTOR(DB, "BrassTable", tablename_ | path_ | readonly_ | compress_strategy_ | lazy_);
 }
@@ -1590,6 +1913,36 @@ BrassTable::erase()
     (void)io_unlink(name + "DB");
 }
 
+void
+BrassTable::use_block_cache(const string & db_id)
+{
+    LOGCALL_VOID(DB, "BrassTable::use_block_cache", db_id);
+    block_cache_id = db_id;
+}
+
+void
+BrassTable::register_with_block_cache()
+{
+    LOGCALL_VOID(DB, "BrassTable::register_with_block_cache", NO_ARGS);
+    block_cache = NULL;
+    if (block_cache_id.empty()) return;
+    BlockCache * cache = BlockCache::get_instance();
+    struct stat statbuf;
+    if (!cache || fstat(handle, &statbuf) < 0) return;
+    // Copies of a database have the same UUID, and if they're modified
+    // separately they can reach the same revision with different blocks, so
+    // we need to identify the file itself too.
+    string id(block_cache_id);
+    id += '/';
+    id += tablename;
+    id += '/';
+    id += str(static_cast<unsigned long long>(statbuf.st_dev));
+    id += ':';
+    id += str(static_cast<unsigned long long>(statbuf.st_ino));
+    block_cache = cache;
+    block_cache_file = cache->register_file(id);
+}
+
 void
 BrassTable::set_block_size(unsigned int block_size_)
 {
@@ -1602,6 +1955,87 @@ BrassTable::set_block_size(unsigned int block_size_)
     block_size = block_size_;
 }
 
+bool
+BrassTable::get_table_setting(const char * envvar, const char * tablename_,
+			      string & value)
+{
+    LOGCALL_STATIC(DB, bool, "BrassTable::get_table_setting", envvar | tablename_ | value);
+    static const char * const table_names[] = {
+	"postlist", "position", "termlist", "synonym", "spelling", "impact",
+	"record"
+    };
+    const char * p = getenv(envvar);
+    if (!p) RETURN(false);
+    bool found = false;
+    bool table_specific = false;
+    while (*p) {
+	const char * comma = strchr(p, ',');
+	if (!comma) comma = p + strlen(p);
+	string entry(p, comma - p);
+	p = *comma ? comma + 1 : comma;
+	if (entry.empty()) continue;
+
+	string::size_type eq = entry.find('=');
+	if (eq == string::npos) {
+	    // A default for all tables, unless overridden.
+	    if (!found) {
+		value = entry;
+		found = true;
+	    }
+	    continue;
+	}
+
+	// Check every table name, not just those up to a match, so that a
+	// typo is reported whichever table is opened first.
+	string name(entry, 0, eq);
+	const char * const * t = table_names;
+	const char * const * t_end = t + sizeof(table_names) / sizeof(table_names[0]);
+	while (t != t_end && name != *t) ++t;
+	if (t == t_end) {
+	    string msg = "Unknown table '";
+	    msg += name;
+	    msg += "' in ";
+	    msg += envvar;
+	    throw Xapian::InvalidArgumentError(msg);
+	}
+
+	if (!table_specific && name == tablename_) {
+	    // A table-specific setting takes precedence, wherever it is in the
+	    // list.
+	    value.assign(entry, eq + 1, string::npos);
+	    found = table_specific = true;
+	}
+    }
+    RETURN(found);
+}
+
+unsigned int
+BrassTable::configured_block_size(const char * tablename_,
+				  unsigned int block_size_)
+{
+    LOGCALL_STATIC(DB, unsigned int, "BrassTable::configured_block_size", tablename_ | block_size_);
+    string value;
+    if (!get_table_setting("XAPIAN_BRASS_BLOCK_SIZE", tablename_, value))
+	RETURN(block_size_);
+    char * end;
+    unsigned long n = strtoul(value.c_str(), &end, 10);
+    if (n <= 64 && (*end == 'K' || *end == 'k')) {
+	++end;
+	n *= 1024;
+    }
+    if (value.empty() || *end || n < 2048 || n > BYTE_PAIR_RANGE ||
+	(n & (n - 1)) != 0) {
+	string msg = "Bad block size '";
+	msg += value;
+	msg += "' for table ";
+	msg += tablename_;
+	msg += " in XAPIAN_BRASS_BLOCK_SIZE - must be a power of 2 between "
+	       "2K and 64K";
+	throw Xapian::InvalidArgumentError(msg);
+    }
+    RETURN(unsigned(n));
+}
+
 void
 BrassTable::create_and_open(unsigned int block_size_)
 {
@@ -1615,6 +2049,19 @@ BrassTable::create_and_open(unsigned int block_size_)
     if (block_size_ == 0) abort();
     set_block_size(block_size_);
 
+    int new_codec = codec_for_create;
+    if (new_codec < 0) {
+	new_codec = BrassCodec::ZLIB;
+	if (compress_strategy != DONT_COMPRESS) {
+	    int configured = BrassCodec::configured_for_table(tablename);
+	    if (configured >= 0) new_codec = configured;
+	}
+    }
+    use_codec(new_codec, dictionary_for_create);
+    // Check now that the codec is supported, rather than failing when we
+    // first try to add a tag.
+    if (compress_strategy != DONT_COMPRESS) (void)get_tag_codec();
+
     // FIXME: it would be good to arrange that this works such that there's
     // always a valid table in place if you run create_and_open() on an
     // existing table.
@@ -1627,6 +2074,10 @@ BrassTable::create_and_open(unsigned int block_size_)
     base_.set_block_size(block_size_);
     base_.set_have_fakeroot(true);
     base_.set_sequential(true);
+    base_.set_codec(codec);
+    base_.set_dictionary(dictionary);
+    flags = flags_for_create;
+    base_.set_flags(flags);
     base_.write_to_file(name + "baseA", 'A', string(), -1, NULL);
 
     /* remove the alternative base file, if any */
@@ -1639,6 +2090,17 @@ BrassTable::create_and_open(unsigned int block_size_)
 BrassTable::~BrassTable() {
     LOGCALL_DTOR(DB, "BrassTable");
     BrassTable::close();
+    delete tag_codec;
+}
+
+void
+BrassTable::use_codec(int codec_, const string & dictionary_)
+{
+    if (codec_ == codec && dictionary_ == dictionary) return;
+    codec = codec_;
+    dictionary = dictionary_;
+    delete tag_codec;
+    tag_codec = NULL;
 }
 
 void BrassTable::close(bool permanent) {
@@ -1650,6 +2112,7 @@ void BrassTable::close(bool permanent) {
 	(void)::close(handle);
 	handle = -1;
     }
+    close_direct_io();
 
     if (permanent) {
 	handle = -2;
@@ -1658,9 +2121,15 @@ void BrassTable::close(bool permanent) {
 	return;
     }
     for (int j = level; j >= 0; j--) {
-	delete [] C[j].p;
+	// If the file is mapped, C[j].p points into the mapping above the
+	// leaf level.
+	if (j == 0 || !mapping.get()) delete [] C[j].p;
 	C[j].p = 0;
     }
+    // Cursors keep the mapping alive while they point into it, and the
+    // version change makes them rebuild before moving again.
+    mapping = NULL;
+    ++cursor_version;
     delete [] split_p;
     split_p = 0;
 
@@ -1668,6 +2137,9 @@ void BrassTable::close(bool permanent) {
     kt = 0;
     delete [] buffer;
     buffer = 0;
+    delete [] direct_buf_storage;
+    direct_buf_storage = 0;
+    direct_buf = 0;
 }
 
 void
@@ -1698,7 +2170,23 @@ BrassTable::commit(brass_revision_number_t revision, int changes_fd,
 		   const string * changes_tail)
 {
     LOGCALL_VOID(DB, "BrassTable::commit", revision | changes_fd | changes_tail);
+    try {
+	commit_start(revision, changes_fd, changes_tail);
+	commit_sync();
+	commit_finish();
+    } catch (...) {
+	commit_abandon();
+	throw;
+    }
+}
+
+void
+BrassTable::commit_start(brass_revision_number_t revision, int changes_fd,
+			 const string * changes_tail)
+{
+    LOGCALL_VOID(DB, "BrassTable::commit_start", revision | changes_fd | changes_tail);
     Assert(writable);
+    Assert(commit_base_fd < 0);
 
     if (revision <= revision_number) {
 	throw Xapian::DatabaseError("New revision too low");
@@ -1741,23 +2229,55 @@ BrassTable::commit(brass_revision_number_t revision, int changes_fd,
 
 	// Save to "<table>.tmp" and then rename to "<table>.base<letter>" so
 	// that a reader can't try to read a partially written base file.
+	string tmp = name;
+	tmp += "tmp";
+	base.write_to_file(tmp, base_letter, tablename, changes_fd, changes_tail,
+			   &commit_base_fd);
+
+	// Start writing back the blocks and base file now, so this can happen
+	// while other tables are being committed.
+	io_start_sync(handle);
+	io_start_sync(commit_base_fd);
+    } catch (...) {
+	BrassTable::close();
+	throw;
+    }
+}
+
+void
+BrassTable::commit_sync()
+{
+    LOGCALL_VOID(DB, "BrassTable::commit_sync", NO_ARGS);
+    if (commit_base_fd < 0) return;
+
+    // Do this as late as possible to allow maximum time for writes to
+    // happen, and so the calls to io_sync() are adjacent which may be
+    // more efficient, at least with some Linux kernel versions.
+    bool ok = io_sync(handle) && io_sync(commit_base_fd);
+    if (::close(commit_base_fd) < 0) ok = false;
+    commit_base_fd = -1;
+    if (!ok) {
+	string tmp = name;
+	tmp += "tmp";
+	(void)unlink(tmp.c_str());
+	BrassTable::close();
+	throw Xapian::DatabaseError("Can't commit new revision - failed to flush DB to disk");
+    }
+}
+
+void
+BrassTable::commit_finish()
+{
+    LOGCALL_VOID(DB, "BrassTable::commit_finish", NO_ARGS);
+    Assert(commit_base_fd < 0);
+    if (handle < 0) return;
+
+    try {
 	string tmp = name;
 	tmp += "tmp";
 	string basefile = name;
 	basefile += "base";
 	basefile += char(base_letter);
-	base.write_to_file(tmp, base_letter, tablename, changes_fd, changes_tail);
-
-	// Do this as late as possible to allow maximum time for writes to
-	// happen, and so the calls to io_sync() are adjacent which may be
-	// more efficient, at least with some Linux kernel versions.
-	if (!io_sync(handle)) {
-	    (void)::close(handle);
-	    handle = -1;
-	    (void)unlink(tmp.c_str());
-	    throw Xapian::DatabaseError("Can't commit new revision - failed to flush DB to disk");
-	}
-
 	if (posixy_rename(tmp.c_str(), basefile.c_str()) < 0) {
 	    // With NFS, rename() failing may just mean that the server crashed
 	    // after successfully renaming, but before reporting this, and then
@@ -1777,6 +2297,12 @@ BrassTable::commit(brass_revision_number_t revision, int changes_fd,
 
 	read_root();
 
+	if (block_cache) {
+	    // Readers of older revisions mustn't keep using cached copies of
+	    // blocks we may now reuse.
+	    block_cache->discard(block_cache_file, revision_number);
+	}
+
 	changed_n = 0;
 	changed_c = DIR_START;
 	seq_count = SEQ_START_POINT;
@@ -1786,6 +2312,22 @@ BrassTable::commit(brass_revision_number_t revision, int changes_fd,
     }
 }
 
+void
+BrassTable::commit_abandon()
+{
+    LOGCALL_VOID(DB, "BrassTable::commit_abandon", NO_ARGS);
+    if (commit_base_fd >= 0) {
+	(void)::close(commit_base_fd);
+	commit_base_fd = -1;
+    }
+    if (handle < 0) return;
+    string tmp = name;
+    tmp += "tmp";
+    (void)unlink(tmp.c_str());
+    // The table's state may reflect a revision which wasn't committed.
+    BrassTable::close();
+}
+
 void
 BrassTable::write_changed_blocks(int changes_fd, bool compressed)
 {
@@ -1884,6 +2426,8 @@ BrassTable::cancel()
     item_count =       base.get_item_count();
     faked_root_block = base.get_have_fakeroot();
     sequential =       base.get_sequential();
+    use_codec(base.get_codec(), base.get_dictionary());
+    flags =            base.get_flags();
 
     latest_revision_number = revision_number; // FIXME: we can end up reusing a revision if we opened a btree at an older revision, start to modify it, then cancel...
 
@@ -1923,6 +2467,8 @@ BrassTable::do_open_to_read(bool revision_supplied, brass_revision_number_t revi
 	throw Xapian::DatabaseOpeningError(message);
     }
 
+    register_with_block_cache();
+
     if (!basic_open(revision_supplied, revision_)) {
 	::close(handle);
 	handle = -1;
@@ -1936,9 +2482,11 @@ BrassTable::do_open_to_read(bool revision_supplied, brass_revision_number_t revi
 	throw Xapian::DatabaseOpeningError("Failed to open table for reading");
     }
 
+    map_file();
+
     for (int j = 0; j <= level; j++) {
 	C[j].n = BLK_UNUSED;
-	C[j].p = new byte[block_size];
+	C[j].p = (j == 0 || !mapping.get()) ? new byte[block_size] : NULL;
     }
 
     read_root();
@@ -2023,8 +2571,10 @@ BrassTable::prev_for_sequential(Brass::Cursor * C_, int /*dummy*/) const
 		    // block.
 		    read_block(n, p);
 		}
-	    } else {
-		read_block(n, p);
+	    } else if (mapping.get()) {
+		copy_mapped_block(n, p);
+	    } else if (!read_block(n, p)) {
+		add_to_block_cache(n, p);
 	    }
 	    if (writable) AssertEq(revision_number, latest_revision_number);
 	    if (REVISION(p) > revision_number + writable) {
@@ -2034,6 +2584,7 @@ BrassTable::prev_for_sequential(Brass::Cursor * C_, int /*dummy*/) const
 	    if (GET_LEVEL(p) == 0) break;
 	}
 	c = DIR_END(p);
+	C_[0].p = p;
 	C_[0].n = n;
     }
     c -= D2;
@@ -2077,8 +2628,10 @@ BrassTable::next_for_sequential(Brass::Cursor * C_, int /*dummy*/) const
 		    // block.
 		    read_block(n, p);
 		}
-	    } else {
-		read_block(n, p);
+	    } else if (mapping.get()) {
+		copy_mapped_block(n, p);
+	    } else if (!read_block(n, p)) {
+		add_to_block_cache(n, p);
 	    }
 	    if (writable) AssertEq(revision_number, latest_revision_number);
 	    if (REVISION(p) > revision_number + writable) {
@@ -2088,6 +2641,7 @@ BrassTable::next_for_sequential(Brass::Cursor * C_, int /*dummy*/) const
 	    if (GET_LEVEL(p) == 0) break;
 	}
 	c = DIR_START;
+	C_[0].p = p;
 	C_[0].n = n;
     }
     C_[0].c = c;
@@ -2106,6 +2660,8 @@ BrassTable::prev_default(Brass::Cursor * C_, int j) const
     if (c == DIR_START) {
 	if (j == level) RETURN(false);
 	if (!prev_default(C_, j + 1)) RETURN(false);
+	// If the DB file is mapped, the block is no longer at p.
+	p = C_[j].p;
 	c = DIR_END(p);
     }
     c -= D2;
@@ -2129,6 +2685,8 @@ BrassTable::next_default(Brass::Cursor * C_, int j) const
     if (c >= DIR_END(p)) {
 	if (j == level) RETURN(false);
 	if (!next_default(C_, j + 1)) RETURN(false);
+	// If the DB file is mapped, the block is no longer at p.
+	p = C_[j].p;
 	c = DIR_START;
     }
     C_[j].c = c;
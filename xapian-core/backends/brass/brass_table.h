@@ -28,8 +28,11 @@
 
 #include "brass_types.h"
 #include "brass_btreebase.h"
+#include "brass_codec.h"
 #include "brass_cursor.h"
 
+#include "backends/blockcache.h"
+
 #include "noreturn.h"
 #include "omassert.h"
 #include "str.h"
@@ -40,6 +43,7 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #define DONT_COMPRESS -1
 
@@ -265,6 +269,12 @@ public:
 
 }
 
+/** How many leaf blocks ahead of a sequential scan to ask the OS to read.
+ *
+ *  Readahead is issued in batches once the scan has used up half of this.
+ */
+#define BRASS_READAHEAD_BLOCKS 16
+
 // Allow for BTREE_CURSOR_LEVELS levels in the B-tree.
 // With 10, overflow is practically impossible
 // FIXME: but we want it to be completely impossible...
@@ -373,6 +383,9 @@ class BrassTable {
 	 */
 	bool is_open() const { return handle >= 0; }
 
+	/// Is the DB file memory mapped?
+	bool is_mapped() const { return mapping.get() != NULL; }
+
 	/** Flush any outstanding changes to the DB file of the table.
 	 *
 	 *  This must be called before commit, to ensure that the DB file is
@@ -399,6 +412,36 @@ class BrassTable {
 	void commit(brass_revision_number_t revision, int changes_fd = -1,
 		    const std::string * changes_tail = NULL);
 
+	/** Start committing outstanding changes to the table.
+	 *
+	 *  Committing is split into three steps so that writing back the data
+	 *  of several tables can overlap: commit_start() for each table writes
+	 *  a new base file and starts writeback of the table's data and base
+	 *  file, commit_sync() for each waits until these are on disk, then
+	 *  commit_finish() for each (in the order the tables need to be
+	 *  committed in) makes the new revision live by renaming the base file
+	 *  into place.
+	 *
+	 *  If any step throws an exception, commit_abandon() should be called
+	 *  for each table for which commit_finish() hasn't returned.
+	 *
+	 *  The parameters are as for commit().
+	 */
+	void commit_start(brass_revision_number_t revision, int changes_fd = -1,
+			  const std::string * changes_tail = NULL);
+
+	/// Wait for the data written by commit_start() to reach the disk.
+	void commit_sync();
+
+	/// Make the revision written by commit_start() live.
+	void commit_finish();
+
+	/** Abandon a commit after an exception.
+	 *
+	 *  The table is closed, as after an exception from commit().
+	 */
+	void commit_abandon();
+
 	/** Append the list of blocks changed to a changeset file.
 	 *
 	 *  @param changes_fd  The file descriptor to write changes to.
@@ -428,6 +471,22 @@ class BrassTable {
 	 */
 	bool get_exact_entry(const std::string & key, std::string & tag) const;
 
+	/** Read the tags for several keys at once.
+	 *
+	 *  This gives the same results as calling get_exact_entry() for each
+	 *  key, but the keys are looked up in ascending order so the descent
+	 *  from the root is shared between neighbouring keys, and readahead is
+	 *  issued for all the leaf blocks needed before any are read.
+	 *
+	 *  @param keys   The keys to look for (in any order).
+	 *  @param tags   Set to the tag of each key in @a keys (or an empty
+	 *		  string for any which aren't found).
+	 *  @param found  Set to whether each key in @a keys was found.
+	 */
+	void get_exact_entries(const std::vector<std::string> & keys,
+			       std::vector<std::string> & tags,
+			       std::vector<bool> & found) const;
+
 	/** Check if a key exists in the Btree.
 	 *
 	 *  This is just like get_exact_entry() except it doesn't read the tag
@@ -489,6 +548,17 @@ class BrassTable {
 	/// Erase this table from disk.
 	void erase();
 
+	/** Share read blocks via the process-wide block cache, if enabled.
+	 *
+	 *  Only a table opened read-only reads blocks from the cache.  A
+	 *  writable table uses it to discard the cached blocks of revisions
+	 *  it has superseded when it commits.
+	 *
+	 *  @param db_id	A string which uniquely identifies the database
+	 *			this table is part of (e.g. its UUID).
+	 */
+	void use_block_cache(const std::string & db_id);
+
 	/** Set the block size.
 	 *
 	 *  It's only safe to do this before the table is created.
@@ -499,6 +569,131 @@ class BrassTable {
 	 */
 	unsigned int get_block_size() const { return block_size; }
 
+	/// Get the name of the table (e.g. "postlist").
+	const char * get_name() const { return tablename; }
+
+	/** Look up a per-table setting in an environment variable.
+	 *
+	 *  The variable's value is a comma-separated list of entries, each
+	 *  either a value to use for all tables, or TABLENAME=VALUE to
+	 *  override the value for a particular table - e.g. "lz4,record=zstd".
+	 *
+	 *  @param envvar	The name of the environment variable.
+	 *  @param tablename_	The table to look up the setting for.
+	 *  @param value	Set to the value for @a tablename_, if there is
+	 *			one.
+	 *
+	 *  @return	true if there's a value for @a tablename_.
+	 *
+	 *  @exception Xapian::InvalidArgumentError if an entry names a table
+	 *		which brass doesn't have.
+	 */
+	static bool get_table_setting(const char * envvar,
+				      const char * tablename_,
+				      std::string & value);
+
+	/** Return the block size to create table @a tablename_ with.
+	 *
+	 *  This is controlled by the environment variable
+	 *  XAPIAN_BRASS_BLOCK_SIZE (see get_table_setting()), e.g.
+	 *  "4K,postlist=64K".
+	 *
+	 *  @param tablename_	The table to look up the block size for.
+	 *  @param block_size_	The block size to return if none is configured.
+	 *
+	 *  @exception Xapian::InvalidArgumentError if the configured block
+	 *		   size isn't valid.
+	 */
+	static unsigned int configured_block_size(const char * tablename_,
+						  unsigned int block_size_);
+
+	/** Set the codec to compress tags with if the table gets created.
+	 *
+	 *  By default, the codec is chosen by BrassCodec::configured_for_table()
+	 *  (falling back to zlib) with no dictionary.  An existing table always
+	 *  uses the codec and dictionary recorded in its base file.
+	 *
+	 *  @param codec_	One of the codec constants in BrassCodec.
+	 *  @param dictionary_	The dictionary to compress tags against (empty
+	 *			for none).
+	 */
+	void set_codec(int codec_,
+		       const std::string & dictionary_ = std::string()) {
+	    codec_for_create = codec_;
+	    dictionary_for_create = dictionary_;
+	}
+
+	/** Get the codec used to compress tags in this table.
+	 *
+	 *  If the table isn't open and set_codec() has been called, this
+	 *  returns the codec the table will be created with.
+	 */
+	int get_codec() const {
+	    if (handle < 0 && codec_for_create >= 0) return codec_for_create;
+	    return codec;
+	}
+
+	/** Get the dictionary used to compress tags in this table.
+	 *
+	 *  If the table isn't open and set_codec() has been called, this
+	 *  returns the dictionary the table will be created with.
+	 */
+	const std::string & get_dictionary() const {
+	    if (handle < 0 && codec_for_create >= 0)
+		return dictionary_for_create;
+	    return dictionary;
+	}
+
+	/// Flags which can be set for a table.
+	enum {
+	    /** Write postlist chunks with enough entries in the bit-packed
+	     *  format (only meaningful for the postlist table).
+	     */
+	    FLAG_PACKED_POSTLISTS = 1,
+	    /** Keep a dense column of document lengths as well as the
+	     *  document length posting list (only meaningful for the postlist
+	     *  table).
+	     */
+	    FLAG_DOCLEN_COLUMN = 2,
+	    /** Write postlist chunks whose entries are dense enough and all
+	     *  have the same wdf as bitmaps (only meaningful for the postlist
+	     *  table).
+	     */
+	    FLAG_BITMAP_POSTLISTS = 4,
+	    /** Write position lists in the block-packed format rather than
+	     *  interpolative coding them (only meaningful for the position
+	     *  table).
+	     */
+	    FLAG_PACKED_POSITIONS = 8,
+	    /** Write value stream chunks whose values are all integers
+	     *  encoded with Xapian::sortable_serialise() as numeric columns
+	     *  (only meaningful for the postlist table).
+	     */
+	    FLAG_NUMERIC_VALUES = 16,
+	    /** Keep a summary of the smallest and largest values in each
+	     *  value stream chunk (only meaningful for the postlist table).
+	     */
+	    FLAG_VALUE_SUMMARIES = 32
+	};
+
+	/** Set the flags to create the table with.
+	 *
+	 *  The flags are recorded in the base file, so an existing table
+	 *  always uses the flags it was created with.
+	 *
+	 *  @param flags_	Bitwise-or of the FLAG_* constants.
+	 */
+	void set_flags(unsigned flags_) { flags_for_create = flags_; }
+
+	/** Get the flags for this table.
+	 *
+	 *  If the table isn't open, this returns the flags it will be created
+	 *  with.
+	 */
+	unsigned get_flags() const {
+	    return handle < 0 ? flags_for_create : flags;
+	}
+
 	/** Create a new empty btree structure on disk and open it at the
 	 *  initial revision.
 	 *
@@ -617,10 +812,31 @@ class BrassTable {
 
 	bool find(Brass::Cursor *) const;
 	int delete_kt();
-	void read_block(uint4 n, byte *p) const;
+	bool read_block(uint4 n, byte *p) const;
+	void read_block_from_file(uint4 n, byte *p) const;
+	void add_to_block_cache(uint4 n, const byte *p) const;
+	void register_with_block_cache();
+	byte * mapped_block(uint4 n) const;
+	void copy_mapped_block(uint4 n, byte *p) const;
+	void map_file();
+	void open_direct_io();
+	bool write_block_direct(uint4 n, const byte *p) const;
+	void close_direct_io() const;
 	void write_block(uint4 n, const byte *p) const;
 	XAPIAN_NORETURN(void set_overwritten() const);
 	void block_to_cursor(Brass::Cursor *C_, int j, uint4 n) const;
+
+	/** Issue readahead for the leaf blocks after the one C_ is on.
+	 *
+	 *  Called when a cursor is scanning forwards through the leaves.
+	 *
+	 *  @param ra_n, ra_c	Where readahead has been issued up to, which
+	 *			this method updates: in sequential mode, ra_n is
+	 *			the last block; otherwise it's the level 1 block
+	 *			and ra_c the directory offset in it of the last
+	 *			leaf.  Set ra_n to BLK_UNUSED initially.
+	 */
+	void readahead(const Brass::Cursor *C_, uint4 & ra_n, int & ra_c) const;
 	void alter();
 	void compact(byte *p);
 	void enter_key(int j, Brass::Key prevkey, Brass::Key newkey);
@@ -773,9 +989,82 @@ class BrassTable {
 
 	CompressionStream comp_stream;
 
+	/** The codec to use if we create the table, or -1 to use the default.
+	 *
+	 *  See set_codec().
+	 */
+	int codec_for_create;
+
+	/// The dictionary to use if we create the table.
+	std::string dictionary_for_create;
+
+	/// The codec the table's tags are compressed with.
+	int codec;
+
+	/// The dictionary the table's tags are compressed against.
+	std::string dictionary;
+
+	/// The object for codec, or NULL if not yet needed.
+	mutable BrassCodec * tag_codec;
+
+	/// The flags to use if we create the table (see set_flags()).
+	unsigned flags_for_create;
+
+	/// The flags recorded in the table's base file.
+	unsigned flags;
+
+	/// Return tag_codec, creating it if necessary.
+	BrassCodec * get_tag_codec() const {
+	    if (!tag_codec) tag_codec = BrassCodec::create(codec, dictionary);
+	    return tag_codec;
+	}
+
+	/// Switch to using codec_ and dictionary_ for tags.
+	void use_codec(int codec_, const std::string & dictionary_);
+
 	/// If true, don't create the table until it's needed.
 	bool lazy;
 
+	/** The id passed to use_block_cache(), or empty if the table doesn't
+	 *  use the shared block cache.
+	 */
+	std::string block_cache_id;
+
+	/** The shared block cache to use, or NULL to always read from disk.
+	 *
+	 *  A writable table never reads from it.
+	 */
+	BlockCache * block_cache;
+
+	/// The id of this table in block_cache.
+	unsigned block_cache_file;
+
+	/** The DB file mapped read-only into memory, or NULL if not mapped.
+	 *
+	 *  If the file is mapped, the block pointers in cursors above the
+	 *  leaf level point directly into the mapping instead of to buffers
+	 *  owned by the cursor.
+	 */
+	Xapian::Internal::intrusive_ptr<Brass::Mapping> mapping;
+
+	/** File descriptor of the new base file during a commit, or -1.
+	 *
+	 *  See commit_start().
+	 */
+	int commit_base_fd;
+
+	/** File descriptor for writing blocks with O_DIRECT, or -1.
+	 *
+	 *  See open_direct_io().
+	 */
+	mutable int direct_handle;
+
+	/// Storage for direct_buf, which may not be suitably aligned itself.
+	mutable byte * direct_buf_storage;
+
+	/// Aligned buffer to copy blocks into for writing to direct_handle.
+	mutable byte * direct_buf;
+
 	/* Debugging methods */
 //	void report_block_full(int m, int n, const byte * p);
 };
@@ -24,6 +24,7 @@
 
 #include "brass_cursor.h"
 #include "brass_database.h"
+#include "brass_table.h"
 #include "omassert.h"
 #include "str.h"
 
@@ -45,6 +46,7 @@ BrassValueList::update_reader()
 BrassValueList::~BrassValueList()
 {
     delete cursor;
+    delete summary_cursor;
 }
 
 Xapian::docid
@@ -67,6 +69,15 @@ BrassValueList::get_value() const
     return reader.get_value();
 }
 
+bool
+BrassValueList::get_value_as_number(double & result) const
+{
+    Assert(!at_end());
+    if (!reader.is_numeric()) return false;
+    result = reader.get_number();
+    return true;
+}
+
 bool
 BrassValueList::at_end() const
 {
@@ -129,6 +140,111 @@ BrassValueList::skip_to(Xapian::docid did)
     cursor = NULL;
 }
 
+bool
+BrassValueList::read_summary(Xapian::docid did)
+{
+    Xapian::docid first_did;
+    if (summary.last_did && did == summary.last_did + 1) {
+	// We want the next chunk, so just step the cursor on to it.
+	if (!summary_cursor->next()) return false;
+	first_did = docid_from_key(slot, summary_cursor->current_key, '\xdc');
+	if (!first_did) return false;
+    } else {
+	const string key = make_valuesummary_key(slot, did);
+	if (summary_cursor->find_entry(key)) {
+	    first_did = did;
+	} else {
+	    // We're on the summary for the chunk before did, if there is one.
+	    first_did = docid_from_key(slot, summary_cursor->current_key,
+				       '\xdc');
+	    if (first_did) {
+		summary_cursor->read_tag();
+		summary.decode(summary_cursor->current_tag, first_did);
+		if (summary.last_did >= did) return true;
+	    }
+	    // Otherwise the next summary is for the chunk we want.
+	    if (!summary_cursor->next()) return false;
+	    first_did = docid_from_key(slot, summary_cursor->current_key,
+				       '\xdc');
+	    if (!first_did) return false;
+	}
+    }
+    summary_cursor->read_tag();
+    summary.decode(summary_cursor->current_tag, first_did);
+    return true;
+}
+
+bool
+BrassValueList::skip_to_value_range(Xapian::docid did,
+				    const string & lo, const string * hi,
+				    Xapian::docid & all_match_until)
+{
+    if (no_summaries) return false;
+    if (!summary_cursor) {
+	summary_cursor = db->get_postlist_cursor();
+	if (!summary_cursor) {
+	    // The table isn't open, so there are no values.
+	    skip_to(did);
+	    return true;
+	}
+	if (!(summary_cursor->get_table()->get_flags() &
+	      BrassTable::FLAG_VALUE_SUMMARIES)) {
+	    no_summaries = true;
+	    delete summary_cursor;
+	    summary_cursor = NULL;
+	    return false;
+	}
+    }
+
+    all_match_until = 0;
+    // Don't move backwards.
+    if (cursor && !reader.at_end() && did < reader.get_docid())
+	did = reader.get_docid();
+    while (true) {
+	if (did > summary.last_did && !read_summary(did)) {
+	    // No chunks end at or after did.
+	    delete cursor;
+	    cursor = NULL;
+	    return true;
+	}
+	if (summary.upper_bound >= lo && (!hi || summary.lower_bound <= *hi))
+	    break;
+	// None of the values in this chunk are in range.
+	if (summary.last_did == Xapian::docid(-1)) {
+	    delete cursor;
+	    cursor = NULL;
+	    return true;
+	}
+	did = summary.last_did + 1;
+    }
+
+    // There are no chunks between did and the summarised one, so this moves
+    // into that chunk.
+    skip_to(did);
+    AssertRel(get_docid(),<=,summary.last_did);
+    if (summary.lower_bound >= lo && (!hi || summary.upper_bound <= *hi))
+	all_match_until = summary.last_did;
+    return true;
+}
+
+Xapian::doccount
+BrassValueList::read_batch(Xapian::docid did, Xapian::docid end_did,
+			   Xapian::doccount max,
+			   Xapian::docid * dids, string * values)
+{
+    // Call our own methods directly to avoid a virtual call per entry.
+    Xapian::doccount n = 0;
+    for (BrassValueList::skip_to(did); cursor && n != max;
+	 BrassValueList::next()) {
+	Xapian::docid d = reader.get_docid();
+	if (d >= end_did) break;
+	dids[n] = d;
+	values[n] = reader.get_value();
+	++n;
+    }
+    return n;
+}
+
 bool
 BrassValueList::check(Xapian::docid did)
 {
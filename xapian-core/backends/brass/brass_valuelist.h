@@ -43,13 +43,33 @@ class BrassValueList : public Xapian::ValueIterator::Internal {
 
     Xapian::Internal::intrusive_ptr<const BrassDatabase> db;
 
+    /** Cursor over the chunk summaries, used by skip_to_value_range().
+     *
+     *  NULL if it hasn't been needed yet, or if the table has no summaries
+     *  (in which case @a no_summaries is true).
+     */
+    BrassCursor * summary_cursor;
+
+    /// True if the table is known to have no chunk summaries.
+    bool no_summaries;
+
+    /// The summary of the chunk @a summary_cursor is on.
+    Brass::ValueChunkSummary summary;
+
     /// Update @a reader to use the chunk currently pointed to by @a cursor.
     bool update_reader();
 
+    /** Read the summary of the first chunk which ends at or after @a did.
+     *
+     *  @return false if there's no such chunk.
+     */
+    bool read_summary(Xapian::docid did);
+
   public:
     BrassValueList(Xapian::valueno slot_,
 		   Xapian::Internal::intrusive_ptr<const BrassDatabase> db_)
-	: cursor(NULL), slot(slot_), db(db_) { }
+	: cursor(NULL), slot(slot_), db(db_), summary_cursor(NULL),
+	  no_summaries(false) { }
 
     ~BrassValueList();
 
@@ -59,14 +79,25 @@ class BrassValueList : public Xapian::ValueIterator::Internal {
 
     std::string get_value() const;
 
+    bool get_value_as_number(double & result) const;
+
     bool at_end() const;
 
     void next();
 
     void skip_to(Xapian::docid);
 
+    bool skip_to_value_range(Xapian::docid did,
+			     const std::string & lo,
+			     const std::string * hi,
+			     Xapian::docid & all_match_until);
+
     bool check(Xapian::docid did);
 
+    Xapian::doccount read_batch(Xapian::docid did, Xapian::docid end_did,
+				Xapian::doccount max,
+				Xapian::docid * dids, std::string * values);
+
     std::string get_description() const;
 };
 
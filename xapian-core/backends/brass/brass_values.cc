@@ -29,11 +29,15 @@
 #include "debuglog.h"
 #include "backends/document.h"
 #include "pack.h"
+#include "stringutils.h"
 
 #include "xapian/error.h"
+#include "xapian/queryparser.h" // For sortable_serialise().
 #include "xapian/valueiterator.h"
 
 #include <algorithm>
+#include <cmath>
+#include <vector>
 #include "autoptr.h"
 
 using namespace Brass;
@@ -68,19 +72,131 @@ make_valuestats_key(Xapian::valueno slot)
     RETURN(key);
 }
 
+/** The offset representing zero in a numeric column.
+ *
+ *  Integers of magnitude up to 2 to the power 53 can be represented exactly
+ *  by a double.
+ */
+static const uint8 NUMBER_BIAS = uint8(1) << 53;
+
+uint8
+ValueChunkReader::to_offset(double number)
+{
+    if (number < 0) return NUMBER_BIAS - uint8(-number);
+    return NUMBER_BIAS + uint8(number);
+}
+
+double
+ValueChunkReader::from_offset(uint8 offset)
+{
+    if (offset < NUMBER_BIAS) return -double(NUMBER_BIAS - offset);
+    return double(offset - NUMBER_BIAS);
+}
+
 void
 ValueChunkReader::assign(const char * p_, size_t len, Xapian::docid did_)
 {
     p = p_;
     end = p_ + len;
     did = did_;
+    numeric = (len != 0 && *p == '\0');
+    if (numeric) {
+	++p;
+	if (!unpack_uint(&p, end, &remaining) || remaining == 0 ||
+	    !unpack_uint(&p, end, &base))
+	    throw Xapian::DatabaseCorruptError("Bad numeric value chunk header");
+	block_last = did_ - 1;
+	read_block(0);
+	did = dids[0];
+	value_set = false;
+	return;
+    }
     if (!unpack_string(&p, end, value))
 	throw Xapian::DatabaseCorruptError("Failed to unpack first value");
 }
 
+void
+ValueChunkReader::read_block(Xapian::docid target)
+{
+    AssertRel(remaining,>,0);
+    while (true) {
+	Xapian::docid inc;
+	if (!unpack_uint(&p, end, &inc) || p == end)
+	    throw Xapian::DatabaseCorruptError("Bad numeric value chunk block");
+	unsigned did_bits = static_cast<unsigned char>(*p++);
+	size_t did_bytes = bitpack_block_bytes(did_bits);
+	if (did_bits > 32 || size_t(end - p) <= did_bytes)
+	    throw Xapian::DatabaseCorruptError("Bad numeric value chunk block");
+	const char * did_data = p;
+	p += did_bytes;
+	unsigned value_bits = static_cast<unsigned char>(*p++);
+	size_t value_bytes = bitpack_block_bytes(value_bits);
+	if (value_bits > 32 || size_t(end - p) < value_bytes)
+	    throw Xapian::DatabaseCorruptError("Bad numeric value chunk block");
+	const char * value_data = p;
+	p += value_bytes;
+
+	unsigned n = unsigned(min(remaining, Xapian::doccount(BITPACK_BLOCK_SIZE)));
+	remaining -= n;
+	if (block_last + inc < target) {
+	    // Nothing in this block can be wanted, so don't decode it.
+	    block_last += inc;
+	    if (remaining == 0) {
+		p = NULL;
+		return;
+	    }
+	    continue;
+	}
+
+	uint4 gaps[BITPACK_BLOCK_SIZE];
+	bitunpack_block(did_data, gaps, did_bits);
+	Xapian::docid d = block_last;
+	for (unsigned i = 0; i != n; ++i) {
+	    d += gaps[i] + 1;
+	    dids[i] = d;
+	}
+	if (d != block_last + inc)
+	    throw Xapian::DatabaseCorruptError("Bad numeric value chunk block");
+	bitunpack_block(value_data, offsets, value_bits);
+	block_last = d;
+	block_size = n;
+	idx = 0;
+	if (remaining == 0 && p != end)
+	    throw Xapian::DatabaseCorruptError("Junk after numeric value chunk");
+	return;
+    }
+}
+
+double
+ValueChunkReader::get_number() const
+{
+    Assert(numeric);
+    return from_offset(base + offsets[idx]);
+}
+
+void
+ValueChunkReader::set_value_from_number() const
+{
+    value = Xapian::sortable_serialise(get_number());
+    value_set = true;
+}
+
 void
 ValueChunkReader::next()
 {
+    if (numeric) {
+	if (++idx == block_size) {
+	    if (remaining == 0) {
+		p = NULL;
+		return;
+	    }
+	    read_block(0);
+	}
+	did = dids[idx];
+	value_set = false;
+	return;
+    }
+
     if (p == end) {
 	p = NULL;
 	return;
@@ -100,6 +216,21 @@ ValueChunkReader::skip_to(Xapian::docid target)
     if (p == NULL || target <= did)
 	return;
 
+    if (numeric) {
+	if (target > block_last) {
+	    if (remaining == 0) {
+		p = NULL;
+		return;
+	    }
+	    read_block(target);
+	    if (p == NULL) return;
+	}
+	idx = lower_bound(dids + idx, dids + block_size, target) - dids;
+	did = dids[idx];
+	value_set = false;
+	return;
+    }
+
     size_t value_len;
     while (p != end) {
 	// Get the next docid
@@ -129,6 +260,190 @@ ValueChunkReader::skip_to(Xapian::docid target)
     p = NULL;
 }
 
+/** Find the offset representing @a value in a numeric column.
+ *
+ *  @return false if @a value isn't an integer encoded with
+ *	    Xapian::sortable_serialise() which a numeric column can hold.
+ */
+static bool
+offset_from_value(const string & value, uint8 & offset)
+{
+    double number = Xapian::sortable_unserialise(value);
+    if (!(fabs(number) <= double(NUMBER_BIAS)) || number != floor(number))
+	return false;
+    // Only values which sortable_serialise() would produce for the number
+    // can be recreated from it.
+    if (Xapian::sortable_serialise(number) != value) return false;
+    offset = ValueChunkReader::to_offset(number);
+    return true;
+}
+
+/** Encode the entries of string chunk @a tag as a numeric column.
+ *
+ *  @return false if the values can't all be held in a numeric column.
+ */
+static bool
+encode_numeric_chunk(string & out, const string & tag)
+{
+    vector<Xapian::docid> dids;
+    vector<uint8> values;
+    uint8 lo = 0, hi = 0;
+    ValueChunkReader reader(tag.data(), tag.size(), 1);
+    for ( ; !reader.at_end(); reader.next()) {
+	uint8 offset;
+	if (!offset_from_value(reader.get_value(), offset)) return false;
+	if (values.empty() || offset < lo) lo = offset;
+	if (values.empty() || offset > hi) hi = offset;
+	dids.push_back(reader.get_docid());
+	values.push_back(offset);
+    }
+    if (values.empty() || hi - lo > uint8(uint4(-1))) return false;
+
+    out.assign(1, '\0');
+    pack_uint(out, values.size());
+    pack_uint(out, lo);
+    Xapian::docid prev = 0;
+    size_t i = 0;
+    while (i != values.size()) {
+	uint4 gaps[BITPACK_BLOCK_SIZE];
+	uint4 offsets[BITPACK_BLOCK_SIZE];
+	Xapian::docid block_prev = prev;
+	unsigned j;
+	for (j = 0; j != BITPACK_BLOCK_SIZE && i != values.size(); ++j, ++i) {
+	    gaps[j] = dids[i] - prev - 1;
+	    prev = dids[i];
+	    offsets[j] = uint4(values[i] - lo);
+	}
+	for ( ; j != BITPACK_BLOCK_SIZE; ++j) {
+	    gaps[j] = offsets[j] = 0;
+	}
+	pack_uint(out, prev - block_prev);
+	unsigned bits = bitpack_bits_needed(gaps, BITPACK_BLOCK_SIZE);
+	out += char(bits);
+	bitpack_block(out, gaps, bits);
+	bits = bitpack_bits_needed(offsets, BITPACK_BLOCK_SIZE);
+	out += char(bits);
+	bitpack_block(out, offsets, bits);
+    }
+    return true;
+}
+
+string
+Brass::summarise_value_chunk(const string & tag)
+{
+    ValueChunkReader reader(tag.data(), tag.size(), 1);
+    string lo = reader.get_value();
+    string hi = lo;
+    Xapian::docid last = 1;
+    for (reader.next(); !reader.at_end(); reader.next()) {
+	const string & value = reader.get_value();
+	if (value < lo) {
+	    lo = value;
+	} else if (value > hi) {
+	    hi = value;
+	}
+	last = reader.get_docid();
+    }
+    string summary;
+    pack_uint(summary, last - 1);
+    pack_string(summary, lo);
+    // As for the value statistics, an empty upper bound means it's the same
+    // as the lower bound.
+    if (lo != hi) summary += hi;
+    return summary;
+}
+
+void
+ValueChunkSummary::decode(const string & tag, Xapian::docid first_did_)
+{
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    Xapian::docid delta;
+    if (!unpack_uint(&p, end, &delta) ||
+	!unpack_string(&p, end, lower_bound) || lower_bound.empty())
+	throw Xapian::DatabaseCorruptError("Bad value chunk summary");
+    first_did = first_did_;
+    last_did = first_did + delta;
+    if (p == end) {
+	upper_bound = lower_bound;
+    } else {
+	upper_bound.assign(p, end - p);
+    }
+}
+
+void
+Brass::convert_value_chunk(string & tag, unsigned flags)
+{
+    bool numeric = (!tag.empty() && tag[0] == '\0');
+    if (flags & BrassTable::FLAG_NUMERIC_VALUES) {
+	string out;
+	if (!numeric && encode_numeric_chunk(out, tag) &&
+	    out.size() <= tag.size()) {
+	    swap(tag, out);
+	}
+	return;
+    }
+    if (!numeric) return;
+
+    // Convert a numeric column back to strings.
+    string out;
+    Xapian::docid prev_did = 0;
+    ValueChunkReader reader(tag.data(), tag.size(), 1);
+    for ( ; !reader.at_end(); reader.next()) {
+	if (prev_did) pack_uint(out, reader.get_docid() - prev_did - 1);
+	prev_did = reader.get_docid();
+	pack_string(out, reader.get_value());
+    }
+    swap(tag, out);
+}
+
+string
+Brass::encode_indexed_slots(const set<Xapian::valueno> & slots)
+{
+    string tag;
+    Xapian::valueno prev_slot = static_cast<Xapian::valueno>(-1);
+    set<Xapian::valueno>::const_iterator i;
+    for (i = slots.begin(); i != slots.end(); ++i) {
+	pack_uint(tag, *i - prev_slot - 1);
+	prev_slot = *i;
+    }
+    return tag;
+}
+
+void
+Brass::decode_indexed_slots(const string & tag, set<Xapian::valueno> & slots)
+{
+    slots.clear();
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    Xapian::valueno prev_slot = static_cast<Xapian::valueno>(-1);
+    while (p != end) {
+	Xapian::valueno slot;
+	if (!unpack_uint(&p, end, &slot)) {
+	    throw Xapian::DatabaseCorruptError("Bad list of indexed value slots");
+	}
+	slot += prev_slot + 1;
+	prev_slot = slot;
+	slots.insert(slots.end(), slot);
+    }
+}
+
+bool
+Brass::decode_valueindex_key(const string & key, Xapian::valueno & slot,
+			     string & value, Xapian::docid & did)
+{
+    AssertRel(key.size(),>=,2);
+    const char * p = key.data() + 2;
+    const char * end = key.data() + key.size();
+    if (p == end) return false;
+    if (!unpack_uint(&p, end, &slot) ||
+	!unpack_string_preserving_sort(&p, end, value) ||
+	!unpack_uint_preserving_sort(&p, end, &did) || p != end) {
+	throw Xapian::DatabaseCorruptError("Bad value index key");
+    }
+    return true;
+}
+
 void
 BrassValueManager::add_value(Xapian::docid did, Xapian::valueno slot,
 			     const string & val)
@@ -215,6 +530,9 @@ class ValueUpdater {
 
     Xapian::docid last_allowed_did;
 
+    /// Does this slot have an index to update?
+    bool indexed;
+
     void append_to_stream(Xapian::docid did, const string & value) {
 	Assert(did);
 	if (tag.empty()) {
@@ -229,11 +547,18 @@ class ValueUpdater {
     }
 
     void write_tag() {
+	bool summaries = (table->get_flags() & BrassTable::FLAG_VALUE_SUMMARIES);
 	// If the first docid has changed, delete the old entry.
 	if (first_did && new_first_did != first_did) {
 	    table->del(make_valuechunk_key(slot, first_did));
+	    if (summaries) table->del(make_valuesummary_key(slot, first_did));
 	}
 	if (!tag.empty()) {
+	    if (summaries) {
+		table->add(make_valuesummary_key(slot, new_first_did),
+			   summarise_value_chunk(tag));
+	    }
+	    convert_value_chunk(tag, table->get_flags());
 	    table->add(make_valuechunk_key(slot, new_first_did), tag);
 	}
 	first_did = 0;
@@ -241,8 +566,10 @@ class ValueUpdater {
     }
 
   public:
-    ValueUpdater(BrassPostListTable * table_, Xapian::valueno slot_)
-       	: table(table_), slot(slot_), first_did(0), last_allowed_did(0) { }
+    ValueUpdater(BrassPostListTable * table_, Xapian::valueno slot_,
+		 bool indexed_)
+       	: table(table_), slot(slot_), first_did(0), last_allowed_did(0),
+	  indexed(indexed_) { }
 
     ~ValueUpdater() {
 	while (!reader.at_end()) {
@@ -313,7 +640,22 @@ class ValueUpdater {
 	    append_to_stream(reader.get_docid(), reader.get_value());
 	    reader.next();
 	}
-	if (!reader.at_end() && reader.get_docid() == did) reader.next();
+	if (!reader.at_end() && reader.get_docid() == did) {
+	    if (indexed) {
+		const string & old_value = reader.get_value();
+		if (old_value == value) {
+		    // The index entry is already right.
+		    reader.next();
+		    append_to_stream(did, value);
+		    return;
+		}
+		table->del(make_valueindex_key(slot, old_value, did));
+	    }
+	    reader.next();
+	}
+	if (indexed && !value.empty()) {
+	    table->add(make_valueindex_key(slot, value, did), string());
+	}
 	if (!value.empty()) {
 	    // Add/update entry for did.
 	    append_to_stream(did, value);
@@ -344,7 +686,7 @@ BrassValueManager::merge_changes()
 	map<Xapian::valueno, map<Xapian::docid, string> >::const_iterator i;
 	for (i = changes.begin(); i != changes.end(); ++i) {
 	    Xapian::valueno slot = i->first;
-	    Brass::ValueUpdater updater(postlist_table, slot);
+	    Brass::ValueUpdater updater(postlist_table, slot, is_indexed(slot));
 	    const map<Xapian::docid, string> & slot_changes = i->second;
 	    map<Xapian::docid, string>::const_iterator j;
 	    for (j = slot_changes.begin(); j != slot_changes.end(); ++j) {
@@ -486,6 +828,84 @@ BrassValueManager::get_value(Xapian::docid did, Xapian::valueno slot) const
     return reader.get_value();
 }
 
+bool
+BrassValueManager::is_indexed(Xapian::valueno slot) const
+{
+    if (!indexed_slots_valid) {
+	string tag;
+	if (postlist_table->get_exact_entry(make_valueindex_slots_key(), tag)) {
+	    decode_indexed_slots(tag, indexed_slots);
+	} else {
+	    indexed_slots.clear();
+	}
+	indexed_slots_valid = true;
+    }
+    return indexed_slots.find(slot) != indexed_slots.end();
+}
+
+void
+BrassValueManager::set_indexed_slots(const set<Xapian::valueno> & slots_)
+{
+    LOGCALL_VOID(DB, "BrassValueManager::set_indexed_slots", slots_.size());
+    if (slots_.empty()) {
+	postlist_table->del(make_valueindex_slots_key());
+    } else {
+	postlist_table->add(make_valueindex_slots_key(),
+			    encode_indexed_slots(slots_));
+    }
+    indexed_slots = slots_;
+    indexed_slots_valid = true;
+}
+
+bool
+BrassValueManager::get_value_range_docids(Xapian::valueno slot,
+					  const string & begin,
+					  const string * end,
+					  Xapian::doccount max_size,
+					  vector<Xapian::docid> & dids) const
+{
+    LOGCALL(DB, bool, "BrassValueManager::get_value_range_docids", slot | begin | end | max_size | Literal("dids"));
+    if (!is_indexed(slot)) RETURN(false);
+    AutoPtr<BrassCursor> cursor(postlist_table->cursor_get());
+    if (!cursor.get()) RETURN(false);
+
+    // The entries for values before begin sort before this key.
+    string prefix("\0\xd4", 2);
+    pack_uint(prefix, slot);
+    string key(prefix);
+    if (begin.size() > VALUE_INDEX_MAX_VALUE_LEN) {
+	pack_string_preserving_sort(key,
+				    begin.substr(0, VALUE_INDEX_MAX_VALUE_LEN));
+    } else {
+	pack_string_preserving_sort(key, begin);
+    }
+
+    dids.clear();
+    string value;
+    for (cursor->find_entry_ge(key); !cursor->after_end(); cursor->next()) {
+	const string & k = cursor->current_key;
+	if (!startswith(k, prefix)) break;
+	Xapian::valueno s;
+	Xapian::docid did;
+	if (!decode_valueindex_key(k, s, value, did)) break;
+	if (end && value > *end) {
+	    // Any truncated values are greater than this too.
+	    break;
+	}
+	if (value.size() == VALUE_INDEX_MAX_VALUE_LEN) {
+	    // The value may have been truncated, so check the whole value.
+	    value = get_value(did, slot);
+	    if (value < begin || (end && value > *end)) continue;
+	} else if (value < begin) {
+	    continue;
+	}
+	if (dids.size() == max_size) RETURN(false);
+	dids.push_back(did);
+    }
+    sort(dids.begin(), dids.end());
+    RETURN(true);
+}
+
 void
 BrassValueManager::get_all_values(map<Xapian::valueno, string> & values,
 				  Xapian::docid did) const
@@ -22,6 +22,8 @@
 #ifndef XAPIAN_INCLUDED_BRASS_VALUES_H
 #define XAPIAN_INCLUDED_BRASS_VALUES_H
 
+#include "bitpack.h"
+#include "internaltypes.h"
 #include "pack.h"
 #include "backends/valuestats.h"
 
@@ -29,7 +31,9 @@
 #include "xapian/types.h"
 
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 namespace Brass {
 
@@ -43,13 +47,70 @@ make_valuechunk_key(Xapian::valueno slot, Xapian::docid did)
     return key;
 }
 
+/** Generate a key for the summary of a value stream chunk.
+ *
+ *  The summary is keyed by the same slot and first docid as the chunk.
+ */
+inline std::string
+make_valuesummary_key(Xapian::valueno slot, Xapian::docid did)
+{
+    std::string key("\0\xdc", 2);
+    pack_uint(key, slot);
+    pack_uint_preserving_sort(key, did);
+    return key;
+}
+
+/** The length that values are truncated to in value index keys.
+ *
+ *  This keeps the keys short enough even if every byte of the value needs
+ *  escaping.
+ */
+const size_t VALUE_INDEX_MAX_VALUE_LEN = 100;
+
+/** Generate the key for the list of value slots which have an index. */
+inline std::string
+make_valueindex_slots_key()
+{
+    return std::string("\0\xd4", 2);
+}
+
+/** Generate a key for an entry in the index of a value slot.
+ *
+ *  The index has an entry for each document with a value in the slot, with
+ *  the value (truncated to VALUE_INDEX_MAX_VALUE_LEN bytes) and the docid in
+ *  the key, so the entries for the slot are in ascending order of value.
+ */
+inline std::string
+make_valueindex_key(Xapian::valueno slot, const std::string & value,
+		    Xapian::docid did)
+{
+    std::string key("\0\xd4", 2);
+    pack_uint(key, slot);
+    if (value.size() > VALUE_INDEX_MAX_VALUE_LEN) {
+	pack_string_preserving_sort(key,
+				    value.substr(0, VALUE_INDEX_MAX_VALUE_LEN));
+    } else {
+	pack_string_preserving_sort(key, value);
+    }
+    pack_uint_preserving_sort(key, did);
+    return key;
+}
+
+/** Return the first docid from a value stream chunk or summary key.
+ *
+ *  @param key_type	'\xd8' for a chunk key, or '\xdc' for a summary key.
+ *
+ *  @return the docid, or 0 if @a key isn't of the type requested for slot
+ *	    @a required_slot.
+ */
 inline Xapian::docid
-docid_from_key(Xapian::valueno required_slot, const std::string & key)
+docid_from_key(Xapian::valueno required_slot, const std::string & key,
+	       char key_type = '\xd8')
 {
     const char * p = key.data();
     const char * end = p + key.length();
     // Fail if not a value chunk key.
-    if (end - p < 2 || *p++ != '\0' || *p++ != '\xd8') return 0;
+    if (end - p < 2 || *p++ != '\0' || *p++ != key_type) return 0;
     Xapian::valueno slot;
     if (!unpack_uint(&p, end, &slot))
        	throw Xapian::DatabaseCorruptError("bad value key");
@@ -90,6 +151,12 @@ class BrassValueManager {
 
     std::map<Xapian::valueno, std::map<Xapian::docid, std::string> > changes;
 
+    /// The value slots which have an index, if indexed_slots_valid is true.
+    mutable std::set<Xapian::valueno> indexed_slots;
+
+    /// Is @a indexed_slots up to date?
+    mutable bool indexed_slots_valid;
+
     void add_value(Xapian::docid did, Xapian::valueno slot,
 		   const std::string & val);
 
@@ -110,7 +177,8 @@ class BrassValueManager {
 		      BrassTermListTable * termlist_table_)
 	: mru_slot(Xapian::BAD_VALUENO),
 	  postlist_table(postlist_table_),
-	  termlist_table(termlist_table_) { }
+	  termlist_table(termlist_table_),
+	  indexed_slots_valid(false) { }
 
     // Merge in batched-up changes.
     void merge_changes();
@@ -126,6 +194,34 @@ class BrassValueManager {
 
     std::string get_value(Xapian::docid did, Xapian::valueno slot) const;
 
+    /// Does value slot @a slot have an index?
+    bool is_indexed(Xapian::valueno slot) const;
+
+    /** Set which value slots have an index.
+     *
+     *  This should only be called for a new database, before any values
+     *  are added.
+     */
+    void set_indexed_slots(const std::set<Xapian::valueno> & slots_);
+
+    /** Find the documents with a value in a range using the slot's index.
+     *
+     *  @param slot	The value slot.
+     *  @param begin	The start of the range.
+     *  @param end	The end of the range, or NULL for no upper limit.
+     *  @param max_size	The most documents to find.
+     *  @param dids	Set to the docids of the documents, in ascending
+     *			order.
+     *
+     *  @return false if @a slot has no index, or more than @a max_size
+     *		documents have a value in the range.
+     */
+    bool get_value_range_docids(Xapian::valueno slot,
+				const std::string & begin,
+				const std::string * end,
+				Xapian::doccount max_size,
+				std::vector<Xapian::docid> & dids) const;
+
     void get_all_values(std::map<Xapian::valueno, std::string> & values,
 			Xapian::docid did) const;
 
@@ -156,6 +252,7 @@ class BrassValueManager {
     void reset() {
 	/// Ignore any old cached valuestats.
 	mru_slot = Xapian::BAD_VALUENO;
+	indexed_slots_valid = false;
     }
 
     bool is_modified() const {
@@ -171,17 +268,143 @@ class BrassValueManager {
 
 namespace Brass {
 
+/** Re-encode a value stream chunk in the format the table flags select.
+ *
+ *  With BrassTable::FLAG_NUMERIC_VALUES set in @a flags, a chunk whose
+ *  values are all integers encoded with Xapian::sortable_serialise() is
+ *  stored as a numeric column if that is no larger.  Otherwise, or without
+ *  that flag, it is stored as strings.
+ *
+ *  Docids in both formats are stored relative to the first docid, which is
+ *  in the key, so the conversion doesn't need to know it.
+ *
+ *  @param tag	The chunk to convert, which is updated in place.
+ *  @param flags	The flags of the table the chunk is for.
+ */
+void convert_value_chunk(std::string & tag, unsigned flags);
+
+/** Summarise the values in a value stream chunk.
+ *
+ *  The summary holds the offset of the chunk's last docid from its first,
+ *  and the smallest and largest values in the chunk, so a range filter can
+ *  tell whether any or all of the chunk's values are in range without
+ *  reading it.
+ *
+ *  @param tag	The chunk, in either format.
+ *
+ *  @return The encoded summary.
+ */
+std::string summarise_value_chunk(const std::string & tag);
+
+/** Encode the list of value slots which have an index.
+ *
+ *  @param slots	The slots, which must be in ascending order.
+ */
+std::string encode_indexed_slots(const std::set<Xapian::valueno> & slots);
+
+/** Decode a list of value slots from encode_indexed_slots(). */
+void decode_indexed_slots(const std::string & tag,
+			  std::set<Xapian::valueno> & slots);
+
+/** Decode the key of a value index entry.
+ *
+ *  @param key	The key, which must start with the value index prefix.
+ *  @param slot	Set to the value slot.
+ *  @param value	Set to the value, which may have been truncated.
+ *  @param did	Set to the docid.
+ *
+ *  @return false if @a key is the list of indexed slots rather than an
+ *	    entry.
+ */
+bool decode_valueindex_key(const std::string & key, Xapian::valueno & slot,
+			   std::string & value, Xapian::docid & did);
+
+/** The decoded summary of a value stream chunk. */
+struct ValueChunkSummary {
+    /// The first docid in the chunk.
+    Xapian::docid first_did;
+
+    /// The last docid in the chunk.
+    Xapian::docid last_did;
+
+    /// The smallest value in the chunk.
+    std::string lower_bound;
+
+    /// The largest value in the chunk.
+    std::string upper_bound;
+
+    ValueChunkSummary() : first_did(0), last_did(0) { }
+
+    /** Decode a summary from summarise_value_chunk().
+     *
+     *  @param first_did_	The first docid in the chunk.
+     */
+    void decode(const std::string & tag, Xapian::docid first_did_);
+};
+
+/** Reads the entries in a value stream chunk.
+ *
+ *  A chunk is either a list of docids and string values, or a numeric
+ *  column.  A numeric column starts with a zero byte (which can't start a
+ *  string chunk since empty values aren't stored), then holds the number of
+ *  entries and the smallest value, then for each block of
+ *  BITPACK_BLOCK_SIZE entries the increase in the last docid over the
+ *  previous block, followed by the docid gaps and the offsets of the values
+ *  from the smallest, each bit-packed with a byte giving the bit width
+ *  first.  The last block is padded with zeros.
+ */
 class ValueChunkReader {
     const char *p;
     const char *end;
 
     Xapian::docid did;
 
-    std::string value;
+    /** The current value.
+     *
+     *  For a numeric column this is only set when get_value() is called.
+     */
+    mutable std::string value;
+
+    /// Is the chunk a numeric column?
+    bool numeric;
+
+    /// Is @a value set for the current entry of a numeric column?
+    mutable bool value_set;
+
+    /// The number of entries in blocks not yet decoded.
+    Xapian::doccount remaining;
+
+    /// The last docid in the current block.
+    Xapian::docid block_last;
+
+    /// The smallest value in the numeric column, offset as by to_offset().
+    uint8 base;
+
+    /// The index of the current entry in the current block.
+    unsigned idx;
+
+    /// The number of entries in the current block.
+    unsigned block_size;
+
+    /// The docids in the current block.
+    Xapian::docid dids[BITPACK_BLOCK_SIZE];
+
+    /// The offsets from @a base of the values in the current block.
+    uint4 offsets[BITPACK_BLOCK_SIZE];
+
+    /** Decode the next block of a numeric column.
+     *
+     *  Blocks whose last docid is less than @a target are skipped over
+     *  without being decoded.
+     */
+    void read_block(Xapian::docid target);
+
+    /// Set @a value from the current entry of a numeric column.
+    void set_value_from_number() const;
 
   public:
     /// Create a ValueChunkReader which is already at_end().
-    ValueChunkReader() : p(NULL) { }
+    ValueChunkReader() : p(NULL), numeric(false) { }
 
     ValueChunkReader(const char * p_, size_t len, Xapian::docid did_) {
 	assign(p_, len, did_);
@@ -193,7 +416,27 @@ class ValueChunkReader {
 
     Xapian::docid get_docid() const { return did; }
 
-    const std::string & get_value() const { return value; }
+    const std::string & get_value() const {
+	if (numeric && !value_set) set_value_from_number();
+	return value;
+    }
+
+    /// Is the chunk a numeric column?
+    bool is_numeric() const { return numeric; }
+
+    /** Return the current value as a number.
+     *
+     *  This must only be called if is_numeric() returns true.
+     */
+    double get_number() const;
+
+    /** Return the offset representing integer @a number, which must be no
+     *  more than 2 to the power 53 in magnitude.
+     */
+    static uint8 to_offset(double number);
+
+    /// Return the integer represented by @a offset.
+    static double from_offset(uint8 offset);
 
     void next();
 
@@ -191,6 +191,7 @@ ChertDatabase::create_and_open_tables(unsigned int block_size)
     // Create postlist_table first, and record_table last.  Existence of
     // record_table is considered to imply existence of the database.
     version_file.create();
+    use_block_cache();
     postlist_table.create_and_open(block_size);
     position_table.create_and_open(block_size);
     termlist_table.create_and_open(block_size);
@@ -209,6 +210,20 @@ ChertDatabase::create_and_open_tables(unsigned int block_size)
     stats.zero();
 }
 
+void
+ChertDatabase::use_block_cache()
+{
+    LOGCALL_VOID(DB, "ChertDatabase::use_block_cache", NO_ARGS);
+    if (!BlockCache::get_instance()) return;
+    string db_id = version_file.get_uuid_string();
+    postlist_table.use_block_cache(db_id);
+    position_table.use_block_cache(db_id);
+    termlist_table.use_block_cache(db_id);
+    synonym_table.use_block_cache(db_id);
+    spelling_table.use_block_cache(db_id);
+    record_table.use_block_cache(db_id);
+}
+
 bool
 ChertDatabase::open_tables_consistent()
 {
@@ -223,8 +238,18 @@ ChertDatabase::open_tables_consistent()
 
     chert_revision_number_t cur_rev = record_table.get_open_revision_number();
 
-    // Check the version file unless we're reopening.
-    if (cur_rev == 0) version_file.read_and_check();
+    if (readonly && BlockCache::get_instance()) {
+	// The UUID forms part of the key for the shared block cache, and if
+	// we're reopening the database might have been replaced since we last
+	// read it, so we need to check the version file every time.
+	version_file.read_and_check();
+	use_block_cache();
+    } else if (cur_rev == 0) {
+	// Check the version file unless we're reopening.
+	version_file.read_and_check();
+	// A writer uses the cache to discard blocks it has superseded.
+	if (!readonly) use_block_cache();
+    }
 
     record_table.open();
     chert_revision_number_t revision = record_table.get_open_revision_number();
@@ -1008,7 +1033,8 @@ ChertDatabase::throw_termlist_table_close_exception() const
 
 ChertWritableDatabase::ChertWritableDatabase(const string &dir, int action,
 					       int block_size)
-	: ChertDatabase(dir, action, block_size),
+	// Chert doesn't support Xapian::DB_BULK_LOAD, so just ignore it.
+	: ChertDatabase(dir, action & XAPIAN_DB_ACTION_MASK, block_size),
 	  freq_deltas(),
 	  doclens(),
 	  mod_plists(),
@@ -138,6 +138,13 @@ class ChertDatabase : public Xapian::Database::Internal {
 	 */
 	bool open_tables_consistent();
 
+	/** Tell the tables to use the shared block cache, if it's enabled.
+	 *
+	 *  The version file must have been read or created first, since the
+	 *  database's UUID forms part of the cache key.
+	 */
+	void use_block_cache();
+
 	/** Get a write lock on the database, or throw an
 	 *  Xapian::DatabaseLockError if failure.
 	 *
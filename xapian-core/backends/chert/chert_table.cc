@@ -29,6 +29,7 @@
 #include <xapian/error.h>
 
 #include "safeerrno.h"
+#include "safesysstat.h"
 
 #include "omassert.h"
 #include "posixy_wrapper.h"
@@ -179,12 +180,46 @@ static inline byte *zeroed_new(size_t size)
 
 #define BYTE_PAIR_RANGE (1 << 2 * CHAR_BIT)
 
-/// read_block(n, p) reads block n of the DB file to address p.
-void
+/** read_block(n, p) reads block n of the DB file to address p.
+ *
+ *  If the table is using the shared block cache, the block is copied from
+ *  there if possible.  A block read from the file isn't added to the cache
+ *  here - the caller should call add_to_block_cache() once it has checked
+ *  the block is part of the revision we have open.
+ *
+ *  @return true if the block came from the shared block cache.
+ */
+bool
 ChertTable::read_block(uint4 n, byte * p) const
 {
     // Log the value of p, not the contents of the block it points to...
-    LOGCALL_VOID(DB, "ChertTable::read_block", n | (void*)p);
+    LOGCALL(DB, bool, "ChertTable::read_block", n | (void*)p);
+    if (block_cache && !writable &&
+	block_cache->lookup(block_cache_file, revision_number, n, p,
+			    block_size))
+	RETURN(true);
+    read_block_from_file(n, p);
+    RETURN(false);
+}
+
+/** add_to_block_cache(n, p) adds block n, read from the file to p, to the
+ *  shared block cache, if the table is using it.
+ */
+void
+ChertTable::add_to_block_cache(uint4 n, const byte * p) const
+{
+    LOGCALL_VOID(DB, "ChertTable::add_to_block_cache", n | (const void*)p);
+    // A block from a later revision has been overwritten since the revision
+    // we have open, so mustn't be shared with other readers of it.
+    if (block_cache && !writable && REVISION(p) <= revision_number)
+	block_cache->insert(block_cache_file, revision_number, n, p,
+			    block_size);
+}
+
+void
+ChertTable::read_block_from_file(uint4 n, byte * p) const
+{
+    LOGCALL_VOID(DB, "ChertTable::read_block_from_file", n | (void*)p);
     /* Use the base bit_map_size not the bitmap's size, because
      * the latter is uninitialised in readonly mode.
      */
@@ -325,6 +360,10 @@ ChertTable::set_overwritten() const
     // overwritten to be flagged, so that's a DatabaseCorruptError.
     if (writable)
 	throw Xapian::DatabaseCorruptError("Db block overwritten - are there multiple writers?");
+    // Other readers of this revision, or older ones, mustn't keep using
+    // cached copies of its blocks.
+    if (block_cache)
+	block_cache->discard(block_cache_file, revision_number + 1);
     throw Xapian::DatabaseModifiedError("The revision being read has been discarded - you should call Xapian::Database::reopen() and retry the operation");
 }
 
@@ -356,11 +395,12 @@ ChertTable::block_to_cursor(Cursor * C_, int j, uint4 n) const
 
     // Check if the block is in the built-in cursor (potentially in
     // modified form).
+    bool from_file = false;
     if (writable && n == C[j].n) {
 	if (p != C[j].p)
 	    memcpy(p, C[j].p, block_size);
     } else {
-	read_block(n, p);
+	from_file = !read_block(n, p);
     }
 
     C_[j].n = n;
@@ -381,6 +421,8 @@ ChertTable::block_to_cursor(Cursor * C_, int j, uint4 n) const
 	msg += str(GET_LEVEL(p));
 	throw Xapian::DatabaseCorruptError(msg);
     }
+
+    if (from_file) add_to_block_cache(n, p);
 }
 
 /** Btree::alter(); is called when the B-tree is to be altered.
@@ -1508,6 +1550,8 @@ ChertTable::do_open_to_write(bool revision_supplied,
 	throw Xapian::DatabaseOpeningError(message);
     }
 
+    register_with_block_cache();
+
     if (!basic_open(revision_supplied, revision_)) {
 	::close(handle);
 	handle = -1;
@@ -1569,7 +1613,9 @@ ChertTable::ChertTable(const char * tablename_, const string & path_,
 	  compress_strategy(compress_strategy_),
 	  deflate_zstream(NULL),
 	  inflate_zstream(NULL),
-	  lazy(lazy_)
+	  lazy(lazy_),
+	  block_cache(NULL),
+	  block_cache_file(0)
 {
     LOGCALL_CTOR(DB, "ChertTable", tablename_ | path_ | readonly_ | compress_strategy_ | lazy_);
 }
@@ -1681,6 +1727,36 @@ ChertTable::erase()
     (void)io_unlink(name + "DB");
 }
 
+void
+ChertTable::use_block_cache(const string & db_id)
+{
+    LOGCALL_VOID(DB, "ChertTable::use_block_cache", db_id);
+    block_cache_id = db_id;
+}
+
+void
+ChertTable::register_with_block_cache()
+{
+    LOGCALL_VOID(DB, "ChertTable::register_with_block_cache", NO_ARGS);
+    block_cache = NULL;
+    if (block_cache_id.empty()) return;
+    BlockCache * cache = BlockCache::get_instance();
+    struct stat statbuf;
+    if (!cache || fstat(handle, &statbuf) < 0) return;
+    // Copies of a database have the same UUID, and if they're modified
+    // separately they can reach the same revision with different blocks, so
+    // we need to identify the file itself too.
+    string id(block_cache_id);
+    id += '/';
+    id += tablename;
+    id += '/';
+    id += str(static_cast<unsigned long long>(statbuf.st_dev));
+    id += ':';
+    id += str(static_cast<unsigned long long>(statbuf.st_ino));
+    block_cache = cache;
+    block_cache_file = cache->register_file(id);
+}
+
 void
 ChertTable::set_block_size(unsigned int block_size_)
 {
@@ -1882,6 +1958,12 @@ ChertTable::commit(chert_revision_number_t revision, int changes_fd,
 
 	read_root();
 
+	if (block_cache) {
+	    // Readers of older revisions mustn't keep using cached copies of
+	    // blocks we may now reuse.
+	    block_cache->discard(block_cache_file, revision_number);
+	}
+
 	changed_n = 0;
 	changed_c = DIR_START;
 	seq_count = SEQ_START_POINT;
@@ -2003,6 +2085,8 @@ ChertTable::do_open_to_read(bool revision_supplied, chert_revision_number_t revi
 	throw Xapian::DatabaseOpeningError(message);
     }
 
+    register_with_block_cache();
+
     if (!basic_open(revision_supplied, revision_)) {
 	::close(handle);
 	handle = -1;
@@ -2103,8 +2187,8 @@ ChertTable::prev_for_sequential(Cursor * C_, int /*dummy*/) const
 		    // block.
 		    read_block(n, p);
 		}
-	    } else {
-		read_block(n, p);
+	    } else if (!read_block(n, p)) {
+		add_to_block_cache(n, p);
 	    }
 	    if (writable) AssertEq(revision_number, latest_revision_number);
 	    if (REVISION(p) > revision_number + writable) {
@@ -2157,8 +2241,8 @@ ChertTable::next_for_sequential(Cursor * C_, int /*dummy*/) const
 		    // block.
 		    read_block(n, p);
 		}
-	    } else {
-		read_block(n, p);
+	    } else if (!read_block(n, p)) {
+		add_to_block_cache(n, p);
 	    }
 	    if (writable) AssertEq(revision_number, latest_revision_number);
 	    if (REVISION(p) > revision_number + writable) {
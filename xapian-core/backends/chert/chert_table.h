@@ -31,6 +31,8 @@
 #include "chert_btreebase.h"
 #include "chert_cursor.h"
 
+#include "backends/blockcache.h"
+
 #include "noreturn.h"
 #include "omassert.h"
 #include "str.h"
@@ -489,6 +491,17 @@ class XAPIAN_VISIBILITY_DEFAULT ChertTable {
 	/// Erase this table from disk.
 	void erase();
 
+	/** Share read blocks via the process-wide block cache, if enabled.
+	 *
+	 *  Only a table opened read-only reads blocks from the cache.  A
+	 *  writable table uses it to discard the cached blocks of revisions
+	 *  it has superseded when it commits.
+	 *
+	 *  @param db_id	A string which uniquely identifies the database
+	 *			this table is part of (e.g. its UUID).
+	 */
+	void use_block_cache(const std::string & db_id);
+
 	/** Set the block size.
 	 *
 	 *  It's only safe to do this before the table is created.
@@ -626,7 +639,10 @@ class XAPIAN_VISIBILITY_DEFAULT ChertTable {
 
 	bool find(Cursor *) const;
 	int delete_kt();
-	void read_block(uint4 n, byte *p) const;
+	bool read_block(uint4 n, byte *p) const;
+	void read_block_from_file(uint4 n, byte *p) const;
+	void add_to_block_cache(uint4 n, const byte *p) const;
+	void register_with_block_cache();
 	void write_block(uint4 n, const byte *p) const;
 	XAPIAN_NORETURN(void set_overwritten() const);
 	void block_to_cursor(Cursor *C_, int j, uint4 n) const;
@@ -794,6 +810,20 @@ class XAPIAN_VISIBILITY_DEFAULT ChertTable {
 	/// If true, don't create the table until it's needed.
 	bool lazy;
 
+	/** The id passed to use_block_cache(), or empty if the table doesn't
+	 *  use the shared block cache.
+	 */
+	std::string block_cache_id;
+
+	/** The shared block cache to use, or NULL to always read from disk.
+	 *
+	 *  A writable table never reads from it.
+	 */
+	BlockCache * block_cache;
+
+	/// The id of this table in block_cache.
+	unsigned block_cache_file;
+
 	/* Debugging methods */
 //	void report_block_full(int m, int n, const byte * p);
 };
@@ -56,6 +56,19 @@ Database::Internal::get_value_freq(Xapian::valueno) const
     throw Xapian::UnimplementedError("This backend doesn't support get_value_freq");
 }
 
+void
+Database::Internal::get_freqs(const vector<string> & terms,
+			      vector<Xapian::doccount> & termfreqs,
+			      vector<Xapian::termcount> & collfreqs) const
+{
+    termfreqs.resize(terms.size());
+    collfreqs.resize(terms.size());
+    for (size_t i = 0; i != terms.size(); ++i) {
+	termfreqs[i] = get_termfreq(terms[i]);
+	collfreqs[i] = get_collection_freq(terms[i]);
+    }
+}
+
 string
 Database::Internal::get_value_lower_bound(Xapian::valueno) const
 {
@@ -224,6 +237,31 @@ Database::Internal::open_value_list(Xapian::valueno slot) const
     return new SlowValueList(Xapian::Database(const_cast<Database::Internal*>(this)), slot);
 }
 
+bool
+Database::Internal::get_value_range_docids(Xapian::valueno, const string &,
+					   const string *, Xapian::doccount,
+					   vector<Xapian::docid> &) const
+{
+    // Only implemented for some database backends - others always read the
+    // value stream.
+    return false;
+}
+
+bool
+Database::Internal::get_impact_weighting(string &, string &) const
+{
+    // Only implemented for some database backends - others will always be
+    // searched in docid order.
+    return false;
+}
+
+ImpactList *
+Database::Internal::open_impact_list(const string &) const
+{
+    // We never get here, since get_impact_weighting() returns false.
+    return NULL;
+}
+
 TermList *
 Database::Internal::open_spelling_termlist(const string &) const
 {
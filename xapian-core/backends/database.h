@@ -26,6 +26,7 @@
 #define OM_HGUARD_DATABASE_H
 
 #include <string>
+#include <vector>
 
 #include "internaltypes.h"
 
@@ -39,6 +40,7 @@
 
 using namespace std;
 
+class ImpactList;
 class LeafPostList;
 class RemoteDatabase;
 
@@ -49,6 +51,11 @@ typedef Xapian::ValueIterator::Internal ValueList;
 // Used by brass and chert.
 const int XAPIAN_DB_READONLY = 0;
 
+/** Mask to extract the action from the flags passed when opening a
+ *  WritableDatabase (the other bits are flags like Xapian::DB_BULK_LOAD).
+ */
+const int XAPIAN_DB_ACTION_MASK = 0x0f;
+
 namespace Xapian {
 
 struct ReplicationInfo;
@@ -161,6 +168,22 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 	 */
 	virtual Xapian::termcount get_collection_freq(const string & tname) const = 0;
 
+	/** Return the term and collection frequencies of several terms.
+	 *
+	 *  The default implementation just calls get_termfreq() and
+	 *  get_collection_freq() for each term, but backends can override
+	 *  this to look up all the terms together more efficiently.
+	 *
+	 *  @param terms      The terms to look up.
+	 *  @param termfreqs  Set to the term frequency of each term in
+	 *                    @a terms.
+	 *  @param collfreqs  Set to the collection frequency of each term in
+	 *                    @a terms.
+	 */
+	virtual void get_freqs(const vector<string> & terms,
+			       vector<Xapian::doccount> & termfreqs,
+			       vector<Xapian::termcount> & collfreqs) const;
+
 	/** Return the frequency of a given value slot.
 	 *
 	 *  This is the number of documents which have a (non-empty) value
@@ -241,6 +264,59 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 	 */
 	virtual ValueList * open_value_list(Xapian::valueno slot) const;
 
+	/** Find the documents with a value in a range using an index.
+	 *
+	 *  Backends may keep an index of the values in some slots, ordered
+	 *  by value, which allows the documents matching a selective range
+	 *  to be found without reading the values of the other documents.
+	 *
+	 *  @param slot	The value slot.
+	 *  @param begin	The start of the range.
+	 *  @param end	The end of the range, or NULL for no upper limit.
+	 *  @param max_size	The most documents the caller wants.
+	 *  @param dids	Set to the docids of the documents with a value in
+	 *			the range, in ascending order.
+	 *
+	 *  @return	false if there's no index for @a slot, or more than
+	 *		@a max_size documents have a value in the range, in
+	 *		which case the caller should read the value stream
+	 *		instead.
+	 */
+	virtual bool get_value_range_docids(Xapian::valueno slot,
+					    const string & begin,
+					    const string * end,
+					    Xapian::doccount max_size,
+					    vector<Xapian::docid> & dids) const;
+
+	/** Get the weighting scheme used for impact-ordered posting lists.
+	 *
+	 *  Impact-ordered posting lists are an optional secondary posting
+	 *  format, built by the compactor, which hold each term's postings in
+	 *  descending order of their contribution to the weight under a
+	 *  particular weighting scheme (with wqf 1 and no scaling).
+	 *
+	 *  @param name	Set to the name of the weighting scheme.
+	 *  @param params	Set to the serialised parameters of the weighting
+	 *			scheme.
+	 *
+	 *  @return	true if the database has impact-ordered posting lists
+	 *		which are current (i.e. the database hasn't been modified
+	 *		since they were built), false otherwise.
+	 */
+	virtual bool get_impact_weighting(string & name, string & params) const;
+
+	/** Open the impact-ordered posting list for a term.
+	 *
+	 *  This should only be called if get_impact_weighting() returned true.
+	 *
+	 *  @param tname	The term.
+	 *
+	 *  @return	Pointer to a new ImpactList object which should be deleted
+	 *		by the caller once it is no longer needed, or NULL if the
+	 *		term doesn't index any documents.
+	 */
+	virtual ImpactList * open_impact_list(const string & tname) const;
+
 	/** Open a term list.
 	 *
 	 *  This is a list of all the terms contained by a given document.
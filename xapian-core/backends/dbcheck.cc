@@ -171,7 +171,7 @@ Database::check(const string & path, int opts, std::ostream &out)
 	// that we can cross-check the document lengths.
 	const char * tables[] = {
 	    "record", "termlist", "postlist", "position",
-	    "spelling", "synonym"
+	    "spelling", "synonym", "impact"
 	};
 	for (const char **t = tables;
 	     t != tables + sizeof(tables)/sizeof(tables[0]); ++t) {
@@ -0,0 +1,149 @@
+/** @file impactlist.cc
+ * @brief A posting list ordered by quantised impact.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "impactlist.h"
+
+#include "xapian/error.h"
+
+#include "noreturn.h"
+#include "omassert.h"
+#include "pack.h"
+#include "serialise-double.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/** Relative slack applied to the bounds on a segment's impacts.
+ *
+ *  The quantised impacts are calculated from the same inputs as the weights
+ *  the matcher calculates, but we allow for the bounds being rounded
+ *  differently to the impacts they're compared with.
+ */
+static const double BOUND_SLACK = 1e-9;
+
+XAPIAN_NORETURN(static void throw_corrupt());
+static void
+throw_corrupt()
+{
+    throw Xapian::DatabaseCorruptError("Bad impact-ordered posting list");
+}
+
+ImpactList::ImpactList(const string & data_)
+    : data(data_), impact(0)
+{
+    pos = data.data();
+    const char * end = pos + data.size();
+    try {
+	max_impact = unserialise_double(&pos, end);
+    } catch (const Xapian::SerialisationError &) {
+	throw_corrupt();
+    }
+    next();
+}
+
+void
+ImpactList::next()
+{
+    Assert(!at_end());
+    const char * end = data.data() + data.size();
+    if (pos == end) {
+	pos = NULL;
+	docids.clear();
+	return;
+    }
+
+    Xapian::doccount count;
+    if (!unpack_uint(&pos, end, &impact) || !unpack_uint(&pos, end, &count) ||
+	count == 0 || count > size_t(end - pos)) {
+	throw_corrupt();
+    }
+    docids.resize(count);
+    Xapian::docid did = 0;
+    for (Xapian::doccount i = 0; i != count; ++i) {
+	Xapian::docid inc;
+	if (!unpack_uint(&pos, end, &inc)) throw_corrupt();
+	did += inc;
+	docids[i] = did;
+    }
+}
+
+double
+ImpactList::get_upper_bound() const
+{
+    return impact * max_impact / MAX_QUANTISED_IMPACT * (1 + BOUND_SLACK);
+}
+
+double
+ImpactList::get_lower_bound() const
+{
+    if (impact == 0) return 0;
+    return (impact - 1) * max_impact / MAX_QUANTISED_IMPACT * (1 - BOUND_SLACK);
+}
+
+/// Order postings by descending quantised impact, then ascending docid.
+struct ByImpact {
+    bool operator()(const pair<unsigned, Xapian::docid> & a,
+		    const pair<unsigned, Xapian::docid> & b) const {
+	if (a.first != b.first) return a.first > b.first;
+	return a.second < b.second;
+    }
+};
+
+void
+ImpactList::encode(string & out, vector<pair<double, Xapian::docid> > & postings)
+{
+    double max_impact = 0;
+    vector<pair<double, Xapian::docid> >::const_iterator i;
+    for (i = postings.begin(); i != postings.end(); ++i) {
+	max_impact = max(max_impact, i->first);
+    }
+
+    vector<pair<unsigned, Xapian::docid> > quantised;
+    quantised.reserve(postings.size());
+    for (i = postings.begin(); i != postings.end(); ++i) {
+	unsigned q = 0;
+	if (i->first > 0) {
+	    // Round up, so the impact is no more than the upper bound of its
+	    // segment and more than its lower bound.
+	    double scaled = ceil(i->first / max_impact * MAX_QUANTISED_IMPACT);
+	    q = unsigned(max(1.0, min(scaled, double(MAX_QUANTISED_IMPACT))));
+	}
+	quantised.push_back(make_pair(q, i->second));
+    }
+    sort(quantised.begin(), quantised.end(), ByImpact());
+
+    out += serialise_double(max_impact);
+    vector<pair<unsigned, Xapian::docid> >::const_iterator j = quantised.begin();
+    while (j != quantised.end()) {
+	vector<pair<unsigned, Xapian::docid> >::const_iterator seg_end = j;
+	while (seg_end != quantised.end() && seg_end->first == j->first)
+	    ++seg_end;
+	pack_uint(out, j->first);
+	pack_uint(out, Xapian::doccount(seg_end - j));
+	Xapian::docid prev = 0;
+	for ( ; j != seg_end; ++j) {
+	    pack_uint(out, j->second - prev);
+	    prev = j->second;
+	}
+    }
+}
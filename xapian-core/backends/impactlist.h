@@ -0,0 +1,101 @@
+/** @file impactlist.h
+ * @brief A posting list ordered by quantised impact.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_IMPACTLIST_H
+#define XAPIAN_INCLUDED_IMPACTLIST_H
+
+#include "xapian/types.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/** A posting list ordered by quantised impact.
+ *
+ *  The postings for a term are grouped into segments, each holding the
+ *  documents whose contribution to the weight (the "impact") quantises to
+ *  the same value.  The segments are stored in descending order of impact,
+ *  and the documents within each segment in ascending docid order, so the
+ *  highest impact postings can be read without reading the rest.
+ *
+ *  The encoded form is the term's maximum impact as a serialised double,
+ *  then for each segment the quantised impact, the number of documents and
+ *  the docids delta-coded, all packed with pack_uint().
+ */
+class ImpactList {
+    /// The encoded impact list.
+    std::string data;
+
+    /// Position of the next segment in @a data.
+    const char * pos;
+
+    /// The maximum impact of any posting in this list.
+    double max_impact;
+
+    /// The quantised impact of the current segment.
+    unsigned impact;
+
+    /// The docids in the current segment.
+    std::vector<Xapian::docid> docids;
+
+    /// Don't allow assignment.
+    void operator=(const ImpactList &);
+
+    /// Don't allow copying.
+    ImpactList(const ImpactList &);
+
+  public:
+    /// The number of distinct non-zero quantised impacts.
+    static const unsigned MAX_QUANTISED_IMPACT = 255;
+
+    /** Construct from an encoded impact list.
+     *
+     *  The list is positioned on its first (highest impact) segment.
+     */
+    explicit ImpactList(const std::string & data_);
+
+    /// Return true if all the segments have been read.
+    bool at_end() const { return pos == NULL; }
+
+    /// Move to the next segment.
+    void next();
+
+    /// Return the quantised impact of the current segment.
+    unsigned get_impact() const { return impact; }
+
+    /// Return the docids in the current segment, in ascending order.
+    const std::vector<Xapian::docid> & get_docids() const { return docids; }
+
+    /// Return an upper bound on the impact of the current segment's postings.
+    double get_upper_bound() const;
+
+    /// Return a lower bound on the impact of the current segment's postings.
+    double get_lower_bound() const;
+
+    /** Encode an impact list.
+     *
+     *  @param out	String to append the encoded list to.
+     *  @param postings	The (impact, docid) pairs for the term, which this
+     *			method sorts.
+     */
+    static void encode(std::string & out,
+		       std::vector<std::pair<double, Xapian::docid> > & postings);
+};
+
+#endif // XAPIAN_INCLUDED_IMPACTLIST_H
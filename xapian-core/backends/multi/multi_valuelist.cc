@@ -43,8 +43,9 @@ struct SubValueList {
     }
 
     void skip_to(Xapian::docid did, size_t multiplier) {
-	// Translate did from merged docid.
-	did = (did - db_idx - 2 + multiplier) / multiplier + 1;
+	// Translate did from merged docid.  Add multiplier first, as
+	// did - db_idx - 2 wraps when did is small.
+	did = (did + multiplier - db_idx - 2) / multiplier + 1;
 	valuelist->skip_to(did);
     }
 
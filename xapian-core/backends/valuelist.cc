@@ -26,6 +26,21 @@ namespace Xapian {
 
 ValueIterator::Internal::~Internal() { }
 
+bool
+ValueIterator::Internal::get_value_as_number(double &) const
+{
+    return false;
+}
+
+bool
+ValueIterator::Internal::skip_to_value_range(Xapian::docid,
+					     const std::string &,
+					     const std::string *,
+					     Xapian::docid &)
+{
+    return false;
+}
+
 bool
 ValueIterator::Internal::check(Xapian::docid did)
 {
@@ -33,4 +48,20 @@ ValueIterator::Internal::check(Xapian::docid did)
     return true;
 }
 
+Xapian::doccount
+ValueIterator::Internal::read_batch(Xapian::docid did, Xapian::docid end_did,
+				    Xapian::doccount max,
+				    Xapian::docid * dids, std::string * values)
+{
+    Xapian::doccount n = 0;
+    for (skip_to(did); !at_end() && n != max; next()) {
+	Xapian::docid d = get_docid();
+	if (d >= end_did) break;
+	dids[n] = d;
+	values[n] = get_value();
+	++n;
+    }
+    return n;
+}
+
 }
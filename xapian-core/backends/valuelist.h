@@ -51,6 +51,22 @@ class Xapian::ValueIterator::Internal : public Xapian::Internal::intrusive_base
     /// Return the value at the current position.
     virtual std::string get_value() const = 0;
 
+    /** Return the value at the current position as a number.
+     *
+     *  Some backends can store values encoded with
+     *  Xapian::sortable_serialise() as numbers, in which case this avoids
+     *  converting them to a string and back.
+     *
+     *  @param result	Set to the number the value encodes, if this method
+     *			returns true.
+     *
+     *  @return true if @a result was set, or false if the caller needs to
+     *		decode get_value() itself.
+     *
+     *  The default implementation returns false.
+     */
+    virtual bool get_value_as_number(double & result) const;
+
     /// Return the value slot for the current position/this iterator.
     virtual Xapian::valueno get_valueno() const = 0;
 
@@ -92,6 +108,58 @@ class Xapian::ValueIterator::Internal : public Xapian::Internal::intrusive_base
      */
     virtual bool check(Xapian::docid did);
 
+    /** Skip forward to an entry which might have a value in a range.
+     *
+     *  This moves to the first entry at or after @a did, except that it may
+     *  skip over entries which are known to have values outside the range.
+     *  Backends which keep summaries of the values in parts of the stream
+     *  can use this to avoid reading those parts with no values in range.
+     *
+     *  @param did	The docid to skip to.
+     *  @param lo	The lower end of the range.
+     *  @param hi	The upper end of the range, or NULL if there isn't one.
+     *  @param all_match_until	Set to a docid such that the values of all
+     *			the entries from the new position up to it are known
+     *			to be in range, or 0 if nothing is known.
+     *
+     *  @return false if this list has no summaries, in which case it
+     *		hasn't moved and the caller should check each value itself;
+     *		true otherwise.
+     *
+     *  The default implementation returns false.
+     */
+    virtual bool skip_to_value_range(Xapian::docid did,
+				     const std::string & lo,
+				     const std::string * hi,
+				     Xapian::docid & all_match_until);
+
+    /** Read the entries for a range of docids.
+     *
+     *  This moves to the first entry at or after @a did, as skip_to() does,
+     *  then reads entries until it reaches one at or after @a end_did or
+     *  has read @a max.  The list is left on the first entry not read (or
+     *  at_end()).
+     *
+     *  @param did	The first docid to read.
+     *  @param end_did	The docid to stop before.
+     *  @param max	The most entries to read.
+     *  @param dids	Array of at least @a max elements to store the
+     *			docids of the entries read in.
+     *  @param values	Array of at least @a max elements to store the
+     *			values of the entries read in.
+     *
+     *  @return The number of entries read.
+     *
+     *  The default implementation uses skip_to(), next() and get_value(),
+     *  but backends which can read a run of entries more cheaply than by
+     *  making those calls for each should override it.
+     */
+    virtual Xapian::doccount read_batch(Xapian::docid did,
+					Xapian::docid end_did,
+					Xapian::doccount max,
+					Xapian::docid * dids,
+					std::string * values);
+
     /// Return a string description of this object.
     virtual std::string get_description() const = 0;
 };
@@ -25,6 +25,7 @@
 #include <xapian.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "gnu_getopt.h"
@@ -37,18 +38,35 @@ using namespace std;
 #define OPT_HELP 1
 #define OPT_VERSION 2
 #define OPT_NO_RENUMBER 3
+#define OPT_DICTIONARY 4
+#define OPT_IMPACTS 5
+#define OPT_REORDER 6
 
 static void show_usage() {
     cout << "Usage: "PROG_NAME" [OPTIONS] SOURCE_DATABASE... DESTINATION_DATABASE\n\n"
 "Options:\n"
 "  -b, --blocksize   Set the blocksize in bytes (e.g. 4096) or K (e.g. 4K)\n"
 "                    (must be between 2K and 64K and a power of 2, default 8K)\n"
+"                    or for one table with TABLE=SIZE (e.g. postlist=64K) -\n"
+"                    may be given more than once (brass only)\n"
 "  -n, --no-full     Disable full compaction\n"
 "  -F, --fuller      Enable fuller compaction (not recommended if you plan to\n"
 "                    update the compacted database)\n"
 "  -m, --multipass   If merging more than 3 databases, merge the postlists in\n"
 "                    multiple passes (which is generally faster but requires\n"
 "                    more disk space for temporary files)\n"
+"      --dictionary  Train a dictionary from the document data and termlists\n"
+"                    and compress them against it (brass only)\n"
+"      --impacts     Also store postings in impact order, so the top documents\n"
+"                    for OR queries can be found without reading all of each\n"
+"                    posting list (brass only)\n"
+"      --reorder=KEY Renumber the documents in order of KEY, which is either a\n"
+"                    value slot number (e.g. one holding each document's URL),\n"
+"                    or 'similarity' to put documents with terms in common\n"
+"                    near each other.  This makes the posting lists smaller,\n"
+"                    but means indexing every document again into a\n"
+"                    temporary database, which needs about as much disk\n"
+"                    space again as the output\n"
 "      --no-renumber Preserve the numbering of document ids (useful if you have\n"
 "                    external references to them, or have set them to match\n"
 "                    unique ids from an external source).  Currently this\n"
@@ -110,6 +128,9 @@ main(int argc, char **argv)
 	{"multipass",	no_argument, 0, 'm'},
 	{"blocksize",	required_argument, 0, 'b'},
 	{"no-renumber", no_argument, 0, OPT_NO_RENUMBER},
+	{"dictionary",	no_argument, 0, OPT_DICTIONARY},
+	{"impacts",	no_argument, 0, OPT_IMPACTS},
+	{"reorder",	required_argument, 0, OPT_REORDER},
 	{"quiet",	no_argument, 0, 'q'},
 	{"help",	no_argument, 0, OPT_HELP},
 	{"version",	no_argument, 0, OPT_VERSION},
@@ -122,8 +143,16 @@ main(int argc, char **argv)
     while ((c = gnu_getopt_long(argc, argv, opts, long_opts, 0)) != -1) {
 	switch (c) {
 	    case 'b': {
+		// A "TABLE=" prefix sets the blocksize for just that table.
+		string table;
+		const char * value = optarg;
+		const char * eq = strchr(optarg, '=');
+		if (eq) {
+		    table.assign(optarg, eq - optarg);
+		    value = eq + 1;
+		}
 		char *p;
-		size_t block_size = strtoul(optarg, &p, 10);
+		size_t block_size = strtoul(value, &p, 10);
 		if (block_size <= 64 && (*p == 'K' || *p == 'k')) {
 		    ++p;
 		    block_size *= 1024;
@@ -135,7 +164,11 @@ main(int argc, char **argv)
 			 << endl;
 		    exit(1);
 		}
-		compactor.set_block_size(block_size);
+		if (eq) {
+		    compactor.set_block_size(table, block_size);
+		} else {
+		    compactor.set_block_size(block_size);
+		}
 		break;
 	    }
 	    case 'n':
@@ -150,6 +183,28 @@ main(int argc, char **argv)
 	    case OPT_NO_RENUMBER:
 		compactor.set_renumber(false);
 		break;
+	    case OPT_DICTIONARY:
+		compactor.set_dictionary_training(true);
+		break;
+	    case OPT_IMPACTS:
+		compactor.set_impact_ordering(true);
+		break;
+	    case OPT_REORDER: {
+		if (strcmp(optarg, "similarity") == 0) {
+		    compactor.set_reorder_by_similarity();
+		    break;
+		}
+		char *p;
+		unsigned long slot = strtoul(optarg, &p, 10);
+		if (!*optarg || *p || slot == Xapian::BAD_VALUENO) {
+		    cerr << PROG_NAME": Bad value '" << optarg
+			 << "' passed for reorder, must be a value slot number or 'similarity'"
+			 << endl;
+		    exit(1);
+		}
+		compactor.set_reorder_by_value(Xapian::valueno(slot));
+		break;
+	    }
 	    case 'q':
 		compactor.set_quiet(true);
 		break;
@@ -1,10 +1,13 @@
 noinst_HEADERS +=\
 	common/append_filename_arg.h\
 	common/autoptr.h\
+	common/bitpack.h\
 	common/bitstream.h\
+	common/blockruns.h\
 	common/closefrom.h\
 	common/compression_stream.h\
 	common/debuglog.h\
+	common/docidsearch.h\
 	common/fd.h\
 	common/filetests.h\
 	common/fileutils.h\
@@ -52,9 +55,11 @@ EXTRA_DIST +=\
 	common/Tokeniseise.pm
 
 lib_src +=\
+	common/bitpack.cc\
 	common/bitstream.cc\
 	common/closefrom.cc\
 	common/debuglog.cc\
+	common/docidsearch.cc\
 	common/fileutils.cc\
 	common/io_utils.cc\
 	common/keyword.cc\
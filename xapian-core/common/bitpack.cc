@@ -0,0 +1,152 @@
+/** @file bitpack.cc
+ * @brief Pack blocks of integers using a fixed number of bits for each.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "bitpack.h"
+
+#include "omassert.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/// The number of 32-bit lanes the values are interleaved across.
+const unsigned LANES = 4;
+
+/// The number of values packed into each lane.
+const unsigned PER_LANE = BITPACK_BLOCK_SIZE / LANES;
+
+unsigned
+bitpack_bits_needed(const uint4 * values, size_t n)
+{
+    uint4 all = 0;
+    for (size_t i = 0; i != n; ++i) all |= values[i];
+    unsigned bits = 0;
+    while (all) {
+	++bits;
+	all >>= 1;
+    }
+    return bits;
+}
+
+void
+bitpack_block(string & out, const uint4 * values, unsigned bits)
+{
+    AssertRel(bits,<=,32);
+    if (bits == 0) return;
+
+    // Word w of lane l is words[w * LANES + l].
+    uint4 words[32 * LANES];
+    memset(words, 0, bits * LANES * sizeof(uint4));
+    for (unsigned j = 0; j != PER_LANE; ++j) {
+	unsigned offset = j * bits;
+	unsigned w = offset / 32;
+	unsigned shift = offset % 32;
+	for (unsigned l = 0; l != LANES; ++l) {
+	    uint4 v = values[j * LANES + l];
+	    AssertRel(bitpack_bits_needed(&v, 1),<=,bits);
+	    words[w * LANES + l] |= v << shift;
+	    if (shift + bits > 32)
+		words[(w + 1) * LANES + l] |= v >> (32 - shift);
+	}
+    }
+
+    // Store the words little-endian.
+    size_t len = out.size();
+    out.resize(len + bits * LANES * 4);
+    unsigned char * p = reinterpret_cast<unsigned char *>(&out[len]);
+    for (unsigned i = 0; i != bits * LANES; ++i) {
+	uint4 word = words[i];
+	*p++ = static_cast<unsigned char>(word);
+	*p++ = static_cast<unsigned char>(word >> 8);
+	*p++ = static_cast<unsigned char>(word >> 16);
+	*p++ = static_cast<unsigned char>(word >> 24);
+    }
+}
+
+#ifdef __SSE2__
+void
+bitunpack_block(const char * p, uint4 * values, unsigned bits)
+{
+    AssertRel(bits,<=,32);
+    if (bits == 0) {
+	memset(values, 0, BITPACK_BLOCK_SIZE * sizeof(uint4));
+	return;
+    }
+
+    const __m128i * in = reinterpret_cast<const __m128i *>(p);
+    __m128i * o = reinterpret_cast<__m128i *>(values);
+    const __m128i mask =
+	_mm_set1_epi32(bits == 32 ? -1 : int((uint4(1) << bits) - 1));
+    __m128i cur = _mm_loadu_si128(in++);
+    unsigned shift = 0;
+    for (unsigned j = 0; j != PER_LANE; ++j) {
+	__m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(shift));
+	shift += bits;
+	if (shift >= 32 && j != PER_LANE - 1) {
+	    // This value (or the next) continues in the next word.
+	    shift -= 32;
+	    cur = _mm_loadu_si128(in++);
+	    if (shift) {
+		v = _mm_or_si128(v, _mm_sll_epi32(cur,
+						  _mm_cvtsi32_si128(bits - shift)));
+	    }
+	}
+	_mm_storeu_si128(o++, _mm_and_si128(v, mask));
+    }
+}
+#else
+/// Read the 32-bit little-endian word @a i from @a p.
+static inline uint4
+get_word(const unsigned char * p, unsigned i)
+{
+    p += i * 4;
+    return uint4(p[0]) | uint4(p[1]) << 8 | uint4(p[2]) << 16 |
+	   uint4(p[3]) << 24;
+}
+
+void
+bitunpack_block(const char * p, uint4 * values, unsigned bits)
+{
+    AssertRel(bits,<=,32);
+    if (bits == 0) {
+	memset(values, 0, BITPACK_BLOCK_SIZE * sizeof(uint4));
+	return;
+    }
+
+    const unsigned char * data = reinterpret_cast<const unsigned char *>(p);
+    const uint4 mask = bits == 32 ? uint4(-1) : (uint4(1) << bits) - 1;
+    for (unsigned j = 0; j != PER_LANE; ++j) {
+	unsigned offset = j * bits;
+	unsigned w = offset / 32;
+	unsigned shift = offset % 32;
+	for (unsigned l = 0; l != LANES; ++l) {
+	    uint4 v = get_word(data, w * LANES + l) >> shift;
+	    if (shift + bits > 32)
+		v |= get_word(data, (w + 1) * LANES + l) << (32 - shift);
+	    values[j * LANES + l] = v & mask;
+	}
+    }
+}
+#endif
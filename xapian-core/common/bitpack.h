@@ -0,0 +1,65 @@
+/** @file bitpack.h
+ * @brief Pack blocks of integers using a fixed number of bits for each.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_BITPACK_H
+#define XAPIAN_INCLUDED_BITPACK_H
+
+#include "internaltypes.h"
+
+#include <cstddef>
+#include <string>
+
+/** The number of values in a packed block.
+ *
+ *  A block of BITPACK_BLOCK_SIZE values packed with @a bits bits each takes
+ *  exactly 16 * @a bits bytes.  The values are interleaved across four
+ *  32-bit lanes (value i goes in lane i % 4), as in the "SIMD-BP128" scheme,
+ *  so a block can be unpacked four values at a time with SSE2 instructions.
+ *  The packed form is the same whether or not SSE2 is used.
+ */
+const unsigned BITPACK_BLOCK_SIZE = 128;
+
+/// Return the size in bytes of a block packed into @a bits bits per value.
+inline size_t
+bitpack_block_bytes(unsigned bits)
+{
+    return bits * (BITPACK_BLOCK_SIZE / 8);
+}
+
+/// Return the number of bits needed to store each of @a n values.
+unsigned bitpack_bits_needed(const uint4 * values, size_t n);
+
+/** Append BITPACK_BLOCK_SIZE values packed into @a bits bits each.
+ *
+ *  @param out	String to append the 16 * @a bits bytes of packed data to.
+ *  @param values	The values to pack, each of which must fit in @a bits
+ *			bits.
+ *  @param bits	The number of bits to use for each value (0 to 32).
+ */
+void bitpack_block(std::string & out, const uint4 * values, unsigned bits);
+
+/** Unpack a block of BITPACK_BLOCK_SIZE values.
+ *
+ *  @param p	Pointer to the 16 * @a bits bytes of packed data.
+ *  @param values	Array to store the BITPACK_BLOCK_SIZE values in.
+ *  @param bits	The number of bits each value was packed into.
+ */
+void bitunpack_block(const char * p, uint4 * values, unsigned bits);
+
+#endif // XAPIAN_INCLUDED_BITPACK_H
@@ -0,0 +1,81 @@
+/** @file blockruns.h
+ * @brief Coalesce block numbers into runs of adjacent blocks.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_BLOCKRUNS_H
+#define XAPIAN_INCLUDED_BLOCKRUNS_H
+
+#include "internaltypes.h"
+
+/** Coalesce a sequence of block numbers into runs of adjacent blocks.
+ *
+ *  This is used to issue one readahead request for each run of blocks,
+ *  rather than one per block.  Feed the block numbers in with add(), then
+ *  call flush() to get the final run.  A block which is already in the
+ *  current run is ignored, so a sorted list with repeats works.
+ */
+class BlockRuns {
+    /// The first block in the current run.
+    uint4 start;
+
+    /// The number of blocks in the current run (0 if there isn't one).
+    uint4 len;
+
+  public:
+    BlockRuns() : start(0), len(0) { }
+
+    /** Add block @a n.
+     *
+     *  @param[out] run_start, run_len	Set to the previous run if @a n
+     *					doesn't extend it.
+     *
+     *  @return true if a run was ended (and so returned).
+     */
+    bool add(uint4 n, uint4 & run_start, uint4 & run_len) {
+	if (len) {
+	    if (n >= start && n - start <= len) {
+		if (n - start == len) ++len;
+		return false;
+	    }
+	    run_start = start;
+	    run_len = len;
+	    start = n;
+	    len = 1;
+	    return true;
+	}
+	start = n;
+	len = 1;
+	return false;
+    }
+
+    /** End the current run.
+     *
+     *  @param[out] run_start, run_len	Set to the current run, if any.
+     *
+     *  @return true if there was a current run (and so it was returned).
+     */
+    bool flush(uint4 & run_start, uint4 & run_len) {
+	if (!len) return false;
+	run_start = start;
+	run_len = len;
+	len = 0;
+	return true;
+    }
+};
+
+#endif // XAPIAN_INCLUDED_BLOCKRUNS_H
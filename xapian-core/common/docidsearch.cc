@@ -0,0 +1,121 @@
+/** @file docidsearch.cc
+ * @brief Search an ascending array of docids.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "docidsearch.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/** Count the entries in @a docids[lo, hi) which are less than @a target.
+ *
+ *  Since the docids are ascending, this is the offset of the first entry
+ *  which isn't.
+ */
+static size_t
+count_below(const Xapian::docid * docids, size_t lo, size_t hi,
+	    Xapian::docid target)
+{
+#ifdef __SSE2__
+    // SSE2 only has signed comparisons, so flip the top bit of both sides to
+    // compare as unsigned.
+    const __m128i bias = _mm_set1_epi32(int(0x80000000u));
+    const __m128i t = _mm_xor_si128(_mm_set1_epi32(int(target)), bias);
+    size_t count = 0;
+    size_t i = lo;
+    while (i + 4 <= hi) {
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(docids + i));
+	v = _mm_xor_si128(v, bias);
+	int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, t)));
+	// The entries below target come first, so the mask is 0, 1, 3, 7 or
+	// 15.
+	if (mask != 15) {
+	    while (mask) {
+		++count;
+		mask >>= 1;
+	    }
+	    return count;
+	}
+	count += 4;
+	i += 4;
+    }
+    while (i != hi && docids[i] < target) {
+	++count;
+	++i;
+    }
+    return count;
+#else
+    return lower_bound(docids + lo, docids + hi, target) - (docids + lo);
+#endif
+}
+
+size_t
+docid_gallop(const Xapian::docid * docids, size_t n, Xapian::docid target)
+{
+    if (n == 0 || docids[0] >= target) return 0;
+    // Find a range [lo, hi) with docids[lo] < target and either hi == n or
+    // docids[hi] >= target, doubling the step each time.
+    size_t lo = 0;
+    size_t step = 1;
+    size_t hi;
+    while (true) {
+	hi = lo + step;
+	if (hi >= n) {
+	    hi = n;
+	    break;
+	}
+	if (docids[hi] >= target) break;
+	lo = hi;
+	step *= 2;
+    }
+    // We know docids[lo] < target.
+    ++lo;
+    if (hi - lo > 16) {
+	// Narrow the range with a binary chop before scanning it.
+	return lower_bound(docids + lo, docids + hi, target) - docids;
+    }
+    return lo + count_below(docids, lo, hi, target);
+}
+
+Xapian::docid
+docid_bitmap_next(const unsigned char * bitmap, Xapian::docid from,
+		  Xapian::docid last)
+{
+    if (from > last) return last + 1;
+    Xapian::docid byte_index = from / 8;
+    Xapian::docid last_byte = last / 8;
+    // Ignore the bits before from in its byte_index.
+    unsigned bits = bitmap[byte_index] >> (from % 8) << (from % 8);
+    while (bits == 0) {
+	if (byte_index == last_byte) return last + 1;
+	bits = bitmap[++byte_index];
+    }
+    Xapian::docid result = byte_index * 8;
+    while (!(bits & 1)) {
+	bits >>= 1;
+	++result;
+    }
+    return result <= last ? result : last + 1;
+}
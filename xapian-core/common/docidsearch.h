@@ -0,0 +1,60 @@
+/** @file docidsearch.h
+ * @brief Search an ascending array or a bitmap of docids.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_DOCIDSEARCH_H
+#define XAPIAN_INCLUDED_DOCIDSEARCH_H
+
+#include "xapian/types.h"
+
+#include <cstddef>
+
+/** Find the first docid which is at least @a target.
+ *
+ *  This uses a galloping (exponential) search, so the cost grows with the
+ *  logarithm of the distance moved rather than of @a n, which suits moving
+ *  forwards through a block of a posting list a little at a time.  Once the
+ *  search has narrowed to a few entries, they are compared four at a time
+ *  with SSE2 instructions where available.
+ *
+ *  @param docids	The docids, in strictly ascending order.
+ *  @param n		The number of entries in @a docids.
+ *  @param target	The docid to search for.
+ *
+ *  @return The index of the first entry >= @a target, or @a n if there
+ *	    isn't one.
+ */
+size_t docid_gallop(const Xapian::docid * docids, size_t n,
+		    Xapian::docid target);
+
+/** Find the first set bit in a bitmap at or after offset @a from.
+ *
+ *  Bit i of the bitmap is bit (i % 8) of byte (i / 8), counting from the
+ *  least significant bit.  Whole bytes of zeros are skipped at a time.
+ *
+ *  @param bitmap	The bitmap.
+ *  @param from		The offset to start from.
+ *  @param last		The offset of the last bit to look at.
+ *
+ *  @return The offset of the first set bit in [@a from, @a last], or
+ *	    @a last + 1 if there isn't one.
+ */
+Xapian::docid docid_bitmap_next(const unsigned char * bitmap,
+				Xapian::docid from, Xapian::docid last);
+
+#endif // XAPIAN_INCLUDED_DOCIDSEARCH_H
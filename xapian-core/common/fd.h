@@ -58,6 +58,13 @@ class FD {
 	fd = -1;
 	return ::close(fd_to_close);
     }
+
+    /// Stop managing the file descriptor, and return it.
+    int release() {
+	int fd_to_release = fd;
+	fd = -1;
+	return fd_to_release;
+    }
 };
 
 inline int close(FD & fd) {
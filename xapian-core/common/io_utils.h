@@ -62,6 +62,38 @@ inline bool io_sync(int fd)
 #endif
 }
 
+/** Start writing out any modified data for fd to disk, without waiting.
+ *
+ *  Starting writeback for several files before calling io_sync() on any of
+ *  them lets the writes proceed concurrently, so the io_sync() calls have
+ *  less to wait for.  This is only a hint, so any error is ignored, and it's
+ *  a no-op if sync_file_range() isn't available.
+ */
+inline void io_start_sync(int fd)
+{
+#ifdef HAVE_SYNC_FILE_RANGE
+    (void)sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#else
+    (void)fd;
+#endif
+}
+
+/** Hint that n bytes at offset o in file descriptor fd will be read soon.
+ *
+ *  This just advises the OS to start reading the data in the background, so
+ *  any error is ignored, and it's a no-op if posix_fadvise() isn't available.
+ */
+inline void io_readahead(int fd, off_t o, off_t n)
+{
+#ifdef HAVE_POSIX_FADVISE
+    (void)posix_fadvise(fd, o, n, POSIX_FADV_WILLNEED);
+#else
+    (void)fd;
+    (void)o;
+    (void)n;
+#endif
+}
+
 /** Read n bytes (or until EOF) into block pointed to by p from file descriptor
  *  fd.
  *
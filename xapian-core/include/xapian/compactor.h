@@ -28,6 +28,7 @@
 #endif
 
 #include <xapian/intrusive_ptr.h>
+#include <xapian/types.h>
 #include <xapian/visibility.h>
 #include <string>
 
@@ -60,6 +61,21 @@ class XAPIAN_VISIBILITY_DEFAULT Compactor {
      */
     void set_block_size(size_t block_size);
 
+    /** Set the block size to use for one table in the output database.
+     *
+     *  This overrides the block size set by the other form of this method
+     *  for the table named @a table (e.g. "postlist" or "record").  Larger
+     *  blocks suit tables which are mostly read sequentially (such as the
+     *  postlist table), while smaller blocks reduce the amount read for
+     *  random lookups.  Currently this is only supported by the brass
+     *  backend, and ignored by chert.
+     *
+     *  @param table	The name of the table.
+     *  @param block_size	The block size to use (see the other form of
+     *				this method for valid block sizes).
+     */
+    void set_block_size(const std::string & table, size_t block_size);
+
     /** Set whether to preserve existing document id values.
      *
      *  @param renumber	The default is true, which means that document ids will
@@ -93,6 +109,66 @@ class XAPIAN_VISIBILITY_DEFAULT Compactor {
      */
     void set_compaction_level(compaction_level compaction);
 
+    /** Set whether to train compression dictionaries.
+     *
+     *  @param train	If true, build a dictionary from a sample of the
+     *			document data and termlists, and compress these tables
+     *			against it in the output.  This can greatly improve
+     *			the compression of small, similar documents.  By
+     *			default we don't do this, but keep any dictionaries
+     *			the source databases use.  Currently this is only
+     *			supported by the brass backend, and ignored by chert.
+     */
+    void set_dictionary_training(bool train);
+
+    /** Set whether to build impact-ordered posting lists.
+     *
+     *  @param impacts	If true, also store each term's postings in
+     *			descending order of their weight under the default
+     *			Xapian::BM25Weight weighting scheme.  Xapian::Enquire
+     *			uses these to find the top documents for a query
+     *			which is an OP_OR of terms (or a single term)
+     *			weighted with that scheme without reading the whole
+     *			of each posting list.  They are ignored once the
+     *			database has been modified.  By default they aren't
+     *			built.  Currently this is only supported by the
+     *			brass backend, and ignored by chert.
+     */
+    void set_impact_ordering(bool impacts);
+
+    /** Reorder the documents by the value in a slot.
+     *
+     *  The documents are renumbered so that their document ids are in
+     *  ascending string order of the value in slot @a slot (documents
+     *  without a value in that slot come first).  Documents with equal
+     *  values keep their existing relative order.  For example, storing
+     *  each document's URL in a slot and reordering by it tends to give
+     *  similar documents nearby document ids, which makes the posting
+     *  lists smaller and faster to decode.
+     *
+     *  Reordering isn't done as part of merging the tables.  Instead every
+     *  document is read from the sources and added, in the new order, to a
+     *  temporary database in the destination directory, which is then
+     *  compacted to give the output.  So it takes about as long as indexing
+     *  the documents again (plus the compaction), and needs room in the
+     *  destination for the temporary database as well as the output -
+     *  roughly twice the size of the compacted database - until it
+     *  finishes.  With brass the temporary database is bulk loaded, which
+     *  reduces the time.  It can't be combined with set_renumber(false).
+     *
+     *  @param slot	The value slot to order by.
+     */
+    void set_reorder_by_value(Xapian::valueno slot);
+
+    /** Reorder the documents so that similar documents are nearby.
+     *
+     *  This is like set_reorder_by_value(), but the documents are ordered
+     *  using a MinHash signature of the terms each indexes, so documents
+     *  which share terms tend to get nearby document ids without needing a
+     *  suitable value to order by.
+     */
+    void set_reorder_by_similarity();
+
     /** Set where to write the output.
      *
      *  @param destdir	Output path.  This can be the same as an input if that
@@ -100,6 +100,26 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	/** Open a Database, automatically determining the database
 	 *  backend to use.
 	 *
+	 *  If XAPIAN_BLOCK_CACHE_SIZE is set in the environment to a number of
+	 *  bytes, blocks read from chert and brass databases opened read-only
+	 *  are kept in a cache of that size which is shared by all such
+	 *  databases in the process, so that Database objects open on the same
+	 *  database (even in different threads) don't each need to reread the
+	 *  blocks which every search visits.  A commit by a WritableDatabase
+	 *  in the same process drops the cached blocks of older revisions, so
+	 *  readers still get Xapian::DatabaseModifiedError once theirs has
+	 *  been overwritten.  A commit by another process can't do this, so
+	 *  a reader whose blocks are all cached may carry on seeing its old
+	 *  revision (which remains consistent) until reopen() is called.
+	 *
+	 *  If XAPIAN_BRASS_MMAP is set to a non-empty value, brass databases
+	 *  opened read-only are memory mapped instead.  Branch blocks are
+	 *  read in place, but leaf blocks are still copied, as cursors keep
+	 *  reading from them after a writer may have reused them.  The
+	 *  database files must not be truncated while mapped (e.g. by
+	 *  overwriting the database), as that will cause the process to be
+	 *  killed by SIGBUS.
+	 *
 	 * @param path directory that the database is stored in.
 	 */
 	explicit Database(const std::string &path);
@@ -566,6 +586,8 @@ class XAPIAN_VISIBILITY_DEFAULT WritableDatabase : public Database {
 	 *    none exists
 	 *  - Xapian::DB_OPEN open for read/write; fail if no db exists
 	 *
+	 *  This may be combined with Xapian::DB_BULK_LOAD using bitwise-or.
+	 *
 	 *  @exception Xapian::DatabaseCorruptError will be thrown if the
 	 *             database is in a corrupt state.
 	 *
@@ -987,6 +1009,31 @@ const int DB_CREATE_OR_OVERWRITE = 3;
 /** Open for read/write; fail if no db exists. */
 const int DB_OPEN = 4;
 
+/** Build a new database using bulk loading.
+ *
+ *  This flag can be combined (using bitwise-or) with one of the actions
+ *  above when opening a WritableDatabase.  If the database doesn't contain
+ *  any documents when it is opened, postlist changes are buffered in sorted
+ *  runs on disk which are merged into the postlist table in a single pass
+ *  when the changes are committed, rather than being merged into the table
+ *  as they are flushed.  This is much faster for building a large database
+ *  from scratch.
+ *
+ *  The posting lists are split into chunks afresh as the runs are merged,
+ *  and written with each block filled, so the postlist table ends up
+ *  compacted, as xapian-compact would leave it.
+ *
+ *  While bulk loading, changes are not automatically committed - they are
+ *  all committed when you call commit() (or when the database is closed).
+ *  Committing ends bulk loading, as does deleting or replacing an existing
+ *  document, or any operation which needs to read posting lists (term
+ *  frequencies and document lengths can be read without ending it).
+ *
+ *  Currently this is only supported by the brass backend, and is ignored
+ *  by other backends.
+ */
+const int DB_BULK_LOAD = 0x10;
+
 /** Show a short-format display of the B-tree contents.
  *
  *  For use with Xapian::Database::check().
@@ -197,6 +197,20 @@ class XAPIAN_VISIBILITY_DEFAULT Weight {
      */
     virtual double get_maxpart() const = 0;
 
+    /** Return an upper bound on what get_sumpart() can return for any
+     *  document in which the term's wdf is at most @a wdf_max.
+     *
+     *  Some backends store an upper bound on the wdf for each block of a
+     *  posting list, and the matcher uses this method to skip over blocks
+     *  which can't contain a high enough weight.
+     *
+     *  The default implementation just returns get_maxpart(), which is
+     *  always correct but means no blocks get skipped.
+     *
+     *  @param wdf_max	An upper bound on the wdf.
+     */
+    virtual double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
+
     /** Calculate the term-independent weight component for a document.
      *
      *  The parameter gives information about the document which may be used
@@ -443,6 +457,7 @@ class XAPIAN_VISIBILITY_DEFAULT TfIdfWeight : public Weight {
     double get_sumpart(Xapian::termcount wdf,
 		       Xapian::termcount doclen) const;
     double get_maxpart() const;
+    double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
 
     double get_sumextra(Xapian::termcount doclen) const;
     double get_maxextra() const;
@@ -546,6 +561,7 @@ class XAPIAN_VISIBILITY_DEFAULT BM25Weight : public Weight {
     double get_sumpart(Xapian::termcount wdf,
 		       Xapian::termcount doclen) const;
     double get_maxpart() const;
+    double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
 
     double get_sumextra(Xapian::termcount doclen) const;
     double get_maxextra() const;
@@ -605,6 +621,7 @@ class XAPIAN_VISIBILITY_DEFAULT TradWeight : public Weight {
     double get_sumpart(Xapian::termcount wdf,
 		       Xapian::termcount doclen) const;
     double get_maxpart() const;
+    double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
 
     double get_sumextra(Xapian::termcount doclen) const;
     double get_maxextra() const;
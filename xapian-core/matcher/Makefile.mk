@@ -7,6 +7,7 @@ noinst_HEADERS +=\
 	matcher/exactphrasepostlist.h\
 	matcher/externalpostlist.h\
 	matcher/extraweightpostlist.h\
+	matcher/impactmatch.h\
 	matcher/localsubmatch.h\
 	matcher/mergepostlist.h\
 	matcher/msetcmp.h\
@@ -21,6 +22,7 @@ noinst_HEADERS +=\
 	matcher/selectpostlist.h\
 	matcher/synonympostlist.h\
 	matcher/valuegepostlist.h\
+	matcher/valueindexpostlist.h\
 	matcher/valuerangepostlist.h\
 	matcher/valuestreamdocument.h
 
@@ -44,6 +46,7 @@ lib_src +=\
 	matcher/const_database_wrapper.cc\
 	matcher/exactphrasepostlist.cc\
 	matcher/externalpostlist.cc\
+	matcher/impactmatch.cc\
 	matcher/localsubmatch.cc\
 	matcher/mergepostlist.cc\
 	matcher/msetcmp.cc\
@@ -56,5 +59,6 @@ lib_src +=\
 	matcher/selectpostlist.cc\
 	matcher/synonympostlist.cc\
 	matcher/valuegepostlist.cc\
+	matcher/valueindexpostlist.cc\
 	matcher/valuerangepostlist.cc\
 	matcher/valuestreamdocument.cc
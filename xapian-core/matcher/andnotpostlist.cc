@@ -87,6 +87,14 @@ AndNotPostList::sync_and_skip_to(Xapian::docid id,
     RETURN(skip_to(id, w_min));
 }
 
+PostList *
+AndNotPostList::next_batch(double w_min, double w_stop, Xapian::doccount & n,
+			   Xapian::docid * docids, double * weights)
+{
+    LOGCALL(MATCH, PostList *, "AndNotPostList::next_batch", w_min | w_stop | n);
+    RETURN(next_batch_helper(this, w_min, w_stop, n, docids, weights));
+}
+
 PostList *
 AndNotPostList::skip_to(Xapian::docid did, double w_min)
 {
@@ -54,6 +54,9 @@ class AndNotPostList : public BranchPostList {
 	double recalc_maxweight();
 
 	PostList *next(double w_min);
+	PostList *next_batch(double w_min, double w_stop,
+			      Xapian::doccount & n,
+			      Xapian::docid * docids, double * weights);
 	PostList *skip_to(Xapian::docid did, double w_min);
 	bool   at_end() const;
 
@@ -0,0 +1,316 @@
+/** @file impactmatch.cc
+ * @brief Find the top documents using impact-ordered posting lists.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "impactmatch.h"
+
+#include "api/leafpostlist.h"
+#include "backends/impactlist.h"
+#include "debuglog.h"
+#include "internaltypes.h"
+#include "omassert.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+/** The accumulators, found by docid using a hash table.
+ *
+ *  This uses open addressing with linear probing, and its size is a power of
+ *  two which is kept at least twice the number of accumulators, so probe
+ *  sequences are short.  Empty buckets hold 0, and others the index of their
+ *  accumulator plus one.
+ */
+class ImpactMatch::AccumulatorTable {
+    /// The buckets.
+    vector<Xapian::doccount> buckets;
+
+    /// The shift which gives a bucket number from a hashed docid.
+    unsigned shift;
+
+    /// Return the bucket to start probing at for @a did.
+    size_t start(Xapian::docid did) const {
+	// Fibonacci hashing - take the top bits of the product, which depend
+	// on all the bits of the docid.
+	return (uint4(did) * uint4(0x9e3779b9)) >> shift;
+    }
+
+  public:
+    /// The accumulators.
+    vector<Accumulator> acc;
+
+    AccumulatorTable() : shift(32) { }
+
+    /** Make room for @a n accumulators without resizing.
+     *
+     *  If @a rebuild is true, the table is rebuilt at the size needed, which
+     *  is needed once accumulators have been removed from @a acc.
+     */
+    void reserve(size_t n, bool rebuild = false) {
+	size_t size = rebuild ? 0 : buckets.size();
+	if (size == 0) size = 16;
+	while (size < n * 2) size *= 2;
+	if (size == buckets.size() && !rebuild) return;
+
+	buckets.assign(size, 0);
+	shift = 32;
+	while (size > 1) {
+	    size >>= 1;
+	    --shift;
+	}
+	size_t mask = buckets.size() - 1;
+	for (size_t i = 0; i != acc.size(); ++i) {
+	    size_t b = start(acc[i].did);
+	    while (buckets[b]) b = (b + 1) & mask;
+	    buckets[b] = Xapian::doccount(i + 1);
+	}
+    }
+
+    /// Return the accumulator for @a did, or NULL if there isn't one.
+    Accumulator * find(Xapian::docid did) {
+	if (buckets.empty()) return NULL;
+	size_t mask = buckets.size() - 1;
+	size_t b = start(did);
+	while (true) {
+	    Xapian::doccount i = buckets[b];
+	    if (i == 0) return NULL;
+	    if (acc[i - 1].did == did) return &acc[i - 1];
+	    b = (b + 1) & mask;
+	}
+    }
+
+    /** Return the accumulator for @a did, adding one if there isn't one.
+     *
+     *  reserve() must have been called to make room for it.
+     */
+    Accumulator & find_or_add(Xapian::docid did) {
+	AssertRel(acc.size() * 2,<,buckets.size());
+	size_t mask = buckets.size() - 1;
+	size_t b = start(did);
+	while (true) {
+	    Xapian::doccount i = buckets[b];
+	    if (i == 0) break;
+	    if (acc[i - 1].did == did) return acc[i - 1];
+	    b = (b + 1) & mask;
+	}
+	acc.push_back(Accumulator(did));
+	buckets[b] = Xapian::doccount(acc.size());
+	return acc.back();
+    }
+};
+
+double
+ImpactMatch::get_upper_bound(const Accumulator & a) const
+{
+    double upper = a.upper;
+    for (size_t i = 0; i != terms.size(); ++i) {
+	if (a.seen & (Xapian::termcount(1) << i)) continue;
+	const ImpactList * impacts = terms[i].impacts;
+	if (!impacts->at_end()) upper += impacts->get_upper_bound();
+    }
+    return upper;
+}
+
+void
+ImpactMatch::prune_accumulators(AccumulatorTable & table,
+				double threshold) const
+{
+    vector<Accumulator> & acc = table.acc;
+    vector<Accumulator>::iterator keep = acc.begin();
+    vector<Accumulator>::const_iterator a;
+    for (a = acc.begin(); a != acc.end(); ++a) {
+	if (get_upper_bound(*a) < threshold) continue;
+	*keep = *a;
+	++keep;
+    }
+    acc.erase(keep, acc.end());
+    table.reserve(acc.size(), true);
+}
+
+ImpactMatch::~ImpactMatch()
+{
+    vector<ImpactTerm>::const_iterator i;
+    for (i = terms.begin(); i != terms.end(); ++i) {
+	delete i->impacts;
+	delete i->postlist;
+    }
+}
+
+void
+ImpactMatch::add_term(ImpactList * impacts, LeafPostList * postlist)
+{
+    AssertRel(terms.size(),<,MAX_TERMS);
+    ImpactTerm t;
+    t.impacts = impacts;
+    t.postlist = postlist;
+    terms.push_back(t);
+}
+
+bool
+ImpactMatch::get_top(Xapian::doccount max_msize, const MSetCmp & mcmp,
+		     vector<Xapian::Internal::MSetItem> & items,
+		     Xapian::doccount & docs_seen,
+		     double & greatest_wt,
+		     Xapian::termcount & greatest_wt_subqs_matched)
+{
+    LOGCALL(MATCH, bool, "ImpactMatch::get_top", max_msize | Literal("mcmp") | Literal("items") | docs_seen | greatest_wt | greatest_wt_subqs_matched);
+    AssertRel(max_msize,>,0);
+
+    // The accumulators for the documents seen.
+    AccumulatorTable table;
+    const vector<Accumulator> & acc = table.acc;
+
+    // A lower bound on the weight of the document ranked max_msize - the
+    // true weights of at least max_msize documents reach it.
+    double threshold = 0;
+    // The greatest lower bound accumulated for any document.
+    double max_lower = 0;
+    // The number of postings read since the threshold was last found.  Only
+    // finding it again once this reaches the number of accumulators keeps
+    // the cost of doing so proportional to the postings read.
+    size_t postings_since = 0;
+    // True while a document not yet seen might still make the MSet.
+    bool growing = true;
+    docs_seen = 0;
+    vector<double> lowers;
+    while (true) {
+	// The most that a document can gain from the segments not yet read.
+	double remaining = 0;
+	size_t best = terms.size();
+	double best_upper = -1;
+	for (size_t i = 0; i != terms.size(); ++i) {
+	    const ImpactList * impacts = terms[i].impacts;
+	    if (impacts->at_end()) continue;
+	    double upper = impacts->get_upper_bound();
+	    remaining += upper;
+	    if (upper > best_upper) {
+		best = i;
+		best_upper = upper;
+	    }
+	}
+	if (best == terms.size()) break;
+
+	bool prune = false;
+	if (acc.size() >= max_msize && postings_since >= acc.size() &&
+	    (!growing || remaining < max_lower)) {
+	    // Only worth finding the threshold if it might let us stop
+	    // accumulating or discard documents.
+	    lowers.clear();
+	    vector<Accumulator>::const_iterator a;
+	    for (a = acc.begin(); a != acc.end(); ++a) {
+		lowers.push_back(a->lower);
+	    }
+	    nth_element(lowers.begin(), lowers.begin() + (max_msize - 1),
+			lowers.end(), greater<double>());
+	    threshold = lowers[max_msize - 1];
+	    postings_since = 0;
+	    prune = !growing;
+	}
+	if (growing && remaining < threshold) {
+	    // No document we haven't seen can reach the threshold, so from now
+	    // on we just tighten the bounds for the documents we have seen.
+	    LOGLINE(MATCH, "Stopping accumulating with " << remaining << " < " << threshold);
+	    growing = false;
+	    docs_seen = acc.size();
+	    prune = true;
+	}
+	if (prune) {
+	    prune_accumulators(table, threshold);
+	    if (acc.size() / REFINE_TARGET <= max_msize) break;
+	}
+
+	ImpactList * impacts = terms[best].impacts;
+	double lower = impacts->get_lower_bound();
+	double upper = impacts->get_upper_bound();
+	Xapian::termcount bit = Xapian::termcount(1) << best;
+	const vector<Xapian::docid> & docids = impacts->get_docids();
+	vector<Xapian::docid>::const_iterator d;
+	if (growing) {
+	    table.reserve(acc.size() + docids.size());
+	    for (d = docids.begin(); d != docids.end(); ++d) {
+		Accumulator & a = table.find_or_add(*d);
+		a.lower += lower;
+		a.upper += upper;
+		a.seen |= bit;
+		if (a.lower > max_lower) max_lower = a.lower;
+	    }
+	} else {
+	    for (d = docids.begin(); d != docids.end(); ++d) {
+		Accumulator * a = table.find(*d);
+		if (!a) continue;
+		a->lower += lower;
+		a->upper += upper;
+		a->seen |= bit;
+	    }
+	}
+	postings_since += docids.size();
+	impacts->next();
+    }
+    if (growing) docs_seen = acc.size();
+
+    // Find the documents which might reach the threshold.
+    vector<Xapian::docid> candidates;
+    vector<Accumulator>::const_iterator a;
+    for (a = acc.begin(); a != acc.end(); ++a) {
+	if (get_upper_bound(*a) >= threshold) candidates.push_back(a->did);
+    }
+
+    // Weight them in ascending docid order, so the posting lists only move
+    // forwards.
+    sort(candidates.begin(), candidates.end());
+    items.clear();
+    greatest_wt = 0;
+    greatest_wt_subqs_matched = 0;
+    vector<Xapian::docid>::const_iterator c;
+    for (c = candidates.begin(); c != candidates.end(); ++c) {
+	Xapian::docid did = *c;
+	double wt = 0;
+	Xapian::termcount subqs = 0;
+	for (size_t i = 0; i != terms.size(); ++i) {
+	    LeafPostList * pl = terms[i].postlist;
+	    PostList * res = pl->skip_to(did, 0.0);
+	    Assert(res == NULL);
+	    (void)res;
+	    if (pl->at_end() || pl->get_docid() != did) continue;
+	    wt += pl->get_weight();
+	    ++subqs;
+	}
+	AssertRel(subqs,>,0);
+
+	items.push_back(Xapian::Internal::MSetItem(wt, did));
+	// Documents are considered in ascending docid order, so on a tie the
+	// one we already have ranks higher, as in the docid-ordered match.
+	if (wt > greatest_wt) {
+	    greatest_wt = wt;
+	    greatest_wt_subqs_matched = subqs;
+	}
+    }
+    LOGLINE(MATCH, "Weighted " << items.size() << " of " << docs_seen <<
+		   " documents seen");
+
+    if (items.size() > max_msize) {
+	nth_element(items.begin(), items.begin() + max_msize, items.end(),
+		    mcmp);
+	items.erase(items.begin() + max_msize, items.end());
+    }
+    // If we were still accumulating, we read every posting.
+    RETURN(growing);
+}
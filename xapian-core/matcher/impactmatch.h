@@ -0,0 +1,166 @@
+/** @file impactmatch.h
+ * @brief Find the top documents using impact-ordered posting lists.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_IMPACTMATCH_H
+#define XAPIAN_INCLUDED_IMPACTMATCH_H
+
+#include "xapian/types.h"
+
+#include "api/omenquireinternal.h"
+#include "msetcmp.h"
+
+#include <vector>
+
+class ImpactList;
+class LeafPostList;
+
+/** Find the top documents for an OR of terms using impact-ordered postings.
+ *
+ *  Rather than merging the docid-ordered posting lists, this reads the
+ *  postings "score-at-a-time": at each step it takes the segment with the
+ *  highest impact from whichever term's impact-ordered list has one, and adds
+ *  its bounds to those accumulated for each document it contains.  Once the
+ *  impacts remaining in all the lists sum to less than the lower bound on the
+ *  weight of the document currently ranked last in the MSet, no document yet
+ *  to be seen can make the MSet, so we stop accumulating new documents.  We
+ *  carry on reading segments only to tighten the bounds of those already
+ *  seen, discarding those which can no longer reach the MSet, until few
+ *  remain.  These are then weighted exactly using the docid-ordered posting
+ *  lists.
+ *
+ *  The accumulators are found by docid using a hash table, so the memory
+ *  used depends on the number of documents seen rather than the size of the
+ *  database.
+ */
+class ImpactMatch {
+    /// A term from the query.
+    struct ImpactTerm {
+	/// The term's impact-ordered posting list, positioned on the next
+	/// segment to process.
+	ImpactList * impacts;
+
+	/// The term's docid-ordered posting list, used to weight candidates.
+	LeafPostList * postlist;
+    };
+
+    /// The bounds accumulated for a document.
+    struct Accumulator {
+	/// The document.
+	Xapian::docid did;
+
+	/// Lower bound on the weight from the segments seen.
+	double lower;
+
+	/// Upper bound on the weight from the segments seen.
+	double upper;
+
+	/// Bitmap of the terms whose segment containing this document was
+	/// seen.
+	Xapian::termcount seen;
+
+	explicit Accumulator(Xapian::docid did_)
+	    : did(did_), lower(0), upper(0), seen(0) { }
+    };
+
+    class AccumulatorTable;
+
+    /** Stop refining the bounds once this many times the number of
+     *  documents wanted remain candidates.
+     *
+     *  Weighting a candidate exactly needs a skip_to() on the posting list
+     *  of each term, which costs much more than accumulating a posting, so
+     *  we keep reading segments until the candidates are few.
+     */
+    static const Xapian::doccount REFINE_TARGET = 4;
+
+    /// The terms in the query.
+    std::vector<ImpactTerm> terms;
+
+    /// Return an upper bound on the weight of the document for @a a.
+    double get_upper_bound(const Accumulator & a) const;
+
+    /** Discard the accumulators for documents which can't reach
+     *  @a threshold.
+     *
+     *  @param table	The accumulators.
+     *  @param threshold	The weight a document must be able to reach.
+     */
+    void prune_accumulators(AccumulatorTable & table, double threshold) const;
+
+    /// Don't allow assignment.
+    void operator=(const ImpactMatch &);
+
+    /// Don't allow copying.
+    ImpactMatch(const ImpactMatch &);
+
+  public:
+    /// The maximum number of terms we handle.
+    static const size_t MAX_TERMS = 32;
+
+    ImpactMatch() { }
+
+    ~ImpactMatch();
+
+    /** Estimate whether reading the postings in impact order will pay off.
+     *
+     *  Unless there are several times as many postings as documents wanted,
+     *  we end up reading nearly all of them, and the docid-ordered match is
+     *  then faster.  The constant allows for the cost of setting up, which
+     *  dominates for rare terms.
+     *
+     *  @param postings	The total number of postings for the query's terms.
+     *  @param max_msize	The number of documents wanted.
+     */
+    static bool worthwhile(double postings, Xapian::doccount max_msize) {
+	return postings >= 4.0 * max_msize + 64;
+    }
+
+    /** Add a term from the query.
+     *
+     *  @param impacts	The term's impact-ordered posting list.  This object
+     *			takes ownership of it.
+     *  @param postlist	The term's posting list, with the weighting scheme
+     *			set.  This object takes ownership of it.
+     */
+    void add_term(ImpactList * impacts, LeafPostList * postlist);
+
+    /** Find the top documents.
+     *
+     *  @param max_msize	The number of documents wanted.
+     *  @param mcmp		Comparison functor for ranking documents.
+     *  @param items		Set to the (up to) @a max_msize top documents,
+     *				in no particular order.
+     *  @param docs_seen	Set to the number of matching documents seen.
+     *  @param greatest_wt	Set to the greatest weight of any matching
+     *				document.
+     *  @param greatest_wt_subqs_matched	Set to the number of terms
+     *				matched by the document with the greatest
+     *				weight.
+     *
+     *  @return true if all the postings were read, in which case
+     *		@a docs_seen is the exact number of matching documents.
+     */
+    bool get_top(Xapian::doccount max_msize, const MSetCmp & mcmp,
+		 std::vector<Xapian::Internal::MSetItem> & items,
+		 Xapian::doccount & docs_seen,
+		 double & greatest_wt,
+		 Xapian::termcount & greatest_wt_subqs_matched);
+};
+
+#endif // XAPIAN_INCLUDED_IMPACTMATCH_H
@@ -27,7 +27,9 @@
 #include "debuglog.h"
 #include "api/emptypostlist.h"
 #include "extraweightpostlist.h"
+#include "impactmatch.h"
 #include "api/leafpostlist.h"
+#include "backends/impactlist.h"
 #include "omassert.h"
 #include "queryoptimiser.h"
 #include "synonympostlist.h"
@@ -35,8 +37,10 @@
 #include "weight/weightinternal.h"
 
 #include "autoptr.h"
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -157,3 +161,82 @@ LocalSubMatch::open_post_list(const string& term, double max_part)
     }
     RETURN(db->open_post_list(term));
 }
+
+/** Append @a q's term to @a terms if it's a term with wqf 1.
+ *
+ *  @return false if @a q isn't such a term.
+ */
+static bool
+add_impact_term(const Xapian::Query::Internal * q, vector<string> & terms)
+{
+    using Xapian::Internal::QueryTerm;
+    const QueryTerm * q_term = dynamic_cast<const QueryTerm *>(q);
+    // MatchAll (the empty term) has no impacts.
+    if (!q_term || q_term->get_term().empty() || q_term->get_length() != 1)
+	return false;
+    terms.push_back(q_term->get_term());
+    return true;
+}
+
+ImpactMatch *
+LocalSubMatch::open_impact_match(Xapian::doccount max_msize)
+{
+    LOGCALL(MATCH, ImpactMatch *, "LocalSubMatch::open_impact_match", max_msize);
+    // The impacts were calculated without relevance information.
+    if (stats->rset_size != 0) RETURN(NULL);
+
+    string name, params;
+    if (!db->get_impact_weighting(name, params) ||
+	name != wt_factory->name() || params != wt_factory->serialise()) {
+	RETURN(NULL);
+    }
+
+    vector<string> terms;
+    const Xapian::Query::Internal * q = query.internal.get();
+    using Xapian::Internal::QueryOr;
+    const QueryOr * q_or = dynamic_cast<const QueryOr *>(q);
+    if (q_or) {
+	const Xapian::QueryVector & subqs = q_or->get_subqueries();
+	Xapian::QueryVector::const_iterator i;
+	for (i = subqs.begin(); i != subqs.end(); ++i) {
+	    if (!add_impact_term((*i).internal.get(), terms)) RETURN(NULL);
+	}
+    } else if (!add_impact_term(q, terms)) {
+	RETURN(NULL);
+    }
+    if (terms.size() > ImpactMatch::MAX_TERMS) RETURN(NULL);
+
+    // A repeated term contributes its impact more than once.
+    vector<string> sorted_terms(terms);
+    sort(sorted_terms.begin(), sorted_terms.end());
+    if (adjacent_find(sorted_terms.begin(), sorted_terms.end()) !=
+	sorted_terms.end()) {
+	RETURN(NULL);
+    }
+
+    // The impacts don't include any term-independent weight contribution.
+    AutoPtr<Xapian::Weight> extra_wt(wt_factory->clone());
+    extra_wt->init_(*stats, qlen);
+    if (extra_wt->get_maxextra() != 0.0) RETURN(NULL);
+
+    double postings = 0;
+    vector<string>::const_iterator t;
+    for (t = terms.begin(); t != terms.end(); ++t) {
+	postings += stats->get_termfreq(*t);
+    }
+    if (!ImpactMatch::worthwhile(postings, max_msize)) RETURN(NULL);
+
+    AutoPtr<ImpactMatch> match(new ImpactMatch);
+    for (t = terms.begin(); t != terms.end(); ++t) {
+	AutoPtr<ImpactList> impacts(db->open_impact_list(*t));
+	if (!impacts.get()) {
+	    if (stats->get_termfreq(*t) != 0) RETURN(NULL);
+	    // The term doesn't index any documents.
+	    continue;
+	}
+	AutoPtr<LeafPostList> pl(db->open_post_list(*t));
+	pl->set_termweight(make_wt(*t, 1, 1.0));
+	match->add_term(impacts.release(), pl.release());
+    }
+    RETURN(match.release());
+}
@@ -31,6 +31,8 @@
 
 #include <map>
 
+class ImpactMatch;
+
 class LocalSubMatch : public SubMatch {
     /// Don't allow assignment.
     void operator=(const LocalSubMatch &);
@@ -101,6 +103,22 @@ class LocalSubMatch : public SubMatch {
 			     double factor);
 
     LeafPostList * open_post_list(const std::string& term, double max_part);
+
+    /** Set up a match using impact-ordered posting lists, if possible.
+     *
+     *  This is possible if the query is a term or an OP_OR of distinct
+     *  terms, each with wqf 1, there's no RSet, and the database has
+     *  current impact-ordered posting lists for the weighting scheme in use.
+     *  Even then, we only use them if ImpactMatch::worthwhile() estimates
+     *  that doing so will be faster.
+     *
+     *  @param max_msize	The number of documents wanted.
+     *
+     *  @return	A new ImpactMatch object, which the caller should delete
+     *		after use, or NULL if impact-ordered posting lists can't be
+     *		used for this match.
+     */
+    ImpactMatch * open_impact_match(Xapian::doccount max_msize);
 };
 
 #endif /* XAPIAN_INCLUDED_LOCALSUBMATCH_H */
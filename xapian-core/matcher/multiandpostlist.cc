@@ -22,6 +22,7 @@
 #include <config.h>
 
 #include "multiandpostlist.h"
+#include "docidsearch.h"
 #include "omassert.h"
 #include "debuglog.h"
 
@@ -190,6 +191,63 @@ MultiAndPostList::recalc_maxweight()
     return max_total;
 }
 
+/** Find the first docid >= @a target which a postlist might contain.
+ *
+ *  This only looks at the postlist's decoded block or bitmap.
+ *
+ *  @param present	Set to true if the postlist is known to contain the
+ *			docid returned.
+ *
+ *  @return The docid, or 0 if the block or bitmap can't tell us.
+ */
+static Xapian::docid
+next_possible_docid(const PostList * pl, Xapian::docid target, bool & present)
+{
+    size_t n;
+    const Xapian::docid * block = pl->get_docid_block(n);
+    if (block) {
+	if (block[n - 1] < target) return 0;
+	present = true;
+	return block[docid_gallop(block, n, target)];
+    }
+
+    Xapian::docid base, first, last;
+    const unsigned char * bitmap = pl->get_docid_bitmap(base, first, last);
+    if (!bitmap || last < target) return 0;
+    if (target < first) target = first;
+    Xapian::docid offset = docid_bitmap_next(bitmap, target - base,
+					     last - base);
+    // If there's no entry up to last, the next can't be before last + 1.
+    present = (offset <= last - base);
+    return base + offset;
+}
+
+Xapian::docid
+MultiAndPostList::find_block_candidate(Xapian::docid first) const
+{
+    Xapian::docid candidate = first;
+    // The number of sub-postlists which we know contain candidate, counting
+    // round from the one which last moved it on (plist[0] is at first).
+    size_t agreed = 1;
+    size_t i = 1;
+    while (agreed != n_kids) {
+	bool present;
+	Xapian::docid next_did = next_possible_docid(plist[i], candidate,
+						     present);
+	// If we can't tell from the block or bitmap, leave it to skip_to().
+	if (next_did == 0) break;
+	if (next_did == candidate) {
+	    ++agreed;
+	} else {
+	    // Nothing before next_did can match.
+	    candidate = next_did;
+	    agreed = present ? 1 : 0;
+	}
+	if (++i == n_kids) i = 0;
+    }
+    return candidate;
+}
+
 PostList *
 MultiAndPostList::find_next_match(double w_min)
 {
@@ -199,6 +257,13 @@ advanced_plist0:
 	return NULL;
     }
     did = plist[0]->get_docid();
+    {
+	Xapian::docid candidate = find_block_candidate(did);
+	if (candidate != did) {
+	    skip_to_helper(0, candidate, w_min);
+	    goto advanced_plist0;
+	}
+    }
     for (size_t i = 1; i < n_kids; ++i) {
 	bool valid;
 	check_helper(i, did, w_min, valid);
@@ -226,6 +291,13 @@ MultiAndPostList::next(double w_min)
     return find_next_match(w_min);
 }
 
+PostList *
+MultiAndPostList::next_batch(double w_min, double w_stop, Xapian::doccount & n,
+			     Xapian::docid * docids, double * weights)
+{
+    return next_batch_helper(this, w_min, w_stop, n, docids, weights);
+}
+
 PostList *
 MultiAndPostList::skip_to(Xapian::docid did_min, double w_min)
 {
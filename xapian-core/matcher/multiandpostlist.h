@@ -106,6 +106,22 @@ class MultiAndPostList : public PostList {
      */
     void allocate_plist_and_max_wt();
 
+    /** Use the sub-postlists' decoded blocks to rule out docids cheaply.
+     *
+     *  While the sub-postlists have a decoded block of docids (see
+     *  PostList::get_docid_block()) or a bitmap of docids (see
+     *  PostList::get_docid_bitmap()) to hand, this intersects them, using
+     *  galloping search for blocks and testing bits directly in bitmaps,
+     *  without any virtual method calls per docid.
+     *
+     *  @param first	The current docid of plist[0].
+     *
+     *  @return A docid >= @a first such that no docid before it matches
+     *		all the sub-postlists.  This is @a first if the blocks
+     *		can't rule it out.
+     */
+    Xapian::docid find_block_candidate(Xapian::docid first) const;
+
     /// Advance the sublists to the next match.
     PostList * find_next_match(double w_min);
 
@@ -175,6 +191,9 @@ class MultiAndPostList : public PostList {
 
     Internal *next(double w_min);
 
+    Internal *next_batch(double w_min, double w_stop, Xapian::doccount & n,
+			 Xapian::docid * docids, double * weights);
+
     Internal *skip_to(Xapian::docid, double w_min);
 
     std::string get_description() const;
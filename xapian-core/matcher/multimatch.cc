@@ -30,6 +30,7 @@
 #include "autoptr.h"
 #include "collapser.h"
 #include "debuglog.h"
+#include "impactmatch.h"
 #include "submatch.h"
 #include "localsubmatch.h"
 #include "omassert.h"
@@ -133,6 +134,9 @@ const Xapian::Enquire::Internal::sort_setting VAL_REL =
 	Xapian::Enquire::Internal::VAL_REL;
 #endif
 
+/// The number of candidates to fetch from the postlist tree at once.
+static const Xapian::doccount MATCH_BATCH_SIZE = 64;
+
 /** Split an RSet into several sub rsets, one for each database.
  *
  *  @param rset The RSet to split.
@@ -254,6 +258,191 @@ MultipleMatchSpy::operator()(const Xapian::Document &doc, double wt) {
     }
 }
 
+/** Adds candidates to the proto-MSet being built by MultiMatch::get_mset().
+ *
+ *  This refers to get_mset()'s state, so that the batched relevance loop and
+ *  the general loop share the handling of each candidate which gets into the
+ *  proto-MSet, and of each new greatest weight.
+ */
+class ProtoMSetAdder {
+    vector<Xapian::Internal::MSetItem> & items;
+
+    Xapian::doccount max_msize;
+
+    MSetCmp & mcmp;
+
+    bool & is_heap;
+
+    Xapian::Internal::MSetItem & min_item;
+
+    double & min_weight;
+
+    Xapian::doccount & docs_matched;
+
+    const Xapian::doccount & check_at_least;
+
+    Xapian::Enquire::Internal::sort_setting sort_by;
+
+    /** Can we stop once enough items have been seen?
+     *
+     *  This is the case for a forward boolean match with only one database
+     *  (bodgetastic, FIXME better if we can!)  In the multi database case,
+     *  MergePostList currently processes each database sequentially (which
+     *  actually may well be more efficient) so the docids in general won't
+     *  arrive in order.
+     */
+    bool stop_when_full;
+
+    double & greatest_wt;
+
+    Xapian::termcount & greatest_wt_subqs_matched;
+
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    unsigned & greatest_wt_subqs_db_num;
+
+    const vector<bool> & is_remote;
+#endif
+
+    /// The postlist tree, positioned on the candidate.
+    AutoPtr<PostList> & pl;
+
+    double percent_cutoff_factor;
+
+  public:
+    ProtoMSetAdder(vector<Xapian::Internal::MSetItem> & items_,
+		   Xapian::doccount max_msize_,
+		   MSetCmp & mcmp_,
+		   bool & is_heap_,
+		   Xapian::Internal::MSetItem & min_item_,
+		   double & min_weight_,
+		   Xapian::doccount & docs_matched_,
+		   const Xapian::doccount & check_at_least_,
+		   Xapian::Enquire::Internal::sort_setting sort_by_,
+		   bool stop_when_full_,
+		   double & greatest_wt_,
+		   Xapian::termcount & greatest_wt_subqs_matched_,
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+		   unsigned & greatest_wt_subqs_db_num_,
+		   const vector<bool> & is_remote_,
+#endif
+		   AutoPtr<PostList> & pl_,
+		   double percent_cutoff_factor_)
+	: items(items_), max_msize(max_msize_), mcmp(mcmp_),
+	  is_heap(is_heap_), min_item(min_item_), min_weight(min_weight_),
+	  docs_matched(docs_matched_), check_at_least(check_at_least_),
+	  sort_by(sort_by_), stop_when_full(stop_when_full_),
+	  greatest_wt(greatest_wt_),
+	  greatest_wt_subqs_matched(greatest_wt_subqs_matched_),
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+	  greatest_wt_subqs_db_num(greatest_wt_subqs_db_num_),
+	  is_remote(is_remote_),
+#endif
+	  pl(pl_), percent_cutoff_factor(percent_cutoff_factor_) { }
+
+    /** Add @a new_item to the proto-MSet and count it as matching.
+     *
+     *  Once the proto-MSet is full, it's kept as a heap and each item added
+     *  expels the lowest ranking item.
+     *
+     *  @return	true if the match can stop now.
+     */
+    bool add(const Xapian::Internal::MSetItem & new_item);
+
+    /** Note the weight of candidate @a did, which @a pl is positioned on.
+     *
+     *  If this is the greatest weight seen so far, we record it and how many
+     *  subqueries matched, and raise min_weight if there's a percentage
+     *  cutoff.
+     */
+    void note_weight(double wt, Xapian::docid did);
+};
+
+bool
+ProtoMSetAdder::add(const Xapian::Internal::MSetItem & new_item)
+{
+    ++docs_matched;
+    if (items.size() >= max_msize) {
+	items.push_back(new_item);
+	if (!is_heap) {
+	    is_heap = true;
+	    make_heap(items.begin(), items.end(), mcmp);
+	} else {
+	    push_heap<vector<Xapian::Internal::MSetItem>::iterator,
+		      MSetCmp>(items.begin(), items.end(), mcmp);
+	}
+	pop_heap<vector<Xapian::Internal::MSetItem>::iterator,
+		 MSetCmp>(items.begin(), items.end(), mcmp);
+	items.pop_back();
+
+	min_item = items.front();
+	if (sort_by == REL || sort_by == REL_VAL) {
+	    if (docs_matched >= check_at_least) {
+		if (rare(stop_when_full)) return true;
+		if (min_item.wt > min_weight) {
+		    LOGLINE(MATCH, "Setting min_weight to " <<
+			    min_item.wt << " from " << min_weight);
+		    min_weight = min_item.wt;
+		}
+	    }
+	}
+    } else {
+	items.push_back(new_item);
+	is_heap = false;
+	if (items.size() == max_msize && docs_matched >= check_at_least) {
+	    if (rare(stop_when_full)) return true;
+	}
+    }
+    return false;
+}
+
+void
+ProtoMSetAdder::note_weight(double wt, Xapian::docid did)
+{
+    if (wt <= greatest_wt) return;
+
+    greatest_wt = wt;
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    const unsigned int multiplier = is_remote.size();
+    unsigned int db_num = (did - 1) % multiplier;
+    if (is_remote[db_num]) {
+	// Note that the greatest weighted document came from a remote
+	// database, and which one.
+	greatest_wt_subqs_db_num = db_num;
+    } else
+#endif
+    {
+	AssertEq(pl->get_docid(), did);
+	greatest_wt_subqs_matched = pl->count_matching_subqs();
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+	greatest_wt_subqs_db_num = UINT_MAX;
+#endif
+    }
+    (void)did;
+    if (percent_cutoff_factor > 0.0) {
+	double w = wt * percent_cutoff_factor;
+	if (w > min_weight) {
+	    min_weight = w;
+	    if (!is_heap) {
+		is_heap = true;
+		make_heap<vector<Xapian::Internal::MSetItem>::iterator,
+			  MSetCmp>(items.begin(), items.end(), mcmp);
+	    }
+	    while (!items.empty() && items.front().wt < min_weight) {
+		pop_heap<vector<Xapian::Internal::MSetItem>::iterator,
+			 MSetCmp>(items.begin(), items.end(), mcmp);
+		Assert(items.back().wt < min_weight);
+		items.pop_back();
+	    }
+#ifdef XAPIAN_ASSERTIONS_PARANOID
+	    vector<Xapian::Internal::MSetItem>::const_iterator i;
+	    for (i = items.begin(); i != items.end(); ++i) {
+		Assert(i->wt >= min_weight);
+	    }
+#endif
+	}
+    }
+}
+
 ////////////////////////////////////
 // Initialisation and cleaning up //
 ////////////////////////////////////
@@ -589,6 +778,121 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
     // Is the mset a valid heap?
     bool is_heap = false;
 
+    // If the database has impact-ordered posting lists which suit the query,
+    // and reading them looks cheaper, find the top documents using those
+    // instead.  This only works for a plain relevance ranking of a single
+    // local database.
+    if (leaves.size() == 1 && !is_remote[0] && leaves[0].get() &&
+	sort_by == REL && sort_forward && collapse_max == 0 &&
+	percent_cutoff == 0 && min_weight == 0.0 && mdecider == NULL &&
+	matchspy == NULL && check_at_least == maxitems) {
+	LocalSubMatch * submatch = static_cast<LocalSubMatch*>(leaves[0].get());
+	AutoPtr<ImpactMatch> impact_match(submatch->open_impact_match(max_msize));
+	if (impact_match.get()) {
+	    LOGLINE(MATCH, "Matching using impact-ordered posting lists");
+	    if (impact_match->get_top(max_msize, mcmp, items, docs_matched,
+				      greatest_wt,
+				      greatest_wt_subqs_matched)) {
+		// We saw every matching document.
+		matches_lower_bound = matches_upper_bound = matches_estimated
+		    = docs_matched;
+	    }
+	    // Leave nothing for the docid-ordered match below to do.
+	    pl.reset(new EmptyPostList);
+	}
+    }
+
+    // Handles the candidates which get into the proto-mset.
+    ProtoMSetAdder adder(items, max_msize, mcmp, is_heap, min_item,
+			 min_weight, docs_matched, check_at_least, sort_by,
+			 sort_by == REL && max_possible == 0 && sort_forward &&
+			 leaves.size() == 1,
+			 greatest_wt, greatest_wt_subqs_matched,
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+			 greatest_wt_subqs_db_num, is_remote,
+#endif
+			 pl, percent_cutoff ? percent_cutoff_factor : 0.0);
+
+    // For a plain relevance match, we don't need to look at the candidates
+    // other than to compare their weights, so fetch them from the postlist
+    // tree in batches, which saves several virtual method calls for each.
+    if (sort_by == REL && !collapser && mdecider == NULL && matchspy == NULL &&
+	percent_cutoff == 0) {
+	Xapian::docid batch_dids[MATCH_BATCH_SIZE];
+	double batch_wts[MATCH_BATCH_SIZE];
+	bool done = false;
+	while (!done) {
+	    if (rare(recalculate_w_max)) {
+		if (min_weight > 0.0) {
+		    if (rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
+			LOGLINE(MATCH, "*** TERMINATING EARLY (1)");
+			break;
+		    }
+		}
+	    }
+
+	    // Any candidate weighing more than greatest_wt ends the batch, so
+	    // only the last candidate can be a new greatest weight, and pl
+	    // is still positioned on it if it is.
+	    Xapian::doccount n = MATCH_BATCH_SIZE;
+	    double w_stop = greatest_wt;
+	    if (items.size() < max_msize) {
+		// Stop when the proto-mset might be full.
+		n = min(n, Xapian::doccount(max_msize - items.size()));
+	    } else if (min_weight > 0.0) {
+		// Stop after any candidate which isn't rejected, since we need
+		// to check if we can terminate early after each of those.
+		w_stop = min(w_stop, min_weight * (1.0 - DBL_EPSILON));
+	    } else {
+		n = 1;
+	    }
+	    PostList * res = pl->next_batch(min_weight, w_stop, n,
+					    batch_dids, batch_wts);
+	    if (rare(res)) {
+		pl.reset(res);
+		recalc_maxweight();
+		LOGLINE(MATCH, "*** REPLACING ROOT");
+	    }
+
+	    for (Xapian::doccount i = 0; i != n; ++i) {
+		double wt = batch_wts[i];
+		if (wt < min_weight) {
+		    LOGLINE(MATCH, "Rejecting potential match due to insufficient weight");
+		    continue;
+		}
+
+		Xapian::docid did = batch_dids[i];
+		LOGLINE(MATCH, "Candidate document id " << did << " wt " << wt);
+		if (check_at_least > maxitems && timeout.timed_out()) {
+		    check_at_least = maxitems;
+		}
+
+		if (adder.add(Xapian::Internal::MSetItem(wt, did))) {
+		    done = true;
+		    break;
+		}
+
+		Assert(wt <= greatest_wt || i + 1 == n);
+		adder.note_weight(wt, did);
+	    }
+	    if (done) break;
+
+	    if (rare(pl->at_end())) {
+		LOGLINE(MATCH, "Reached end of potential matches");
+		break;
+	    }
+
+	    if (min_weight > 0.0) {
+		if (rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
+		    LOGLINE(MATCH, "*** TERMINATING EARLY (3)");
+		    break;
+		}
+	    }
+	}
+	// Leave nothing for the loop below to do.
+	pl.reset(new EmptyPostList);
+    }
+
     while (true) {
 	bool pushback;
 
@@ -666,7 +970,7 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 		    if (matchspy) {
 			matchspy->operator()(doc, wt);
 		    }
-		    if (wt > greatest_wt) goto new_greatest_weight;
+		    adder.note_weight(wt, did);
 		    continue;
 		}
 		if (docs_matched >= check_at_least) {
@@ -674,7 +978,7 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 		    LOGLINE(MATCH, "Dropping candidate which sorts lower than min_item");
 		    // FIXME: hmm, match decider might have rejected this...
 		    if (!calculated_weight) wt = pl->get_weight();
-		    if (wt > greatest_wt) goto new_greatest_weight;
+		    adder.note_weight(wt, did);
 		    continue;
 		}
 		// We can't drop the item, because we need to test whether the
@@ -724,7 +1028,7 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 		// If we're sorting by relevance primarily, then we throw away
 		// the lower weighted document anyway.
 		if (sort_by != REL && sort_by != REL_VAL) {
-		    if (wt > greatest_wt) goto new_greatest_weight;
+		    adder.note_weight(wt, did);
 		}
 		continue;
 	    }
@@ -769,111 +1073,16 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 
 	// OK, actually add the item to the mset.
 	if (pushback) {
-	    ++docs_matched;
-	    if (items.size() >= max_msize) {
-		items.push_back(new_item);
-		if (!is_heap) {
-		    is_heap = true;
-		    make_heap(items.begin(), items.end(), mcmp);
-		} else {
-		    push_heap<vector<Xapian::Internal::MSetItem>::iterator,
-			      MSetCmp>(items.begin(), items.end(), mcmp);
-		}
-		pop_heap<vector<Xapian::Internal::MSetItem>::iterator,
-			 MSetCmp>(items.begin(), items.end(), mcmp);
-		items.pop_back();
-
-		min_item = items.front();
-		if (sort_by == REL || sort_by == REL_VAL) {
-		    if (docs_matched >= check_at_least) {
-			if (sort_by == REL) {
-			    // We're done if this is a forward boolean match
-			    // with only one database (bodgetastic, FIXME
-			    // better if we can!)
-			    if (rare(max_possible == 0 && sort_forward)) {
-				// In the multi database case, MergePostList
-				// currently processes each database
-				// sequentially (which actually may well be
-				// more efficient) so the docids in general
-				// won't arrive in order.
-				if (leaves.size() == 1) break;
-			    }
-			}
-			if (min_item.wt > min_weight) {
-			    LOGLINE(MATCH, "Setting min_weight to " <<
-				    min_item.wt << " from " << min_weight);
-			    min_weight = min_item.wt;
-			}
-		    }
-		}
-		if (rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
-		    LOGLINE(MATCH, "*** TERMINATING EARLY (3)");
-		    break;
-		}
-	    } else {
-		items.push_back(new_item);
-		is_heap = false;
-		if (sort_by == REL && items.size() == max_msize) {
-		    if (docs_matched >= check_at_least) {
-			// We're done if this is a forward boolean match
-			// with only one database (bodgetastic, FIXME
-			// better if we can!)
-			if (rare(max_possible == 0 && sort_forward)) {
-			    // In the multi database case, MergePostList
-			    // currently processes each database
-			    // sequentially (which actually may well be
-			    // more efficient) so the docids in general
-			    // won't arrive in order.
-			    if (leaves.size() == 1) break;
-			}
-		    }
-		}
+	    bool was_full = (items.size() >= max_msize);
+	    if (adder.add(new_item)) break;
+	    if (was_full && rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
+		LOGLINE(MATCH, "*** TERMINATING EARLY (3)");
+		break;
 	    }
 	}
 
 	// Keep a track of the greatest weight we've seen.
-	if (wt > greatest_wt) {
-new_greatest_weight:
-	    greatest_wt = wt;
-#ifdef XAPIAN_HAS_REMOTE_BACKEND
-	    const unsigned int multiplier = db.internal.size();
-	    unsigned int db_num = (did - 1) % multiplier;
-	    if (is_remote[db_num]) {
-		// Note that the greatest weighted document came from a remote
-		// database, and which one.
-		greatest_wt_subqs_db_num = db_num;
-	    } else
-#endif
-	    {
-		greatest_wt_subqs_matched = pl->count_matching_subqs();
-#ifdef XAPIAN_HAS_REMOTE_BACKEND
-		greatest_wt_subqs_db_num = UINT_MAX;
-#endif
-	    }
-	    if (percent_cutoff) {
-		double w = wt * percent_cutoff_factor;
-		if (w > min_weight) {
-		    min_weight = w;
-		    if (!is_heap) {
-			is_heap = true;
-			make_heap<vector<Xapian::Internal::MSetItem>::iterator,
-				  MSetCmp>(items.begin(), items.end(), mcmp);
-		    }
-		    while (!items.empty() && items.front().wt < min_weight) {
-			pop_heap<vector<Xapian::Internal::MSetItem>::iterator,
-				 MSetCmp>(items.begin(), items.end(), mcmp);
-			Assert(items.back().wt < min_weight);
-			items.pop_back();
-		    }
-#ifdef XAPIAN_ASSERTIONS_PARANOID
-		    vector<Xapian::Internal::MSetItem>::const_iterator i;
-		    for (i = items.begin(); i != items.end(); ++i) {
-			Assert(i->wt >= min_weight);
-		    }
-#endif
-		}
-	    }
-	}
+	adder.note_weight(wt, did);
     }
 
     // done with posting list tree
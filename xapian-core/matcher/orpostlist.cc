@@ -124,6 +124,14 @@ OrPostList::next(double w_min)
     RETURN(ret);
 }
 
+PostList *
+OrPostList::next_batch(double w_min, double w_stop, Xapian::doccount & n,
+		       Xapian::docid * docids, double * weights)
+{
+    LOGCALL(MATCH, PostList *, "OrPostList::next_batch", w_min | w_stop | n);
+    RETURN(next_batch_helper(this, w_min, w_stop, n, docids, weights));
+}
+
 PostList *
 OrPostList::skip_to(Xapian::docid did, double w_min)
 {
@@ -55,6 +55,9 @@ class OrPostList : public BranchPostList {
 	double recalc_maxweight();
 
 	PostList *next(double w_min);
+	PostList *next_batch(double w_min, double w_stop,
+			      Xapian::doccount & n,
+			      Xapian::docid * docids, double * weights);
 	PostList *skip_to(Xapian::docid did, double w_min);
 	PostList *check(Xapian::docid did, double w_min, bool &valid);
 	bool   at_end() const;
@@ -24,57 +24,11 @@
 
 #include "valuegepostlist.h"
 
-#include "omassert.h"
 #include "str.h"
 #include "unicode/description_append.h"
 
 using namespace std;
 
-PostList *
-ValueGePostList::next(double)
-{
-    Assert(db);
-    if (!valuelist) valuelist = db->open_value_list(slot);
-    valuelist->next();
-    while (!valuelist->at_end()) {
-	const string & v = valuelist->get_value();
-	if (v >= begin) return NULL;
-	valuelist->next();
-    }
-    db = NULL;
-    return NULL;
-}
-
-PostList *
-ValueGePostList::skip_to(Xapian::docid did, double)
-{
-    Assert(db);
-    if (!valuelist) valuelist = db->open_value_list(slot);
-    valuelist->skip_to(did);
-    while (!valuelist->at_end()) {
-	const string & v = valuelist->get_value();
-	if (v >= begin) return NULL;
-	valuelist->next();
-    }
-    db = NULL;
-    return NULL;
-}
-
-PostList *
-ValueGePostList::check(Xapian::docid did, double, bool &valid)
-{
-    Assert(db);
-    AssertRelParanoid(did, <=, db->get_lastdocid());
-    if (!valuelist) valuelist = db->open_value_list(slot);
-    valid = valuelist->check(did);
-    if (!valid) {
-	return NULL;
-    }
-    const string & v = valuelist->get_value();
-    valid = (v >= begin);
-    return NULL;
-}
-
 string
 ValueGePostList::get_description() const
 {
@@ -35,13 +35,11 @@ class ValueGePostList: public ValueRangePostList {
     ValueGePostList(const Xapian::Database::Internal *db_,
 		    Xapian::valueno slot_,
 		    const std::string &begin_)
-	: ValueRangePostList(db_, slot_, begin_, std::string()) {}
-
-    PostList * next(double w_min);
-
-    PostList * skip_to(Xapian::docid, double w_min);
-
-    PostList * check(Xapian::docid did, double w_min, bool &valid);
+	: ValueRangePostList(db_, slot_, begin_, std::string())
+    {
+	numeric_bounds = decode_bound(begin, begin_number);
+	has_end = false;
+    }
 
     string get_description() const;
 };
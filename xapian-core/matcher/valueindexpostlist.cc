@@ -0,0 +1,163 @@
+/** @file valueindexpostlist.cc
+ * @brief Return document ids found for a value range using a value index.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "valueindexpostlist.h"
+
+#include "debuglog.h"
+#include "omassert.h"
+#include "str.h"
+#include "unicode/description_append.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ValueIndexPostList::ValueIndexPostList(const Xapian::Database::Internal *db,
+				       Xapian::valueno slot_,
+				       const string &begin_,
+				       const string &end_,
+				       vector<Xapian::docid> & dids_)
+    : slot(slot_), begin(begin_), end(end_), db_size(db->get_doccount())
+{
+    swap(dids, dids_);
+    pos = dids.size() + 1;
+}
+
+Xapian::doccount
+ValueIndexPostList::get_termfreq_min() const
+{
+    return dids.size();
+}
+
+Xapian::doccount
+ValueIndexPostList::get_termfreq_est() const
+{
+    return dids.size();
+}
+
+Xapian::doccount
+ValueIndexPostList::get_termfreq_max() const
+{
+    return dids.size();
+}
+
+TermFreqs
+ValueIndexPostList::get_termfreq_est_using_stats(
+	const Xapian::Weight::Internal & stats) const
+{
+    LOGCALL(MATCH, TermFreqs, "ValueIndexPostList::get_termfreq_est_using_stats", stats);
+    // Assume the other databases have a similar proportion of matches.
+    double ratio = db_size ? double(dids.size()) / db_size : 0;
+    RETURN(TermFreqs(Xapian::doccount(stats.collection_size * ratio + 0.5),
+		     Xapian::doccount(stats.rset_size * ratio + 0.5),
+		     Xapian::termcount(stats.total_term_count * ratio + 0.5)));
+}
+
+double
+ValueIndexPostList::get_maxweight() const
+{
+    return 0;
+}
+
+Xapian::docid
+ValueIndexPostList::get_docid() const
+{
+    AssertRel(pos,<,dids.size());
+    return dids[pos];
+}
+
+double
+ValueIndexPostList::get_weight() const
+{
+    return 0;
+}
+
+Xapian::termcount
+ValueIndexPostList::get_doclength() const
+{
+    return 0;
+}
+
+double
+ValueIndexPostList::recalc_maxweight()
+{
+    return 0;
+}
+
+PositionList *
+ValueIndexPostList::read_position_list()
+{
+    return NULL;
+}
+
+PositionList *
+ValueIndexPostList::open_position_list() const
+{
+    return NULL;
+}
+
+PostList *
+ValueIndexPostList::next(double)
+{
+    Assert(!at_end());
+    if (pos > dids.size()) {
+	pos = 0;
+    } else {
+	++pos;
+    }
+    return NULL;
+}
+
+PostList *
+ValueIndexPostList::skip_to(Xapian::docid did, double)
+{
+    Assert(!at_end());
+    size_t start = (pos > dids.size()) ? 0 : pos;
+    pos = lower_bound(dids.begin() + start, dids.end(), did) - dids.begin();
+    return NULL;
+}
+
+bool
+ValueIndexPostList::at_end() const
+{
+    return pos == dids.size();
+}
+
+Xapian::termcount
+ValueIndexPostList::count_matching_subqs() const
+{
+    return 1;
+}
+
+string
+ValueIndexPostList::get_description() const
+{
+    string desc = "ValueIndexPostList(";
+    desc += str(slot);
+    desc += ", ";
+    description_append(desc, begin);
+    desc += ", ";
+    description_append(desc, end);
+    desc += ", ";
+    desc += str(dids.size());
+    desc += ")";
+    return desc;
+}
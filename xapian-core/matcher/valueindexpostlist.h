@@ -0,0 +1,106 @@
+/** @file valueindexpostlist.h
+ * @brief Return document ids found for a value range using a value index.
+ */
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_VALUEINDEXPOSTLIST_H
+#define XAPIAN_INCLUDED_VALUEINDEXPOSTLIST_H
+
+#include "backends/database.h"
+#include "api/postlist.h"
+
+#include <string>
+#include <vector>
+
+/** Return the documents with a value in a range, found using a value index.
+ *
+ *  The matching docids are found up front with
+ *  Xapian::Database::Internal::get_value_range_docids(), so this is only
+ *  used for ranges which match few documents.  Unlike ValueRangePostList,
+ *  the number of matching documents is known exactly.
+ */
+class ValueIndexPostList : public PostList {
+    /// The value slot.
+    Xapian::valueno slot;
+
+    /// The range, for the description.
+    std::string begin, end;
+
+    /// The number of documents in the database.
+    Xapian::doccount db_size;
+
+    /// The matching docids, in ascending order.
+    std::vector<Xapian::docid> dids;
+
+    /** The position of the current docid in @a dids.
+     *
+     *  This is dids.size() + 1 before next() is first called.
+     */
+    size_t pos;
+
+    /// Disallow copying.
+    ValueIndexPostList(const ValueIndexPostList &);
+
+    /// Disallow assignment.
+    void operator=(const ValueIndexPostList &);
+
+  public:
+    /** Construct.
+     *
+     *  @param dids_	The matching docids, in ascending order.  This
+     *			object takes the contents, leaving @a dids_ empty.
+     */
+    ValueIndexPostList(const Xapian::Database::Internal *db,
+		       Xapian::valueno slot_,
+		       const std::string &begin_, const std::string &end_,
+		       std::vector<Xapian::docid> & dids_);
+
+    Xapian::doccount get_termfreq_min() const;
+
+    Xapian::doccount get_termfreq_est() const;
+
+    Xapian::doccount get_termfreq_max() const;
+
+    TermFreqs get_termfreq_est_using_stats(
+	const Xapian::Weight::Internal & stats) const;
+
+    double get_maxweight() const;
+
+    Xapian::docid get_docid() const;
+
+    double get_weight() const;
+
+    Xapian::termcount get_doclength() const;
+
+    double recalc_maxweight();
+
+    PositionList * read_position_list();
+
+    PositionList * open_position_list() const;
+
+    PostList * next(double w_min);
+
+    PostList * skip_to(Xapian::docid, double w_min);
+
+    bool at_end() const;
+
+    Xapian::termcount count_matching_subqs() const;
+
+    std::string get_description() const;
+};
+
+#endif // XAPIAN_INCLUDED_VALUEINDEXPOSTLIST_H
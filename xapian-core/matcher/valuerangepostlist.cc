@@ -28,9 +28,17 @@
 #include "omassert.h"
 #include "str.h"
 #include "unicode/description_append.h"
+#include "xapian/queryparser.h" // For sortable_serialise().
 
 using namespace std;
 
+bool
+ValueRangePostList::decode_bound(const string & bound, double & result)
+{
+    result = Xapian::sortable_unserialise(bound);
+    return Xapian::sortable_serialise(result) == bound;
+}
+
 ValueRangePostList::~ValueRangePostList()
 {
     delete valuelist;
@@ -119,15 +127,67 @@ ValueRangePostList::open_position_list() const
     return NULL;
 }
 
+void
+ValueRangePostList::skip_to_match(Xapian::docid did)
+{
+    const string * hi = has_end ? &end : NULL;
+    while (use_summaries) {
+	if (!valuelist->skip_to_value_range(did, begin, hi, all_match_until)) {
+	    use_summaries = false;
+	    break;
+	}
+	if (valuelist->at_end()) {
+	    db = NULL;
+	    return;
+	}
+	Xapian::docid current = valuelist->get_docid();
+	if (current <= all_match_until || value_in_range()) return;
+	if (current == Xapian::docid(-1)) {
+	    db = NULL;
+	    return;
+	}
+	did = current + 1;
+    }
+
+    valuelist->skip_to(did);
+    while (!valuelist->at_end()) {
+	if (value_in_range()) return;
+	valuelist->next();
+    }
+    db = NULL;
+}
+
 PostList *
 ValueRangePostList::next(double)
 {
     Assert(db);
-    if (!valuelist) valuelist = db->open_value_list(slot);
+    if (!valuelist) {
+	valuelist = db->open_value_list(slot);
+	skip_to_match(1);
+	return NULL;
+    }
+    if (use_summaries) {
+	Xapian::docid did = valuelist->get_docid();
+	if (did < all_match_until) {
+	    // The rest of this part of the stream is all in range.
+	    valuelist->next();
+	    if (valuelist->at_end()) {
+		db = NULL;
+	    } else if (valuelist->get_docid() > all_match_until) {
+		skip_to_match(valuelist->get_docid());
+	    }
+	    return NULL;
+	}
+	if (did == Xapian::docid(-1)) {
+	    db = NULL;
+	    return NULL;
+	}
+	skip_to_match(did + 1);
+	return NULL;
+    }
     valuelist->next();
     while (!valuelist->at_end()) {
-	const string & v = valuelist->get_value();
-	if (v >= begin && v <= end) {
+	if (value_in_range()) {
 	    return NULL;
 	}
 	valuelist->next();
@@ -141,15 +201,7 @@ ValueRangePostList::skip_to(Xapian::docid did, double)
 {
     Assert(db);
     if (!valuelist) valuelist = db->open_value_list(slot);
-    valuelist->skip_to(did);
-    while (!valuelist->at_end()) {
-	const string & v = valuelist->get_value();
-	if (v >= begin && v <= end) {
-	    return NULL;
-	}
-	valuelist->next();
-    }
-    db = NULL;
+    skip_to_match(did);
     return NULL;
 }
 
@@ -163,8 +215,7 @@ ValueRangePostList::check(Xapian::docid did, double, bool &valid)
     if (!valid) {
 	return NULL;
     }
-    const string & v = valuelist->get_value();
-    valid = (v >= begin && v <= end);
+    valid = (valuelist->get_docid() <= all_match_until || value_in_range());
     return NULL;
 }
 
@@ -35,10 +35,58 @@ class ValueRangePostList : public PostList {
 
     const std::string begin, end;
 
+    /** Can values be compared with the bounds as numbers?
+     *
+     *  This is true if the bounds were both encoded with
+     *  Xapian::sortable_serialise(), in which case a value encoded the same
+     *  way is in the range exactly when the number it encodes is.
+     */
+    bool numeric_bounds;
+
+    /// The numbers @a begin and @a end encode, if numeric_bounds is true.
+    double begin_number, end_number;
+
     Xapian::doccount db_size;
 
     ValueList * valuelist;
 
+    /** Decode a bound encoded with Xapian::sortable_serialise().
+     *
+     *  @return false if @a bound isn't what sortable_serialise() gives for
+     *		any number.
+     */
+    static bool decode_bound(const std::string & bound, double & result);
+
+    /** Does the range have an upper end?
+     *
+     *  This is false for the subclass ValueGePostList.
+     */
+    bool has_end;
+
+    /** The values of the entries up to this docid are all in range.
+     *
+     *  Set from value stream summaries, if there are any.
+     */
+    Xapian::docid all_match_until;
+
+    /// Might @a valuelist have summaries for skip_to_value_range()?
+    bool use_summaries;
+
+    /// Is the current value in the range?
+    bool value_in_range() const {
+	double number;
+	if (numeric_bounds && valuelist->get_value_as_number(number))
+	    return number >= begin_number && (!has_end || number <= end_number);
+	const std::string & v = valuelist->get_value();
+	return v >= begin && (!has_end || v <= end);
+    }
+
+    /** Move to the first entry at or after @a did with a value in range.
+     *
+     *  If there's no such entry, the postlist is left at_end().
+     */
+    void skip_to_match(Xapian::docid did);
+
     /// Disallow copying.
     ValueRangePostList(const ValueRangePostList &);
 
@@ -50,7 +98,12 @@ class ValueRangePostList : public PostList {
 		       Xapian::valueno slot_,
 		       const std::string &begin_, const std::string &end_)
 	: db(db_), slot(slot_), begin(begin_), end(end_),
-	  db_size(db->get_doccount()), valuelist(0) { }
+	  db_size(db->get_doccount()), valuelist(0), has_end(true),
+	  all_match_until(0), use_summaries(true)
+    {
+	numeric_bounds = decode_bound(begin, begin_number) &&
+			 decode_bound(end, end_number);
+    }
 
     ~ValueRangePostList();
 
@@ -25,10 +25,10 @@
 
 using namespace std;
 
-static void
-clear_valuelists(map<Xapian::valueno, ValueList *> & valuelists)
+void
+ValueStreamDocument::clear_valuelists()
 {
-    map<Xapian::valueno, ValueList *>::const_iterator i;
+    map<Xapian::valueno, SlotValues *>::const_iterator i;
     for (i = valuelists.begin(); i != valuelists.end(); ++i) {
 	delete i->second;
     }
@@ -38,7 +38,7 @@ clear_valuelists(map<Xapian::valueno, ValueList *> & valuelists)
 ValueStreamDocument::~ValueStreamDocument()
 {
     delete doc;
-    clear_valuelists(valuelists);
+    clear_valuelists();
 }
 
 void
@@ -48,7 +48,7 @@ ValueStreamDocument::new_subdb(int n)
     AssertRel(size_t(n),<,db.internal.size());
     current = unsigned(n);
     database = db.internal[n];
-    clear_valuelists(valuelists);
+    clear_valuelists();
 }
 
 string
@@ -61,34 +61,67 @@ ValueStreamDocument::do_get_value(Xapian::valueno slot) const
     }
 #endif
 
-    pair<map<Xapian::valueno, ValueList *>::iterator, bool> ret;
-    ret = valuelists.insert(make_pair(slot, static_cast<ValueList*>(NULL)));
-    ValueList * vl;
-    if (ret.second) {
+    SlotValues *& slot_values = valuelists[slot];
+    if (!slot_values) {
 	// Entry didn't already exist, so open a value list for slot.
-	vl = database->open_value_list(slot);
-	ret.first->second = vl;
-    } else {
-	vl = ret.first->second;
-	if (!vl) {
-	    AssertEqParanoid(string(), doc->get_value(slot));
-	    return string();
-	}
+	slot_values = new SlotValues(database->open_value_list(slot));
     }
+    SlotValues & sv = *slot_values;
 
     size_t multiplier = db.internal.size();
     Xapian::docid sub_did = (did - current - 2 + multiplier) / multiplier + 1;
     AssertEq((sub_did - 1) * multiplier + current + 1, did);
-    if (vl->check(sub_did)) {
-	if (vl->at_end()) {
-	    delete vl;
-	    ret.first->second = NULL;
-	} else if (vl->get_docid() == sub_did) {
-	    Assert(vl);
-	    string v = vl->get_value();
-	    AssertEq(v, doc->get_value(slot));
-	    return v;
+
+    Xapian::docid last = sv.last;
+    sv.last = sub_did;
+    if (sub_did < sv.begin || sub_did >= sv.end) {
+	// Not covered by the current batch.
+	sv.begin = sv.end = 0;
+	ValueList * vl = sv.vl;
+	if (!vl) {
+	    AssertEqParanoid(string(), doc->get_value(slot));
+	    return string();
 	}
+
+	if (sub_did > last && sub_did - last <= DENSE_GAP) {
+	    // The candidates are dense, so read the entries for a window of
+	    // docids starting at this one.
+	    Xapian::docid end_did = sub_did + VALUE_BATCH_SIZE;
+	    if (end_did < sub_did) end_did = Xapian::docid(-1);
+	    sv.size = vl->read_batch(sub_did, end_did, VALUE_BATCH_SIZE,
+				     sv.dids, sv.values);
+	    sv.pos = 0;
+	    sv.begin = sub_did;
+	    // If we filled the batch, it only covers up to its last entry.
+	    sv.end = (sv.size == VALUE_BATCH_SIZE) ?
+		sv.dids[sv.size - 1] + 1 : end_did;
+	    if (vl->at_end()) {
+		delete vl;
+		sv.vl = NULL;
+	    }
+	} else {
+	    if (vl->check(sub_did)) {
+		if (vl->at_end()) {
+		    delete vl;
+		    sv.vl = NULL;
+		} else if (vl->get_docid() == sub_did) {
+		    string v = vl->get_value();
+		    AssertEq(v, doc->get_value(slot));
+		    return v;
+		}
+	    }
+	    AssertEqParanoid(string(), doc->get_value(slot));
+	    return string();
+	}
+    } else if (sub_did < last) {
+	// Shouldn't happen, but cope if the lookups go backwards.
+	sv.pos = 0;
+    }
+
+    while (sv.pos != sv.size && sv.dids[sv.pos] < sub_did) ++sv.pos;
+    if (sv.pos != sv.size && sv.dids[sv.pos] == sub_did) {
+	AssertEq(sv.values[sv.pos], doc->get_value(slot));
+	return sv.values[sv.pos];
     }
     AssertEqParanoid(string(), doc->get_value(slot));
     return string();
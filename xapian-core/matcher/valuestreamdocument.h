@@ -35,7 +35,53 @@ class ValueStreamDocument : public Xapian::Document::Internal {
     /// Don't allow copying.
     ValueStreamDocument(const ValueStreamDocument &);
 
-    mutable std::map<Xapian::valueno, ValueList *> valuelists;
+    /** The number of entries to read from a value stream at once.
+     *
+     *  When the candidates are dense, reading the values for a window of
+     *  docids in one go is much cheaper than checking each docid in turn.
+     */
+    static const Xapian::doccount VALUE_BATCH_SIZE = 64;
+
+    /** The largest gap between candidates for which we read in batches.
+     *
+     *  If the candidates are further apart than this, most of a batch would
+     *  be wasted so we just check() each one.
+     */
+    static const Xapian::docid DENSE_GAP = 4;
+
+    /// The value stream for a slot, and a batch of entries read from it.
+    struct SlotValues {
+	/// The value stream, or NULL once it's been read to the end.
+	ValueList * vl;
+
+	/// The docid of the previous lookup in this slot.
+	Xapian::docid last;
+
+	/// The docids covered by the batch are [begin, end).
+	Xapian::docid begin, end;
+
+	/// The number of entries in the batch.
+	Xapian::doccount size;
+
+	/// Index of the next entry in the batch to consider.
+	Xapian::doccount pos;
+
+	/// The docids of the entries in the batch.
+	Xapian::docid dids[VALUE_BATCH_SIZE];
+
+	/// The values of the entries in the batch.
+	std::string values[VALUE_BATCH_SIZE];
+
+	explicit SlotValues(ValueList * vl_)
+	    : vl(vl_), last(0), begin(0), end(0), size(0), pos(0) { }
+
+	~SlotValues() { delete vl; }
+    };
+
+    mutable std::map<Xapian::valueno, SlotValues *> valuelists;
+
+    /// Delete the value streams and batches for all slots.
+    void clear_valuelists();
 
     Xapian::Database db;
 
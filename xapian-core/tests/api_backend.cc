@@ -27,9 +27,12 @@
 #define XAPIAN_DEPRECATED(X) X
 #include <xapian.h>
 
+#include "filetests.h"
+#include "pack.h"
 #include "str.h"
 #include "testsuite.h"
 #include "testutils.h"
+#include "unixcmds.h"
 
 #include "apitest.h"
 
@@ -37,6 +40,12 @@
 #include "safesysstat.h"
 #include "safeunistd.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
 using namespace std;
 
 /// Regression test - lockfile should honour umask, was only user-readable.
@@ -321,6 +330,12 @@ DEFINE_TESTCASE(databasemodified1, writable && !inmemory && !remote) {
     //
     // The remote backend doesn't work as expected here, I think due to
     // test harness issues.
+    //
+    // Brass's packed and bitmap postlist formats store these postings in
+    // so few blocks that the writer needn't reuse those the reader is using,
+    // so use the default format to make sure the reader's revision is
+    // overwritten.
+    ScopedEnv postlist_format("XAPIAN_BRASS_POSTLIST_FORMAT", string());
     Xapian::WritableDatabase db(get_writable_database());
     Xapian::Document doc;
     doc.set_data("cargo");
@@ -697,6 +712,89 @@ DEFINE_TESTCASE(failedreplace2, brass || chert) {
     return true;
 }
 
+/** Check copies of a database which are modified separately don't share
+ *  blocks in the shared block cache.
+ *
+ *  A copy has the same UUID as the original, so if both are then updated to
+ *  the same revision, the UUID, table name and revision don't identify the
+ *  blocks.  This only exercises the cache if XAPIAN_BLOCK_CACHE_SIZE is set.
+ */
+DEFINE_TESTCASE(blockcachecopy1, brass || chert) {
+    string path = get_named_writable_database_path("blockcachecopy1");
+    {
+	Xapian::WritableDatabase db =
+	    get_named_writable_database("blockcachecopy1");
+	Xapian::Document doc;
+	doc.add_term("original");
+	db.add_document(doc);
+	db.commit();
+    }
+    string copy = path + "copy";
+    rm_rf(copy);
+    cp_R(path, copy);
+
+    {
+	Xapian::WritableDatabase db(path, Xapian::DB_OPEN);
+	Xapian::Document doc;
+	doc.add_term("alpha");
+	db.replace_document(1, doc);
+	db.commit();
+    }
+    {
+	Xapian::WritableDatabase db(copy, Xapian::DB_OPEN);
+	Xapian::Document doc;
+	doc.add_term("beta");
+	db.replace_document(1, doc);
+	db.commit();
+    }
+
+    Xapian::Database db(path);
+    TEST_EQUAL(db.get_termfreq("alpha"), 1);
+    TEST_EQUAL(db.get_termfreq("beta"), 0);
+    Xapian::Database db_copy(copy);
+    TEST_EQUAL(db_copy.get_termfreq("alpha"), 0);
+    TEST_EQUAL(db_copy.get_termfreq("beta"), 1);
+    TEST_EQUAL(*db_copy.termlist_begin(1), "beta");
+    db_copy.close();
+    rm_rf(copy);
+    return true;
+}
+
+/** Check a reader using the block cache notices its revision being discarded.
+ *
+ *  Once a writer in the same process has reused the reader's blocks, the
+ *  reader should get DatabaseModifiedError rather than carrying on reading
+ *  cached copies of them.  This only exercises the cache if
+ *  XAPIAN_BLOCK_CACHE_SIZE is set.
+ */
+DEFINE_TESTCASE(blockcachemodified1, brass || chert) {
+    Xapian::WritableDatabase db =
+	get_named_writable_database("blockcachemodified1");
+    Xapian::Document doc;
+    for (int i = 100; i < 120; ++i) {
+	doc.add_term(str(i));
+    }
+    for (int j = 0; j < 50; ++j) {
+	db.add_document(doc);
+    }
+    db.commit();
+
+    Xapian::Database rodb(get_named_writable_database_path("blockcachemodified1"));
+    TEST_EXCEPTION(Xapian::DatabaseModifiedError,
+	for (int k = 0; k < 10; ++k) {
+	    Xapian::TermIterator t;
+	    Xapian::termcount count = 0;
+	    for (t = rodb.allterms_begin(); t != rodb.allterms_end(); ++t) {
+		++count;
+	    }
+	    TEST_EQUAL(count, 20);
+	    db.add_document(doc);
+	    db.commit();
+	}
+    );
+    return true;
+}
+
 /// Coverage for SelectPostList::skip_to().
 DEFINE_TESTCASE(phrase3, positional) {
     Xapian::Database db = get_database("apitest_phrase");
@@ -875,3 +973,1952 @@ DEFINE_TESTCASE(itorskiptofromend1, backend) {
 
     return true;
 }
+
+/// The environment variables which change how brass databases are stored.
+static const char * const brass_setting_names[] = {
+    "XAPIAN_BRASS_BLOCK_SIZE",
+    "XAPIAN_BRASS_COMPRESSION",
+    "XAPIAN_BRASS_DIRECT_IO",
+    "XAPIAN_BRASS_DOCLEN_FORMAT",
+    "XAPIAN_BRASS_MMAP",
+    "XAPIAN_BRASS_POSITION_FORMAT",
+    "XAPIAN_BRASS_POSTLIST_FORMAT",
+    "XAPIAN_BRASS_VALUE_FORMAT",
+    "XAPIAN_BRASS_VALUE_INDEX",
+    "XAPIAN_BRASS_VALUE_SUMMARIES"
+};
+
+/** Clear all the brass settings until this object goes out of scope.
+ *
+ *  Testcases which compare formats or table sizes use this so they don't
+ *  depend on which settings the testsuite happens to be run with.
+ */
+class BrassSettings {
+    enum {
+	N_SETTINGS = sizeof(brass_setting_names) / sizeof(brass_setting_names[0])
+    };
+
+    ScopedEnv * envs[N_SETTINGS];
+
+    /// Copy not allowed.
+    BrassSettings(const BrassSettings &);
+
+    /// Assignment not allowed.
+    void operator=(const BrassSettings &);
+
+  public:
+    BrassSettings() {
+	for (size_t i = 0; i != N_SETTINGS; ++i)
+	    envs[i] = new ScopedEnv(brass_setting_names[i], string());
+    }
+
+    ~BrassSettings() {
+	for (size_t i = 0; i != N_SETTINGS; ++i)
+	    delete envs[i];
+    }
+
+    /// Set @a name to @a value - an empty value gives the default.
+    void set(const char * name, const string & value) {
+	for (size_t i = 0; i != N_SETTINGS; ++i) {
+	    if (strcmp(brass_setting_names[i], name) == 0) {
+		envs[i]->set(value);
+		return;
+	    }
+	}
+	FAIL_TEST("Unknown brass setting " << name);
+    }
+};
+
+/// Make the document with docid @a did for a testcase.
+typedef Xapian::Document (*doc_maker)(Xapian::docid did);
+
+/** Build a checked brass database at @a path.
+ *
+ *  @a name is set to @a value while the database is created (which is when
+ *  most brass settings take effect), unless @a value is NULL.  The documents
+ *  are @a make_doc(1) to @a make_doc(@a n_docs), committed every
+ *  @a commit_every documents if that's non-zero, and at the end.
+ */
+static Xapian::WritableDatabase
+build_brass_db(BrassSettings & settings, const string & path,
+	       const char * name, const char * value,
+	       doc_maker make_doc, Xapian::docid n_docs,
+	       Xapian::docid commit_every = 0)
+{
+    if (value) settings.set(name, value);
+    Xapian::WritableDatabase db =
+	Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+    if (value) settings.set(name, string());
+    for (Xapian::docid did = 1; did <= n_docs; ++did) {
+	db.add_document(make_doc(did));
+	if (commit_every && did % commit_every == 0) db.commit();
+    }
+    db.commit();
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+    return db;
+}
+
+/** Compact @a src to a checked database at @a out.
+ *
+ *  @a name is set to @a value while compacting, unless @a value is NULL.
+ */
+static void
+compact_brass_db(BrassSettings & settings, const string & src,
+		 const string & out, const char * name, const char * value,
+		 bool renumber = true)
+{
+    rm_rf(out);
+    if (value) settings.set(name, value);
+    {
+	Xapian::Compactor compact;
+	compact.set_renumber(renumber);
+	compact.set_destdir(out);
+	compact.add_source(src);
+	compact.compact();
+    }
+    if (value) settings.set(name, string());
+    TEST_EQUAL(Xapian::Database::check(out, 0, tout), 0);
+}
+
+/** Return integer @a n (counting from 1) of the current base file of
+ *  @a table in the brass database at @a path.
+ */
+static unsigned long
+brass_base_uint(const string & path, const string & table, int n)
+{
+    // The current base file is the one with the higher revision (the first
+    // integer).
+    unsigned long best_revision = 0, result = 0;
+    for (char ch = 'A'; ch <= 'B'; ++ch) {
+	string base = path + "/" + table + ".base" + ch;
+	if (!file_exists(base)) continue;
+	ifstream in(base.c_str(), ios::binary);
+	string data((istreambuf_iterator<char>(in)),
+		    istreambuf_iterator<char>());
+	const char * p = data.data();
+	const char * end = p + data.size();
+	unsigned long revision;
+	TEST(unpack_uint(&p, end, &revision));
+	unsigned long value = revision;
+	for (int i = 2; i <= n; ++i) {
+	    TEST(unpack_uint(&p, end, &value));
+	}
+	if (revision >= best_revision) {
+	    best_revision = revision;
+	    result = value;
+	}
+    }
+    return result;
+}
+
+/// Return whether @a table in the brass database at @a path is sequential.
+static bool
+brass_table_sequential(const string & path, const string & table)
+{
+    return brass_base_uint(path, table, 10) != 0;
+}
+
+/// Return the number of items in @a table in the brass database at @a path.
+static unsigned long
+brass_table_items(const string & path, const string & table)
+{
+    return brass_base_uint(path, table, 7);
+}
+
+/// Check reading a brass database with the tables memory mapped.
+DEFINE_TESTCASE(brassmmap1, brass) {
+    BrassSettings settings;
+    Xapian::Database db = get_database("etext");
+    settings.set("XAPIAN_BRASS_MMAP", "1");
+    Xapian::Database mapped(get_database_path("etext"));
+    settings.set("XAPIAN_BRASS_MMAP", "");
+
+    TEST_EQUAL(db.get_doccount(), mapped.get_doccount());
+    TEST_EQUAL(db.get_avlength(), mapped.get_avlength());
+
+    // Walk every postlist, which visits every block of the postlist table.
+    Xapian::TermIterator t = db.allterms_begin();
+    Xapian::TermIterator u = mapped.allterms_begin();
+    while (t != db.allterms_end()) {
+	TEST(u != mapped.allterms_end());
+	TEST_EQUAL(*t, *u);
+	TEST_EQUAL(t.get_termfreq(), u.get_termfreq());
+	Xapian::PostingIterator p = db.postlist_begin(*t);
+	Xapian::PostingIterator q = mapped.postlist_begin(*u);
+	while (p != db.postlist_end(*t)) {
+	    TEST(q != mapped.postlist_end(*u));
+	    TEST_EQUAL(*p, *q);
+	    TEST_EQUAL(p.get_wdf(), q.get_wdf());
+	    ++p;
+	    ++q;
+	}
+	TEST(q == mapped.postlist_end(*u));
+	++t;
+	++u;
+    }
+    TEST(u == mapped.allterms_end());
+
+    for (Xapian::docid did = 1; did <= db.get_lastdocid(); ++did) {
+	TEST_EQUAL(db.get_document(did).get_data(),
+		   mapped.get_document(did).get_data());
+	TEST_EQUAL(db.get_doclength(did), mapped.get_doclength(did));
+    }
+
+    Xapian::Enquire enquire(db), enquire_mapped(mapped);
+    Xapian::Query query(Xapian::Query::OP_OR,
+			Xapian::Query("time"), Xapian::Query("gutenberg"));
+    enquire.set_query(query);
+    enquire_mapped.set_query(query);
+    Xapian::MSet mset = enquire.get_mset(0, 20);
+    TEST(!mset.empty());
+    TEST_EQUAL(mset, enquire_mapped.get_mset(0, 20));
+
+    // Check iterators keep working after reopen() replaces the mapping.
+    // This used to segfault, as their cursors pointed into the old one.
+    string path = get_named_writable_database_path("brassmmap1");
+    Xapian::WritableDatabase wdb = get_named_writable_database("brassmmap1");
+    for (unsigned i = 1000; i < 2000; ++i) {
+	Xapian::Document doc;
+	doc.add_term("all");
+	doc.add_term("T" + str(i));
+	doc.set_data(string(100, 'x'));
+	wdb.add_document(doc);
+    }
+    wdb.commit();
+    settings.set("XAPIAN_BRASS_MMAP", "1");
+    Xapian::Database reader(path);
+    settings.set("XAPIAN_BRASS_MMAP", "");
+    Xapian::TermIterator term = reader.allterms_begin("T");
+    Xapian::PostingIterator post = reader.postlist_begin("all");
+    for (unsigned i = 1000; i < 1500; ++i) {
+	TEST_EQUAL(*term, "T" + str(i));
+	TEST_EQUAL(*post, i - 999);
+	++term;
+	++post;
+    }
+    for (unsigned i = 2000; i < 3000; ++i) {
+	Xapian::Document doc;
+	doc.add_term("all");
+	doc.add_term("U" + str(i));
+	wdb.add_document(doc);
+    }
+    wdb.commit();
+    TEST(reader.reopen());
+    for (unsigned i = 1500; i < 2000; ++i) {
+	TEST(term != reader.allterms_end("T"));
+	TEST_EQUAL(*term, "T" + str(i));
+	TEST_EQUAL(*post, i - 999);
+	++term;
+	++post;
+    }
+    TEST(term == reader.allterms_end("T"));
+    TEST_EQUAL(reader.get_termfreq("all"), 2000);
+    TEST_EQUAL(reader.get_document(2000).get_data(), "");
+
+    return true;
+}
+
+/// Check databasemodified1 with the tables memory mapped.
+DEFINE_TESTCASE(brassmmap2, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassmmap2");
+    Xapian::WritableDatabase db = get_named_writable_database("brassmmap2");
+    Xapian::Document doc;
+    doc.set_data("cargo");
+    doc.add_term("abc");
+    doc.add_term("def");
+    doc.add_term("ghi");
+    const int N = 500;
+    for (int i = 0; i < N; ++i) {
+	db.add_document(doc);
+    }
+    db.commit();
+
+    settings.set("XAPIAN_BRASS_MMAP", "1");
+    Xapian::Database rodb(path);
+    settings.set("XAPIAN_BRASS_MMAP", string());
+    db.add_document(doc);
+    db.commit();
+
+    db.add_document(doc);
+    db.commit();
+
+    db.add_document(doc);
+    // The branch blocks are read in place in the mapping, and used to be
+    // followed after a writer had reused them, giving DatabaseError.
+    TEST_EXCEPTION(Xapian::DatabaseModifiedError,
+		   TEST_EQUAL(*rodb.termlist_begin(N - 1), "abc"));
+
+    TEST_EXCEPTION(Xapian::DatabaseModifiedError,
+	Xapian::Enquire enq(rodb);
+	enq.set_query(Xapian::Query("abc"));
+	Xapian::MSet mset = enq.get_mset(0, 10);
+    );
+
+    return true;
+}
+
+/// Check a commit which fails part way through leaves the old revision.
+DEFINE_TESTCASE(brasscommitfail1, brass) {
+    string path = get_named_writable_database_path("brasscommitfail1");
+    string record = path + "/record.";
+    Xapian::Document doc;
+    doc.add_term("abc");
+    {
+	Xapian::WritableDatabase db =
+	    get_named_writable_database("brasscommitfail1");
+	db.add_document(doc);
+	db.commit();
+	db.add_document(doc);
+	db.commit();
+
+	// Make the record table's commit_start() fail, after the other tables
+	// have written their new base files.
+	mkdir((record + "tmp").c_str(), 0755);
+	db.add_document(doc);
+	TEST_EXCEPTION(Xapian::DatabaseError, db.commit());
+	rm_rf(record + "tmp");
+    }
+    TEST_EQUAL(Xapian::Database(path).get_doccount(), 2);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The next commit will rename the record table's new base file to
+    // whichever of record.baseA and record.baseB doesn't exist.
+    string new_base = record + "baseA";
+    if (file_exists(new_base)) new_base = record + "baseB";
+    TEST(!file_exists(new_base));
+
+    {
+	Xapian::WritableDatabase db(path, Xapian::DB_OPEN);
+	// Make the record table's commit_finish() fail, after all the other
+	// tables have made their new revision live.
+	mkdir(new_base.c_str(), 0755);
+	db.add_document(doc);
+	TEST_EXCEPTION(Xapian::DatabaseError, db.commit());
+	rm_rf(new_base);
+    }
+    TEST_EQUAL(Xapian::Database(path).get_doccount(), 2);
+    TEST_EQUAL(Xapian::Database(path).get_termfreq("abc"), 2);
+
+    // Check the database can still be updated.
+    {
+	Xapian::WritableDatabase db(path, Xapian::DB_OPEN);
+	db.add_document(doc);
+	db.commit();
+    }
+    TEST_EQUAL(Xapian::Database(path).get_doccount(), 3);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    return true;
+}
+
+/// Check the term statistics for a query with many terms.
+DEFINE_TESTCASE(manytermstats1, backend) {
+    Xapian::Database db = get_database("etext");
+    vector<string> terms;
+    unsigned n = 0;
+    for (Xapian::TermIterator t = db.allterms_begin(); t != db.allterms_end();
+	 ++t) {
+	// Take every 37th term so the terms are spread over the table.
+	if (n++ % 37 == 0) terms.push_back(*t);
+    }
+    // Add terms which aren't in the database too.
+    terms.push_back("zzzzzzzz");
+    terms.push_back("Anotindb");
+    terms.push_back(string(300, 'x'));
+
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query(Xapian::Query::OP_OR,
+				    terms.begin(), terms.end()));
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    vector<string>::const_iterator i;
+    for (i = terms.begin(); i != terms.end(); ++i) {
+	TEST_EQUAL(mset.get_termfreq(*i), db.get_termfreq(*i));
+    }
+
+    return true;
+}
+
+/// Check building a brass database with DB_BULK_LOAD.
+DEFINE_TESTCASE(bulkload1, brass) {
+    BrassSettings settings;
+    ScopedEnv flush_threshold("XAPIAN_FLUSH_THRESHOLD");
+    Xapian::Database src = get_database("etext");
+    string path = get_named_writable_database_path("bulkload1");
+    string path_bulk = get_named_writable_database_path("bulkload1b");
+
+    // Use a tiny flush threshold so we get enough runs to need merging.
+    flush_threshold.set("3");
+    Xapian::WritableDatabase db =
+	Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+    Xapian::WritableDatabase bulk =
+	Xapian::Brass::open(path_bulk,
+			    Xapian::DB_CREATE_OR_OVERWRITE |
+			    Xapian::DB_BULK_LOAD);
+    flush_threshold.set("");
+    db.set_metadata("foo", "bar");
+    bulk.set_metadata("foo", "bar");
+    for (Xapian::docid did = 1; did <= src.get_lastdocid(); ++did) {
+	Xapian::Document doc = src.get_document(did);
+	doc.add_value(0, str(did % 7));
+	doc.add_value(1, str(did));
+	db.add_document(doc);
+	bulk.add_document(doc);
+	if (did % 100 == 0) {
+	    // Check statistics can be read part way through, from both the
+	    // runs and the changes which haven't been written as a run yet.
+	    TEST_EQUAL(db.get_termfreq("the"), bulk.get_termfreq("the"));
+	    TEST_EQUAL(db.get_collection_freq("the"),
+		       bulk.get_collection_freq("the"));
+	    TEST_EQUAL(db.get_doclength(did / 2), bulk.get_doclength(did / 2));
+	    TEST_EQUAL(db.get_doclength(did), bulk.get_doclength(did));
+	}
+    }
+    TEST_EQUAL(bulk.get_doccount(), src.get_doccount());
+    // Reading the statistics shouldn't have ended bulk loading, so nothing
+    // should have been committed yet.
+    TEST_EQUAL(Xapian::Database(path_bulk).get_doccount(), 0);
+    db.commit();
+    bulk.commit();
+    TEST(!dir_exists(path_bulk + "/bulk0"));
+    TEST_EQUAL(bulk.get_metadata("foo"), "bar");
+
+    TEST_EQUAL(db.get_doccount(), bulk.get_doccount());
+    TEST_EQUAL(db.get_lastdocid(), bulk.get_lastdocid());
+    TEST_EQUAL(db.get_avlength(), bulk.get_avlength());
+    TEST_EQUAL(db.get_doclength_lower_bound(), bulk.get_doclength_lower_bound());
+    TEST_EQUAL(db.get_doclength_upper_bound(), bulk.get_doclength_upper_bound());
+    TEST_EQUAL(db.get_wdf_upper_bound("the"), bulk.get_wdf_upper_bound("the"));
+
+    Xapian::TermIterator t = db.allterms_begin();
+    Xapian::TermIterator u = bulk.allterms_begin();
+    while (t != db.allterms_end()) {
+	TEST(u != bulk.allterms_end());
+	TEST_EQUAL(*t, *u);
+	TEST_EQUAL(t.get_termfreq(), u.get_termfreq());
+	TEST_EQUAL(db.get_collection_freq(*t), bulk.get_collection_freq(*u));
+	Xapian::PostingIterator p = db.postlist_begin(*t);
+	Xapian::PostingIterator q = bulk.postlist_begin(*u);
+	while (p != db.postlist_end(*t)) {
+	    TEST(q != bulk.postlist_end(*u));
+	    TEST_EQUAL(*p, *q);
+	    TEST_EQUAL(p.get_wdf(), q.get_wdf());
+	    ++p;
+	    ++q;
+	}
+	TEST(q == bulk.postlist_end(*u));
+	++t;
+	++u;
+    }
+    TEST(u == bulk.allterms_end());
+
+    for (Xapian::docid did = 1; did <= db.get_lastdocid(); ++did) {
+	TEST_EQUAL(db.get_doclength(did), bulk.get_doclength(did));
+	TEST_EQUAL(db.get_document(did).get_data(),
+		   bulk.get_document(did).get_data());
+    }
+
+    for (Xapian::valueno slot = 0; slot <= 1; ++slot) {
+	TEST_EQUAL(db.get_value_freq(slot), bulk.get_value_freq(slot));
+	TEST_EQUAL(db.get_value_lower_bound(slot),
+		   bulk.get_value_lower_bound(slot));
+	TEST_EQUAL(db.get_value_upper_bound(slot),
+		   bulk.get_value_upper_bound(slot));
+	Xapian::ValueIterator v = db.valuestream_begin(slot);
+	Xapian::ValueIterator w = bulk.valuestream_begin(slot);
+	while (v != db.valuestream_end(slot)) {
+	    TEST(w != bulk.valuestream_end(slot));
+	    TEST_EQUAL(v.get_docid(), w.get_docid());
+	    TEST_EQUAL(*v, *w);
+	    ++v;
+	    ++w;
+	}
+	TEST(w == bulk.valuestream_end(slot));
+    }
+
+    // The postlist table should have been written fully packed.
+    TEST_REL(file_size(path_bulk + "/postlist.DB"), <,
+	     file_size(path + "/postlist.DB"));
+
+    db.close();
+    bulk.close();
+    TEST_EQUAL(Xapian::Database::check(path_bulk, 0, tout), 0);
+    // Compacting doesn't split chunks afresh, so if the runs' chunks had
+    // been copied as they were, the table would have many more items than a
+    // compacted copy of the incrementally built database.
+    string compacted = path + "c";
+    compact_brass_db(settings, path, compacted, NULL, NULL);
+    TEST_REL(brass_table_items(path_bulk, "postlist"), <=,
+	     brass_table_items(compacted, "postlist"));
+
+    // Changes after the commit should work as normal.
+    bulk = Xapian::WritableDatabase(path_bulk, Xapian::DB_OPEN);
+    bulk.delete_document(1);
+    bulk.commit();
+    TEST_EQUAL(bulk.get_doccount(), src.get_doccount() - 1);
+
+    return true;
+}
+
+/// Check that @a db has the same documents as @a src.
+static void
+check_same_documents(const Xapian::Database & src, const Xapian::Database & db)
+{
+    TEST_EQUAL(db.get_doccount(), src.get_doccount());
+    for (Xapian::docid did = 1; did <= src.get_lastdocid(); ++did) {
+	Xapian::Document a = src.get_document(did);
+	Xapian::Document b = db.get_document(did);
+	TEST_EQUAL(a.get_data(), b.get_data());
+	Xapian::TermIterator t = a.termlist_begin();
+	Xapian::TermIterator u = b.termlist_begin();
+	while (t != a.termlist_end()) {
+	    TEST(u != b.termlist_end());
+	    TEST_EQUAL(*t, *u);
+	    TEST_EQUAL(t.get_wdf(), u.get_wdf());
+	    ++t;
+	    ++u;
+	}
+	TEST(u == b.termlist_end());
+    }
+}
+
+/// Check brass tag compression codecs.
+DEFINE_TESTCASE(brasscodec1, brass) {
+    BrassSettings settings;
+    Xapian::Database src = get_database("etext");
+
+    string path = get_named_writable_database_path("brasscodec1");
+    settings.set("XAPIAN_BRASS_COMPRESSION", "nosuchcodec");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+    settings.set("XAPIAN_BRASS_COMPRESSION", "record=nosuchcodec");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+    settings.set("XAPIAN_BRASS_COMPRESSION", "postlists=zlib");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+
+    static const char * const codecs[] = {
+	"zlib", "lz4", "zstd", "lz4,termlist=zstd"
+    };
+    for (size_t i = 0; i != sizeof(codecs) / sizeof(codecs[0]); ++i) {
+	tout << codecs[i] << '\n';
+	settings.set("XAPIAN_BRASS_COMPRESSION", codecs[i]);
+	rm_rf(path);
+	try {
+	    Xapian::WritableDatabase db =
+		Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+	    for (Xapian::docid did = 1; did <= src.get_lastdocid(); ++did) {
+		db.add_document(src.get_document(did));
+	    }
+	    db.commit();
+	} catch (const Xapian::FeatureUnavailableError &) {
+	    tout << "Skipping " << codecs[i] << " - not supported\n";
+	    continue;
+	}
+	// The codec is recorded in the database, so this shouldn't matter
+	// when reading or updating it.
+	settings.set("XAPIAN_BRASS_COMPRESSION", "");
+
+	check_same_documents(src, Xapian::Database(path));
+	TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+	// Check that compaction with a different codec configured
+	// recompresses the tags.
+	string out = path + "out";
+	compact_brass_db(settings, path, out, "XAPIAN_BRASS_COMPRESSION", "zlib");
+	check_same_documents(src, Xapian::Database(out));
+
+	// And without a codec configured, the input codec should be kept.
+	compact_brass_db(settings, path, out, NULL, NULL);
+	check_same_documents(src, Xapian::Database(out));
+    }
+
+    return true;
+}
+
+/// Make a small JSON-like document for brassdictionary1.
+static Xapian::Document
+dictionary_doc(Xapian::docid did)
+{
+    static const char * const colours[] = {
+	"red", "orange", "yellow", "green", "blue", "indigo", "violet"
+    };
+    unsigned i = did - 1;
+    const char * colour = colours[i % 7];
+    Xapian::Document doc;
+    string data = "{\"id\":";
+    data += str(i);
+    data += ",\"title\":\"Example document number ";
+    data += str(i * 7919 % 2000);
+    data += "\",\"colour\":\"";
+    data += colour;
+    data += "\",\"in_stock\":";
+    data += (i % 3) ? "true" : "false";
+    data += ",\"tags\":[\"example\",\"";
+    data += colour;
+    data += "\"]}";
+    doc.set_data(data);
+    doc.add_term("Q" + str(i));
+    doc.add_term(colour);
+    doc.add_term("example");
+    doc.add_term("number");
+    return doc;
+}
+
+/// Check compacting with compression dictionaries.
+DEFINE_TESTCASE(brassdictionary1, brass) {
+    BrassSettings settings;
+    // Small, similar documents are where a dictionary helps most.
+    string path = get_named_writable_database_path("brassdictionary1");
+    build_brass_db(settings, path, NULL, NULL, dictionary_doc, 2000);
+
+    string plain = path + "plain";
+    string dict = path + "dict";
+    string copy = path + "copy";
+    compact_brass_db(settings, path, plain, NULL, NULL);
+    rm_rf(dict);
+    {
+	Xapian::Compactor compact;
+	compact.set_dictionary_training(true);
+	compact.set_destdir(dict);
+	compact.add_source(path);
+	compact.compact();
+    }
+    TEST_EQUAL(Xapian::Database::check(dict, 0, tout), 0);
+    // Compacting without training a dictionary should keep the existing
+    // one.
+    compact_brass_db(settings, dict, copy, NULL, NULL);
+
+    Xapian::Database src(path);
+    check_same_documents(src, Xapian::Database(dict));
+    check_same_documents(src, Xapian::Database(copy));
+    TEST_REL(file_size(dict + "/record.DB"), <, file_size(plain + "/record.DB"));
+    TEST_EQUAL(file_size(copy + "/record.DB"), file_size(dict + "/record.DB"));
+
+    // Updates to a table with a dictionary should use it too.
+    {
+	Xapian::WritableDatabase db(dict, Xapian::DB_OPEN);
+	Xapian::Document doc;
+	doc.set_data("{\"id\":2000,\"title\":\"Example document number 0\"}");
+	doc.add_term("example");
+	db.replace_document(1, doc);
+	db.commit();
+    }
+    Xapian::Database db(dict);
+    TEST_EQUAL(db.get_document(1).get_data(),
+	       "{\"id\":2000,\"title\":\"Example document number 0\"}");
+    TEST_EQUAL(db.get_document(2).get_data(), src.get_document(2).get_data());
+    TEST_EQUAL(Xapian::Database::check(dict, 0, tout), 0);
+
+    return true;
+}
+
+/// Check a huge compression dictionary size in a base file is rejected.
+DEFINE_TESTCASE(brassdictionary2, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassdictionary2");
+    {
+	Xapian::WritableDatabase db =
+	    Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+	db.add_document(Xapian::Document());
+	db.commit();
+    }
+    // Overwrite the dictionary size in the record table's base files, which
+    // is the twelfth integer in them.
+    for (char ch = 'A'; ch <= 'B'; ++ch) {
+	string base = path + "/record.base" + ch;
+	if (!file_exists(base)) continue;
+	string data;
+	{
+	    ifstream in(base.c_str(), ios::binary);
+	    data.assign(istreambuf_iterator<char>(in),
+			istreambuf_iterator<char>());
+	}
+	const char * p = data.data();
+	const char * end = p + data.size();
+	for (int i = 0; i != 11; ++i) {
+	    unsigned dummy;
+	    TEST(unpack_uint(&p, end, &dummy));
+	}
+	const char * q = p;
+	unsigned dictionary_size;
+	TEST(unpack_uint(&q, end, &dictionary_size));
+	TEST_EQUAL(dictionary_size, 0);
+	string corrupt(data.data(), p - data.data());
+	pack_uint(corrupt, 0xffffffffu);
+	corrupt.append(q, end - q);
+	ofstream out(base.c_str(), ios::binary | ios::trunc);
+	out << corrupt;
+    }
+    TEST_EXCEPTION(Xapian::DatabaseCorruptError, Xapian::Database db(path));
+
+    return true;
+}
+
+/// Check per-table block sizes for brass.
+DEFINE_TESTCASE(brassblocksize1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassblocksize1");
+    settings.set("XAPIAN_BRASS_BLOCK_SIZE", "64K,record=3000");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+
+    // A misspelt table name should be reported, even if it comes after the
+    // entry for the table being opened.
+    settings.set("XAPIAN_BRASS_BLOCK_SIZE", "4K,postlist=64K,records=4K");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+
+    settings.set("XAPIAN_BRASS_BLOCK_SIZE", "4K,postlist=64K,position=16384");
+    Xapian::WritableDatabase db =
+	Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+    settings.set("XAPIAN_BRASS_BLOCK_SIZE", "");
+    // The position table is created when first needed, but should still get
+    // the block size configured when the database was opened.
+    Xapian::Database src = get_database("apitest_simpledata");
+    for (Xapian::docid did = 1; did <= src.get_lastdocid(); ++did) {
+	db.add_document(src.get_document(did));
+    }
+    db.commit();
+
+    TEST_EQUAL(file_size(path + "/postlist.DB") % 65536, 0);
+    TEST_REL(file_size(path + "/record.DB"), <, 65536);
+    TEST_EQUAL(file_size(path + "/position.DB") % 16384, 0);
+    db.close();
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // Check per-table block sizes when compacting.
+    string out = path + "out";
+    rm_rf(out);
+    {
+	Xapian::Compactor compact;
+	compact.set_block_size(2048);
+	compact.set_block_size("record", 65536);
+	compact.set_destdir(out);
+	compact.add_source(path);
+	compact.compact();
+    }
+    TEST_EQUAL(file_size(out + "/record.DB") % 65536, 0);
+    TEST_REL(file_size(out + "/postlist.DB"), <, 65536);
+    TEST_EQUAL(Xapian::Database::check(out, 0, tout), 0);
+    check_same_documents(src, Xapian::Database(out));
+
+    return true;
+}
+
+static Xapian::Document
+readahead_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    doc.add_term("common");
+    // Add the unique terms in a scrambled order, so the leaf blocks they are
+    // in get split and the postlist table isn't sequential.
+    doc.add_term("u" + str((did * 7919) % 3001));
+    return doc;
+}
+
+/// Check scanning with a cursor, which issues readahead, in both modes.
+DEFINE_TESTCASE(brassreadahead1, brass) {
+    BrassSettings settings;
+    const Xapian::docid N = 3000;
+    string path = get_named_writable_database_path("brassreadahead1");
+    // Use small blocks so a scan crosses lots of leaf blocks, and several
+    // level 1 blocks.
+    build_brass_db(settings, path, "XAPIAN_BRASS_BLOCK_SIZE", "2048",
+		   readahead_doc, N, 100).close();
+
+    string out = path + "out";
+    rm_rf(out);
+    {
+	Xapian::Compactor compact;
+	compact.set_block_size(2048);
+	compact.set_destdir(out);
+	compact.add_source(path);
+	compact.compact();
+    }
+
+    TEST(!brass_table_sequential(path, "postlist"));
+    TEST(brass_table_sequential(out, "postlist"));
+
+    const string * dbpaths[] = { &path, &out };
+    for (size_t i = 0; i != sizeof(dbpaths) / sizeof(dbpaths[0]); ++i) {
+	tout << *dbpaths[i] << endl;
+	Xapian::Database db(*dbpaths[i]);
+	vector<string> terms;
+	for (Xapian::TermIterator t = db.allterms_begin("u");
+	     t != db.allterms_end("u"); ++t) {
+	    TEST_EQUAL(t.get_termfreq(), 1);
+	    terms.push_back(*t);
+	}
+	vector<string> expected;
+	for (Xapian::docid did = 1; did <= N; ++did) {
+	    expected.push_back("u" + str((did * 7919) % 3001));
+	}
+	sort(expected.begin(), expected.end());
+	TEST(terms == expected);
+
+	Xapian::docid did = 0;
+	for (Xapian::PostingIterator p = db.postlist_begin("common");
+	     p != db.postlist_end("common"); ++p) {
+	    TEST_EQUAL(*p, ++did);
+	}
+	TEST_EQUAL(did, N);
+    }
+
+    return true;
+}
+
+/// Check that @a db has the same postings for @a terms as @a src.
+static void
+check_same_postings(const Xapian::Database & src, const Xapian::Database & db,
+		    const char * const * terms)
+{
+    for (const char * const * t = terms; *t; ++t) {
+	tout << "Term " << *t << '\n';
+	TEST_EQUAL(db.get_termfreq(*t), src.get_termfreq(*t));
+	Xapian::PostingIterator p = src.postlist_begin(*t);
+	Xapian::PostingIterator q = db.postlist_begin(*t);
+	while (p != src.postlist_end(*t)) {
+	    TEST(q != db.postlist_end(*t));
+	    TEST_EQUAL(*p, *q);
+	    TEST_EQUAL(p.get_wdf(), q.get_wdf());
+	    TEST_EQUAL(p.get_doclength(), q.get_doclength());
+	    ++p;
+	    ++q;
+	}
+	TEST(q == db.postlist_end(*t));
+
+	// Check skipping, by different amounts.
+	for (Xapian::docid step = 1; step < 500; step = step * 3 + 2) {
+	    p = src.postlist_begin(*t);
+	    q = db.postlist_begin(*t);
+	    for (Xapian::docid did = 1; p != src.postlist_end(*t); did += step) {
+		p.skip_to(did);
+		q.skip_to(did);
+		if (p == src.postlist_end(*t)) break;
+		TEST(q != db.postlist_end(*t));
+		TEST_EQUAL(*p, *q);
+		TEST_EQUAL(p.get_wdf(), q.get_wdf());
+	    }
+	    TEST(q == db.postlist_end(*t));
+	}
+    }
+}
+
+/// Check the bit-packed postlist format for brass.
+DEFINE_TESTCASE(brasspackedpostlist1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brasspackedpostlist1");
+    string plain = path + "plain";
+    settings.set("XAPIAN_BRASS_POSTLIST_FORMAT", "nosuchformat");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+
+    static const char * const terms[] = {
+	"all", "even", "sparse", "bigwdf", "rare", NULL
+    };
+    settings.set("XAPIAN_BRASS_POSTLIST_FORMAT", "packed");
+    Xapian::WritableDatabase db =
+	Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+    settings.set("XAPIAN_BRASS_POSTLIST_FORMAT", "varint");
+    Xapian::WritableDatabase ref =
+	Xapian::Brass::open(plain, Xapian::DB_CREATE_OR_OVERWRITE);
+    settings.set("XAPIAN_BRASS_POSTLIST_FORMAT", "");
+    for (Xapian::docid did = 1; did <= 3000; ++did) {
+	Xapian::Document doc;
+	doc.add_term("all", did % 7 + 1);
+	if (did % 2 == 0) doc.add_term("even");
+	if (did % 97 == 0 || did % 101 == 0) doc.add_term("sparse");
+	doc.add_term("bigwdf", did * 100000);
+	if (did == 1234) doc.add_term("rare");
+	// Make a gap in the docids, so some increases need many bits.
+	Xapian::docid new_did = did < 2000 ? did : did + 5000000;
+	db.replace_document(new_did, doc);
+	ref.replace_document(new_did, doc);
+	if (did % 1000 == 0) {
+	    db.commit();
+	    ref.commit();
+	}
+    }
+    db.commit();
+    ref.commit();
+    check_same_postings(ref, db, terms);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+    // Bit-packing should make the postlist table smaller.
+    TEST_REL(file_size(path + "/postlist.DB"), <,
+	     file_size(plain + "/postlist.DB"));
+
+    // Modify existing chunks.
+    for (Xapian::docid did = 1; did <= 1500; did += 7) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    for (Xapian::docid did = 10; did <= 1500; did += 11) {
+	Xapian::Document doc;
+	doc.add_term("all", 1000);
+	doc.add_term("rare");
+	db.replace_document(did, doc);
+	ref.replace_document(did, doc);
+    }
+    db.commit();
+    ref.commit();
+    check_same_postings(ref, db, terms);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The compactor should keep the format of its input, unless another is
+    // configured.
+    off_t sizes[3];
+    for (size_t i = 0; i != 3; ++i) {
+	const string & src = (i == 2) ? plain : path;
+	string out = path + "out";
+	static const char * const formats[] = { NULL, "varint", "packed" };
+	compact_brass_db(settings, src, out,
+			 "XAPIAN_BRASS_POSTLIST_FORMAT", formats[i], false);
+	check_same_postings(ref, Xapian::Database(out), terms);
+	sizes[i] = file_size(out + "/postlist.DB");
+    }
+    TEST_REL(sizes[0], <, sizes[1]);
+    TEST_REL(sizes[2], <, sizes[1]);
+
+    return true;
+}
+
+static Xapian::Document
+postlistskip_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    doc.add_term("all", did % 5 + 1);
+    if (did & 1) doc.add_term("odd", did);
+    if (did % 10 == 0) doc.add_term("tenth");
+    if (did % 1000 < 300) doc.add_term("clumped");
+    return doc;
+}
+
+/// Check skip_to() uses the skip tables in brass postlist chunks correctly.
+DEFINE_TESTCASE(brasspostlistskip1, brass) {
+    BrassSettings settings;
+    static const char * const terms[] = {
+	"all", "odd", "tenth", "clumped", NULL
+    };
+    for (int packed = 0; packed != 2; ++packed) {
+	string path = get_named_writable_database_path("brasspostlistskip1");
+	Xapian::WritableDatabase db =
+	    build_brass_db(settings, path, "XAPIAN_BRASS_POSTLIST_FORMAT",
+			   packed ? "packed" : "varint", postlistskip_doc, 5000);
+
+	for (const char * const * t = terms; *t; ++t) {
+	    tout << "Term " << *t << '\n';
+	    vector<Xapian::docid> dids;
+	    Xapian::PostingIterator p;
+	    for (p = db.postlist_begin(*t); p != db.postlist_end(*t); ++p) {
+		dids.push_back(*p);
+	    }
+	    for (Xapian::docid step = 1; step < 3000; step = step * 2 + 1) {
+		p = db.postlist_begin(*t);
+		vector<Xapian::docid>::iterator i = dids.begin();
+		for (Xapian::docid did = step; true; did += step) {
+		    p.skip_to(did);
+		    i = lower_bound(i, dids.end(), did);
+		    if (i == dids.end()) {
+			TEST(p == db.postlist_end(*t));
+			break;
+		    }
+		    TEST(p != db.postlist_end(*t));
+		    TEST_EQUAL(*p, *i);
+		    // Skipping backwards shouldn't move.
+		    p.skip_to(did - step / 2);
+		    TEST_EQUAL(*p, *i);
+		    // Check next() works after skipping.
+		    if (step % 3 == 0) {
+			++p;
+			if (++i == dids.end()) {
+			    TEST(p == db.postlist_end(*t));
+			    break;
+			}
+			TEST_EQUAL(*p, *i);
+		    }
+		}
+	    }
+	}
+    }
+    return true;
+}
+
+static Xapian::Document
+blockmax_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    // Only a few documents have a high wdf for "common", so most of its
+    // blocks can be skipped once the top ten have been found.
+    doc.add_term("common", did % 397 == 0 ? 50 : 1);
+    if (did % 3 == 0) doc.add_term("third", did % 4 + 1);
+    if (did % 1000 == 7) doc.add_term("rare", 2);
+    doc.add_term("pad", did % 13 + 1);
+    return doc;
+}
+
+/// Check the matcher gets the same results when skipping brass blocks.
+DEFINE_TESTCASE(brassblockmax1, brass) {
+    BrassSettings settings;
+    for (int packed = 0; packed != 2; ++packed) {
+	string path = get_named_writable_database_path("brassblockmax1");
+	Xapian::WritableDatabase db =
+	    build_brass_db(settings, path, "XAPIAN_BRASS_POSTLIST_FORMAT",
+			   packed ? "packed" : "varint", blockmax_doc, 5000);
+
+	static const char * const terms[] = { "common", "third", "rare" };
+	Xapian::Query queries[] = {
+	    Xapian::Query(Xapian::Query::OP_OR, terms, terms + 3),
+	    Xapian::Query(Xapian::Query::OP_OR, terms, terms + 2),
+	    Xapian::Query(Xapian::Query::OP_AND, terms, terms + 2),
+	    Xapian::Query("common")
+	};
+	Xapian::Enquire enquire(db);
+	for (size_t q = 0; q != sizeof(queries) / sizeof(queries[0]); ++q) {
+	    enquire.set_query(queries[q]);
+	    tout << enquire.get_query().get_description() << '\n';
+	    // With check_at_least set to the number of documents, the matcher
+	    // can't skip anything.
+	    Xapian::MSet all = enquire.get_mset(0, 10, db.get_doccount());
+	    Xapian::MSet mset = enquire.get_mset(0, 10);
+	    TEST_EQUAL(mset.size(), all.size());
+	    for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		TEST_EQUAL(*mset[i], *all[i]);
+		TEST_EQUAL_DOUBLE(mset[i].get_weight(), all[i].get_weight());
+	    }
+	}
+    }
+    return true;
+}
+
+static Xapian::Document
+doclencolumn_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    // Leave some documents without any terms.
+    if (did % 97) doc.add_term("t", did % 7 + 1);
+    // A few long documents need wider entries in the column.
+    if (did % 500 == 0) doc.add_term("big", 70000);
+    return doc;
+}
+
+/// Check the optional doclen column for brass.
+DEFINE_TESTCASE(brassdoclencolumn1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassdoclencolumn1");
+    string plain = path + "plain";
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_DOCLEN_FORMAT", "column",
+		       doclencolumn_doc, 2000, 700);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_DOCLEN_FORMAT", NULL,
+		       doclencolumn_doc, 2000, 700);
+
+    // Delete some documents, including all those in one chunk of the
+    // column, and change the length of others.
+    for (Xapian::docid did = 1; did <= 2000; ++did) {
+	if (did % 11 == 0 || (did > 512 && did <= 1024)) {
+	    db.delete_document(did);
+	    ref.delete_document(did);
+	} else if (did % 13 == 0) {
+	    Xapian::Document doc;
+	    doc.add_term("t", did % 5 + 2);
+	    doc.add_term("u");
+	    db.replace_document(did, doc);
+	    ref.replace_document(did, doc);
+	}
+    }
+    // Check lengths are right before and after committing.
+    for (int committed = 0; committed != 2; ++committed) {
+	for (Xapian::docid did = 1; did <= 2001; ++did) {
+	    if (did % 11 == 0 || (did > 512 && did <= 1024) || did > 2000) {
+		TEST_EXCEPTION(Xapian::DocNotFoundError, db.get_doclength(did));
+	    } else {
+		TEST_EQUAL(db.get_doclength(did), ref.get_doclength(did));
+	    }
+	}
+	db.commit();
+	ref.commit();
+    }
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // Check the compactor rebuilds the column, and can add or drop it.
+    off_t sizes[2];
+    for (int i = 0; i != 3; ++i) {
+	string out = path + "out";
+	static const char * const formats[] = { NULL, "postlist", "column" };
+	compact_brass_db(settings, i == 2 ? plain : path, out,
+			 "XAPIAN_BRASS_DOCLEN_FORMAT", formats[i]);
+	Xapian::Database outdb(out);
+	TEST_EQUAL(outdb.get_doccount(), ref.get_doccount());
+	Xapian::PostingIterator p;
+	for (p = ref.postlist_begin(string()); p != ref.postlist_end(string()); ++p) {
+	    TEST_EQUAL(outdb.get_doclength(*p), p.get_doclength());
+	}
+	if (i < 2) sizes[i] = file_size(out + "/postlist.DB");
+    }
+    TEST_REL(sizes[1], <, sizes[0]);
+
+    return true;
+}
+
+/// Check writing brass tables with O_DIRECT (where supported).
+DEFINE_TESTCASE(brassdirectio1, brass) {
+    BrassSettings settings;
+    Xapian::Database src = get_database("etext");
+    string path = get_named_writable_database_path("brassdirectio1");
+    string out = path + "out";
+    rm_rf(out);
+
+    settings.set("XAPIAN_BRASS_DIRECT_IO", "1");
+    {
+	Xapian::WritableDatabase db =
+	    Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+	for (Xapian::docid did = 1; did <= src.get_lastdocid(); ++did) {
+	    db.add_document(src.get_document(did));
+	    if (did % 50 == 0) db.commit();
+	}
+	db.commit();
+	// Check blocks read back after being written are up to date.
+	check_same_documents(src, db);
+	db.delete_document(1);
+	db.commit();
+	db.replace_document(1, src.get_document(1));
+	db.commit();
+    }
+    {
+	Xapian::Compactor compact;
+	compact.set_destdir(out);
+	compact.add_source(path);
+	compact.compact();
+    }
+    settings.set("XAPIAN_BRASS_DIRECT_IO", "");
+
+    check_same_documents(src, Xapian::Database(path));
+    check_same_documents(src, Xapian::Database(out));
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+    TEST_EQUAL(Xapian::Database::check(out, 0, tout), 0);
+
+    return true;
+}
+
+static Xapian::Document
+impact_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    doc.add_term("common", did % 7 + 1);
+    if (did % 3 == 0) doc.add_term("third", did % 5 + 1);
+    if (did % 500 == 7) doc.add_term("rare", 3);
+    // Vary the document lengths, but leave plenty of ties.
+    doc.add_term("pad", did % 11 + 1);
+    return doc;
+}
+
+/// Check the matcher gets the same results using impact-ordered postings.
+DEFINE_TESTCASE(brassimpact1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassimpact1");
+    build_brass_db(settings, path, NULL, NULL, impact_doc, 3000);
+
+    string out = path + "out";
+    string plain = path + "plain";
+    for (int impacts = 0; impacts != 2; ++impacts) {
+	Xapian::Compactor compact;
+	compact.set_destdir(impacts ? out : plain);
+	compact.add_source(path);
+	compact.set_impact_ordering(impacts);
+	compact.compact();
+    }
+    TEST(file_exists(out + "/impact.DB"));
+    TEST(!file_exists(plain + "/impact.DB"));
+    TEST_EQUAL(Xapian::Database::check(out, 0, tout), 0);
+
+    static const char * const terms[] = { "common", "third", "rare" };
+    Xapian::Query queries[] = {
+	Xapian::Query(Xapian::Query::OP_OR, terms, terms + 3),
+	Xapian::Query(Xapian::Query::OP_OR, terms, terms + 2),
+	Xapian::Query(Xapian::Query::OP_OR, terms + 1, terms + 3),
+	Xapian::Query("common"),
+	Xapian::Query("rare"),
+	Xapian::Query("absent")
+    };
+    Xapian::Document doc;
+    doc.add_term("common", 40);
+    doc.add_term("third", 40);
+    for (int stage = 0; stage != 3; ++stage) {
+	// Check the results with the impacts current, then once the database
+	// has uncommitted changes, and then once those are committed (when the
+	// impacts are out of date and so must be ignored).
+	Xapian::WritableDatabase db(out, Xapian::DB_OPEN);
+	Xapian::WritableDatabase ref(plain, Xapian::DB_OPEN);
+	if (stage > 0) {
+	    db.add_document(doc);
+	    ref.add_document(doc);
+	    if (stage > 1) {
+		db.commit();
+		ref.commit();
+	    }
+	}
+	Xapian::Enquire enquire(db);
+	Xapian::Enquire ref_enquire(ref);
+	for (size_t q = 0; q != sizeof(queries) / sizeof(queries[0]); ++q) {
+	    enquire.set_query(queries[q]);
+	    ref_enquire.set_query(queries[q]);
+	    tout << enquire.get_query().get_description() << '\n';
+	    for (Xapian::doccount size = 1; size <= 100; size *= 10) {
+		Xapian::MSet mset = enquire.get_mset(0, size);
+		Xapian::MSet all = ref_enquire.get_mset(0, size, ref.get_doccount());
+		TEST_EQUAL(mset.size(), all.size());
+		for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		    TEST_EQUAL(*mset[i], *all[i]);
+		    TEST_EQUAL_DOUBLE(mset[i].get_weight(), all[i].get_weight());
+		}
+		TEST_REL(mset.get_matches_lower_bound(),<=,all.get_matches_estimated());
+		TEST_REL(mset.get_matches_upper_bound(),>=,all.get_matches_estimated());
+		TEST_EQUAL_DOUBLE(mset.get_max_possible(), all.get_max_possible());
+		if (mset.size()) {
+		    TEST_EQUAL_DOUBLE(mset.get_max_attained(),
+				      all.get_max_attained());
+		}
+	    }
+	}
+    }
+
+    return true;
+}
+
+static const unsigned blockand_moduli[] = { 2, 3, 5, 7, 11, 13, 97 };
+
+static Xapian::Document
+blockand_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    for (size_t i = 0; i != sizeof(blockand_moduli) / sizeof(unsigned); ++i) {
+	unsigned m = blockand_moduli[i];
+	if (did % m == 0) doc.add_term("m" + str(m), i + 1);
+    }
+    // A term in a run of consecutive documents.
+    if (did > 5000 && did < 5400) doc.add_term("run");
+    doc.add_term("all");
+    return doc;
+}
+
+/// Check AND queries over brass postlists which intersect decoded blocks.
+DEFINE_TESTCASE(brassblockand1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassblockand1");
+    string plain = path + "plain";
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_POSTLIST_FORMAT", "packed",
+		       blockand_doc, 20000);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_POSTLIST_FORMAT", "varint",
+		       blockand_doc, 20000);
+    const unsigned * moduli = blockand_moduli;
+    const size_t n_terms = sizeof(blockand_moduli) / sizeof(unsigned);
+
+    vector<string> terms;
+    for (size_t i = 0; i != n_terms; ++i) terms.push_back("m" + str(moduli[i]));
+    terms.push_back("run");
+    terms.push_back("all");
+    vector<Xapian::Query> queries;
+    for (size_t n = 2; n <= terms.size(); ++n) {
+	queries.push_back(Xapian::Query(Xapian::Query::OP_AND,
+					terms.begin(), terms.begin() + n));
+	queries.push_back(Xapian::Query(Xapian::Query::OP_AND,
+					terms.end() - n, terms.end()));
+    }
+    queries.push_back(Xapian::Query(Xapian::Query::OP_FILTER,
+				    Xapian::Query("m3"),
+				    Xapian::Query(Xapian::Query::OP_AND,
+						  terms.begin() + 1,
+						  terms.begin() + 4)));
+
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire ref_enquire(ref);
+    for (size_t q = 0; q != queries.size(); ++q) {
+	enquire.set_query(queries[q]);
+	ref_enquire.set_query(queries[q]);
+	tout << queries[q].get_description() << '\n';
+	Xapian::MSet mset = enquire.get_mset(0, 20000);
+	Xapian::MSet all = ref_enquire.get_mset(0, 20000);
+	TEST_EQUAL(mset.size(), all.size());
+	for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	    TEST_EQUAL(*mset[i], *all[i]);
+	    TEST_EQUAL_DOUBLE(mset[i].get_weight(), all[i].get_weight());
+	}
+	// Also check the top few, which lets the matcher skip blocks.
+	mset = enquire.get_mset(0, 5);
+	all = ref_enquire.get_mset(0, 5);
+	TEST_EQUAL(mset.size(), all.size());
+	for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	    TEST_EQUAL(*mset[i], *all[i]);
+	}
+    }
+
+    return true;
+}
+
+class AcceptAllMatchDecider : public Xapian::MatchDecider {
+  public:
+    bool operator()(const Xapian::Document &) const { return true; }
+};
+
+/// Check fetching candidates in batches doesn't change the MSet.
+DEFINE_TESTCASE(matchbatch1, backend && !remote) {
+    Xapian::Database db(get_database("etext"));
+    Xapian::Enquire enquire(db);
+    // Using a match decider stops the matcher fetching candidates in batches.
+    AcceptAllMatchDecider mdecider;
+
+    vector<Xapian::Query> queries;
+    queries.push_back(Xapian::Query("the"));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_OR,
+				    Xapian::Query("the"),
+				    Xapian::Query("of")));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_AND,
+				    Xapian::Query("the"),
+				    Xapian::Query("of")));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_AND_NOT,
+				    Xapian::Query("the"),
+				    Xapian::Query("of")));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_OR,
+				    Xapian::Query(Xapian::Query::OP_AND,
+						  Xapian::Query("the"),
+						  Xapian::Query("and")),
+				    Xapian::Query("paragraph")));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_SCALE_WEIGHT,
+				    Xapian::Query("the"), 0.0));
+
+    static const Xapian::doccount sizes[] = { 1, 10, 100, 1000 };
+    for (size_t q = 0; q != queries.size(); ++q) {
+	enquire.set_query(queries[q]);
+	tout << queries[q].get_description() << '\n';
+	for (size_t s = 0; s != sizeof(sizes) / sizeof(sizes[0]); ++s) {
+	    for (int check = 0; check != 2; ++check) {
+		Xapian::doccount check_at_least = check ? sizes[s] * 3 : 0;
+		Xapian::MSet mset = enquire.get_mset(0, sizes[s], check_at_least);
+		Xapian::MSet ref = enquire.get_mset(0, sizes[s], check_at_least,
+						    NULL, &mdecider);
+		TEST_EQUAL(mset.size(), ref.size());
+		for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		    TEST_EQUAL(*mset[i], *ref[i]);
+		    TEST_EQUAL_DOUBLE(mset[i].get_weight(), ref[i].get_weight());
+		}
+		TEST_EQUAL_DOUBLE(mset.get_max_attained(),
+				  ref.get_max_attained());
+		if (!mset.empty()) {
+		    TEST_EQUAL(mset[0].get_percent(), ref[0].get_percent());
+		}
+	    }
+	}
+    }
+
+    return true;
+}
+
+static Xapian::Document
+bitmappostlist_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    // Boolean terms dense enough to be stored as bitmaps.
+    doc.add_boolean_term("Lall");
+    if (did % 2 == 0) doc.add_boolean_term("Leven");
+    if (did % 3 == 0) doc.add_boolean_term("Lthird");
+    if (did % 7 != 0 && did % 1000 < 600) doc.add_boolean_term("Tgappy");
+    // Too sparse for a bitmap.
+    if (did % 97 == 0) doc.add_boolean_term("sparse");
+    // Dense, but the wdfs differ.
+    doc.add_term("mixed", did % 3 + 1);
+    return doc;
+}
+
+/// Check the bitmap postlist format for brass.
+DEFINE_TESTCASE(brassbitmappostlist1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassbitmappostlist1");
+    string plain = path + "plain";
+    static const char * const terms[] = {
+	"Lall", "Leven", "Lthird", "Tgappy", "sparse", "mixed", NULL
+    };
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_POSTLIST_FORMAT", "bitmap",
+		       bitmappostlist_doc, 6000);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_POSTLIST_FORMAT", "varint",
+		       bitmappostlist_doc, 6000);
+    check_same_postings(ref, db, terms);
+    TEST_REL(file_size(path + "/postlist.DB"), <,
+	     file_size(plain + "/postlist.DB"));
+
+    // Check filtering, which intersects bitmaps directly.
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire ref_enquire(ref);
+    for (const char * const * t = terms; *t; ++t) {
+	for (const char * const * f = terms; *f; ++f) {
+	    if (t == f) continue;
+	    Xapian::Query q(Xapian::Query::OP_FILTER,
+			    Xapian::Query(Xapian::Query::OP_AND,
+					  Xapian::Query(*t),
+					  Xapian::Query("mixed")),
+			    Xapian::Query(*f));
+	    tout << q.get_description() << '\n';
+	    enquire.set_query(q);
+	    ref_enquire.set_query(q);
+	    Xapian::MSet mset = enquire.get_mset(0, 6000);
+	    Xapian::MSet ref_mset = ref_enquire.get_mset(0, 6000);
+	    TEST_EQUAL(mset.size(), ref_mset.size());
+	    for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		TEST_EQUAL(*mset[i], *ref_mset[i]);
+	    }
+	}
+    }
+
+    // Modify existing chunks, so some stop being bitmaps.
+    for (Xapian::docid did = 1; did <= 3000; did += 5) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    for (Xapian::docid did = 10; did <= 2000; did += 11) {
+	Xapian::Document doc;
+	doc.add_term("Lall", 2);
+	doc.add_boolean_term("Lthird");
+	db.replace_document(did, doc);
+	ref.replace_document(did, doc);
+    }
+    db.commit();
+    ref.commit();
+    check_same_postings(ref, db, terms);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The compactor should convert to and from bitmaps.
+    for (size_t i = 0; i != 2; ++i) {
+	const string & src = i ? plain : path;
+	string out = path + "out";
+	compact_brass_db(settings, src, out, "XAPIAN_BRASS_POSTLIST_FORMAT",
+			 i ? "bitmap" : "varint", false);
+	check_same_postings(ref, Xapian::Database(out), terms);
+	if (i) {
+	    TEST_REL(file_size(out + "/postlist.DB"), <,
+		     file_size(plain + "/postlist.DB"));
+	}
+    }
+
+    return true;
+}
+
+/// Check that @a db has the same positions for @a terms as @a src.
+static void
+check_same_positions(const Xapian::Database & src, const Xapian::Database & db,
+		     const char * const * terms)
+{
+    for (const char * const * t = terms; *t; ++t) {
+	Xapian::PostingIterator p = src.postlist_begin(*t);
+	for ( ; p != src.postlist_end(*t); ++p) {
+	    Xapian::docid did = *p;
+	    Xapian::PositionIterator i = src.positionlist_begin(did, *t);
+	    Xapian::PositionIterator j = db.positionlist_begin(did, *t);
+	    while (i != src.positionlist_end(did, *t)) {
+		TEST(j != db.positionlist_end(did, *t));
+		TEST_EQUAL(*i, *j);
+		++i;
+		++j;
+	    }
+	    TEST(j == db.positionlist_end(did, *t));
+	    // Check skip_to() lands in the right place.
+	    for (Xapian::termpos pos = 0; pos < 2000; pos += 37) {
+		i = src.positionlist_begin(did, *t);
+		j = db.positionlist_begin(did, *t);
+		i.skip_to(pos);
+		j.skip_to(pos);
+		if (i == src.positionlist_end(did, *t)) {
+		    TEST(j == db.positionlist_end(did, *t));
+		    break;
+		}
+		TEST(j != db.positionlist_end(did, *t));
+		TEST_EQUAL(*i, *j);
+	    }
+	}
+    }
+}
+
+static Xapian::Document
+packedpositions_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    // Long position lists, spanning several blocks.
+    Xapian::termpos n = did * 7;
+    for (Xapian::termpos pos = 1; pos <= n; ++pos) {
+	if (pos % 3 == 0) {
+	    doc.add_posting("the", pos);
+	} else if (pos % 3 == 1) {
+	    doc.add_posting(pos % 5 ? "quick" : "brown", pos);
+	} else {
+	    doc.add_posting(pos % 7 ? "brown" : "fox", pos * (did % 2 + 1));
+	}
+    }
+    doc.add_posting("once", did);
+    return doc;
+}
+
+/// Test the block-packed position list format.
+DEFINE_TESTCASE(brasspackedpositions1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brasspackedpositions1");
+    string plain = path + "plain";
+    static const char * const terms[] = {
+	"the", "quick", "brown", "fox", "once", NULL
+    };
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_POSITION_FORMAT", "packed",
+		       packedpositions_doc, 200);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_POSITION_FORMAT",
+		       "interpolative", packedpositions_doc, 200);
+    check_same_positions(ref, db, terms);
+
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire ref_enquire(ref);
+    static const Xapian::Query::op ops[] = {
+	Xapian::Query::OP_PHRASE, Xapian::Query::OP_NEAR
+    };
+    for (size_t o = 0; o != sizeof(ops) / sizeof(ops[0]); ++o) {
+	for (const char * const * t = terms; *t; ++t) {
+	    for (const char * const * u = terms; *u; ++u) {
+		if (t == u) continue;
+		Xapian::Query subqs[2] = { Xapian::Query(*t), Xapian::Query(*u) };
+		for (Xapian::termcount window = 2; window <= 4; ++window) {
+		    Xapian::Query q(ops[o], subqs, subqs + 2, window);
+		    tout << q.get_description() << '\n';
+		    enquire.set_query(q);
+		    ref_enquire.set_query(q);
+		    Xapian::MSet mset = enquire.get_mset(0, 200);
+		    Xapian::MSet ref_mset = ref_enquire.get_mset(0, 200);
+		    TEST_EQUAL(mset.size(), ref_mset.size());
+		    for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+			TEST_EQUAL(*mset[i], *ref_mset[i]);
+		    }
+		}
+	    }
+	}
+    }
+
+    // The compactor should convert between the formats.
+    for (size_t i = 0; i != 2; ++i) {
+	const string & src = i ? plain : path;
+	string out = path + "out";
+	compact_brass_db(settings, src, out, "XAPIAN_BRASS_POSITION_FORMAT",
+			 i ? "packed" : "interpolative");
+	check_same_positions(ref, Xapian::Database(out), terms);
+    }
+
+    return true;
+}
+
+/// Check that @a db has the same values in slots 0 to 3 as @a src.
+static void
+check_same_values(const Xapian::Database & src, const Xapian::Database & db)
+{
+    for (Xapian::valueno slot = 0; slot != 4; ++slot) {
+	TEST_EQUAL(db.get_value_freq(slot), src.get_value_freq(slot));
+	Xapian::ValueIterator i = src.valuestream_begin(slot);
+	Xapian::ValueIterator j = db.valuestream_begin(slot);
+	while (i != src.valuestream_end(slot)) {
+	    TEST(j != db.valuestream_end(slot));
+	    TEST_EQUAL(i.get_docid(), j.get_docid());
+	    TEST_EQUAL(*i, *j);
+	    ++i;
+	    ++j;
+	}
+	TEST(j == db.valuestream_end(slot));
+	for (Xapian::docid did = 1; did <= src.get_lastdocid(); did += 13) {
+	    i = src.valuestream_begin(slot);
+	    j = db.valuestream_begin(slot);
+	    i.skip_to(did);
+	    j.skip_to(did);
+	    if (i == src.valuestream_end(slot)) {
+		TEST(j == db.valuestream_end(slot));
+		break;
+	    }
+	    TEST(j != db.valuestream_end(slot));
+	    TEST_EQUAL(i.get_docid(), j.get_docid());
+	    TEST_EQUAL(*i, *j);
+	}
+    }
+}
+
+static Xapian::Document
+numericvalues_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    doc.add_boolean_term("Tall");
+    // Integers, including negative and large ones.
+    double n = (double(did) * 7919) - 1000000;
+    if (did % 500 == 0) n *= 1e6;
+    doc.add_value(0, Xapian::sortable_serialise(n));
+    // Not integers, so stored as strings.
+    if (did % 3 == 0)
+	doc.add_value(1, Xapian::sortable_serialise(did / 4.0));
+    // Integers, except in some chunks.
+    if (did % 2 == 0) {
+	if (did > 1000 && did < 1200) {
+	    doc.add_value(2, "not a number");
+	} else {
+	    doc.add_value(2, Xapian::sortable_serialise(did % 300));
+	}
+    }
+    // Not what sortable_serialise() gives for any number.
+    if (did % 5 == 0) doc.add_value(3, string(1, char(did % 7 + 1)));
+    return doc;
+}
+
+/// Test storing integer values as numeric columns.
+DEFINE_TESTCASE(brassnumericvalues1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassnumericvalues1");
+    string plain = path + "plain";
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_VALUE_FORMAT", "numeric",
+		       numericvalues_doc, 3000);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_VALUE_FORMAT", "string",
+		       numericvalues_doc, 3000);
+    check_same_values(ref, db);
+    TEST_REL(file_size(path + "/postlist.DB"), <,
+	     file_size(plain + "/postlist.DB"));
+
+    // Check value ranges, which compare numeric columns as numbers, and
+    // ValueWeightPostingSource.
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire ref_enquire(ref);
+    static const double bounds[] = { -1e12, -1000, 0, 0.5, 150, 1e6, 1e12 };
+    const size_t n_bounds = sizeof(bounds) / sizeof(bounds[0]);
+    for (Xapian::valueno slot = 0; slot != 4; ++slot) {
+	vector<Xapian::Query> queries;
+	for (size_t b = 0; b != n_bounds; ++b) {
+	    string lo = Xapian::sortable_serialise(bounds[b]);
+	    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_GE,
+					    slot, lo));
+	    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_LE,
+					    slot, lo));
+	    for (size_t e = b; e != n_bounds; ++e) {
+		string hi = Xapian::sortable_serialise(bounds[e]);
+		queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_RANGE,
+						slot, lo, hi));
+	    }
+	}
+	// Bounds which aren't what sortable_serialise() gives.
+	queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_RANGE,
+					slot, "\x81", "\xc0\x01"));
+	queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_GE,
+					slot, "\xa0z"));
+	for (size_t q = 0; q != queries.size(); ++q) {
+	    Xapian::Query query(Xapian::Query::OP_FILTER,
+				Xapian::Query("Tall"), queries[q]);
+	    tout << query.get_description() << '\n';
+	    enquire.set_query(query);
+	    ref_enquire.set_query(query);
+	    Xapian::MSet mset = enquire.get_mset(0, 3000);
+	    Xapian::MSet ref_mset = ref_enquire.get_mset(0, 3000);
+	    TEST_EQUAL(mset.size(), ref_mset.size());
+	    for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		TEST_EQUAL(*mset[i], *ref_mset[i]);
+	    }
+	}
+    }
+    {
+	Xapian::ValueWeightPostingSource src(2), ref_src(2);
+	enquire.set_query(Xapian::Query(&src));
+	ref_enquire.set_query(Xapian::Query(&ref_src));
+	Xapian::MSet mset = enquire.get_mset(0, 3000);
+	Xapian::MSet ref_mset = ref_enquire.get_mset(0, 3000);
+	TEST_EQUAL(mset.size(), ref_mset.size());
+	for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	    TEST_EQUAL(*mset[i], *ref_mset[i]);
+	    TEST_EQUAL(mset[i].get_weight(), ref_mset[i].get_weight());
+	}
+    }
+
+    // Modify existing chunks, including making one numeric column hold a
+    // value which isn't an integer.
+    for (Xapian::docid did = 1; did <= 3000; did += 7) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    for (Xapian::docid did = 10; did <= 2000; did += 11) {
+	Xapian::Document doc;
+	doc.add_value(0, Xapian::sortable_serialise(did % 3 ? did : did + 0.5));
+	doc.add_value(2, Xapian::sortable_serialise(-double(did)));
+	db.replace_document(did, doc);
+	ref.replace_document(did, doc);
+    }
+    db.commit();
+    ref.commit();
+    check_same_values(ref, db);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The compactor should convert to and from numeric columns.
+    for (size_t i = 0; i != 2; ++i) {
+	const string & src = i ? plain : path;
+	string out = path + "out";
+	compact_brass_db(settings, src, out, "XAPIAN_BRASS_VALUE_FORMAT",
+			 i ? "numeric" : "string", false);
+	Xapian::Database out_db(out);
+	TEST_EQUAL(out_db.get_avlength(), ref.get_avlength());
+	check_same_values(ref, out_db);
+    }
+
+    return true;
+}
+
+/// Check value range queries give the same results with value summaries.
+static void
+check_same_value_ranges(Xapian::Database & ref, Xapian::Database & db)
+{
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire ref_enquire(ref);
+    static const double bounds[] = { -1, 0, 150, 999, 1000, 2500, 1e6 };
+    const size_t n_bounds = sizeof(bounds) / sizeof(bounds[0]);
+    for (Xapian::valueno slot = 0; slot != 3; ++slot) {
+	vector<Xapian::Query> queries;
+	for (size_t b = 0; b != n_bounds; ++b) {
+	    string lo = Xapian::sortable_serialise(bounds[b]);
+	    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_GE,
+					    slot, lo));
+	    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_LE,
+					    slot, lo));
+	    for (size_t e = b; e != n_bounds; ++e) {
+		string hi = Xapian::sortable_serialise(bounds[e]);
+		queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_RANGE,
+						slot, lo, hi));
+	    }
+	}
+	for (size_t q = 0; q != queries.size(); ++q) {
+	    // Both on its own and filtering a term, so the range is both
+	    // iterated and checked.
+	    Xapian::Query filtered(Xapian::Query::OP_FILTER,
+				   Xapian::Query("Todd"), queries[q]);
+	    for (size_t f = 0; f != 2; ++f) {
+		const Xapian::Query & query = f ? filtered : queries[q];
+		tout << query.get_description() << '\n';
+		enquire.set_query(query);
+		ref_enquire.set_query(query);
+		Xapian::MSet mset = enquire.get_mset(0, 5000);
+		Xapian::MSet ref_mset = ref_enquire.get_mset(0, 5000);
+		TEST_EQUAL(mset.size(), ref_mset.size());
+		for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		    TEST_EQUAL(*mset[i], *ref_mset[i]);
+		}
+	    }
+	}
+    }
+}
+
+static Xapian::Document
+valuesummaries_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    if (did & 1) doc.add_boolean_term("Todd");
+    // Increasing with the docid, so most chunks are entirely inside or
+    // outside a range.
+    doc.add_value(0, Xapian::sortable_serialise(did));
+    // Cycling, so every chunk overlaps most ranges.
+    if (did % 3 == 0)
+	doc.add_value(1, Xapian::sortable_serialise(did % 1001));
+    // Sparse and constant within runs of documents.
+    if (did % 17 == 0)
+	doc.add_value(2, Xapian::sortable_serialise(did / 1000 * 1000));
+    return doc;
+}
+
+/// Test value chunk summaries in brass.
+DEFINE_TESTCASE(brassvaluesummaries1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassvaluesummaries1");
+    string plain = path + "plain";
+    settings.set("XAPIAN_BRASS_VALUE_SUMMARIES", "yes");
+    TEST_EXCEPTION(Xapian::InvalidArgumentError,
+		   Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE));
+
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_VALUE_SUMMARIES", "on",
+		       valuesummaries_doc, 4000);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_VALUE_SUMMARIES", "off",
+		       valuesummaries_doc, 4000);
+    check_same_values(ref, db);
+    check_same_value_ranges(ref, db);
+
+    // Modifying chunks should update their summaries.
+    for (Xapian::docid did = 1; did <= 4000; did += 7) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    for (Xapian::docid did = 10; did <= 3000; did += 13) {
+	Xapian::Document doc;
+	doc.add_boolean_term("Todd");
+	doc.add_value(0, Xapian::sortable_serialise(5000 - double(did)));
+	doc.add_value(2, Xapian::sortable_serialise(-double(did)));
+	db.replace_document(did, doc);
+	ref.replace_document(did, doc);
+    }
+    db.commit();
+    ref.commit();
+    check_same_values(ref, db);
+    check_same_value_ranges(ref, db);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The compactor should add and drop summaries.
+    for (size_t i = 0; i != 2; ++i) {
+	const string & src = i ? plain : path;
+	string out = path + "out";
+	compact_brass_db(settings, src, out, "XAPIAN_BRASS_VALUE_SUMMARIES",
+			 i ? "on" : "off", false);
+	Xapian::Database out_db(out);
+	check_same_values(ref, out_db);
+	check_same_value_ranges(ref, out_db);
+    }
+
+    return true;
+}
+
+/// Make a long value for brassvalueindex1 which differs after 100 bytes.
+static string
+long_value(Xapian::docid did)
+{
+    string value(99, 'p');
+    value += char(did % 3);
+    value += str(did % 40);
+    return value;
+}
+
+/// Check string value ranges on slot 1 for brassvalueindex1.
+static void
+check_same_long_value_ranges(Xapian::Database & ref, Xapian::Database & db)
+{
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire ref_enquire(ref);
+    vector<Xapian::Query> queries;
+    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_RANGE, 1,
+				    long_value(3), long_value(3)));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_RANGE, 1,
+				    long_value(1), long_value(41)));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_RANGE, 1,
+				    string(99, 'p'), long_value(0)));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_GE, 1,
+				    long_value(119)));
+    queries.push_back(Xapian::Query(Xapian::Query::OP_VALUE_LE, 1,
+				    long_value(30)));
+    for (size_t q = 0; q != queries.size(); ++q) {
+	tout << queries[q].get_description() << '\n';
+	enquire.set_query(queries[q]);
+	ref_enquire.set_query(queries[q]);
+	Xapian::MSet mset = enquire.get_mset(0, 5000);
+	Xapian::MSet ref_mset = ref_enquire.get_mset(0, 5000);
+	TEST_EQUAL(mset.size(), ref_mset.size());
+	for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+	    TEST_EQUAL(*mset[i], *ref_mset[i]);
+	}
+    }
+}
+
+static Xapian::Document
+valueindex_doc(Xapian::docid did)
+{
+    Xapian::Document doc;
+    if (did & 1) doc.add_boolean_term("Todd");
+    doc.add_value(0, Xapian::sortable_serialise(did));
+    // Longer than the index keeps, so the index has to check the values.
+    if (did % 3 == 0) doc.add_value(1, long_value(did));
+    // Not indexed.
+    if (did % 17 == 0)
+	doc.add_value(2, Xapian::sortable_serialise(did / 1000 * 1000));
+    return doc;
+}
+
+/// Test value slot indexes in brass.
+DEFINE_TESTCASE(brassvalueindex1, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassvalueindex1");
+    string plain = path + "plain";
+    Xapian::WritableDatabase db =
+	build_brass_db(settings, path, "XAPIAN_BRASS_VALUE_INDEX", "0,1",
+		       valueindex_doc, 4000);
+    Xapian::WritableDatabase ref =
+	build_brass_db(settings, plain, "XAPIAN_BRASS_VALUE_INDEX", "none",
+		       valueindex_doc, 4000);
+    check_same_values(ref, db);
+    check_same_value_ranges(ref, db);
+    check_same_long_value_ranges(ref, db);
+
+    // Modifying values should update the index, and uncommitted changes
+    // should be seen.
+    for (Xapian::docid did = 1; did <= 4000; did += 7) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    for (Xapian::docid did = 10; did <= 3000; did += 13) {
+	Xapian::Document doc;
+	doc.add_boolean_term("Todd");
+	doc.add_value(0, Xapian::sortable_serialise(5000 - double(did)));
+	// Sometimes the same value as before.
+	if (did % 3 == 0) doc.add_value(1, long_value(did % 2 ? did : did + 1));
+	db.replace_document(did, doc);
+	ref.replace_document(did, doc);
+    }
+    check_same_value_ranges(ref, db);
+    check_same_long_value_ranges(ref, db);
+    db.commit();
+    ref.commit();
+    check_same_values(ref, db);
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The compactor should keep the index by default, and add or drop it if
+    // configured to.
+    for (size_t i = 0; i != 3; ++i) {
+	const string & src = (i == 1) ? plain : path;
+	string out = path + "out";
+	static const char * const indexes[] = { NULL, "0,1", "none" };
+	compact_brass_db(settings, src, out, "XAPIAN_BRASS_VALUE_INDEX",
+			 indexes[i], false);
+	Xapian::Database out_db(out);
+	check_same_value_ranges(ref, out_db);
+	check_same_long_value_ranges(ref, out_db);
+    }
+
+    return true;
+}
+
+/// Check compacting an empty database with value indexes.
+DEFINE_TESTCASE(brassvalueindex2, brass) {
+    BrassSettings settings;
+    string path = get_named_writable_database_path("brassvalueindex2");
+    settings.set("XAPIAN_BRASS_VALUE_INDEX", "0,1");
+    {
+	Xapian::WritableDatabase db =
+	    Xapian::Brass::open(path, Xapian::DB_CREATE_OR_OVERWRITE);
+	db.commit();
+    }
+    settings.set("XAPIAN_BRASS_VALUE_INDEX", "");
+    TEST_EQUAL(Xapian::Database::check(path, 0, tout), 0);
+
+    // The postlist table only holds the value index key, which compaction
+    // rebuilds rather than copies, so used to decode a stale entry.
+    string out = path + "out";
+    for (int i = 1; i <= 2; ++i) {
+	rm_rf(out);
+	Xapian::Compactor compact;
+	compact.set_destdir(out);
+	compact.add_source(path);
+	if (i == 2) compact.add_source(path);
+	compact.compact();
+
+	Xapian::Database out_db(out);
+	TEST_EQUAL(out_db.get_doccount(), 0);
+	TEST_EQUAL(out_db.get_lastdocid(), 0);
+	TEST_EQUAL(Xapian::Database::check(out, 0, tout), 0);
+    }
+
+    return true;
+}
@@ -25,6 +25,7 @@
 #include <xapian.h>
 
 #include "apitest.h"
+#include "str.h"
 #include "testutils.h"
 
 using namespace std;
@@ -81,3 +82,48 @@ DEFINE_TESTCASE(collapsekey5,backend) {
 
     return true;
 }
+
+/// Test sorting and collapsing where the values are read in batches.
+DEFINE_TESTCASE(collapsekey6,writable) {
+    Xapian::WritableDatabase db = get_writable_database();
+    for (Xapian::docid did = 1; did <= 1000; ++did) {
+	Xapian::Document doc;
+	doc.add_boolean_term("Tall");
+	if (did % 3 == 0) doc.add_boolean_term("Tthird");
+	// Dense values for the first half, then sparse ones.
+	if (did <= 500 ? did % 7 != 0 : did % 11 == 0)
+	    doc.add_value(0, Xapian::sortable_serialise(did % 97));
+	if (did % 4 != 0)
+	    doc.add_value(1, str(did % 5));
+	db.add_document(doc);
+    }
+    db.commit();
+
+    Xapian::Enquire enquire(db);
+    enquire.set_sort_by_value(0, false);
+    enquire.set_collapse_key(1);
+    const char * terms[] = { "Tall", "Tthird" };
+    for (size_t t = 0; t != sizeof(terms) / sizeof(terms[0]); ++t) {
+	tout << terms[t] << endl;
+	enquire.set_query(Xapian::Query(terms[t]));
+	Xapian::MSet mset = enquire.get_mset(0, 1000);
+	// One document for each value in slot 1, plus those without one.
+	Xapian::doccount without = 0;
+	for (Xapian::PostingIterator p = db.postlist_begin(terms[t]);
+	     p != db.postlist_end(terms[t]); ++p) {
+	    if (*p % 4 == 0) ++without;
+	}
+	TEST_EQUAL(mset.size(), without + 5);
+
+	string prev;
+	for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	    Xapian::Document doc = i.get_document();
+	    TEST_EQUAL(i.get_collapse_key(), doc.get_value(1));
+	    const string & v = doc.get_value(0);
+	    TEST_REL(prev,<=,v);
+	    prev = v;
+	}
+    }
+
+    return true;
+}
@@ -556,6 +556,51 @@ DEFINE_TESTCASE(compactempty1, brass || chert) {
     return true;
 }
 
+// Regression test - the brass compactor didn't skip the oldest changeset in
+// the database statistics, but read it as part of the total document length.
+// Merging the stats of two databases then garbled both values.
+DEFINE_TESTCASE(compactoldestchangeset1, brass) {
+    string indbpath =
+	get_named_writable_database_path("compactoldestchangeset1");
+    string outdbpath = indbpath + "out";
+    {
+	// Keep one changeset, so older ones get removed and the oldest
+	// changeset in the statistics keeps rising.  Once it is 64 or more,
+	// the sum for two databases needs more than one byte to encode.
+	ScopedEnv max_changesets("XAPIAN_MAX_CHANGESETS", "1");
+	Xapian::WritableDatabase db =
+	    get_named_writable_database("compactoldestchangeset1");
+	for (Xapian::termcount i = 1; i <= 70; ++i) {
+	    Xapian::Document doc;
+	    doc.add_term("word", i);
+	    db.add_document(doc);
+	    db.commit();
+	}
+    }
+    TEST(!file_exists(indbpath + "/changes64"));
+    TEST(file_exists(indbpath + "/changes69"));
+
+    rm_rf(outdbpath);
+    Xapian::Compactor compact;
+    compact.set_destdir(outdbpath);
+    compact.add_source(indbpath);
+    compact.add_source(indbpath);
+    compact.compact();
+
+    Xapian::Database indb(indbpath);
+    Xapian::Database outdb(outdbpath);
+    TEST_EQUAL(outdb.get_doccount(), 140);
+    TEST_EQUAL_DOUBLE(outdb.get_avlength(), indb.get_avlength());
+    Xapian::termcount totlen = 0;
+    for (Xapian::docid did = 1; did <= outdb.get_lastdocid(); ++did) {
+	totlen += outdb.get_doclength(did);
+    }
+    TEST_EQUAL(totlen, 2 * (70 * 71 / 2));
+    dbcheck(outdb, 140, 140);
+
+    return true;
+}
+
 DEFINE_TESTCASE(compactmultipass1, brass || chert) {
     string empty_dbpath = get_database_path(string());
     string outdbpath = get_named_writable_database_path("compactmultipass1");
@@ -584,3 +629,104 @@ DEFINE_TESTCASE(compactmultipass1, brass || chert) {
 
     return true;
 }
+
+static void
+make_reorder_db(Xapian::WritableDatabase &db, const string &)
+{
+    for (unsigned i = 1; i <= 100; ++i) {
+	Xapian::Document doc;
+	// Alternate between two groups of documents with the same terms.
+	const char * group = (i % 2) ? "odd" : "even";
+	for (unsigned j = 0; j != 5; ++j) {
+	    doc.add_posting(group + str(j), j + 1);
+	}
+	doc.add_value(0, str(1000 - (i % 10) * 10 - i / 10));
+	doc.set_data(str(i));
+	db.add_document(doc);
+    }
+    db.add_spelling("reorder", 2);
+    db.add_synonym("reorder", "shuffle");
+    db.set_metadata("key", "value");
+    db.commit();
+}
+
+// Test reordering documents while compacting.
+DEFINE_TESTCASE(compactreorder1, generated) {
+    string indbpath = get_database_path("compactreorder1in",
+					make_reorder_db, "");
+    string outdbpath = get_named_writable_database_path("compactreorder1out");
+    Xapian::Database indb(indbpath);
+
+    for (int similarity = 0; similarity != 2; ++similarity) {
+	rm_rf(outdbpath);
+	Xapian::Compactor compact;
+	compact.set_destdir(outdbpath);
+	compact.add_source(indbpath);
+	compact.add_source(indbpath);
+	if (similarity) {
+	    compact.set_reorder_by_similarity();
+	} else {
+	    compact.set_reorder_by_value(0);
+	}
+	compact.compact();
+	TEST(!file_exists(outdbpath + "/reorder.tmp/record.DB"));
+
+	Xapian::Database outdb(outdbpath);
+	TEST_EQUAL(outdb.get_doccount(), indb.get_doccount() * 2);
+	dbcheck(outdb, outdb.get_doccount(), outdb.get_doccount());
+	TEST_EQUAL(outdb.get_spelling_suggestion("reorde"), "reorder");
+	TEST_EQUAL(outdb.get_metadata("key"), "value");
+	TEST_EQUAL(*outdb.synonyms_begin("reorder"), "shuffle");
+
+	string prev_value;
+	Xapian::termcount group_changes = 0;
+	for (Xapian::docid did = 1; did <= outdb.get_doccount(); ++did) {
+	    Xapian::Document doc = outdb.get_document(did);
+	    // Each document should still have its own data and positions.
+	    unsigned i = atoi(doc.get_data().c_str());
+	    TEST_EQUAL(doc.get_value(0), indb.get_document(i).get_value(0));
+	    const char * group = (i % 2) ? "odd3" : "even3";
+	    TEST_EQUAL(*outdb.positionlist_begin(did, group), 4);
+	    if (similarity) {
+		// Documents with the same terms should be next to each other.
+		if (did > 1 && doc.termlist_begin() != doc.termlist_end() &&
+		    *doc.termlist_begin() !=
+		    *outdb.get_document(did - 1).termlist_begin()) {
+		    ++group_changes;
+		}
+	    } else {
+		TEST_REL(doc.get_value(0),>=,prev_value);
+		prev_value = doc.get_value(0);
+	    }
+	}
+	if (similarity) TEST_EQUAL(group_changes, 1);
+    }
+
+    // Check the temporary database is removed if compaction fails.
+    {
+	class FailingCompactor : public Xapian::Compactor {
+	  public:
+	    void set_status(const string & table, const string &) {
+		if (table == "postlist")
+		    throw Xapian::DatabaseError("Simulated failure");
+	    }
+	};
+	rm_rf(outdbpath);
+	FailingCompactor compact;
+	compact.set_destdir(outdbpath);
+	compact.add_source(indbpath);
+	compact.set_reorder_by_value(0);
+	TEST_EXCEPTION(Xapian::DatabaseError, compact.compact());
+	TEST(!dir_exists(outdbpath + "/reorder.tmp"));
+    }
+
+    // Reordering the documents means renumbering them.
+    Xapian::Compactor compact;
+    compact.set_destdir(outdbpath);
+    compact.add_source(indbpath);
+    compact.set_renumber(false);
+    compact.set_reorder_by_value(0);
+    TEST_EXCEPTION(Xapian::InvalidOperationError, compact.compact());
+
+    return true;
+}
@@ -327,3 +327,100 @@ DEFINE_TESTCASE(matchspy6, !backend)
 
     return true;
 }
+
+/// Check that two spies counting the same slot saw the same values.
+static void
+check_same_counts(const Xapian::ValueCountMatchSpy & spy,
+		  const Xapian::ValueOrdinalCountMatchSpy & ordspy)
+{
+    TEST_EQUAL(spy.get_total(), ordspy.get_total());
+    Xapian::TermIterator i = spy.values_begin();
+    Xapian::TermIterator j = ordspy.values_begin();
+    for ( ; i != spy.values_end(); ++i, ++j) {
+	TEST(j != ordspy.values_end());
+	TEST_EQUAL(*i, *j);
+	TEST_EQUAL(i.get_termfreq(), j.get_termfreq());
+    }
+    TEST(j == ordspy.values_end());
+    for (size_t count = 0; count != 12; ++count) {
+	i = spy.top_values_begin(count);
+	j = ordspy.top_values_begin(count);
+	for ( ; i != spy.top_values_end(count); ++i, ++j) {
+	    TEST(j != ordspy.top_values_end(count));
+	    TEST_EQUAL(*i, *j);
+	    TEST_EQUAL(i.get_termfreq(), j.get_termfreq());
+	}
+	TEST(j == ordspy.top_values_end(count));
+    }
+}
+
+// Test ValueOrdinalCountMatchSpy counts the same as ValueCountMatchSpy.
+DEFINE_TESTCASE(matchspy7, generated)
+{
+    Xapian::Database db = get_database("matchspy2", make_matchspy2_db);
+
+    for (int sorted = 0; sorted != 2; ++sorted) {
+	Xapian::Enquire enq(db);
+	enq.set_query(Xapian::Query("all"));
+	if (sorted) enq.set_sort_by_value(1, false);
+
+	vector<Xapian::ValueCountMatchSpy *> spies;
+	vector<Xapian::ValueOrdinalCountMatchSpy *> ordspies;
+	for (Xapian::valueno slot = 0; slot != 5; ++slot) {
+	    spies.push_back(new Xapian::ValueCountMatchSpy(slot));
+	    ordspies.push_back(new Xapian::ValueOrdinalCountMatchSpy(slot));
+	    enq.add_matchspy(spies.back());
+	    enq.add_matchspy(ordspies.back());
+	}
+	// Count twice, to check the second match adds to the counts.
+	enq.get_mset(0, 10, db.get_doccount());
+	enq.get_mset(0, 10, db.get_doccount());
+
+	for (size_t k = 0; k != spies.size(); ++k) {
+	    tout << "slot " << k << endl;
+	    TEST_EQUAL(ordspies[k]->get_total(), 50);
+	    check_same_counts(*spies[k], *ordspies[k]);
+	    delete spies[k];
+	    delete ordspies[k];
+	}
+    }
+
+    Xapian::ValueOrdinalCountMatchSpy spy(1);
+    TEST_STRINGS_EQUAL(spy.name(), "Xapian::ValueOrdinalCountMatchSpy");
+    Xapian::MatchSpy * clone = spy.unserialise(spy.serialise(),
+					       Xapian::Registry());
+    TEST_STRINGS_EQUAL(clone->serialise(), spy.serialise());
+    delete clone;
+
+    return true;
+}
+
+// Test ValueOrdinalCountMatchSpy with all backends, including remote ones
+// which use serialise_results() and merge_results().
+DEFINE_TESTCASE(matchspy8, backend)
+{
+    Xapian::Database db(get_database("apitest_simpledata"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("this"));
+
+    vector<Xapian::ValueCountMatchSpy *> spies;
+    vector<Xapian::ValueOrdinalCountMatchSpy *> ordspies;
+    for (Xapian::valueno slot = 0; slot != 12; ++slot) {
+	spies.push_back(new Xapian::ValueCountMatchSpy(slot));
+	ordspies.push_back(new Xapian::ValueOrdinalCountMatchSpy(slot));
+	enquire.add_matchspy(spies.back());
+	enquire.add_matchspy(ordspies.back());
+    }
+    Xapian::MSet mset = enquire.get_mset(0, 100);
+    TEST_EQUAL(mset.size(), 6);
+
+    for (size_t k = 0; k != spies.size(); ++k) {
+	tout << "slot " << k << endl;
+	TEST_EQUAL(ordspies[k]->get_total(), 6);
+	check_same_counts(*spies[k], *ordspies[k]);
+	delete spies[k];
+	delete ordspies[k];
+    }
+
+    return true;
+}
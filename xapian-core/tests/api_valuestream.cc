@@ -68,6 +68,9 @@ DEFINE_TESTCASE(valuestream2, backend) {
 	    Xapian::docid did = 1;
 	    Xapian::ValueIterator it = db.valuestream_begin(slot);
 	    if (it == db.valuestream_end(slot)) break;
+	    // Skipping to the first docid shouldn't reach the end.
+	    it.skip_to(did);
+	    TEST(it != db.valuestream_end(slot));
 	    while (it.skip_to(did), it != db.valuestream_end(slot)) {
 		TEST_EQUAL(it.get_valueno(), slot);
 		string value = *it;
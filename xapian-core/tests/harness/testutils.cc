@@ -25,7 +25,10 @@
 
 #include "testsuite.h"
 
+#include <cstdlib> // For getenv(), setenv() or putenv().
+#include <cstring>
 #include <fstream>
+#include <map>
 #include <vector>
 
 using namespace std;
@@ -214,3 +217,72 @@ test_mset_order_equal(const Xapian::MSet &mset1, const Xapian::MSet &mset2)
 			 mset1 << "\n !=\n" << mset2);
     }
 }
+
+// ######################################################################
+// Environment variables
+
+/** Set environment variable @a name to @a value.
+ *
+ *  If @a remove is true, unset the variable instead, or set it to an empty
+ *  value where that isn't possible.
+ */
+static void
+set_env(const string & name, const string & value, bool remove = false)
+{
+#ifdef __WIN32__
+    // Setting an empty value removes the variable.
+    _putenv_s(name.c_str(), remove ? "" : value.c_str());
+#elif defined HAVE_SETENV
+    if (remove) {
+	unsetenv(name.c_str());
+    } else {
+	setenv(name.c_str(), value.c_str(), 1);
+    }
+#else
+    // putenv() keeps a pointer to the string we pass, so that needs to stay
+    // valid until it is replaced by a later call for the same variable.
+    static map<string, char *> env_strings;
+    string entry = name;
+    entry += '=';
+    if (!remove) entry += value;
+    char * p = new char[entry.size() + 1];
+    memcpy(p, entry.c_str(), entry.size() + 1);
+    putenv(p);
+    char *& slot = env_strings[name];
+    delete [] slot;
+    slot = p;
+#endif
+}
+
+/// Get the value of environment variable @a name, if it is set.
+static bool
+get_env(const string & name, string & value)
+{
+    const char * p = getenv(name.c_str());
+    if (!p) return false;
+    value = p;
+    return true;
+}
+
+ScopedEnv::ScopedEnv(const string & name_)
+    : name(name_), had_old_value(get_env(name_, old_value))
+{
+}
+
+ScopedEnv::ScopedEnv(const string & name_, const string & value)
+    : name(name_), had_old_value(get_env(name_, old_value))
+{
+    set(value);
+}
+
+void
+ScopedEnv::set(const string & value)
+{
+    set_env(name, value);
+}
+
+void
+ScopedEnv::restore()
+{
+    set_env(name, old_value, !had_old_value);
+}
@@ -26,6 +26,8 @@
 #include "testsuite.h"
 #include <xapian.h>
 
+#include <string>
+
 // ######################################################################
 // Useful display operators
 
@@ -66,6 +68,46 @@ void mset_expect_order(const Xapian::MSet &A,
 void test_mset_order_equal(const Xapian::MSet &mset1,
 			   const Xapian::MSet &mset2);
 
+// ######################################################################
+// Environment variables
+
+/** Set an environment variable until this object goes out of scope.
+ *
+ *  The previous value (or absence) of the variable is restored by the
+ *  destructor, so a test which fails part way through doesn't leave it set
+ *  for later tests.
+ */
+class ScopedEnv {
+    std::string name;
+
+    /// The original value, if had_old_value is true.
+    std::string old_value;
+
+    /// Was the variable originally set?
+    bool had_old_value;
+
+    /// Copy not allowed.
+    ScopedEnv(const ScopedEnv &);
+
+    /// Assignment not allowed.
+    void operator=(const ScopedEnv &);
+
+  public:
+    /// Remember the current value of @a name_, but leave it unchanged.
+    explicit ScopedEnv(const std::string & name_);
+
+    /// Set @a name_ to @a value.
+    ScopedEnv(const std::string & name_, const std::string & value);
+
+    ~ScopedEnv() { restore(); }
+
+    /// Set the variable to @a value.
+    void set(const std::string & value);
+
+    /// Restore the variable's original value.
+    void restore();
+};
+
 // ######################################################################
 // Useful test macros
 
@@ -0,0 +1,227 @@
+/* perftest_impactmatch.cc: performance tests for matching using impacts
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "perftest/perftest_impactmatch.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <xapian.h>
+
+#include "backendmanager.h"
+#include "perftest.h"
+#include "str.h"
+#include "testrunner.h"
+#include "testsuite.h"
+#include "testutils.h"
+#include "unixcmds.h"
+
+using namespace std;
+
+/** Generate a term, from a vocabulary of @a range terms.
+ *
+ *  Lower numbered terms are much more likely, roughly following Zipf's law.
+ */
+static string
+gen_zipf_term(unsigned int range)
+{
+    double v = pow(double(range), rand() / (RAND_MAX + 1.0));
+    return "t" + str((unsigned int)v - 1);
+}
+
+static void
+builddb_impacts1(Xapian::WritableDatabase &db, const string & dbname)
+{
+    logger.testcase_begin(dbname);
+    unsigned int runsize = 20000;
+    unsigned int seed = 42;
+    unsigned int minterms = 20;
+    unsigned int maxterms = 220;
+    unsigned int vocabulary = 50000;
+
+    srand(seed);
+
+    std::map<std::string, std::string> params;
+    params["runsize"] = str(runsize);
+    params["seed"] = str(seed);
+    params["minterms"] = str(minterms);
+    params["maxterms"] = str(maxterms);
+    params["vocabulary"] = str(vocabulary);
+    logger.indexing_begin(dbname, params);
+    for (unsigned int i = 0; i < runsize; ++i) {
+	Xapian::Document doc;
+	unsigned int terms = minterms + rand() % (maxterms - minterms + 1);
+	for (unsigned int j = 0; j < terms; ++j) {
+	    doc.add_term(gen_zipf_term(vocabulary));
+	}
+	db.add_document(doc);
+	logger.indexing_add();
+    }
+    db.commit();
+    logger.indexing_end();
+    logger.testcase_end();
+}
+
+/** Build a database with few documents but a high last docid.
+ *
+ *  Each document has a few terms from a small vocabulary, so each term has a
+ *  few hundred postings, spread thinly over the docid range.
+ */
+static void
+builddb_impacts2(Xapian::WritableDatabase &db, const string & dbname)
+{
+    logger.testcase_begin(dbname);
+    unsigned int runsize = 5000;
+    unsigned int seed = 42;
+    unsigned int docid_step = 20000;
+    unsigned int terms = 5;
+    unsigned int vocabulary = 50;
+
+    srand(seed);
+
+    std::map<std::string, std::string> params;
+    params["runsize"] = str(runsize);
+    params["seed"] = str(seed);
+    params["docid_step"] = str(docid_step);
+    params["terms"] = str(terms);
+    params["vocabulary"] = str(vocabulary);
+    logger.indexing_begin(dbname, params);
+    for (unsigned int i = 0; i < runsize; ++i) {
+	Xapian::Document doc;
+	for (unsigned int j = 0; j < terms; ++j) {
+	    doc.add_term("t" + str(rand() % vocabulary));
+	}
+	db.replace_document(i * docid_step + 1, doc);
+	logger.indexing_add();
+    }
+    db.commit();
+    logger.indexing_end();
+    logger.testcase_end();
+}
+
+/** Compact the database at @a path with and without impacts.
+ *
+ *  @param paths	Set to the paths of the two compacted databases.
+ */
+static void
+compact_with_impacts(const string & path, string paths[2])
+{
+    paths[0] = path + "_plain";
+    paths[1] = path + "_impacts";
+    for (int impacts = 0; impacts != 2; ++impacts) {
+	rm_rf(paths[impacts]);
+	Xapian::Compactor compact;
+	compact.set_destdir(paths[impacts]);
+	// This must be set before add_source() to take effect.
+	compact.set_renumber(false);
+	compact.add_source(path);
+	compact.set_impact_ordering(impacts);
+	compact.compact();
+    }
+}
+
+/// Generate 300 OR queries of 2 to 5 terms from gen_zipf_term(@a range).
+static void
+gen_or_queries(unsigned int range, vector<Xapian::Query> & queries)
+{
+    srand(42);
+    for (int i = 0; i != 300; ++i) {
+	vector<string> terms;
+	int n = 2 + rand() % 4;
+	for (int j = 0; j != n; ++j) {
+	    terms.push_back(gen_zipf_term(range));
+	}
+	queries.push_back(Xapian::Query(Xapian::Query::OP_OR,
+					terms.begin(), terms.end()));
+    }
+}
+
+/** Run @a queries on the databases at @a paths, and check the results match.
+ *
+ *  The first database is searched using docid-ordered postings, and the
+ *  second using impact-ordered postings.
+ */
+static void
+compare_impact_match(const string paths[2],
+		     const vector<Xapian::Query> & queries,
+		     Xapian::doccount max_msize)
+{
+    static const char * const descs[2] = {
+	"Docid-ordered postings", "Impact-ordered postings"
+    };
+    for (Xapian::doccount msize = 10; msize <= max_msize; msize *= 10) {
+	vector<Xapian::MSet> msets[2];
+	for (int impacts = 0; impacts != 2; ++impacts) {
+	    Xapian::Database db(paths[impacts]);
+	    Xapian::Enquire enquire(db);
+	    logger.searching_start(string(descs[impacts]) + ", top " +
+				   str(msize));
+	    vector<Xapian::Query>::const_iterator q;
+	    for (q = queries.begin(); q != queries.end(); ++q) {
+		logger.search_start();
+		enquire.set_query(*q);
+		Xapian::MSet mset = enquire.get_mset(0, msize);
+		logger.search_end(*q, mset);
+		msets[impacts].push_back(mset);
+	    }
+	    logger.searching_end();
+	}
+	for (size_t i = 0; i != queries.size(); ++i) {
+	    test_mset_order_equal(msets[0][i], msets[1][i]);
+	}
+    }
+}
+
+// Compare OR queries run with and without impact-ordered posting lists.
+DEFINE_TESTCASE(impactmatch1, brass) {
+    string path = backendmanager->get_database_path("impacts1",
+						    builddb_impacts1,
+						    "impacts1");
+    string paths[2];
+    compact_with_impacts(path, paths);
+
+    logger.testcase_begin("impactmatch1");
+    // Queries of mostly common terms.
+    vector<Xapian::Query> queries;
+    gen_or_queries(2000, queries);
+    compare_impact_match(paths, queries, 1000);
+    logger.testcase_end();
+    return true;
+}
+
+// Compare sparse OR queries on a database with a high last docid.
+DEFINE_TESTCASE(impactmatch2, brass) {
+    string path = backendmanager->get_database_path("impacts2",
+						    builddb_impacts2,
+						    "impacts2");
+    string paths[2];
+    compact_with_impacts(path, paths);
+
+    logger.testcase_begin("impactmatch2");
+    // The last docid is about 100 million, but each term only has a few
+    // hundred postings, so this shows up any cost per query which grows with
+    // the last docid.
+    vector<Xapian::Query> queries;
+    gen_or_queries(50, queries);
+    compare_impact_match(paths, queries, 100);
+    logger.testcase_end();
+    return true;
+}
@@ -46,6 +46,10 @@ using namespace std;
     } while (0)
 
 // Code we're unit testing:
+#include "../backends/blockcache.cc"
+#include "../common/blockruns.h"
+#include "../common/bitpack.cc"
+#include "../common/docidsearch.cc"
 #include "../common/fileutils.cc"
 #include "../common/serialise-double.cc"
 #include "../net/length.cc"
@@ -310,6 +314,156 @@ static bool test_log2()
     return true;
 }
 
+// Test BlockCache.
+static bool test_blockcache1()
+{
+    // Room for two 16 byte blocks in each shard.
+    BlockCache cache(16 * 2 * 16);
+    byte block[16], out[16];
+    memset(block, 'x', sizeof(block));
+    unsigned file = cache.register_file("uuid/postlist");
+    TEST_EQUAL(cache.register_file("uuid/postlist"), file);
+    TEST_NOT_EQUAL(cache.register_file("uuid/record"), file);
+
+    TEST(!cache.lookup(file, 1, 0, out, sizeof(out)));
+    cache.insert(file, 1, 0, block, sizeof(block));
+    memset(out, 0, sizeof(out));
+    TEST(cache.lookup(file, 1, 0, out, sizeof(out)));
+    TEST(memcmp(block, out, sizeof(out)) == 0);
+    // A different revision shouldn't match.
+    TEST(!cache.lookup(file, 2, 0, out, sizeof(out)));
+    TEST_EQUAL(cache.get_hits(), 1);
+    TEST_EQUAL(cache.get_misses(), 2);
+
+    // Blocks 0, 16 and 32 all go in the same shard, so inserting two more
+    // should evict the least recently used.
+    cache.insert(file, 1, 16, block, sizeof(block));
+    TEST(cache.lookup(file, 1, 0, out, sizeof(out)));
+    cache.insert(file, 1, 32, block, sizeof(block));
+    TEST(cache.lookup(file, 1, 0, out, sizeof(out)));
+    TEST(!cache.lookup(file, 1, 16, out, sizeof(out)));
+    TEST(cache.lookup(file, 1, 32, out, sizeof(out)));
+
+    // Shrinking the cache should discard blocks.
+    cache.set_capacity(16 * 16);
+    TEST(!cache.lookup(file, 1, 0, out, sizeof(out)));
+    TEST(cache.lookup(file, 1, 32, out, sizeof(out)));
+    cache.set_capacity(0);
+    TEST(!cache.lookup(file, 1, 32, out, sizeof(out)));
+    return true;
+}
+
+// Test packing and unpacking blocks of integers.
+static bool test_bitpack1()
+{
+    uint4 values[BITPACK_BLOCK_SIZE], out[BITPACK_BLOCK_SIZE];
+    for (unsigned bits = 0; bits <= 32; ++bits) {
+	uint4 mask = bits == 32 ? uint4(-1) : (uint4(1) << bits) - 1;
+	uint4 x = 0x12345678;
+	for (unsigned i = 0; i != BITPACK_BLOCK_SIZE; ++i) {
+	    x = x * 1103515245 + 12345;
+	    values[i] = x & mask;
+	}
+	// Make sure the largest value is used.
+	values[BITPACK_BLOCK_SIZE - 1] = mask;
+	TEST_EQUAL(bitpack_bits_needed(values, BITPACK_BLOCK_SIZE), bits);
+	string packed("x");
+	bitpack_block(packed, values, bits);
+	TEST_EQUAL(packed.size(), bitpack_block_bytes(bits) + 1);
+	memset(out, 0xff, sizeof(out));
+	bitunpack_block(packed.data() + 1, out, bits);
+	for (unsigned i = 0; i != BITPACK_BLOCK_SIZE; ++i) {
+	    TEST_EQUAL(out[i], values[i]);
+	}
+    }
+    return true;
+}
+
+// Test galloping search of an ascending array of docids.
+static bool test_docidgallop1()
+{
+    Xapian::docid docids[100];
+    for (size_t i = 0; i != 100; ++i) {
+	// Include docids with the top bit set, which SSE2 compares as signed.
+	docids[i] = (i < 90) ? Xapian::docid(3 * i + 1) : 0x7ffffff0 + Xapian::docid(i) * 4;
+    }
+    for (size_t n = 0; n <= 100; ++n) {
+	for (size_t i = 0; i != 100; ++i) {
+	    Xapian::docid targets[] = { docids[i] - 1, docids[i], docids[i] + 1 };
+	    for (size_t k = 0; k != 3; ++k) {
+		Xapian::docid target = targets[k];
+		size_t expect = 0;
+		while (expect < n && docids[expect] < target) ++expect;
+		TEST_EQUAL(docid_gallop(docids, n, target), expect);
+	    }
+	}
+    }
+    TEST_EQUAL(docid_gallop(docids, 100, Xapian::docid(-1)), 100);
+    return true;
+}
+
+// Test finding the next set bit in a bitmap of docids.
+static bool test_docidbitmapnext1()
+{
+    unsigned char bitmap[40] = { 0 };
+    static const Xapian::docid set[] = { 0, 1, 7, 8, 9, 63, 64, 200, 319 };
+    const size_t n_set = sizeof(set) / sizeof(set[0]);
+    for (size_t i = 0; i != n_set; ++i) {
+	bitmap[set[i] / 8] |= (1 << (set[i] % 8));
+    }
+    for (Xapian::docid last = 0; last != 320; ++last) {
+	for (Xapian::docid from = 0; from <= last + 1; ++from) {
+	    Xapian::docid expect = last + 1;
+	    for (size_t i = 0; i != n_set; ++i) {
+		if (set[i] >= from && set[i] <= last) {
+		    expect = set[i];
+		    break;
+		}
+	    }
+	    TEST_EQUAL(docid_bitmap_next(bitmap, from, last), expect);
+	}
+    }
+    return true;
+}
+
+// Test coalescing block numbers into runs of adjacent blocks.
+static bool test_blockruns1()
+{
+    static const uint4 blocks[] = {
+	3, 4, 4, 5, 7, 8, 8, 9, 20, 6, 7, 100, 101, 50, 50, 51, 200
+    };
+    static const uint4 expect[][2] = {
+	{ 3, 3 }, { 7, 3 }, { 20, 1 }, { 6, 2 }, { 100, 2 }, { 50, 2 },
+	{ 200, 1 }
+    };
+    const size_t n_blocks = sizeof(blocks) / sizeof(blocks[0]);
+    const size_t n_expect = sizeof(expect) / sizeof(expect[0]);
+    BlockRuns runs;
+    uint4 start, len;
+    TEST(!runs.flush(start, len));
+    size_t e = 0;
+    for (size_t i = 0; i != n_blocks; ++i) {
+	if (runs.add(blocks[i], start, len)) {
+	    TEST(e < n_expect);
+	    TEST_EQUAL(start, expect[e][0]);
+	    TEST_EQUAL(len, expect[e][1]);
+	    ++e;
+	}
+    }
+    TEST(runs.flush(start, len));
+    TEST_EQUAL(e, n_expect - 1);
+    TEST_EQUAL(start, expect[e][0]);
+    TEST_EQUAL(len, expect[e][1]);
+    TEST(!runs.flush(start, len));
+
+    // A block before the start of the current run starts a new one.
+    TEST(!runs.add(10, start, len));
+    TEST(runs.add(9, start, len));
+    TEST_EQUAL(start, 10);
+    TEST_EQUAL(len, 1);
+    return true;
+}
+
 static const test_desc tests[] = {
     TESTCASE(simple_exceptions_work1),
     TESTCASE(class_exceptions_work1),
@@ -320,6 +474,11 @@ static const test_desc tests[] = {
     TESTCASE(serialiselength2),
 #endif
     TESTCASE(log2),
+    TESTCASE(blockcache1),
+    TESTCASE(blockruns1),
+    TESTCASE(bitpack1),
+    TESTCASE(docidgallop1),
+    TESTCASE(docidbitmapnext1),
     END_OF_TESTCASES
 };
 
@@ -175,7 +175,14 @@ double
 BM25Weight::get_maxpart() const
 {
     LOGCALL(WTCALC, double, "BM25Weight::get_maxpart", NO_ARGS);
-    double wdf_max(get_wdf_upper_bound());
+    RETURN(get_maxpart_for_wdf(get_wdf_upper_bound()));
+}
+
+double
+BM25Weight::get_maxpart_for_wdf(Xapian::termcount wdf_bound) const
+{
+    LOGCALL(WTCALC, double, "BM25Weight::get_maxpart_for_wdf", wdf_bound);
+    double wdf_max(min(wdf_bound, get_wdf_upper_bound()));
     double denom = wdf_max;
     if (param_k1 != 0.0) {
 	if (param_b != 0.0) {
@@ -21,6 +21,7 @@
 #include <config.h>
 
 #include "xapian/weight.h"
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 
@@ -95,10 +96,18 @@ TfIdfWeight::get_sumpart(Xapian::termcount wdf, Xapian::termcount) const
 // and N are constants.
 double
 TfIdfWeight::get_maxpart() const
+{
+    return get_maxpart_for_wdf(get_wdf_upper_bound());
+}
+
+// All the wdf normalizations increase with the wdf, so we can calculate a
+// tighter bound when we know a tighter bound on the wdf.
+double
+TfIdfWeight::get_maxpart_for_wdf(Xapian::termcount wdf_bound) const
 {
     Xapian::doccount termfreq = 1;
     if (normalizations[1] != 'n') termfreq = get_termfreq();
-    Xapian::termcount wdf_max = get_wdf_upper_bound();
+    Xapian::termcount wdf_max = min(wdf_bound, get_wdf_upper_bound());
     double wt = get_wdfn(wdf_max, normalizations[0]) *
 		get_idfn(termfreq, normalizations[1]);
     return get_wtn(wt, normalizations[2]) * factor;
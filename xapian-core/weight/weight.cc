@@ -133,4 +133,10 @@ Weight::unserialise(const string &) const
     throw Xapian::UnimplementedError("unserialise() not supported for this Xapian::Weight subclass");
 }
 
+double
+Weight::get_maxpart_for_wdf(Xapian::termcount) const
+{
+    return get_maxpart();
+}
+
 }
@@ -32,6 +32,7 @@
 
 #include "autoptr.h"
 #include <set>
+#include <vector>
 
 using namespace std;
 
@@ -95,11 +96,22 @@ Weight::Internal::accumulate_stats(const Xapian::Database::Internal &subdb,
     rset_size += rset.size();
 
     total_term_count += subdb.get_doccount() * subdb.get_total_length();
+
+    // Look up the frequencies of all the terms in one go, which allows the
+    // backend to share the work between them.
+    vector<string> terms;
+    terms.reserve(termfreqs.size());
     map<string, TermFreqs>::iterator t;
     for (t = termfreqs.begin(); t != termfreqs.end(); ++t) {
-	const string & term = t->first;
-	t->second.termfreq += subdb.get_termfreq(term);
-	t->second.collfreq += subdb.get_collection_freq(term);
+	terms.push_back(t->first);
+    }
+    vector<Xapian::doccount> tfs;
+    vector<Xapian::termcount> cfs;
+    subdb.get_freqs(terms, tfs, cfs);
+    size_t i = 0;
+    for (t = termfreqs.begin(); t != termfreqs.end(); ++t, ++i) {
+	t->second.termfreq += tfs[i];
+	t->second.collfreq += cfs[i];
     }
 
     const set<Xapian::docid> & items(rset.internal->get_items());